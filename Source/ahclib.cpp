@@ -0,0 +1,662 @@
+/*******************************************************************************
+*
+*  (C) COPYRIGHT AUTHORS, 2026
+*
+*  TITLE:       AHCLIB.CPP
+*
+*  VERSION:     1.05
+*
+*  DATE:        14 Oct 2026
+*
+*  AuthHashCalc hashing library handle based interface.
+*
+*  Engine owns private heap and a lock free list of hash context caches.
+*  Every call takes a cache from the list, or creates one when all are busy,
+*  and returns it when done, so concurrent calls never share contexts.
+*
+* THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+* ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED
+* TO THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*******************************************************************************/
+
+#include "global.h"
+#include "ahclib.h"
+
+#define AHC_AUTHENTICODE_DIGESTS_COUNT AHC_DIGEST_PAGE_SHA1
+
+#define AHC_AUTHENTICODE_DIGESTS_MASK (AHC_DIGEST_FLAG(AHC_AUTHENTICODE_DIGESTS_COUNT) - 1)
+
+typedef struct _AHC_CACHE_ENTRY {
+    SLIST_ENTRY ListEntry;
+    PHASH_CONTEXT_CACHE Cache;
+} AHC_CACHE_ENTRY, * PAHC_CACHE_ENTRY;
+
+struct _AHC_ENGINE {
+    SLIST_HEADER FreeCaches;
+    HANDLE HeapHandle;
+    ULONG PageSize;
+};
+
+struct _AHC_STREAM {
+    AHC_ENGINE Engine;
+    PAHC_CACHE_ENTRY Entry;
+    AHC_RESULT Result;
+    PHASH_PUSH Push;
+    ULONG Digests;
+    ULONG ContextCount;
+    PCNG_CTX HashContexts[AHC_AUTHENTICODE_DIGESTS_COUNT];
+    ULONG ContextIndex[AHC_AUTHENTICODE_DIGESTS_COUNT];
+};
+
+struct _AHC_RESULT {
+    HANDLE HeapHandle;
+    ULONG ImageError;
+    UCHAR Length[AHC_DIGEST_COUNT];
+    UCHAR Data[AHC_DIGEST_COUNT][AHC_DIGEST_MAX_SIZE];
+};
+
+static const PCWSTR g_AhcAlgorithms[AHC_DIGEST_COUNT] = {
+    BCRYPT_MD5_ALGORITHM,
+    BCRYPT_SHA1_ALGORITHM,
+    BCRYPT_SHA256_ALGORITHM,
+    BCRYPT_SHA384_ALGORITHM,
+    BCRYPT_SHA512_ALGORITHM,
+    BCRYPT_SHA1_ALGORITHM,
+    BCRYPT_SHA256_ALGORITHM
+};
+
+/*
+* AhcpAcquireCache
+*
+* Purpose:
+*
+* Take idle context cache of the engine or create new one.
+*
+*/
+PAHC_CACHE_ENTRY AhcpAcquireCache(
+    _In_ AHC_ENGINE Engine
+)
+{
+    PAHC_CACHE_ENTRY entry;
+
+    entry = (PAHC_CACHE_ENTRY)InterlockedPopEntrySList(&Engine->FreeCaches);
+    if (entry)
+        return entry;
+
+    entry = (PAHC_CACHE_ENTRY)HeapAlloc(Engine->HeapHandle,
+        HEAP_ZERO_MEMORY,
+        sizeof(AHC_CACHE_ENTRY));
+
+    if (entry == NULL)
+        return NULL;
+
+    if (!NT_SUCCESS(HashCreateContextCache(Engine->HeapHandle, &entry->Cache))) {
+        HeapFree(Engine->HeapHandle, 0, entry);
+        return NULL;
+    }
+
+    return entry;
+}
+
+/*
+* AhcpReleaseCache
+*
+* Purpose:
+*
+* Return context cache to the engine.
+*
+*/
+VOID AhcpReleaseCache(
+    _In_ AHC_ENGINE Engine,
+    _In_ PAHC_CACHE_ENTRY Entry
+)
+{
+    InterlockedPushEntrySList(&Engine->FreeCaches, &Entry->ListEntry);
+}
+
+/*
+* AhcpStoreDigest
+*
+* Purpose:
+*
+* Copy context digest to the result.
+*
+*/
+VOID AhcpStoreDigest(
+    _In_ AHC_RESULT Result,
+    _In_ ULONG DigestId,
+    _In_ PCNG_CTX HashContext
+)
+{
+    if (HashContext->HashSize <= AHC_DIGEST_MAX_SIZE) {
+        RtlCopyMemory(Result->Data[DigestId], HashContext->Hash, HashContext->HashSize);
+        Result->Length[DigestId] = (UCHAR)HashContext->HashSize;
+    }
+}
+
+/*
+* AhcpAcquireAuthenticodeContexts
+*
+* Purpose:
+*
+* Take contexts for requested authenticode digests, ContextIndex receives
+* digest identifier of every context.
+*
+*/
+ULONG AhcpAcquireAuthenticodeContexts(
+    _In_ PHASH_CONTEXT_CACHE Cache,
+    _In_ ULONG Digests,
+    _Out_writes_(AHC_AUTHENTICODE_DIGESTS_COUNT) PCNG_CTX* HashContexts,
+    _Out_writes_(AHC_AUTHENTICODE_DIGESTS_COUNT) PULONG ContextIndex
+)
+{
+    ULONG i, cContexts = 0;
+
+    for (i = 0; i < AHC_AUTHENTICODE_DIGESTS_COUNT; i++) {
+        if ((Digests & AHC_DIGEST_FLAG(i)) &&
+            NT_SUCCESS(HashAcquireContext(Cache, g_AhcAlgorithms[i], &HashContexts[cContexts])))
+        {
+            ContextIndex[cContexts++] = i;
+        }
+    }
+
+    return cContexts;
+}
+
+/*
+* AhcpHashPages
+*
+* Purpose:
+*
+* Compute requested page digests of the validated view.
+* Must be called after authenticode digests are stored, contexts are shared.
+*
+*/
+VOID AhcpHashPages(
+    _In_ AHC_ENGINE Engine,
+    _In_ PHASH_CONTEXT_CACHE Cache,
+    _In_ PFILE_VIEW_INFO ViewInformation,
+    _In_ ULONG Digests,
+    _Inout_ AHC_RESULT Result
+)
+{
+    ULONG i;
+    PCNG_CTX hashContext;
+
+    for (i = AHC_AUTHENTICODE_DIGESTS_COUNT; i < AHC_DIGEST_COUNT; i++) {
+        if ((Digests & AHC_DIGEST_FLAG(i)) &&
+            NT_SUCCESS(HashAcquireContext(Cache, g_AhcAlgorithms[i], &hashContext)) &&
+            CalculateFirstPageHash(Engine->PageSize, ViewInformation, hashContext))
+        {
+            AhcpStoreDigest(Result, i, hashContext);
+        }
+    }
+}
+
+/*
+* AhcpHashView
+*
+* Purpose:
+*
+* Compute requested digests of the validated view.
+* Authenticode digests are computed in a single pass.
+*
+*/
+VOID AhcpHashView(
+    _In_ AHC_ENGINE Engine,
+    _In_ PHASH_CONTEXT_CACHE Cache,
+    _In_ PFILE_VIEW_INFO ViewInformation,
+    _In_ ULONG Digests,
+    _Inout_ AHC_RESULT Result
+)
+{
+    ULONG i, cContexts;
+    PCNG_CTX hashContexts[AHC_AUTHENTICODE_DIGESTS_COUNT];
+    ULONG contextIndex[AHC_AUTHENTICODE_DIGESTS_COUNT];
+
+    cContexts = AhcpAcquireAuthenticodeContexts(Cache, Digests, hashContexts, contextIndex);
+
+    if (cContexts &&
+        CalculateAuthenticodeHashMulti(ViewInformation, hashContexts, cContexts, NULL))
+    {
+        for (i = 0; i < cContexts; i++)
+            AhcpStoreDigest(Result, contextIndex[i], hashContexts[i]);
+    }
+
+    AhcpHashPages(Engine, Cache, ViewInformation, Digests, Result);
+
+    Result->ImageError = ViewInformation->LastError;
+}
+
+/*
+* AhcpBeginRequest
+*
+* Purpose:
+*
+* Validate request parameters, allocate result and take context cache.
+*
+*/
+NTSTATUS AhcpBeginRequest(
+    _In_ AHC_ENGINE Engine,
+    _In_ ULONG Digests,
+    _Out_ AHC_RESULT* Result,
+    _Out_ PAHC_CACHE_ENTRY* Entry
+)
+{
+    AHC_RESULT result;
+
+    *Result = NULL;
+    *Entry = NULL;
+
+    if (Digests == 0 || (Digests & ~AHC_DIGEST_ALL))
+        return STATUS_INVALID_PARAMETER;
+
+    result = (AHC_RESULT)HeapAlloc(Engine->HeapHandle,
+        HEAP_ZERO_MEMORY,
+        sizeof(struct _AHC_RESULT));
+
+    if (result == NULL)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    *Entry = AhcpAcquireCache(Engine);
+    if (*Entry == NULL) {
+        HeapFree(Engine->HeapHandle, 0, result);
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    result->HeapHandle = Engine->HeapHandle;
+    result->ImageError = IMAGE_VERIFY_UNKNOWN_ERROR;
+    *Result = result;
+
+    return STATUS_SUCCESS;
+}
+
+/*
+* AhcOpenEngine
+*
+* Purpose:
+*
+* Create hashing engine, Flags are reserved and must be zero.
+*
+*/
+AHCAPI NTSTATUS WINAPI AhcOpenEngine(
+    _In_ ULONG Flags,
+    _Out_ AHC_ENGINE* Engine
+)
+{
+    HANDLE heapHandle;
+    AHC_ENGINE engine;
+    SYSTEM_INFO systemInfo;
+
+    if (Engine == NULL)
+        return STATUS_INVALID_PARAMETER;
+
+    *Engine = NULL;
+
+    if (Flags != 0)
+        return STATUS_INVALID_PARAMETER;
+
+    heapHandle = HeapCreate(0, 0, 0);
+    if (heapHandle == NULL)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    engine = (AHC_ENGINE)HeapAlloc(heapHandle, HEAP_ZERO_MEMORY, sizeof(struct _AHC_ENGINE));
+    if (engine == NULL) {
+        HeapDestroy(heapHandle);
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    GetSystemInfo(&systemInfo);
+
+    InitializeSListHead(&engine->FreeCaches);
+    engine->HeapHandle = heapHandle;
+    engine->PageSize = systemInfo.dwPageSize;
+
+    *Engine = engine;
+    return STATUS_SUCCESS;
+}
+
+/*
+* AhcCloseEngine
+*
+* Purpose:
+*
+* Destroy engine, no calls may be in progress and all results must be freed.
+*
+*/
+AHCAPI VOID WINAPI AhcCloseEngine(
+    _In_ AHC_ENGINE Engine
+)
+{
+    PAHC_CACHE_ENTRY entry;
+
+    if (Engine == NULL)
+        return;
+
+    while ((entry = (PAHC_CACHE_ENTRY)InterlockedPopEntrySList(&Engine->FreeCaches)) != NULL)
+        HashDestroyContextCache(entry->Cache);
+
+    //
+    // Engine itself and remaining entries are heap blocks.
+    //
+    HeapDestroy(Engine->HeapHandle);
+}
+
+/*
+* AhcHashFile
+*
+* Purpose:
+*
+* Compute requested digests of the PE file.
+* Result is returned for load and validation failures as well, it holds
+* image error then, only parameter and memory failures leave it NULL.
+*
+*/
+AHCAPI NTSTATUS WINAPI AhcHashFile(
+    _In_ AHC_ENGINE Engine,
+    _In_ LPCWSTR FileName,
+    _In_ ULONG Digests,
+    _Out_ AHC_RESULT* Result
+)
+{
+    NTSTATUS ntStatus;
+    PAHC_CACHE_ENTRY entry;
+    FILE_VIEW_INFO fvi;
+
+    if (Engine == NULL || FileName == NULL || Result == NULL)
+        return STATUS_INVALID_PARAMETER;
+
+    ntStatus = AhcpBeginRequest(Engine, Digests, Result, &entry);
+    if (!NT_SUCCESS(ntStatus))
+        return ntStatus;
+
+    RtlSecureZeroMemory(&fvi, sizeof(fvi));
+    fvi.FileName = FileName;
+
+    //
+    // Page hashes only need headers.
+    //
+    ntStatus = HashLoadFile(&fvi, (Digests & AHC_AUTHENTICODE_DIGESTS_MASK) == 0);
+    if (NT_SUCCESS(ntStatus)) {
+        AhcpHashView(Engine, entry->Cache, &fvi, Digests, *Result);
+        HashUnloadFile(&fvi);
+    }
+    else {
+        (*Result)->ImageError = fvi.LastError;
+    }
+
+    AhcpReleaseCache(Engine, entry);
+
+    return ntStatus;
+}
+
+/*
+* AhcHashBuffer
+*
+* Purpose:
+*
+* Compute requested digests of the PE file image held in memory.
+* Buffer holds raw file contents and is only read.
+*
+*/
+AHCAPI NTSTATUS WINAPI AhcHashBuffer(
+    _In_ AHC_ENGINE Engine,
+    _In_reads_bytes_(Size) const VOID* Buffer,
+    _In_ SIZE_T Size,
+    _In_ ULONG Digests,
+    _Out_ AHC_RESULT* Result
+)
+{
+    NTSTATUS ntStatus;
+    PAHC_CACHE_ENTRY entry;
+    FILE_VIEW_INFO fvi;
+
+    if (Engine == NULL || Buffer == NULL || Size == 0 || Result == NULL)
+        return STATUS_INVALID_PARAMETER;
+
+    ntStatus = AhcpBeginRequest(Engine, Digests, Result, &entry);
+    if (!NT_SUCCESS(ntStatus))
+        return ntStatus;
+
+    //
+    // Whole buffer is the headers view, nothing is mapped or opened.
+    //
+    RtlSecureZeroMemory(&fvi, sizeof(fvi));
+
+    ntStatus = HashLoadBuffer(&fvi, Buffer, Size);
+    if (NT_SUCCESS(ntStatus)) {
+        AhcpHashView(Engine, entry->Cache, &fvi, Digests, *Result);
+        HashUnloadFile(&fvi);
+    }
+    else {
+        (*Result)->ImageError = fvi.LastError;
+    }
+
+    AhcpReleaseCache(Engine, entry);
+
+    return ntStatus;
+}
+
+/*
+* AhcBeginStream
+*
+* Purpose:
+*
+* Start hashing PE file which contents are pushed with AhcStreamData in file
+* order, e.g. by archive extractor. Excluded fields are located by the stream.
+* Stream holds context cache until AhcEndStream.
+*
+*/
+AHCAPI NTSTATUS WINAPI AhcBeginStream(
+    _In_ AHC_ENGINE Engine,
+    _In_ ULONGLONG FileSize,
+    _In_ ULONG Digests,
+    _Out_ AHC_STREAM* Stream
+)
+{
+    NTSTATUS ntStatus;
+    AHC_STREAM stream;
+
+    if (Stream == NULL)
+        return STATUS_INVALID_PARAMETER;
+
+    *Stream = NULL;
+
+    if (Engine == NULL || FileSize == 0)
+        return STATUS_INVALID_PARAMETER;
+
+    stream = (AHC_STREAM)HeapAlloc(Engine->HeapHandle,
+        HEAP_ZERO_MEMORY,
+        sizeof(struct _AHC_STREAM));
+
+    if (stream == NULL)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    ntStatus = AhcpBeginRequest(Engine, Digests, &stream->Result, &stream->Entry);
+    if (!NT_SUCCESS(ntStatus)) {
+        HeapFree(Engine->HeapHandle, 0, stream);
+        return ntStatus;
+    }
+
+    stream->Engine = Engine;
+    stream->Digests = Digests;
+    stream->ContextCount = AhcpAcquireAuthenticodeContexts(stream->Entry->Cache,
+        Digests,
+        stream->HashContexts,
+        stream->ContextIndex);
+
+    //
+    // Without authenticode digests push only collects and validates headers.
+    //
+    ntStatus = HashPushCreate(Engine->HeapHandle,
+        NULL,
+        FileSize,
+        stream->HashContexts,
+        stream->ContextCount,
+        &stream->Push);
+
+    if (!NT_SUCCESS(ntStatus)) {
+        AhcpReleaseCache(Engine, stream->Entry);
+        AhcFreeResult(stream->Result);
+        HeapFree(Engine->HeapHandle, 0, stream);
+        return ntStatus;
+    }
+
+    *Stream = stream;
+    return STATUS_SUCCESS;
+}
+
+/*
+* AhcStreamData
+*
+* Purpose:
+*
+* Push next block of file data, block size is arbitrary.
+* Failure is sticky, it is reported by AhcEndStream as well.
+*
+*/
+AHCAPI NTSTATUS WINAPI AhcStreamData(
+    _In_ AHC_STREAM Stream,
+    _In_reads_bytes_(Size) const VOID* Data,
+    _In_ SIZE_T Size
+)
+{
+    if (Stream == NULL || (Data == NULL && Size))
+        return STATUS_INVALID_PARAMETER;
+
+    if (Size == 0)
+        return STATUS_SUCCESS;
+
+    return HashPushData(Stream->Push, Data, Size);
+}
+
+/*
+* AhcEndStream
+*
+* Purpose:
+*
+* Finalize digests and destroy stream.
+* Result is returned like AhcHashFile does, it holds image error of
+* failed stream.
+*
+*/
+AHCAPI NTSTATUS WINAPI AhcEndStream(
+    _In_ AHC_STREAM Stream,
+    _Out_ AHC_RESULT* Result
+)
+{
+    NTSTATUS ntStatus;
+    ULONG i;
+    AHC_ENGINE engine;
+    AHC_RESULT result;
+    PFILE_VIEW_INFO viewInfo;
+
+    if (Stream == NULL || Result == NULL)
+        return STATUS_INVALID_PARAMETER;
+
+    engine = Stream->Engine;
+    result = Stream->Result;
+    viewInfo = HashPushQueryView(Stream->Push);
+
+    ntStatus = HashPushFinish(Stream->Push);
+    if (NT_SUCCESS(ntStatus)) {
+
+        for (i = 0; i < Stream->ContextCount; i++)
+            AhcpStoreDigest(result, Stream->ContextIndex[i], Stream->HashContexts[i]);
+
+        AhcpHashPages(engine, Stream->Entry->Cache, viewInfo, Stream->Digests, result);
+
+    }
+
+    result->ImageError = viewInfo->LastError;
+
+    HashPushDestroy(Stream->Push);
+    AhcpReleaseCache(engine, Stream->Entry);
+    HeapFree(engine->HeapHandle, 0, Stream);
+
+    *Result = result;
+    return ntStatus;
+}
+
+/*
+* AhcGetDigest
+*
+* Purpose:
+*
+* Copy digest from the result, DigestSize receives its length.
+* Returns STATUS_NOT_FOUND if digest was not requested or failed.
+*
+*/
+AHCAPI NTSTATUS WINAPI AhcGetDigest(
+    _In_ AHC_RESULT Result,
+    _In_ ULONG DigestId,
+    _Out_writes_bytes_to_opt_(BufferSize, *DigestSize) PUCHAR Buffer,
+    _In_ ULONG BufferSize,
+    _Out_ PULONG DigestSize
+)
+{
+    ULONG cbDigest;
+
+    if (Result == NULL || DigestSize == NULL || DigestId >= AHC_DIGEST_COUNT)
+        return STATUS_INVALID_PARAMETER;
+
+    cbDigest = Result->Length[DigestId];
+    *DigestSize = cbDigest;
+
+    if (cbDigest == 0)
+        return STATUS_NOT_FOUND;
+
+    if (Buffer == NULL || BufferSize < cbDigest)
+        return STATUS_BUFFER_TOO_SMALL;
+
+    RtlCopyMemory(Buffer, Result->Data[DigestId], cbDigest);
+    return STATUS_SUCCESS;
+}
+
+/*
+* AhcGetImageError
+*
+* Purpose:
+*
+* Return image verification code of the result.
+*
+*/
+AHCAPI ULONG WINAPI AhcGetImageError(
+    _In_ AHC_RESULT Result
+)
+{
+    return (Result) ? Result->ImageError : IMAGE_VERIFY_UNKNOWN_ERROR;
+}
+
+/*
+* AhcImageErrorToString
+*
+* Purpose:
+*
+* Return description of image verification code.
+*
+*/
+AHCAPI LPCWSTR WINAPI AhcImageErrorToString(
+    _In_ ULONG ImageError
+)
+{
+    return supImageVerifyErrorToString(ImageError);
+}
+
+/*
+* AhcFreeResult
+*
+* Purpose:
+*
+* Release result.
+*
+*/
+AHCAPI VOID WINAPI AhcFreeResult(
+    _In_ AHC_RESULT Result
+)
+{
+    if (Result)
+        HeapFree(Result->HeapHandle, 0, Result);
+}
@@ -0,0 +1,120 @@
+/*******************************************************************************
+*
+*  (C) COPYRIGHT AUTHORS, 2026
+*
+*  TITLE:       AHCLIB.H
+*
+*  VERSION:     1.05
+*
+*  DATE:        14 Oct 2026
+*
+*  AuthHashCalc hashing library public interface.
+*
+*  Header does not depend on program headers, include it after Windows.h
+*  and bcrypt.h. Define AHC_DLL when linking against DLL build of the library.
+*
+* THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+* ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED
+* TO THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*******************************************************************************/
+#pragma once
+
+#if defined(AHC_DLL_EXPORTS)
+#define AHCAPI __declspec(dllexport)
+#elif defined(AHC_DLL)
+#define AHCAPI __declspec(dllimport)
+#else
+#define AHCAPI
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//
+// Digest identifiers, request mask is built with AHC_DIGEST_FLAG.
+// Page digests are WDAC header page hashes.
+//
+#define AHC_DIGEST_MD5          0
+#define AHC_DIGEST_SHA1         1
+#define AHC_DIGEST_SHA256       2
+#define AHC_DIGEST_SHA384       3
+#define AHC_DIGEST_SHA512       4
+#define AHC_DIGEST_PAGE_SHA1    5
+#define AHC_DIGEST_PAGE_SHA256  6
+#define AHC_DIGEST_COUNT        7
+
+#define AHC_DIGEST_FLAG(Id)     (1UL << (Id))
+#define AHC_DIGEST_ALL          (AHC_DIGEST_FLAG(AHC_DIGEST_COUNT) - 1)
+
+#define AHC_DIGEST_MAX_SIZE     64
+
+//
+// Engine is safe to use from any number of threads at once.
+// Results are allocated from the engine and must be freed before it is closed.
+//
+typedef struct _AHC_ENGINE* AHC_ENGINE;
+typedef struct _AHC_RESULT* AHC_RESULT;
+
+//
+// Stream is used by one thread at a time, AhcEndStream always destroys it
+// and must be called before the engine is closed.
+//
+typedef struct _AHC_STREAM* AHC_STREAM;
+
+AHCAPI NTSTATUS WINAPI AhcOpenEngine(
+    _In_ ULONG Flags,
+    _Out_ AHC_ENGINE* Engine);
+
+AHCAPI VOID WINAPI AhcCloseEngine(
+    _In_ AHC_ENGINE Engine);
+
+AHCAPI NTSTATUS WINAPI AhcHashFile(
+    _In_ AHC_ENGINE Engine,
+    _In_ LPCWSTR FileName,
+    _In_ ULONG Digests,
+    _Out_ AHC_RESULT* Result);
+
+AHCAPI NTSTATUS WINAPI AhcHashBuffer(
+    _In_ AHC_ENGINE Engine,
+    _In_reads_bytes_(Size) const VOID* Buffer,
+    _In_ SIZE_T Size,
+    _In_ ULONG Digests,
+    _Out_ AHC_RESULT* Result);
+
+AHCAPI NTSTATUS WINAPI AhcBeginStream(
+    _In_ AHC_ENGINE Engine,
+    _In_ ULONGLONG FileSize,
+    _In_ ULONG Digests,
+    _Out_ AHC_STREAM* Stream);
+
+AHCAPI NTSTATUS WINAPI AhcStreamData(
+    _In_ AHC_STREAM Stream,
+    _In_reads_bytes_(Size) const VOID* Data,
+    _In_ SIZE_T Size);
+
+AHCAPI NTSTATUS WINAPI AhcEndStream(
+    _In_ AHC_STREAM Stream,
+    _Out_ AHC_RESULT* Result);
+
+AHCAPI NTSTATUS WINAPI AhcGetDigest(
+    _In_ AHC_RESULT Result,
+    _In_ ULONG DigestId,
+    _Out_writes_bytes_to_opt_(BufferSize, *DigestSize) PUCHAR Buffer,
+    _In_ ULONG BufferSize,
+    _Out_ PULONG DigestSize);
+
+AHCAPI ULONG WINAPI AhcGetImageError(
+    _In_ AHC_RESULT Result);
+
+AHCAPI LPCWSTR WINAPI AhcImageErrorToString(
+    _In_ ULONG ImageError);
+
+AHCAPI VOID WINAPI AhcFreeResult(
+    _In_ AHC_RESULT Result);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,607 @@
+/*******************************************************************************
+*
+*  (C) COPYRIGHT AUTHORS, 2026
+*
+*  TITLE:       ALLOW.CPP
+*
+*  VERSION:     1.05
+*
+*  DATE:        14 Oct 2026
+*
+*  Known good hash list.
+*
+*  List file is a sorted array of digests mapped read only. Open builds an
+*  index of bucket boundaries by leading ALLOW_INDEX_BITS bits, digests are
+*  uniform so every lookup is a short binary search inside one bucket,
+*  usually within a single page of the view.
+*
+* THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+* ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED
+* TO THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*******************************************************************************/
+
+#include "global.h"
+
+//
+// Largest single write while storing the list.
+//
+#define ALLOW_WRITE_CHUNK (64 * RTL_MEG)
+
+#define ALLOW_BUCKET(Digest) (((ULONG)(Digest)[0] << 8) | (ULONG)(Digest)[1])
+
+/*
+* AllowpDigest
+*
+* Purpose:
+*
+* Return pointer to digest at given index.
+*
+*/
+__forceinline const UCHAR* AllowpDigest(
+    _In_ PALLOW_LIST List,
+    _In_ ULONG Index
+)
+{
+    return List->Digests + (SIZE_T)Index * List->DigestSize;
+}
+
+/*
+* AllowpBuildIndex
+*
+* Purpose:
+*
+* Find first digest of every bucket, lower bounds only move forward.
+* Must be called under exception handler.
+*
+*/
+VOID AllowpBuildIndex(
+    _In_ PALLOW_LIST List
+)
+{
+    ULONG bucket, lo = 0, hi, mid;
+
+    for (bucket = 0; bucket < ALLOW_INDEX_SIZE; bucket++) {
+
+        hi = List->Count;
+
+        while (lo < hi) {
+            mid = lo + (hi - lo) / 2;
+            if (ALLOW_BUCKET(AllowpDigest(List, mid)) < bucket)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+
+        List->Index[bucket] = lo;
+    }
+
+    List->Index[ALLOW_INDEX_SIZE] = List->Count;
+}
+
+/*
+* AllowListOpen
+*
+* Purpose:
+*
+* Map known good hash list and build its lookup index.
+*
+*/
+NTSTATUS AllowListOpen(
+    _In_ LPCWSTR FileName,
+    _Out_ PALLOW_LIST* List
+)
+{
+    NTSTATUS ntStatus = STATUS_INSUFFICIENT_RESOURCES;
+    DWORD cbRead;
+    LARGE_INTEGER fileSize;
+    ALLOW_HEADER header;
+    PALLOW_LIST list;
+
+    *List = NULL;
+
+    list = (PALLOW_LIST)supHeapAlloc(sizeof(ALLOW_LIST));
+    if (list == NULL)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    do {
+
+        list->FileHandle = CreateFile(FileName,
+            GENERIC_READ,
+            FILE_SHARE_READ,
+            NULL,
+            OPEN_EXISTING,
+            FILE_FLAG_RANDOM_ACCESS,
+            NULL);
+
+        if (list->FileHandle == INVALID_HANDLE_VALUE) {
+            list->FileHandle = NULL;
+            ntStatus = STATUS_OBJECT_NAME_NOT_FOUND;
+            break;
+        }
+
+        RtlSecureZeroMemory(&header, sizeof(header));
+
+        if (!GetFileSizeEx(list->FileHandle, &fileSize) ||
+            !ReadFile(list->FileHandle, &header, sizeof(header), &cbRead, NULL) ||
+            cbRead != sizeof(header) ||
+            header.Signature != ALLOW_SIGNATURE ||
+            header.Version != ALLOW_VERSION ||
+            header.DigestSize < ALLOW_DIGEST_MIN_SIZE ||
+            header.DigestSize > ALLOW_DIGEST_MAX_SIZE ||
+            (ULONGLONG)fileSize.QuadPart !=
+            sizeof(ALLOW_HEADER) + (ULONGLONG)header.Count * header.DigestSize)
+        {
+            ntStatus = STATUS_INVALID_IMAGE_FORMAT;
+            break;
+        }
+
+        if ((ULONGLONG)fileSize.QuadPart > (SIZE_T)-1) {
+            ntStatus = STATUS_INSUFFICIENT_RESOURCES;
+            break;
+        }
+
+        list->MappingHandle = CreateFileMapping(list->FileHandle,
+            NULL,
+            PAGE_READONLY,
+            0,
+            0,
+            NULL);
+
+        if (list->MappingHandle == NULL)
+            break;
+
+        list->ViewBase = (PUCHAR)MapViewOfFile(list->MappingHandle,
+            FILE_MAP_READ,
+            0,
+            0,
+            (SIZE_T)fileSize.QuadPart);
+
+        if (list->ViewBase == NULL)
+            break;
+
+        list->Index = (PULONG)supHeapAlloc((ALLOW_INDEX_SIZE + 1) * sizeof(ULONG));
+        if (list->Index == NULL)
+            break;
+
+        list->Digests = list->ViewBase + sizeof(ALLOW_HEADER);
+        list->DigestSize = header.DigestSize;
+        list->Count = header.Count;
+
+        __try {
+            AllowpBuildIndex(list);
+        }
+        __except (EXCEPTION_EXECUTE_HANDLER) {
+            StatsExceptionCaught();
+            ntStatus = STATUS_IN_PAGE_ERROR;
+            break;
+        }
+
+        *List = list;
+        return STATUS_SUCCESS;
+
+    } while (FALSE);
+
+    AllowListClose(list);
+    return ntStatus;
+}
+
+/*
+* AllowListClose
+*
+* Purpose:
+*
+* Unmap list and release it.
+*
+*/
+VOID AllowListClose(
+    _In_ PALLOW_LIST List
+)
+{
+    if (List->Index)
+        supHeapFree(List->Index);
+
+    if (List->ViewBase)
+        UnmapViewOfFile(List->ViewBase);
+
+    if (List->MappingHandle)
+        CloseHandle(List->MappingHandle);
+
+    if (List->FileHandle)
+        CloseHandle(List->FileHandle);
+
+    supHeapFree(List);
+}
+
+/*
+* AllowListContains
+*
+* Purpose:
+*
+* Return TRUE if digest is in the list.
+* Digest of other size than list digests is never found.
+*
+*/
+BOOLEAN AllowListContains(
+    _In_ PALLOW_LIST List,
+    _In_reads_bytes_(Length) const UCHAR* Digest,
+    _In_ ULONG Length
+)
+{
+    BOOLEAN bFound = FALSE;
+    ULONG bucket, lo, hi, mid;
+    INT cmp;
+
+    InterlockedIncrement(&List->Statistics.Checked);
+
+    if (Length == List->DigestSize) {
+
+        bucket = ALLOW_BUCKET(Digest);
+        lo = List->Index[bucket];
+        hi = List->Index[bucket + 1];
+
+        __try {
+
+            while (lo < hi) {
+
+                mid = lo + (hi - lo) / 2;
+                cmp = memcmp(AllowpDigest(List, mid), Digest, Length);
+
+                if (cmp == 0) {
+                    bFound = TRUE;
+                    break;
+                }
+
+                if (cmp < 0)
+                    lo = mid + 1;
+                else
+                    hi = mid;
+            }
+
+        }
+        __except (EXCEPTION_EXECUTE_HANDLER) {
+            StatsExceptionCaught();
+            bFound = FALSE;
+        }
+    }
+
+    if (!bFound)
+        InterlockedIncrement(&List->Statistics.Missing);
+
+    return bFound;
+}
+
+/*
+* AllowpHexValue
+*
+* Purpose:
+*
+* Return value of hex digit or -1.
+*
+*/
+INT AllowpHexValue(
+    _In_ CHAR c
+)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+/*
+* AllowpIsWordChar
+*
+* Purpose:
+*
+* Return TRUE for characters that cannot delimit digest token.
+*
+*/
+BOOLEAN AllowpIsWordChar(
+    _In_ CHAR c
+)
+{
+    return ((c >= '0' && c <= '9') ||
+        (c >= 'a' && c <= 'z') ||
+        (c >= 'A' && c <= 'Z') ||
+        c == '_');
+}
+
+/*
+* AllowpIsDigestSize
+*
+* Purpose:
+*
+* Return TRUE for sizes of digests the program computes.
+*
+*/
+BOOLEAN AllowpIsDigestSize(
+    _In_ SIZE_T Size
+)
+{
+    return (Size == 16 || Size == 20 || Size == 32 || Size == 48 || Size == 64);
+}
+
+/*
+* AllowpCompareDigests
+*
+* Purpose:
+*
+* qsort_s callback, context is digest size.
+*
+*/
+INT __cdecl AllowpCompareDigests(
+    _In_ void* Context,
+    _In_ const void* First,
+    _In_ const void* Second
+)
+{
+    return memcmp(First, Second, *(PULONG)Context);
+}
+
+/*
+* AllowpReadText
+*
+* Purpose:
+*
+* Read whole text file into zero terminated heap buffer.
+*
+*/
+NTSTATUS AllowpReadText(
+    _In_ LPCWSTR FileName,
+    _Out_ PCHAR* Text,
+    _Out_ PSIZE_T Size
+)
+{
+    NTSTATUS ntStatus = STATUS_INSUFFICIENT_RESOURCES;
+    HANDLE fileHandle;
+    LARGE_INTEGER fileSize;
+    DWORD cbRead;
+    SIZE_T cbTotal = 0;
+    PCHAR text = NULL;
+
+    *Text = NULL;
+    *Size = 0;
+
+    fileHandle = CreateFile(FileName,
+        GENERIC_READ,
+        FILE_SHARE_READ,
+        NULL,
+        OPEN_EXISTING,
+        FILE_FLAG_SEQUENTIAL_SCAN,
+        NULL);
+
+    if (fileHandle == INVALID_HANDLE_VALUE)
+        return STATUS_OBJECT_NAME_NOT_FOUND;
+
+    do {
+
+        if (!GetFileSizeEx(fileHandle, &fileSize) ||
+            (ULONGLONG)fileSize.QuadPart >= (SIZE_T)-1)
+        {
+            break;
+        }
+
+        text = (PCHAR)supHeapAlloc((SIZE_T)fileSize.QuadPart + 1);
+        if (text == NULL)
+            break;
+
+        while (cbTotal < (SIZE_T)fileSize.QuadPart) {
+
+            if (!ReadFile(fileHandle,
+                text + cbTotal,
+                (DWORD)min((SIZE_T)fileSize.QuadPart - cbTotal, ALLOW_WRITE_CHUNK),
+                &cbRead,
+                NULL) || cbRead == 0)
+            {
+                break;
+            }
+
+            cbTotal += cbRead;
+        }
+
+        if (cbTotal != (SIZE_T)fileSize.QuadPart) {
+            ntStatus = STATUS_IN_PAGE_ERROR;
+            break;
+        }
+
+        *Text = text;
+        *Size = cbTotal;
+        ntStatus = STATUS_SUCCESS;
+
+    } while (FALSE);
+
+    CloseHandle(fileHandle);
+
+    if (!NT_SUCCESS(ntStatus) && text)
+        supHeapFree(text);
+
+    return ntStatus;
+}
+
+/*
+* AllowpWriteList
+*
+* Purpose:
+*
+* Store header and sorted digests.
+*
+*/
+NTSTATUS AllowpWriteList(
+    _In_ LPCWSTR FileName,
+    _In_ PALLOW_HEADER Header,
+    _In_reads_bytes_(Size) const UCHAR* Digests,
+    _In_ SIZE_T Size
+)
+{
+    BOOL bResult;
+    HANDLE fileHandle;
+    DWORD cbChunk, cbWritten;
+
+    fileHandle = CreateFile(FileName,
+        GENERIC_WRITE,
+        0,
+        NULL,
+        CREATE_ALWAYS,
+        FILE_ATTRIBUTE_NORMAL,
+        NULL);
+
+    if (fileHandle == INVALID_HANDLE_VALUE)
+        return STATUS_ACCESS_DENIED;
+
+    bResult = WriteFile(fileHandle, Header, sizeof(ALLOW_HEADER), &cbWritten, NULL) &&
+        cbWritten == sizeof(ALLOW_HEADER);
+
+    while (bResult && Size) {
+        cbChunk = (DWORD)min(Size, ALLOW_WRITE_CHUNK);
+        bResult = WriteFile(fileHandle, Digests, cbChunk, &cbWritten, NULL) &&
+            cbWritten == cbChunk;
+        Digests += cbChunk;
+        Size -= cbChunk;
+    }
+
+    CloseHandle(fileHandle);
+
+    if (!bResult) {
+        DeleteFile(FileName);
+        return STATUS_DISK_FULL;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/*
+* AllowListBuild
+*
+* Purpose:
+*
+* Convert text list to list file. First hex token of every line is taken
+* as digest, size of the first one found sets the list digest size and
+* lines with digests of other size are skipped.
+*
+*/
+NTSTATUS AllowListBuild(
+    _In_ LPCWSTR TextFileName,
+    _In_ LPCWSTR FileName,
+    _Out_ PULONG Count
+)
+{
+    NTSTATUS ntStatus;
+    INT hi, lo;
+    ULONG digestSize = 0, i, cDigests = 0, cUnique;
+    SIZE_T cbText, cbToken, capacity = 0;
+    PCHAR text, p, token, lineEnd;
+    PUCHAR digests = NULL, digest;
+    ALLOW_HEADER header;
+
+    *Count = 0;
+
+    ntStatus = AllowpReadText(TextFileName, &text, &cbText);
+    if (!NT_SUCCESS(ntStatus))
+        return ntStatus;
+
+    text[cbText] = 0;
+
+    for (p = text; *p; p = (*lineEnd) ? lineEnd + 1 : lineEnd) {
+
+        lineEnd = strchr(p, '\n');
+        if (lineEnd == NULL)
+            lineEnd = p + strlen(p);
+
+        //
+        // Find first token of hex digits only with one of digest sizes.
+        //
+        for (token = p; token < lineEnd; ) {
+
+            while (token < lineEnd && AllowpHexValue(*token) < 0)
+                token++;
+
+            for (cbToken = 0; token + cbToken < lineEnd && AllowpHexValue(token[cbToken]) >= 0; )
+                cbToken++;
+
+            if (cbToken && (cbToken & 1) == 0 && AllowpIsDigestSize(cbToken / 2) &&
+                (token + cbToken == lineEnd || !AllowpIsWordChar(token[cbToken])) &&
+                (token == p || !AllowpIsWordChar(token[-1])))
+            {
+                break;
+            }
+
+            token += cbToken;
+        }
+
+        if (token >= lineEnd)
+            continue;
+
+        if (digestSize == 0) {
+
+            digestSize = (ULONG)(cbToken / 2);
+
+            //
+            // Upper bound of digests count for this size.
+            //
+            capacity = cbText / cbToken + 1;
+            if (capacity > MAXULONG)
+                capacity = MAXULONG;
+
+            digests = (PUCHAR)supHeapAlloc(capacity * digestSize);
+            if (digests == NULL) {
+                ntStatus = STATUS_INSUFFICIENT_RESOURCES;
+                break;
+            }
+        }
+
+        if (cbToken / 2 != digestSize || cDigests == capacity)
+            continue;
+
+        digest = digests + (SIZE_T)cDigests * digestSize;
+
+        for (i = 0; i < digestSize; i++) {
+            hi = AllowpHexValue(token[i * 2]);
+            lo = AllowpHexValue(token[i * 2 + 1]);
+            digest[i] = (UCHAR)((hi << 4) | lo);
+        }
+
+        cDigests += 1;
+    }
+
+    supHeapFree(text);
+
+    if (!NT_SUCCESS(ntStatus))
+        return ntStatus;
+
+    if (digestSize == 0)
+        return STATUS_NO_MORE_ENTRIES;
+
+    qsort_s(digests, cDigests, digestSize, AllowpCompareDigests, &digestSize);
+
+    for (i = 0, cUnique = 0; i < cDigests; i++) {
+
+        digest = digests + (SIZE_T)i * digestSize;
+
+        if (cUnique &&
+            RtlEqualMemory(digests + (SIZE_T)(cUnique - 1) * digestSize, digest, digestSize))
+        {
+            continue;
+        }
+
+        if (cUnique != i)
+            RtlCopyMemory(digests + (SIZE_T)cUnique * digestSize, digest, digestSize);
+
+        cUnique += 1;
+    }
+
+    header.Signature = ALLOW_SIGNATURE;
+    header.Version = ALLOW_VERSION;
+    header.DigestSize = digestSize;
+    header.Count = cUnique;
+
+    ntStatus = AllowpWriteList(FileName, &header, digests, (SIZE_T)cUnique * digestSize);
+
+    supHeapFree(digests);
+
+    if (NT_SUCCESS(ntStatus))
+        *Count = cUnique;
+
+    return ntStatus;
+}
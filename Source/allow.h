@@ -0,0 +1,75 @@
+/*******************************************************************************
+*
+*  (C) COPYRIGHT AUTHORS, 2026
+*
+*  TITLE:       ALLOW.H
+*
+*  VERSION:     1.05
+*
+*  DATE:        14 Oct 2026
+*
+*  Known good hash list header file.
+*
+* THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+* ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED
+* TO THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*******************************************************************************/
+#pragma once
+
+#define ALLOW_SIGNATURE     'LAHA'
+#define ALLOW_VERSION       1
+
+//
+// Lookup index buckets are selected by leading digest bits.
+//
+#define ALLOW_INDEX_BITS    16
+#define ALLOW_INDEX_SIZE    (1UL << ALLOW_INDEX_BITS)
+
+#define ALLOW_DIGEST_MIN_SIZE   16
+#define ALLOW_DIGEST_MAX_SIZE   64
+
+//
+// File layout: header followed by Count digests of DigestSize bytes
+// sorted in ascending byte order without duplicates.
+//
+typedef struct _ALLOW_HEADER {
+    ULONG Signature;
+    ULONG Version;
+    ULONG DigestSize;
+    ULONG Count;
+} ALLOW_HEADER, * PALLOW_HEADER;
+
+typedef struct _ALLOW_STATISTICS {
+    volatile LONG Checked;
+    volatile LONG Missing;
+} ALLOW_STATISTICS, * PALLOW_STATISTICS;
+
+typedef struct _ALLOW_LIST {
+    HANDLE FileHandle;
+    HANDLE MappingHandle;
+    PUCHAR ViewBase;
+    const UCHAR* Digests;
+    ULONG DigestSize;
+    ULONG Count;
+    PULONG Index;
+    ALLOW_STATISTICS Statistics;
+} ALLOW_LIST, * PALLOW_LIST;
+
+NTSTATUS AllowListOpen(
+    _In_ LPCWSTR FileName,
+    _Out_ PALLOW_LIST* List);
+
+VOID AllowListClose(
+    _In_ PALLOW_LIST List);
+
+BOOLEAN AllowListContains(
+    _In_ PALLOW_LIST List,
+    _In_reads_bytes_(Length) const UCHAR* Digest,
+    _In_ ULONG Length);
+
+NTSTATUS AllowListBuild(
+    _In_ LPCWSTR TextFileName,
+    _In_ LPCWSTR FileName,
+    _Out_ PULONG Count);
@@ -0,0 +1,1376 @@
+/*******************************************************************************
+*
+*  (C) COPYRIGHT AUTHORS, 2026
+*
+*  TITLE:       ARCHIVE.CPP
+*
+*  VERSION:     1.05
+*
+*  DATE:        14 Oct 2026
+*
+*  Archive member hashing support.
+*
+*  Members are decompressed into memory by extractor threads, one archive
+*  per extractor at a time, and handed to hash workers through a queue.
+*  Nothing is written to disk. Memory held by decompressed members that
+*  are not hashed yet is bounded, extractors wait when limit is reached.
+*  CAB is decoded with system FDI library, ZIP stored and deflated members
+*  with built-in inflater, other formats are reported as not supported.
+*
+* THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+* ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED
+* TO THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*******************************************************************************/
+
+#include "global.h"
+#include <fdi.h>
+
+#pragma comment(lib, "Cabinet.lib")
+
+//
+// Decompressed member bytes waiting for hash workers.
+// Single member above the limit is admitted when nothing else is pending.
+//
+#define ARCHIVE_INFLIGHT_MAX (256 * RTL_MEG)
+
+#define ARCHIVE_SIGNATURE_MAX 6
+
+#define ARCHIVE_READ_CHUNK (16 * RTL_MEG)
+
+#define ARCHIVE_ZIP_EOCD_SIGNATURE      0x06054b50
+#define ARCHIVE_ZIP_EOCD_SIZE           22
+#define ARCHIVE_ZIP_COMMENT_MAX         0xFFFF
+#define ARCHIVE_ZIP64_LOCATOR_SIGNATURE 0x07064b50
+#define ARCHIVE_ZIP64_LOCATOR_SIZE      20
+#define ARCHIVE_ZIP64_EOCD_SIGNATURE    0x06064b50
+#define ARCHIVE_ZIP64_EOCD_SIZE         56
+#define ARCHIVE_ZIP_CENTRAL_SIGNATURE   0x02014b50
+#define ARCHIVE_ZIP_CENTRAL_SIZE        46
+#define ARCHIVE_ZIP_LOCAL_SIGNATURE     0x04034b50
+#define ARCHIVE_ZIP_LOCAL_SIZE          30
+#define ARCHIVE_ZIP_EXTRA_ZIP64         0x0001
+#define ARCHIVE_ZIP_FLAG_ENCRYPTED      0x0001
+#define ARCHIVE_ZIP_FLAG_UTF8           0x0800
+#define ARCHIVE_ZIP_METHOD_STORED       0
+#define ARCHIVE_ZIP_METHOD_DEFLATE      8
+
+#define ARCHIVE_FDI_FILE_ARCHIVE 0
+#define ARCHIVE_FDI_FILE_MEMBER  1
+
+typedef struct _ARCHIVE_ENTRY {
+    struct _ARCHIVE_ENTRY* Next;
+    struct _ARCHIVE_ENTRY* NextQueued;
+    LPWSTR Name;
+    PUCHAR Data;
+    SIZE_T Size;
+    SIZE_T Written;
+    BOOLEAN Completed;
+    PVOID Result;
+} ARCHIVE_ENTRY, * PARCHIVE_ENTRY;
+
+typedef struct _ARCHIVE_ITEM {
+    LPCWSTR FileName;
+    PARCHIVE_ENTRY First;
+    PARCHIVE_ENTRY* Tail;
+    NTSTATUS Status;
+    BOOLEAN Extracted;
+} ARCHIVE_ITEM, * PARCHIVE_ITEM;
+
+typedef struct _ARCHIVE_CONTEXT {
+    PBATCH_FILE_LIST ArchiveList;
+    PARCHIVE_CALLBACKS Callbacks;
+    PARCHIVE_ITEM Items;
+    volatile LONG NextArchive;
+    SRWLOCK Lock;
+    CONDITION_VARIABLE QueueReady;
+    CONDITION_VARIABLE MemoryFree;
+    CONDITION_VARIABLE Progress;
+    PARCHIVE_ENTRY QueueHead;
+    PARCHIVE_ENTRY* QueueTail;
+    SIZE_T InFlight;
+    ULONG ExtractorsRunning;
+} ARCHIVE_CONTEXT, * PARCHIVE_CONTEXT;
+
+//
+// FDI file handle, either archive file or member being decompressed.
+//
+typedef struct _ARCHIVE_FDI_FILE {
+    ULONG Type;
+    HANDLE FileHandle;
+    PARCHIVE_ENTRY Entry;
+} ARCHIVE_FDI_FILE, * PARCHIVE_FDI_FILE;
+
+typedef struct _ARCHIVE_EXTRACTOR {
+    PARCHIVE_CONTEXT Context;
+    PARCHIVE_ITEM Item;
+    PARCHIVE_FDI_FILE Member;
+    NTSTATUS Status;
+} ARCHIVE_EXTRACTOR, * PARCHIVE_EXTRACTOR;
+
+/*
+* ArchiveQueryFormat
+*
+* Purpose:
+*
+* Detect archive format by file signature.
+*
+*/
+ULONG ArchiveQueryFormat(
+    _In_ LPCWSTR FileName
+)
+{
+    ULONG format = ARCHIVE_FORMAT_UNKNOWN;
+    DWORD cbRead = 0;
+    HANDLE fileHandle;
+    UCHAR signature[ARCHIVE_SIGNATURE_MAX];
+
+    fileHandle = CreateFile(FileName,
+        GENERIC_READ,
+        FILE_SHARE_READ | FILE_SHARE_DELETE,
+        NULL,
+        OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL,
+        NULL);
+
+    if (fileHandle == INVALID_HANDLE_VALUE)
+        return ARCHIVE_FORMAT_UNKNOWN;
+
+    if (ReadFile(fileHandle, signature, sizeof(signature), &cbRead, NULL) &&
+        cbRead == sizeof(signature))
+    {
+        if (RtlEqualMemory(signature, "MSCF", 4))
+            format = ARCHIVE_FORMAT_CAB;
+        else if (RtlEqualMemory(signature, "PK\x03\x04", 4))
+            format = ARCHIVE_FORMAT_ZIP;
+        else if (RtlEqualMemory(signature, "PK\x05\x06", 4))
+            format = ARCHIVE_FORMAT_ZIP;
+    }
+
+    CloseHandle(fileHandle);
+    return format;
+}
+
+/*
+* ArchivepAllocateEntry
+*
+* Purpose:
+*
+* Allocate member entry with result and full name, then wait until
+* member data fits into in-flight limit and allocate it.
+*
+*/
+PARCHIVE_ENTRY ArchivepAllocateEntry(
+    _In_ PARCHIVE_CONTEXT Context,
+    _In_ PARCHIVE_ITEM Item,
+    _In_ LPCSTR MemberName,
+    _In_ UINT CodePage,
+    _In_ SIZE_T Size
+)
+{
+    INT cchMember;
+    SIZE_T cchArchive, cbHeader, cbTotal;
+    PARCHIVE_ENTRY entry;
+
+    cchMember = MultiByteToWideChar(CodePage, 0, MemberName, -1, NULL, 0);
+    if (cchMember <= 0)
+        return NULL;
+
+    cchArchive = wcslen(Item->FileName);
+    cbHeader = ALIGN_UP_BY(sizeof(ARCHIVE_ENTRY), MEMORY_ALLOCATION_ALIGNMENT) +
+        ALIGN_UP_BY(Context->Callbacks->ResultSize, MEMORY_ALLOCATION_ALIGNMENT);
+    cbTotal = cbHeader + (cchArchive + 1 + (SIZE_T)cchMember) * sizeof(WCHAR);
+
+    entry = (PARCHIVE_ENTRY)supHeapAlloc(cbTotal);
+    if (entry == NULL)
+        return NULL;
+
+    entry->Result = RtlOffsetToPointer(entry,
+        ALIGN_UP_BY(sizeof(ARCHIVE_ENTRY), MEMORY_ALLOCATION_ALIGNMENT));
+    entry->Name = (LPWSTR)RtlOffsetToPointer(entry, cbHeader);
+    entry->Size = Size;
+
+    RtlCopyMemory(entry->Name, Item->FileName, cchArchive * sizeof(WCHAR));
+    entry->Name[cchArchive] = ARCHIVE_NAME_SEPARATOR;
+    MultiByteToWideChar(CodePage, 0, MemberName, -1, &entry->Name[cchArchive + 1], cchMember);
+
+    AcquireSRWLockExclusive(&Context->Lock);
+    while (Context->InFlight && Context->InFlight + Size > ARCHIVE_INFLIGHT_MAX)
+        SleepConditionVariableSRW(&Context->MemoryFree, &Context->Lock, INFINITE, 0);
+    Context->InFlight += Size;
+    ReleaseSRWLockExclusive(&Context->Lock);
+
+    entry->Data = (PUCHAR)supHeapAlloc((Size) ? Size : 1);
+    if (entry->Data == NULL) {
+        AcquireSRWLockExclusive(&Context->Lock);
+        Context->InFlight -= Size;
+        ReleaseSRWLockExclusive(&Context->Lock);
+        WakeAllConditionVariable(&Context->MemoryFree);
+        supHeapFree(entry);
+        return NULL;
+    }
+
+    return entry;
+}
+
+/*
+* ArchivepDiscardEntry
+*
+* Purpose:
+*
+* Free member that was not completely decompressed.
+*
+*/
+VOID ArchivepDiscardEntry(
+    _In_ PARCHIVE_CONTEXT Context,
+    _In_ PARCHIVE_ENTRY Entry
+)
+{
+    AcquireSRWLockExclusive(&Context->Lock);
+    Context->InFlight -= Entry->Size;
+    ReleaseSRWLockExclusive(&Context->Lock);
+    WakeAllConditionVariable(&Context->MemoryFree);
+
+    supHeapFree(Entry->Data);
+    supHeapFree(Entry);
+}
+
+/*
+* ArchivepQueueEntry
+*
+* Purpose:
+*
+* Append decompressed member to archive output list and hash queue.
+*
+*/
+VOID ArchivepQueueEntry(
+    _In_ PARCHIVE_CONTEXT Context,
+    _In_ PARCHIVE_ITEM Item,
+    _In_ PARCHIVE_ENTRY Entry
+)
+{
+    AcquireSRWLockExclusive(&Context->Lock);
+
+    *Item->Tail = Entry;
+    Item->Tail = &Entry->Next;
+
+    *Context->QueueTail = Entry;
+    Context->QueueTail = &Entry->NextQueued;
+
+    ReleaseSRWLockExclusive(&Context->Lock);
+
+    WakeConditionVariable(&Context->QueueReady);
+}
+
+/*
+* ArchivepFdiAlloc
+*
+* Purpose:
+*
+* FDI memory allocation callback.
+*
+*/
+FNALLOC(ArchivepFdiAlloc)
+{
+    return supHeapAlloc(cb);
+}
+
+/*
+* ArchivepFdiFree
+*
+* Purpose:
+*
+* FDI memory release callback.
+*
+*/
+FNFREE(ArchivepFdiFree)
+{
+    supHeapFree(pv);
+}
+
+/*
+* ArchivepFdiOpen
+*
+* Purpose:
+*
+* FDI open callback, only archive files are opened and only for read.
+* Names are UTF-8, FDI passes them through unchanged.
+*
+*/
+FNOPEN(ArchivepFdiOpen)
+{
+    INT cchName;
+    LPWSTR lpFileName;
+    PARCHIVE_FDI_FILE file;
+
+    UNREFERENCED_PARAMETER(oflag);
+    UNREFERENCED_PARAMETER(pmode);
+
+    cchName = MultiByteToWideChar(CP_UTF8, 0, pszFile, -1, NULL, 0);
+    if (cchName <= 0)
+        return -1;
+
+    file = (PARCHIVE_FDI_FILE)supHeapAlloc(sizeof(ARCHIVE_FDI_FILE) + (SIZE_T)cchName * sizeof(WCHAR));
+    if (file == NULL)
+        return -1;
+
+    lpFileName = (LPWSTR)(file + 1);
+    MultiByteToWideChar(CP_UTF8, 0, pszFile, -1, lpFileName, cchName);
+
+    file->Type = ARCHIVE_FDI_FILE_ARCHIVE;
+    file->FileHandle = CreateFile(lpFileName,
+        GENERIC_READ,
+        FILE_SHARE_READ | FILE_SHARE_DELETE,
+        NULL,
+        OPEN_EXISTING,
+        FILE_FLAG_SEQUENTIAL_SCAN,
+        NULL);
+
+    if (file->FileHandle == INVALID_HANDLE_VALUE) {
+        supHeapFree(file);
+        return -1;
+    }
+
+    return (INT_PTR)file;
+}
+
+/*
+* ArchivepFdiRead
+*
+* Purpose:
+*
+* FDI read callback.
+*
+*/
+FNREAD(ArchivepFdiRead)
+{
+    DWORD cbRead = 0;
+    PARCHIVE_FDI_FILE file = (PARCHIVE_FDI_FILE)hf;
+
+    if (file->Type != ARCHIVE_FDI_FILE_ARCHIVE ||
+        !ReadFile(file->FileHandle, pv, cb, &cbRead, NULL))
+    {
+        return (UINT)-1;
+    }
+
+    return cbRead;
+}
+
+/*
+* ArchivepFdiWrite
+*
+* Purpose:
+*
+* FDI write callback, member data is copied to its memory buffer.
+*
+*/
+FNWRITE(ArchivepFdiWrite)
+{
+    PARCHIVE_FDI_FILE file = (PARCHIVE_FDI_FILE)hf;
+    PARCHIVE_ENTRY entry = file->Entry;
+
+    if (file->Type != ARCHIVE_FDI_FILE_MEMBER ||
+        cb > entry->Size - entry->Written)
+    {
+        return (UINT)-1;
+    }
+
+    RtlCopyMemory(entry->Data + entry->Written, pv, cb);
+    entry->Written += cb;
+
+    return cb;
+}
+
+/*
+* ArchivepFdiClose
+*
+* Purpose:
+*
+* FDI close callback.
+*
+*/
+FNCLOSE(ArchivepFdiClose)
+{
+    PARCHIVE_FDI_FILE file = (PARCHIVE_FDI_FILE)hf;
+
+    if (file->Type == ARCHIVE_FDI_FILE_ARCHIVE)
+        CloseHandle(file->FileHandle);
+
+    supHeapFree(file);
+    return 0;
+}
+
+/*
+* ArchivepFdiSeek
+*
+* Purpose:
+*
+* FDI seek callback.
+*
+*/
+FNSEEK(ArchivepFdiSeek)
+{
+    DWORD moveMethod;
+    LARGE_INTEGER distance, position;
+    PARCHIVE_FDI_FILE file = (PARCHIVE_FDI_FILE)hf;
+
+    if (file->Type != ARCHIVE_FDI_FILE_ARCHIVE)
+        return -1;
+
+    switch (seektype) {
+    case SEEK_CUR:
+        moveMethod = FILE_CURRENT;
+        break;
+    case SEEK_END:
+        moveMethod = FILE_END;
+        break;
+    default:
+        moveMethod = FILE_BEGIN;
+        break;
+    }
+
+    distance.QuadPart = dist;
+    if (!SetFilePointerEx(file->FileHandle, distance, &position, moveMethod) ||
+        position.QuadPart > MAXLONG)
+    {
+        return -1;
+    }
+
+    return (long)position.QuadPart;
+}
+
+/*
+* ArchivepFdiNotify
+*
+* Purpose:
+*
+* FDICopy notification callback, starts and completes members.
+*
+*/
+FNFDINOTIFY(ArchivepFdiNotify)
+{
+    PARCHIVE_EXTRACTOR extractor = (PARCHIVE_EXTRACTOR)pfdin->pv;
+    PARCHIVE_FDI_FILE file;
+
+    switch (fdint) {
+
+    case fdintCOPY_FILE:
+
+        if (pfdin->cb < 0)
+            return 0;
+
+        file = (PARCHIVE_FDI_FILE)supHeapAlloc(sizeof(ARCHIVE_FDI_FILE));
+        if (file == NULL) {
+            extractor->Status = STATUS_INSUFFICIENT_RESOURCES;
+            return -1;
+        }
+
+        file->Type = ARCHIVE_FDI_FILE_MEMBER;
+        file->Entry = ArchivepAllocateEntry(extractor->Context,
+            extractor->Item,
+            pfdin->psz1,
+            (pfdin->attribs & _A_NAME_IS_UTF) ? CP_UTF8 : CP_ACP,
+            (SIZE_T)pfdin->cb);
+
+        if (file->Entry == NULL) {
+            supHeapFree(file);
+            extractor->Status = STATUS_INSUFFICIENT_RESOURCES;
+            return -1;
+        }
+
+        extractor->Member = file;
+        return (INT_PTR)file;
+
+    case fdintCLOSE_FILE_INFO:
+
+        file = (PARCHIVE_FDI_FILE)pfdin->hf;
+        extractor->Member = NULL;
+
+        if (file->Entry->Written != file->Entry->Size) {
+            ArchivepDiscardEntry(extractor->Context, file->Entry);
+            extractor->Status = STATUS_DATA_ERROR;
+            supHeapFree(file);
+            return FALSE;
+        }
+
+        ArchivepQueueEntry(extractor->Context, extractor->Item, file->Entry);
+        supHeapFree(file);
+        return TRUE;
+
+    default:
+        //
+        // Continuation cabinets are opened from the same directory.
+        //
+        return 0;
+    }
+}
+
+/*
+* ArchivepFdiErrorToStatus
+*
+* Purpose:
+*
+* Convert FDI error to NTSTATUS.
+*
+*/
+NTSTATUS ArchivepFdiErrorToStatus(
+    _In_ INT ErrorCode
+)
+{
+    switch (ErrorCode) {
+    case FDIERROR_CABINET_NOT_FOUND:
+        return STATUS_OBJECT_NAME_NOT_FOUND;
+    case FDIERROR_NOT_A_CABINET:
+    case FDIERROR_UNKNOWN_CABINET_VERSION:
+    case FDIERROR_BAD_COMPR_TYPE:
+        return STATUS_NOT_SUPPORTED;
+    case FDIERROR_ALLOC_FAIL:
+        return STATUS_INSUFFICIENT_RESOURCES;
+    case FDIERROR_CORRUPT_CABINET:
+    case FDIERROR_MDI_FAIL:
+    case FDIERROR_WRONG_CABINET:
+        return STATUS_DATA_ERROR;
+    default:
+        return STATUS_UNSUCCESSFUL;
+    }
+}
+
+/*
+* ArchivepExtractCab
+*
+* Purpose:
+*
+* Decompress all members of the cabinet into hash queue.
+*
+*/
+NTSTATUS ArchivepExtractCab(
+    _In_ PARCHIVE_CONTEXT Context,
+    _In_ HFDI FdiHandle,
+    _In_ PERF FdiError,
+    _In_ PARCHIVE_ITEM Item
+)
+{
+    INT cbPath;
+    LPSTR lpPath, lpName, lpSeparator, lpSlash;
+    ARCHIVE_EXTRACTOR extractor;
+
+    cbPath = WideCharToMultiByte(CP_UTF8, 0, Item->FileName, -1, NULL, 0, NULL, NULL);
+    if (cbPath <= 0)
+        return STATUS_OBJECT_NAME_INVALID;
+
+    lpPath = (LPSTR)supHeapAlloc((SIZE_T)cbPath * 2);
+    if (lpPath == NULL)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    WideCharToMultiByte(CP_UTF8, 0, Item->FileName, -1, lpPath, cbPath, NULL, NULL);
+
+    //
+    // FDI takes directory with trailing separator and name apart.
+    //
+    lpName = lpPath + cbPath;
+    lpSeparator = strrchr(lpPath, '\\');
+    lpSlash = strrchr(lpPath, '/');
+    if (lpSlash > lpSeparator)
+        lpSeparator = lpSlash;
+
+    if (lpSeparator) {
+        StringCbCopyA(lpName, cbPath, lpSeparator + 1);
+        lpSeparator[1] = 0;
+    }
+    else {
+        StringCbCopyA(lpName, cbPath, lpPath);
+        lpPath[0] = 0;
+    }
+
+    RtlSecureZeroMemory(&extractor, sizeof(extractor));
+    extractor.Context = Context;
+    extractor.Item = Item;
+    extractor.Status = STATUS_SUCCESS;
+
+    if (!FDICopy(FdiHandle, lpName, lpPath, 0, ArchivepFdiNotify, NULL, &extractor)) {
+
+        if (extractor.Member) {
+            ArchivepDiscardEntry(Context, extractor.Member->Entry);
+            supHeapFree(extractor.Member);
+        }
+
+        if (NT_SUCCESS(extractor.Status))
+            extractor.Status = ArchivepFdiErrorToStatus(FdiError->erfOper);
+    }
+
+    supHeapFree(lpPath);
+    return extractor.Status;
+}
+
+/*
+* ArchivepReadAt
+*
+* Purpose:
+*
+* Read exactly Size bytes at given file offset.
+*
+*/
+BOOLEAN ArchivepReadAt(
+    _In_ HANDLE FileHandle,
+    _In_ ULONGLONG Offset,
+    _Out_writes_bytes_(Size) PVOID Buffer,
+    _In_ SIZE_T Size
+)
+{
+    DWORD cbChunk, cbRead;
+    SIZE_T cbDone = 0;
+    OVERLAPPED overlapped;
+
+    while (cbDone < Size) {
+
+        cbChunk = (DWORD)min(Size - cbDone, (SIZE_T)ARCHIVE_READ_CHUNK);
+
+        RtlSecureZeroMemory(&overlapped, sizeof(overlapped));
+        overlapped.Offset = (DWORD)(Offset + cbDone);
+        overlapped.OffsetHigh = (DWORD)((Offset + cbDone) >> 32);
+
+        cbRead = 0;
+        if (!ReadFile(FileHandle, RtlOffsetToPointer(Buffer, cbDone), cbChunk, &cbRead, &overlapped) ||
+            cbRead != cbChunk)
+        {
+            return FALSE;
+        }
+
+        cbDone += cbChunk;
+    }
+
+    return TRUE;
+}
+
+FORCEINLINE USHORT ArchivepGet16(
+    _In_reads_bytes_(2) const UCHAR* Buffer
+)
+{
+    return (USHORT)(Buffer[0] | (Buffer[1] << 8));
+}
+
+FORCEINLINE ULONG ArchivepGet32(
+    _In_reads_bytes_(4) const UCHAR* Buffer
+)
+{
+    return (ULONG)ArchivepGet16(Buffer) | ((ULONG)ArchivepGet16(Buffer + 2) << 16);
+}
+
+FORCEINLINE ULONGLONG ArchivepGet64(
+    _In_reads_bytes_(8) const UCHAR* Buffer
+)
+{
+    return (ULONGLONG)ArchivepGet32(Buffer) | ((ULONGLONG)ArchivepGet32(Buffer + 4) << 32);
+}
+
+/*
+* ArchivepZipFindDirectory
+*
+* Purpose:
+*
+* Locate ZIP central directory through end of central directory record,
+* following ZIP64 locator when classic record fields are saturated.
+*
+*/
+NTSTATUS ArchivepZipFindDirectory(
+    _In_ HANDLE FileHandle,
+    _In_ ULONGLONG FileSize,
+    _Out_ PULONGLONG DirectoryOffset,
+    _Out_ PULONGLONG DirectorySize,
+    _Out_ PULONGLONG EntryCount
+)
+{
+    NTSTATUS ntStatus = STATUS_DATA_ERROR;
+    SIZE_T cbTail, pos;
+    ULONGLONG tailOffset, eocdOffset, eocd64Offset;
+    ULONG diskNumber, directoryDisk;
+    PUCHAR tail = NULL, record;
+    UCHAR locator[ARCHIVE_ZIP64_LOCATOR_SIZE];
+    UCHAR eocd64[ARCHIVE_ZIP64_EOCD_SIZE];
+
+    *DirectoryOffset = 0;
+    *DirectorySize = 0;
+    *EntryCount = 0;
+
+    do {
+
+        if (FileSize < ARCHIVE_ZIP_EOCD_SIZE)
+            break;
+
+        cbTail = (SIZE_T)min(FileSize, (ULONGLONG)(ARCHIVE_ZIP_EOCD_SIZE + ARCHIVE_ZIP_COMMENT_MAX));
+        tailOffset = FileSize - cbTail;
+
+        tail = (PUCHAR)supHeapAlloc(cbTail);
+        if (tail == NULL) {
+            ntStatus = STATUS_INSUFFICIENT_RESOURCES;
+            break;
+        }
+
+        if (!ArchivepReadAt(FileHandle, tailOffset, tail, cbTail)) {
+            ntStatus = STATUS_DATA_ERROR;
+            break;
+        }
+
+        //
+        // Record is followed by comment of its declared length, search backwards.
+        //
+        record = NULL;
+        pos = cbTail - ARCHIVE_ZIP_EOCD_SIZE + 1;
+        while (pos-- > 0) {
+            if (ArchivepGet32(&tail[pos]) == ARCHIVE_ZIP_EOCD_SIGNATURE &&
+                pos + ARCHIVE_ZIP_EOCD_SIZE + ArchivepGet16(&tail[pos + 20]) <= cbTail)
+            {
+                record = &tail[pos];
+                break;
+            }
+        }
+
+        if (record == NULL)
+            break;
+
+        eocdOffset = tailOffset + pos;
+        diskNumber = ArchivepGet16(&record[4]);
+        directoryDisk = ArchivepGet16(&record[6]);
+        *EntryCount = ArchivepGet16(&record[10]);
+        *DirectorySize = ArchivepGet32(&record[12]);
+        *DirectoryOffset = ArchivepGet32(&record[16]);
+
+        if (*EntryCount == 0xFFFF ||
+            *DirectorySize == 0xFFFFFFFF ||
+            *DirectoryOffset == 0xFFFFFFFF)
+        {
+            if (eocdOffset < ARCHIVE_ZIP64_LOCATOR_SIZE ||
+                !ArchivepReadAt(FileHandle, eocdOffset - ARCHIVE_ZIP64_LOCATOR_SIZE, locator, sizeof(locator)) ||
+                ArchivepGet32(locator) != ARCHIVE_ZIP64_LOCATOR_SIGNATURE)
+            {
+                break;
+            }
+
+            if (ArchivepGet32(&locator[16]) != 1) {
+                ntStatus = STATUS_NOT_SUPPORTED;
+                break;
+            }
+
+            eocd64Offset = ArchivepGet64(&locator[8]);
+            if (eocd64Offset > FileSize - sizeof(eocd64) ||
+                !ArchivepReadAt(FileHandle, eocd64Offset, eocd64, sizeof(eocd64)) ||
+                ArchivepGet32(eocd64) != ARCHIVE_ZIP64_EOCD_SIGNATURE)
+            {
+                break;
+            }
+
+            diskNumber = ArchivepGet32(&eocd64[16]);
+            directoryDisk = ArchivepGet32(&eocd64[20]);
+            *EntryCount = ArchivepGet64(&eocd64[32]);
+            *DirectorySize = ArchivepGet64(&eocd64[40]);
+            *DirectoryOffset = ArchivepGet64(&eocd64[48]);
+        }
+
+        //
+        // Spanned archives are not supported.
+        //
+        if (diskNumber != 0 || directoryDisk != 0) {
+            ntStatus = STATUS_NOT_SUPPORTED;
+            break;
+        }
+
+        if (*DirectoryOffset > FileSize || *DirectorySize > FileSize - *DirectoryOffset)
+            break;
+
+        ntStatus = STATUS_SUCCESS;
+
+    } while (FALSE);
+
+    if (tail)
+        supHeapFree(tail);
+
+    return ntStatus;
+}
+
+/*
+* ArchivepZipReadMember
+*
+* Purpose:
+*
+* Read member data into entry, decompress when deflated and check CRC.
+*
+*/
+NTSTATUS ArchivepZipReadMember(
+    _In_ HANDLE FileHandle,
+    _In_ ULONGLONG DataOffset,
+    _In_ ULONGLONG CompressedSize,
+    _In_ USHORT Method,
+    _In_ ULONG Crc32,
+    _In_ PARCHIVE_ENTRY Entry
+)
+{
+    NTSTATUS ntStatus;
+    SIZE_T cbWritten = 0, cbDone;
+    ULONG cbChunk, crc = 0;
+    PUCHAR compressed;
+
+    if (Method == ARCHIVE_ZIP_METHOD_STORED) {
+
+        if (CompressedSize != Entry->Size)
+            return STATUS_DATA_ERROR;
+
+        if (!ArchivepReadAt(FileHandle, DataOffset, Entry->Data, Entry->Size))
+            return STATUS_DATA_ERROR;
+
+    }
+    else {
+
+        if (CompressedSize > MAXSIZE_T)
+            return STATUS_NOT_SUPPORTED;
+
+        compressed = (PUCHAR)supHeapAlloc((CompressedSize) ? (SIZE_T)CompressedSize : 1);
+        if (compressed == NULL)
+            return STATUS_INSUFFICIENT_RESOURCES;
+
+        if (ArchivepReadAt(FileHandle, DataOffset, compressed, (SIZE_T)CompressedSize)) {
+            ntStatus = InflateBuffer(compressed,
+                (SIZE_T)CompressedSize,
+                Entry->Data,
+                Entry->Size,
+                &cbWritten);
+        }
+        else {
+            ntStatus = STATUS_DATA_ERROR;
+        }
+
+        supHeapFree(compressed);
+
+        if (!NT_SUCCESS(ntStatus))
+            return ntStatus;
+
+        if (cbWritten != Entry->Size)
+            return STATUS_DATA_ERROR;
+    }
+
+    for (cbDone = 0; cbDone < Entry->Size; cbDone += cbChunk) {
+        cbChunk = (ULONG)min(Entry->Size - cbDone, (SIZE_T)ARCHIVE_READ_CHUNK);
+        crc = RtlComputeCrc32(crc, &Entry->Data[cbDone], cbChunk);
+    }
+
+    if (crc != Crc32)
+        return STATUS_DATA_ERROR;
+
+    Entry->Written = Entry->Size;
+    return STATUS_SUCCESS;
+}
+
+/*
+* ArchivepExtractZip
+*
+* Purpose:
+*
+* Decompress all stored and deflated members of the ZIP archive into hash
+* queue. Encrypted members and other methods are skipped and archive is
+* reported as not supported, damaged members as data error.
+*
+*/
+NTSTATUS ArchivepExtractZip(
+    _In_ PARCHIVE_CONTEXT Context,
+    _In_ PARCHIVE_ITEM Item
+)
+{
+    NTSTATUS ntStatus, memberStatus;
+    HANDLE fileHandle;
+    LARGE_INTEGER fileSize;
+    ULONGLONG directoryOffset, directorySize, entryCount, index;
+    ULONGLONG compressedSize, size, localOffset, dataOffset;
+    SIZE_T pos, cbRecord, extraPos, extraEnd, fieldPos;
+    USHORT flags, method, cchName, cbExtra, cbComment, fieldId, cbField;
+    ULONG crc32;
+    PUCHAR directory = NULL, record;
+    LPSTR lpName = NULL;
+    PARCHIVE_ENTRY entry;
+    UCHAR localHeader[ARCHIVE_ZIP_LOCAL_SIZE];
+
+    fileHandle = CreateFile(Item->FileName,
+        GENERIC_READ,
+        FILE_SHARE_READ | FILE_SHARE_DELETE,
+        NULL,
+        OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL,
+        NULL);
+
+    if (fileHandle == INVALID_HANDLE_VALUE)
+        return STATUS_OBJECT_NAME_NOT_FOUND;
+
+    ntStatus = STATUS_SUCCESS;
+
+    do {
+
+        if (!GetFileSizeEx(fileHandle, &fileSize)) {
+            ntStatus = STATUS_UNSUCCESSFUL;
+            break;
+        }
+
+        ntStatus = ArchivepZipFindDirectory(fileHandle,
+            (ULONGLONG)fileSize.QuadPart,
+            &directoryOffset,
+            &directorySize,
+            &entryCount);
+
+        if (!NT_SUCCESS(ntStatus))
+            break;
+
+        if (directorySize > ARCHIVE_INFLIGHT_MAX) {
+            ntStatus = STATUS_NOT_SUPPORTED;
+            break;
+        }
+
+        directory = (PUCHAR)supHeapAlloc((directorySize) ? (SIZE_T)directorySize : 1);
+        lpName = (LPSTR)supHeapAlloc(MAXUSHORT + 1);
+        if (directory == NULL || lpName == NULL) {
+            ntStatus = STATUS_INSUFFICIENT_RESOURCES;
+            break;
+        }
+
+        if (!ArchivepReadAt(fileHandle, directoryOffset, directory, (SIZE_T)directorySize)) {
+            ntStatus = STATUS_DATA_ERROR;
+            break;
+        }
+
+        pos = 0;
+        for (index = 0; index < entryCount; index++, pos += cbRecord) {
+
+            if (directorySize - pos < ARCHIVE_ZIP_CENTRAL_SIZE) {
+                ntStatus = STATUS_DATA_ERROR;
+                break;
+            }
+
+            record = &directory[pos];
+            if (ArchivepGet32(record) != ARCHIVE_ZIP_CENTRAL_SIGNATURE) {
+                ntStatus = STATUS_DATA_ERROR;
+                break;
+            }
+
+            flags = ArchivepGet16(&record[8]);
+            method = ArchivepGet16(&record[10]);
+            crc32 = ArchivepGet32(&record[16]);
+            compressedSize = ArchivepGet32(&record[20]);
+            size = ArchivepGet32(&record[24]);
+            cchName = ArchivepGet16(&record[28]);
+            cbExtra = ArchivepGet16(&record[30]);
+            cbComment = ArchivepGet16(&record[32]);
+            localOffset = ArchivepGet32(&record[42]);
+
+            cbRecord = (SIZE_T)ARCHIVE_ZIP_CENTRAL_SIZE + cchName + cbExtra + cbComment;
+            if (directorySize - pos < cbRecord) {
+                ntStatus = STATUS_DATA_ERROR;
+                break;
+            }
+
+            //
+            // ZIP64 extended information holds only saturated fields, in fixed order.
+            //
+            extraPos = ARCHIVE_ZIP_CENTRAL_SIZE + (SIZE_T)cchName;
+            extraEnd = extraPos + cbExtra;
+            while (extraEnd - extraPos >= 4) {
+
+                fieldId = ArchivepGet16(&record[extraPos]);
+                cbField = ArchivepGet16(&record[extraPos + 2]);
+                extraPos += 4;
+                if (extraEnd - extraPos < cbField)
+                    break;
+
+                if (fieldId == ARCHIVE_ZIP_EXTRA_ZIP64) {
+                    fieldPos = extraPos;
+                    if (size == 0xFFFFFFFF && extraPos + cbField - fieldPos >= 8) {
+                        size = ArchivepGet64(&record[fieldPos]);
+                        fieldPos += 8;
+                    }
+                    if (compressedSize == 0xFFFFFFFF && extraPos + cbField - fieldPos >= 8) {
+                        compressedSize = ArchivepGet64(&record[fieldPos]);
+                        fieldPos += 8;
+                    }
+                    if (localOffset == 0xFFFFFFFF && extraPos + cbField - fieldPos >= 8) {
+                        localOffset = ArchivepGet64(&record[fieldPos]);
+                    }
+                    break;
+                }
+
+                extraPos += cbField;
+            }
+
+            RtlCopyMemory(lpName, &record[ARCHIVE_ZIP_CENTRAL_SIZE], cchName);
+            lpName[cchName] = 0;
+
+            //
+            // Directory entries carry no data.
+            //
+            if (cchName && (lpName[cchName - 1] == '/' || lpName[cchName - 1] == '\\'))
+                continue;
+
+            if ((flags & ARCHIVE_ZIP_FLAG_ENCRYPTED) ||
+                (method != ARCHIVE_ZIP_METHOD_STORED && method != ARCHIVE_ZIP_METHOD_DEFLATE) ||
+                size > MAXSIZE_T)
+            {
+                if (NT_SUCCESS(ntStatus))
+                    ntStatus = STATUS_NOT_SUPPORTED;
+                continue;
+            }
+
+            if (localOffset > (ULONGLONG)fileSize.QuadPart - sizeof(localHeader) ||
+                !ArchivepReadAt(fileHandle, localOffset, localHeader, sizeof(localHeader)) ||
+                ArchivepGet32(localHeader) != ARCHIVE_ZIP_LOCAL_SIGNATURE)
+            {
+                if (NT_SUCCESS(ntStatus))
+                    ntStatus = STATUS_DATA_ERROR;
+                continue;
+            }
+
+            dataOffset = localOffset + ARCHIVE_ZIP_LOCAL_SIZE +
+                ArchivepGet16(&localHeader[26]) + ArchivepGet16(&localHeader[28]);
+
+            if (dataOffset > (ULONGLONG)fileSize.QuadPart ||
+                compressedSize > (ULONGLONG)fileSize.QuadPart - dataOffset)
+            {
+                if (NT_SUCCESS(ntStatus))
+                    ntStatus = STATUS_DATA_ERROR;
+                continue;
+            }
+
+            entry = ArchivepAllocateEntry(Context,
+                Item,
+                lpName,
+                (flags & ARCHIVE_ZIP_FLAG_UTF8) ? CP_UTF8 : CP_OEMCP,
+                (SIZE_T)size);
+
+            if (entry == NULL) {
+                ntStatus = STATUS_INSUFFICIENT_RESOURCES;
+                break;
+            }
+
+            memberStatus = ArchivepZipReadMember(fileHandle,
+                dataOffset,
+                compressedSize,
+                method,
+                crc32,
+                entry);
+
+            if (!NT_SUCCESS(memberStatus)) {
+                ArchivepDiscardEntry(Context, entry);
+                if (NT_SUCCESS(ntStatus))
+                    ntStatus = memberStatus;
+                continue;
+            }
+
+            ArchivepQueueEntry(Context, Item, entry);
+        }
+
+    } while (FALSE);
+
+    if (lpName) supHeapFree(lpName);
+    if (directory) supHeapFree(directory);
+    CloseHandle(fileHandle);
+
+    return ntStatus;
+}
+
+/*
+* ArchivepExtractor
+*
+* Purpose:
+*
+* Thread pool callback, takes next archive of the list and decompresses it.
+*
+*/
+VOID CALLBACK ArchivepExtractor(
+    _Inout_ PTP_CALLBACK_INSTANCE Instance,
+    _Inout_opt_ PVOID Parameter,
+    _Inout_ PTP_WORK Work
+)
+{
+    PARCHIVE_CONTEXT context = (PARCHIVE_CONTEXT)Parameter;
+    PARCHIVE_ITEM item;
+    HFDI fdiHandle;
+    ERF fdiError;
+    ULONG index;
+
+    UNREFERENCED_PARAMETER(Instance);
+    UNREFERENCED_PARAMETER(Work);
+
+    if (context == NULL)
+        return;
+
+    RtlSecureZeroMemory(&fdiError, sizeof(fdiError));
+
+    fdiHandle = FDICreate(ArchivepFdiAlloc,
+        ArchivepFdiFree,
+        ArchivepFdiOpen,
+        ArchivepFdiRead,
+        ArchivepFdiWrite,
+        ArchivepFdiClose,
+        ArchivepFdiSeek,
+        cpuUNKNOWN,
+        &fdiError);
+
+    for (;;) {
+
+        index = (ULONG)InterlockedIncrement(&context->NextArchive) - 1;
+        if (index >= context->ArchiveList->Count)
+            break;
+
+        item = &context->Items[index];
+
+        switch (ArchiveQueryFormat(item->FileName)) {
+
+        case ARCHIVE_FORMAT_CAB:
+            item->Status = (fdiHandle) ?
+                ArchivepExtractCab(context, fdiHandle, &fdiError, item) :
+                STATUS_INSUFFICIENT_RESOURCES;
+            break;
+
+        case ARCHIVE_FORMAT_ZIP:
+            item->Status = ArchivepExtractZip(context, item);
+            break;
+
+        default:
+            item->Status = STATUS_NOT_SUPPORTED;
+            break;
+        }
+
+        AcquireSRWLockExclusive(&context->Lock);
+        item->Extracted = TRUE;
+        ReleaseSRWLockExclusive(&context->Lock);
+        WakeAllConditionVariable(&context->Progress);
+    }
+
+    if (fdiHandle)
+        FDIDestroy(fdiHandle);
+
+    AcquireSRWLockExclusive(&context->Lock);
+    context->ExtractorsRunning -= 1;
+    ReleaseSRWLockExclusive(&context->Lock);
+    WakeAllConditionVariable(&context->QueueReady);
+}
+
+/*
+* ArchivepWorker
+*
+* Purpose:
+*
+* Thread pool callback, hashes queued members until extractors are done.
+* Member data is freed right after hashing, entry stays for output.
+*
+*/
+VOID CALLBACK ArchivepWorker(
+    _Inout_ PTP_CALLBACK_INSTANCE Instance,
+    _Inout_opt_ PVOID Parameter,
+    _Inout_ PTP_WORK Work
+)
+{
+    PARCHIVE_CONTEXT context = (PARCHIVE_CONTEXT)Parameter;
+    PARCHIVE_CALLBACKS callbacks;
+    PARCHIVE_ENTRY entry;
+    PVOID workerData = NULL;
+
+    UNREFERENCED_PARAMETER(Instance);
+    UNREFERENCED_PARAMETER(Work);
+
+    if (context == NULL)
+        return;
+
+    callbacks = context->Callbacks;
+
+    if (callbacks->WorkerStartup) {
+        if (!callbacks->WorkerStartup(callbacks->Context, &workerData))
+            workerData = NULL;
+    }
+
+    for (;;) {
+
+        AcquireSRWLockExclusive(&context->Lock);
+
+        while (context->QueueHead == NULL && context->ExtractorsRunning)
+            SleepConditionVariableSRW(&context->QueueReady, &context->Lock, INFINITE, 0);
+
+        entry = context->QueueHead;
+        if (entry) {
+            context->QueueHead = entry->NextQueued;
+            if (context->QueueHead == NULL)
+                context->QueueTail = &context->QueueHead;
+        }
+
+        ReleaseSRWLockExclusive(&context->Lock);
+
+        if (entry == NULL)
+            break;
+
+        callbacks->ProcessEntry(callbacks->Context,
+            workerData,
+            entry->Name,
+            entry->Data,
+            entry->Size,
+            entry->Result);
+
+        supHeapFree(entry->Data);
+        entry->Data = NULL;
+
+        AcquireSRWLockExclusive(&context->Lock);
+        context->InFlight -= entry->Size;
+        entry->Completed = TRUE;
+        ReleaseSRWLockExclusive(&context->Lock);
+
+        WakeAllConditionVariable(&context->MemoryFree);
+        WakeAllConditionVariable(&context->Progress);
+    }
+
+    if (callbacks->WorkerShutdown)
+        callbacks->WorkerShutdown(callbacks->Context, workerData);
+}
+
+/*
+* ArchivepOutputArchive
+*
+* Purpose:
+*
+* Pass results of archive members to OutputResult in archive order as
+* they complete, followed by archive failure if extraction failed.
+*
+*/
+VOID ArchivepOutputArchive(
+    _In_ PARCHIVE_CONTEXT Context,
+    _In_ PARCHIVE_ITEM Item
+)
+{
+    PARCHIVE_CALLBACKS callbacks = Context->Callbacks;
+    PARCHIVE_ENTRY entry, previous = NULL;
+    PARCHIVE_ENTRY* link = &Item->First;
+
+    for (;;) {
+
+        AcquireSRWLockExclusive(&Context->Lock);
+
+        while (!((*link && (*link)->Completed) || (*link == NULL && Item->Extracted)))
+            SleepConditionVariableSRW(&Context->Progress, &Context->Lock, INFINITE, 0);
+
+        entry = *link;
+
+        ReleaseSRWLockExclusive(&Context->Lock);
+
+        //
+        // Previous entry is kept until its Next link is read.
+        //
+        if (previous)
+            supHeapFree(previous);
+
+        if (entry == NULL)
+            break;
+
+        callbacks->OutputResult(callbacks->Context, entry->Name, entry->Result);
+
+        previous = entry;
+        link = &entry->Next;
+    }
+
+    if (!NT_SUCCESS(Item->Status) && callbacks->OutputFailure)
+        callbacks->OutputFailure(callbacks->Context, Item->FileName, Item->Status);
+}
+
+/*
+* ArchiveRun
+*
+* Purpose:
+*
+* Hash members of every archive of the list. Archives are decompressed by
+* ExtractorCount threads while WorkerCount threads hash members.
+* Results are passed to OutputResult on the calling thread in list order,
+* members of each archive in archive order.
+*
+*/
+NTSTATUS ArchiveRun(
+    _In_ PBATCH_FILE_LIST ArchiveList,
+    _In_ ULONG ExtractorCount,
+    _In_ ULONG WorkerCount,
+    _In_ PARCHIVE_CALLBACKS Callbacks
+)
+{
+    NTSTATUS ntStatus = STATUS_INSUFFICIENT_RESOURCES;
+    ULONG i;
+    PTP_POOL pool = NULL;
+    PTP_WORK extractWork = NULL, hashWork = NULL;
+    TP_CALLBACK_ENVIRON callbackEnviron;
+    ARCHIVE_CONTEXT context;
+
+    if (ArchiveList->Count == 0)
+        return STATUS_NO_MORE_FILES;
+
+    if (ExtractorCount == 0)
+        ExtractorCount = 1;
+    if (ExtractorCount > ArchiveList->Count)
+        ExtractorCount = ArchiveList->Count;
+    if (WorkerCount == 0)
+        WorkerCount = 1;
+
+    RtlSecureZeroMemory(&context, sizeof(context));
+    context.ArchiveList = ArchiveList;
+    context.Callbacks = Callbacks;
+    context.QueueTail = &context.QueueHead;
+    context.ExtractorsRunning = ExtractorCount;
+    InitializeSRWLock(&context.Lock);
+    InitializeConditionVariable(&context.QueueReady);
+    InitializeConditionVariable(&context.MemoryFree);
+    InitializeConditionVariable(&context.Progress);
+
+    InitializeThreadpoolEnvironment(&callbackEnviron);
+
+    do {
+
+        context.Items = (PARCHIVE_ITEM)supHeapAlloc((SIZE_T)ArchiveList->Count * sizeof(ARCHIVE_ITEM));
+        if (context.Items == NULL)
+            break;
+
+        for (i = 0; i < ArchiveList->Count; i++) {
+            context.Items[i].FileName = ArchiveList->Items[i];
+            context.Items[i].Tail = &context.Items[i].First;
+        }
+
+        pool = CreateThreadpool(NULL);
+        if (pool == NULL)
+            break;
+
+        //
+        // Extractors block on memory limit until workers run, all must be started.
+        //
+        SetThreadpoolThreadMaximum(pool, ExtractorCount + WorkerCount);
+        if (!SetThreadpoolThreadMinimum(pool, ExtractorCount + WorkerCount))
+            break;
+
+        SetThreadpoolCallbackPool(&callbackEnviron, pool);
+
+        extractWork = CreateThreadpoolWork(ArchivepExtractor, &context, &callbackEnviron);
+        if (extractWork == NULL)
+            break;
+
+        hashWork = CreateThreadpoolWork(ArchivepWorker, &context, &callbackEnviron);
+        if (hashWork == NULL)
+            break;
+
+        for (i = 0; i < WorkerCount; i++)
+            SubmitThreadpoolWork(hashWork);
+
+        for (i = 0; i < ExtractorCount; i++)
+            SubmitThreadpoolWork(extractWork);
+
+        for (i = 0; i < ArchiveList->Count; i++)
+            ArchivepOutputArchive(&context, &context.Items[i]);
+
+        WaitForThreadpoolWorkCallbacks(extractWork, FALSE);
+        WaitForThreadpoolWorkCallbacks(hashWork, FALSE);
+        ntStatus = STATUS_SUCCESS;
+
+    } while (FALSE);
+
+    if (hashWork) CloseThreadpoolWork(hashWork);
+    if (extractWork) CloseThreadpoolWork(extractWork);
+    DestroyThreadpoolEnvironment(&callbackEnviron);
+    if (pool) CloseThreadpool(pool);
+    if (context.Items) supHeapFree(context.Items);
+
+    return ntStatus;
+}
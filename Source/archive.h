@@ -0,0 +1,61 @@
+/*******************************************************************************
+*
+*  (C) COPYRIGHT AUTHORS, 2026
+*
+*  TITLE:       ARCHIVE.H
+*
+*  VERSION:     1.05
+*
+*  DATE:        14 Oct 2026
+*
+*  Archive member hashing support header file.
+*
+* THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+* ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED
+* TO THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*******************************************************************************/
+#pragma once
+
+#define ARCHIVE_FORMAT_UNKNOWN  0
+#define ARCHIVE_FORMAT_CAB      1
+#define ARCHIVE_FORMAT_ZIP      2
+
+//
+// Member name is archive name, separator and path inside archive.
+// Character is not valid in file names, so the split is unambiguous.
+//
+#define ARCHIVE_NAME_SEPARATOR L'|'
+
+typedef VOID(CALLBACK* PARCHIVE_PROCESS_ENTRY)(
+    _In_opt_ PVOID Context,
+    _In_opt_ PVOID WorkerData,
+    _In_ LPCWSTR EntryName,
+    _In_reads_bytes_(Size) const VOID* Data,
+    _In_ SIZE_T Size,
+    _Out_ PVOID Result);
+
+typedef VOID(CALLBACK* PARCHIVE_OUTPUT_FAILURE)(
+    _In_opt_ PVOID Context,
+    _In_ LPCWSTR ArchiveName,
+    _In_ NTSTATUS Status);
+
+typedef struct _ARCHIVE_CALLBACKS {
+    PVOID Context;
+    ULONG ResultSize;
+    PBATCH_WORKER_STARTUP WorkerStartup;
+    PBATCH_WORKER_SHUTDOWN WorkerShutdown;
+    PARCHIVE_PROCESS_ENTRY ProcessEntry;
+    PBATCH_OUTPUT_RESULT OutputResult;
+    PARCHIVE_OUTPUT_FAILURE OutputFailure;
+} ARCHIVE_CALLBACKS, * PARCHIVE_CALLBACKS;
+
+ULONG ArchiveQueryFormat(
+    _In_ LPCWSTR FileName);
+
+NTSTATUS ArchiveRun(
+    _In_ PBATCH_FILE_LIST ArchiveList,
+    _In_ ULONG ExtractorCount,
+    _In_ ULONG WorkerCount,
+    _In_ PARCHIVE_CALLBACKS Callbacks);
@@ -0,0 +1,280 @@
+/*******************************************************************************
+*
+*  (C) COPYRIGHT AUTHORS, 2026
+*
+*  TITLE:       ARENA.CPP
+*
+*  VERSION:     1.05
+*
+*  DATE:        14 Oct 2026
+*
+*  Per-worker bump allocator.
+*
+*  Scratch memory of one file is taken from the worker arena and dropped at
+*  once by ArenaReset after the file result is out. Allocations are not
+*  freed individually; arena is not thread safe and belongs to one worker.
+*
+* THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+* ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED
+* TO THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*******************************************************************************/
+
+#include "global.h"
+
+/*
+* ArenaCreate
+*
+* Purpose:
+*
+* Reserve arena address space on preferred node, nothing is committed yet.
+* Arena left zeroed on failure is valid and fails every allocation.
+*
+*/
+BOOLEAN ArenaCreate(
+    _Out_ PARENA Arena,
+    _In_ SIZE_T ReserveSize,
+    _In_ ULONG Node,
+    _In_ BOOLEAN LargePages
+)
+{
+    RtlSecureZeroMemory(Arena, sizeof(ARENA));
+
+    ReserveSize = ALIGN_UP_BY(ReserveSize, ARENA_COMMIT_STEP);
+
+    Arena->Base = (PUCHAR)VirtualAllocExNuma(GetCurrentProcess(),
+        NULL,
+        ReserveSize,
+        MEM_RESERVE,
+        PAGE_READWRITE,
+        Node);
+
+    if (Arena->Base == NULL)
+        return FALSE;
+
+    Arena->ReserveSize = ReserveSize;
+    Arena->Node = Node;
+    Arena->LargePages = LargePages;
+    return TRUE;
+}
+
+/*
+* ArenaDestroy
+*
+* Purpose:
+*
+* Release arena address space and large page block.
+*
+*/
+VOID ArenaDestroy(
+    _In_ PARENA Arena
+)
+{
+    if (Arena->LargeBase)
+        VirtualFree(Arena->LargeBase, 0, MEM_RELEASE);
+
+    if (Arena->Base)
+        VirtualFree(Arena->Base, 0, MEM_RELEASE);
+
+    RtlSecureZeroMemory(Arena, sizeof(ARENA));
+}
+
+/*
+* ArenaReset
+*
+* Purpose:
+*
+* Drop all allocations. Pages above ARENA_RETAIN_SIZE are decommitted so
+* one oversized file does not pin its peak for the rest of the run.
+*
+*/
+VOID ArenaReset(
+    _In_ PARENA Arena
+)
+{
+    Arena->Offset = 0;
+
+    if (Arena->CommitSize > ARENA_RETAIN_SIZE) {
+        VirtualFree(Arena->Base + ARENA_RETAIN_SIZE,
+            Arena->CommitSize - ARENA_RETAIN_SIZE,
+            MEM_DECOMMIT);
+        Arena->CommitSize = ARENA_RETAIN_SIZE;
+    }
+}
+
+/*
+* ArenaAlloc
+*
+* Purpose:
+*
+* Take Size bytes aligned to Alignment (power of two) from the arena.
+* Memory is not zeroed. Returns NULL when arena is absent or exhausted.
+*
+*/
+PVOID ArenaAlloc(
+    _In_opt_ PARENA Arena,
+    _In_ SIZE_T Size,
+    _In_ SIZE_T Alignment
+)
+{
+    SIZE_T offset, end, commitEnd;
+
+    if (Arena == NULL || Arena->Base == NULL)
+        return NULL;
+
+    offset = ALIGN_UP_BY(Arena->Offset, Alignment);
+    if (offset > Arena->ReserveSize || Size > Arena->ReserveSize - offset)
+        return NULL;
+
+    end = offset + Size;
+
+    if (end > Arena->CommitSize) {
+
+        commitEnd = ALIGN_UP_BY(end, ARENA_COMMIT_STEP);
+        if (commitEnd > Arena->ReserveSize)
+            commitEnd = Arena->ReserveSize;
+
+        if (VirtualAlloc(Arena->Base + Arena->CommitSize,
+            commitEnd - Arena->CommitSize,
+            MEM_COMMIT,
+            PAGE_READWRITE) == NULL)
+        {
+            return NULL;
+        }
+
+        Arena->CommitSize = commitEnd;
+    }
+
+    Arena->Offset = end;
+    return Arena->Base + offset;
+}
+
+/*
+* ArenaContains
+*
+* Purpose:
+*
+* Return TRUE if memory belongs to arena address space.
+*
+*/
+BOOLEAN ArenaContains(
+    _In_opt_ PARENA Arena,
+    _In_opt_ const VOID* Memory
+)
+{
+    if (Arena == NULL || Arena->Base == NULL || Memory == NULL)
+        return FALSE;
+
+    return ((const UCHAR*)Memory >= Arena->Base &&
+        (const UCHAR*)Memory < Arena->Base + Arena->ReserveSize);
+}
+
+/*
+* ArenaAcquireLarge
+*
+* Purpose:
+*
+* Return large page block of at least Size bytes, allocating it on arena
+* node on first use. Returns NULL when large pages were not requested,
+* are unavailable or the block is in use. Release with ArenaReleaseLarge.
+*
+*/
+PVOID ArenaAcquireLarge(
+    _In_opt_ PARENA Arena,
+    _In_ SIZE_T Size
+)
+{
+    SIZE_T largeMinimum;
+
+    if (Arena == NULL || !Arena->LargePages || Arena->LargeInUse)
+        return NULL;
+
+    if (Arena->LargeBase == NULL) {
+
+        if (Arena->LargeFailed)
+            return NULL;
+
+        largeMinimum = GetLargePageMinimum();
+        if (largeMinimum) {
+            Arena->LargeSize = ALIGN_UP_BY(Size, largeMinimum);
+            Arena->LargeBase = (PUCHAR)VirtualAllocExNuma(GetCurrentProcess(),
+                NULL,
+                Arena->LargeSize,
+                MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES,
+                PAGE_READWRITE,
+                Arena->Node);
+        }
+
+        if (Arena->LargeBase == NULL) {
+            Arena->LargeSize = 0;
+            Arena->LargeFailed = TRUE;
+            return NULL;
+        }
+    }
+
+    if (Size > Arena->LargeSize)
+        return NULL;
+
+    Arena->LargeInUse = TRUE;
+    return Arena->LargeBase;
+}
+
+/*
+* ArenaReleaseLarge
+*
+* Purpose:
+*
+* Return large page block to the arena, block stays committed.
+*
+*/
+VOID ArenaReleaseLarge(
+    _In_opt_ PARENA Arena,
+    _In_opt_ const VOID* Memory
+)
+{
+    if (Arena && Memory && Memory == Arena->LargeBase)
+        Arena->LargeInUse = FALSE;
+}
+
+/*
+* ArenaHeapAlloc
+*
+* Purpose:
+*
+* Allocate zeroed memory from the arena, falling back to process heap when
+* there is no arena or it is exhausted. Release with ArenaHeapFree.
+*
+*/
+PVOID ArenaHeapAlloc(
+    _In_opt_ PARENA Arena,
+    _In_ SIZE_T Size
+)
+{
+    PVOID memory;
+
+    memory = ArenaAlloc(Arena, Size, ARENA_ALIGN);
+    if (memory) {
+        RtlZeroMemory(memory, Size);
+        return memory;
+    }
+
+    return supHeapAlloc(Size);
+}
+
+/*
+* ArenaHeapFree
+*
+* Purpose:
+*
+* Free ArenaHeapAlloc result, arena memory is left for ArenaReset.
+*
+*/
+VOID ArenaHeapFree(
+    _In_opt_ PARENA Arena,
+    _In_ PVOID Memory
+)
+{
+    if (!ArenaContains(Arena, Memory))
+        supHeapFree(Memory);
+}
@@ -0,0 +1,94 @@
+/*******************************************************************************
+*
+*  (C) COPYRIGHT AUTHORS, 2026
+*
+*  TITLE:       ARENA.H
+*
+*  VERSION:     1.05
+*
+*  DATE:        14 Oct 2026
+*
+*  Per-worker bump allocator header file.
+*
+* THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+* ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED
+* TO THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*******************************************************************************/
+#pragma once
+
+//
+// Address space is reserved once per worker, pages are committed in
+// ARENA_COMMIT_STEP steps and everything above ARENA_RETAIN_SIZE is
+// decommitted on reset. Retained size covers unbuffered reader buffers,
+// the largest scratch a worker touches for one file.
+//
+#ifdef _WIN64
+#define ARENA_RESERVE_SIZE  (64 * RTL_MEG)
+#else
+#define ARENA_RESERVE_SIZE  (16 * RTL_MEG)
+#endif
+#define ARENA_RETAIN_SIZE   (16 * RTL_MEG)
+#define ARENA_COMMIT_STEP   0x10000
+#define ARENA_ALIGN         MEMORY_ALLOCATION_ALIGNMENT
+
+typedef struct _ARENA {
+    PUCHAR Base;
+    SIZE_T ReserveSize;
+    SIZE_T CommitSize;
+    SIZE_T Offset;
+
+    //
+    // Preferred NUMA node of arena memory, NUMA_NO_PREFERRED_NODE if none.
+    //
+    ULONG Node;
+
+    //
+    // Large page block kept for the worker lifetime, it is allocated on
+    // first request and handed to one user at a time. Failure is sticky
+    // since large pages rarely become available later.
+    //
+    BOOLEAN LargePages;
+    BOOLEAN LargeInUse;
+    BOOLEAN LargeFailed;
+    PUCHAR LargeBase;
+    SIZE_T LargeSize;
+} ARENA, * PARENA;
+
+BOOLEAN ArenaCreate(
+    _Out_ PARENA Arena,
+    _In_ SIZE_T ReserveSize,
+    _In_ ULONG Node,
+    _In_ BOOLEAN LargePages);
+
+VOID ArenaDestroy(
+    _In_ PARENA Arena);
+
+VOID ArenaReset(
+    _In_ PARENA Arena);
+
+PVOID ArenaAlloc(
+    _In_opt_ PARENA Arena,
+    _In_ SIZE_T Size,
+    _In_ SIZE_T Alignment);
+
+BOOLEAN ArenaContains(
+    _In_opt_ PARENA Arena,
+    _In_opt_ const VOID* Memory);
+
+PVOID ArenaAcquireLarge(
+    _In_opt_ PARENA Arena,
+    _In_ SIZE_T Size);
+
+VOID ArenaReleaseLarge(
+    _In_opt_ PARENA Arena,
+    _In_opt_ const VOID* Memory);
+
+PVOID ArenaHeapAlloc(
+    _In_opt_ PARENA Arena,
+    _In_ SIZE_T Size);
+
+VOID ArenaHeapFree(
+    _In_opt_ PARENA Arena,
+    _In_ PVOID Memory);
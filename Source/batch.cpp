@@ -0,0 +1,797 @@
+/*******************************************************************************
+*
+*  (C) COPYRIGHT AUTHORS, 2026
+*
+*  TITLE:       BATCH.CPP
+*
+*  VERSION:     1.05
+*
+*  DATE:        14 Oct 2026
+*
+*  Batch processing: input enumeration and work-stealing file scheduler.
+*
+* THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+* ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED
+* TO THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*******************************************************************************/
+
+#include "global.h"
+
+#define BATCH_LIST_INITIAL_CAPACITY 256
+#define BATCH_LIST_FILE_PREFIX      L'@'
+#define BATCH_WILDCARD_CHARS        L"*?"
+
+typedef struct _BATCH_QUEUE {
+    SRWLOCK Lock;
+    ULONG Head;
+    ULONG Tail;
+} BATCH_QUEUE, * PBATCH_QUEUE;
+
+typedef struct _BATCH_CONTEXT {
+    PBATCH_FILE_LIST FileList;
+    PBATCH_CALLBACKS Callbacks;
+    PUCHAR Results;
+    volatile LONG* Completed;
+    HANDLE ProgressEvent;
+    ULONG WorkerCount;
+    volatile LONG NextWorkerId;
+    PBATCH_QUEUE Queues;
+} BATCH_CONTEXT, * PBATCH_CONTEXT;
+
+/*
+* BatchpAddFile
+*
+* Purpose:
+*
+* Append file name to the list, list takes ownership of FileName.
+*
+*/
+BOOLEAN BatchpAddFile(
+    _Inout_ PBATCH_FILE_LIST FileList,
+    _In_ LPWSTR FileName
+)
+{
+    ULONG newCapacity;
+    LPWSTR* newItems;
+
+    if (FileList->Count == FileList->Capacity) {
+
+        newCapacity = (FileList->Capacity) ?
+            FileList->Capacity * 2 : BATCH_LIST_INITIAL_CAPACITY;
+
+        newItems = (LPWSTR*)supHeapAlloc(newCapacity * sizeof(LPWSTR));
+        if (newItems == NULL)
+            return FALSE;
+
+        if (FileList->Items) {
+            RtlCopyMemory(newItems, FileList->Items, FileList->Count * sizeof(LPWSTR));
+            supHeapFree(FileList->Items);
+        }
+
+        FileList->Items = newItems;
+        FileList->Capacity = newCapacity;
+    }
+
+    FileList->Items[FileList->Count++] = FileName;
+    return TRUE;
+}
+
+/*
+* BatchpJoinPath
+*
+* Purpose:
+*
+* Allocate Directory\Name string.
+* Returned buffer must be freed with supHeapFree when no longer needed.
+*
+*/
+LPWSTR BatchpJoinPath(
+    _In_ LPCWSTR Directory,
+    _In_ LPCWSTR Name
+)
+{
+    SIZE_T cchDir, cch;
+    LPWSTR lpPath;
+
+    cchDir = wcslen(Directory);
+    cch = cchDir + wcslen(Name) + 2;
+
+    lpPath = (LPWSTR)supHeapAlloc(cch * sizeof(WCHAR));
+    if (lpPath) {
+        if (cchDir && Directory[cchDir - 1] == L'\\')
+            StringCchPrintf(lpPath, cch, TEXT("%ws%ws"), Directory, Name);
+        else
+            StringCchPrintf(lpPath, cch, TEXT("%ws\\%ws"), Directory, Name);
+    }
+
+    return lpPath;
+}
+
+/*
+* BatchpDuplicateString
+*
+* Purpose:
+*
+* Allocate copy of the given string.
+*
+*/
+LPWSTR BatchpDuplicateString(
+    _In_ LPCWSTR lpString
+)
+{
+    SIZE_T cch = wcslen(lpString) + 1;
+    LPWSTR lpCopy;
+
+    lpCopy = (LPWSTR)supHeapAlloc(cch * sizeof(WCHAR));
+    if (lpCopy)
+        StringCchCopy(lpCopy, cch, lpString);
+
+    return lpCopy;
+}
+
+/*
+* BatchpEnumerateDirectory
+*
+* Purpose:
+*
+* Add directory files matching Pattern to the list, walk subdirectories if requested.
+* Reparse point directories are skipped to avoid cycles.
+*
+*/
+BOOLEAN BatchpEnumerateDirectory(
+    _Inout_ PBATCH_FILE_LIST FileList,
+    _In_ LPCWSTR Directory,
+    _In_ LPCWSTR Pattern,
+    _In_ BOOLEAN Recursive
+)
+{
+    BOOLEAN bResult = TRUE;
+    HANDLE findHandle;
+    LPWSTR lpSearch, lpPath;
+    WIN32_FIND_DATA findData;
+
+    lpSearch = BatchpJoinPath(Directory, TEXT("*"));
+    if (lpSearch == NULL)
+        return FALSE;
+
+    findHandle = FindFirstFileEx(lpSearch,
+        FindExInfoBasic,
+        &findData,
+        FindExSearchNameMatch,
+        NULL,
+        FIND_FIRST_EX_LARGE_FETCH);
+
+    supHeapFree(lpSearch);
+
+    if (findHandle == INVALID_HANDLE_VALUE)
+        return TRUE;
+
+    do {
+
+        if (_wcsicmp(findData.cFileName, TEXT(".")) == 0 ||
+            _wcsicmp(findData.cFileName, TEXT("..")) == 0)
+        {
+            continue;
+        }
+
+        if (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+
+            if (!Recursive || (findData.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT))
+                continue;
+
+            lpPath = BatchpJoinPath(Directory, findData.cFileName);
+            if (lpPath == NULL) {
+                bResult = FALSE;
+                break;
+            }
+
+            bResult = BatchpEnumerateDirectory(FileList, lpPath, Pattern, Recursive);
+            supHeapFree(lpPath);
+
+            if (!bResult)
+                break;
+
+        }
+        else {
+
+            if (!PathMatchSpec(findData.cFileName, Pattern))
+                continue;
+
+            lpPath = BatchpJoinPath(Directory, findData.cFileName);
+            if (lpPath == NULL || !BatchpAddFile(FileList, lpPath)) {
+                if (lpPath) supHeapFree(lpPath);
+                bResult = FALSE;
+                break;
+            }
+
+        }
+
+    } while (FindNextFile(findHandle, &findData));
+
+    FindClose(findHandle);
+    return bResult;
+}
+
+/*
+* BatchpAddInput
+*
+* Purpose:
+*
+* Resolve single input entry: directory, wildcard mask or file.
+*
+*/
+BOOLEAN BatchpAddInput(
+    _Inout_ PBATCH_FILE_LIST FileList,
+    _In_ LPCWSTR lpInput,
+    _In_ BOOLEAN Recursive
+)
+{
+    BOOLEAN bResult;
+    DWORD dwAttributes;
+    LPWSTR lpDirectory, lpFileName, lpSeparator;
+
+    if (wcspbrk(lpInput, BATCH_WILDCARD_CHARS)) {
+
+        lpDirectory = BatchpDuplicateString(lpInput);
+        if (lpDirectory == NULL)
+            return FALSE;
+
+        lpSeparator = wcsrchr(lpDirectory, L'\\');
+        if (lpSeparator) {
+            *lpSeparator = 0;
+            bResult = BatchpEnumerateDirectory(FileList,
+                (*lpDirectory) ? lpDirectory : TEXT("\\"),
+                lpSeparator + 1,
+                Recursive);
+        }
+        else {
+            bResult = BatchpEnumerateDirectory(FileList,
+                TEXT("."),
+                lpDirectory,
+                Recursive);
+        }
+
+        supHeapFree(lpDirectory);
+        return bResult;
+    }
+
+    dwAttributes = GetFileAttributes(lpInput);
+    if (dwAttributes != INVALID_FILE_ATTRIBUTES &&
+        (dwAttributes & FILE_ATTRIBUTE_DIRECTORY))
+    {
+        return BatchpEnumerateDirectory(FileList, lpInput, TEXT("*"), TRUE);
+    }
+
+    lpFileName = BatchpDuplicateString(lpInput);
+    if (lpFileName == NULL)
+        return FALSE;
+
+    if (!BatchpAddFile(FileList, lpFileName)) {
+        supHeapFree(lpFileName);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/*
+* BatchpReadListFile
+*
+* Purpose:
+*
+* Read list file and convert it to zero terminated UTF-16 text.
+* UTF-16LE (with BOM) and UTF-8 files are supported.
+* Returned buffer must be freed with supHeapFree when no longer needed.
+*
+*/
+LPWSTR BatchpReadListFile(
+    _In_ LPCWSTR lpListFileName
+)
+{
+    HANDLE fileHandle;
+    LARGE_INTEGER fileSize;
+    PUCHAR pbData = NULL;
+    LPWSTR lpText = NULL;
+    DWORD cbRead = 0;
+    INT cchText, cbSkip;
+
+    fileHandle = CreateFile(lpListFileName,
+        GENERIC_READ,
+        FILE_SHARE_READ,
+        NULL,
+        OPEN_EXISTING,
+        FILE_FLAG_SEQUENTIAL_SCAN,
+        NULL);
+
+    if (fileHandle == INVALID_HANDLE_VALUE)
+        return NULL;
+
+    do {
+
+        if (!GetFileSizeEx(fileHandle, &fileSize) ||
+            fileSize.QuadPart == 0 ||
+            fileSize.QuadPart > MAXLONG / 2)
+        {
+            break;
+        }
+
+        pbData = (PUCHAR)supHeapAlloc((SIZE_T)fileSize.LowPart + sizeof(WCHAR));
+        if (pbData == NULL)
+            break;
+
+        if (!ReadFile(fileHandle, pbData, fileSize.LowPart, &cbRead, NULL))
+            break;
+
+        if (cbRead >= 2 && pbData[0] == 0xFF && pbData[1] == 0xFE) {
+
+            //
+            // UTF-16LE, buffer is zero terminated by allocation.
+            //
+            cchText = (INT)((cbRead - 2) / sizeof(WCHAR));
+            lpText = (LPWSTR)supHeapAlloc(((SIZE_T)cchText + 1) * sizeof(WCHAR));
+            if (lpText)
+                RtlCopyMemory(lpText, pbData + 2, (SIZE_T)cchText * sizeof(WCHAR));
+
+            break;
+        }
+
+        cbSkip = 0;
+        if (cbRead >= 3 && pbData[0] == 0xEF && pbData[1] == 0xBB && pbData[2] == 0xBF)
+            cbSkip = 3;
+
+        cchText = MultiByteToWideChar(CP_UTF8, 0,
+            (LPCCH)(pbData + cbSkip), (INT)cbRead - cbSkip, NULL, 0);
+
+        if (cchText <= 0)
+            break;
+
+        lpText = (LPWSTR)supHeapAlloc(((SIZE_T)cchText + 1) * sizeof(WCHAR));
+        if (lpText) {
+            MultiByteToWideChar(CP_UTF8, 0,
+                (LPCCH)(pbData + cbSkip), (INT)cbRead - cbSkip, lpText, cchText);
+        }
+
+    } while (FALSE);
+
+    if (pbData) supHeapFree(pbData);
+    CloseHandle(fileHandle);
+
+    return lpText;
+}
+
+/*
+* BatchpAddListFile
+*
+* Purpose:
+*
+* Add every non empty line of the list file as input entry.
+*
+*/
+BOOLEAN BatchpAddListFile(
+    _Inout_ PBATCH_FILE_LIST FileList,
+    _In_ LPCWSTR lpListFileName,
+    _In_ BOOLEAN Recursive
+)
+{
+    BOOLEAN bResult = TRUE;
+    LPWSTR lpText, lpLine, lpEnd, lpNext;
+
+    lpText = BatchpReadListFile(lpListFileName);
+    if (lpText == NULL)
+        return FALSE;
+
+    lpLine = lpText;
+
+    while (*lpLine) {
+
+        lpNext = wcspbrk(lpLine, TEXT("\r\n"));
+        if (lpNext) {
+            *lpNext++ = 0;
+        }
+        else {
+            lpNext = lpLine + wcslen(lpLine);
+        }
+
+        while (*lpLine == L' ' || *lpLine == L'\t')
+            lpLine++;
+
+        lpEnd = lpLine + wcslen(lpLine);
+        while (lpEnd > lpLine && (lpEnd[-1] == L' ' || lpEnd[-1] == L'\t'))
+            *--lpEnd = 0;
+
+        if (*lpLine) {
+            bResult = BatchpAddInput(FileList, lpLine, Recursive);
+            if (!bResult)
+                break;
+        }
+
+        lpLine = lpNext;
+    }
+
+    supHeapFree(lpText);
+    return bResult;
+}
+
+/*
+* BatchAddFile
+*
+* Purpose:
+*
+* Append copy of the file name to the list.
+*
+*/
+BOOLEAN BatchAddFile(
+    _Inout_ PBATCH_FILE_LIST FileList,
+    _In_ LPCWSTR FileName
+)
+{
+    LPWSTR lpCopy;
+
+    lpCopy = BatchpDuplicateString(FileName);
+    if (lpCopy == NULL)
+        return FALSE;
+
+    if (!BatchpAddFile(FileList, lpCopy)) {
+        supHeapFree(lpCopy);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/*
+* BatchIsBatchInput
+*
+* Purpose:
+*
+* Return TRUE if input names list file, wildcard mask or directory.
+*
+*/
+BOOLEAN BatchIsBatchInput(
+    _In_ LPCWSTR lpInput
+)
+{
+    DWORD dwAttributes;
+
+    if (*lpInput == BATCH_LIST_FILE_PREFIX)
+        return TRUE;
+
+    if (wcspbrk(lpInput, BATCH_WILDCARD_CHARS))
+        return TRUE;
+
+    dwAttributes = GetFileAttributes(lpInput);
+
+    return (dwAttributes != INVALID_FILE_ATTRIBUTES &&
+        (dwAttributes & FILE_ATTRIBUTE_DIRECTORY));
+}
+
+/*
+* BatchBuildFileList
+*
+* Purpose:
+*
+* Expand batch input to the list of files, in enumeration order.
+*
+*/
+BOOLEAN BatchBuildFileList(
+    _In_ LPCWSTR lpInput,
+    _In_ BOOLEAN Recursive,
+    _Inout_ PBATCH_FILE_LIST FileList
+)
+{
+    if (*lpInput == BATCH_LIST_FILE_PREFIX)
+        return BatchpAddListFile(FileList, lpInput + 1, Recursive);
+
+    return BatchpAddInput(FileList, lpInput, Recursive);
+}
+
+/*
+* BatchFreeFileList
+*
+* Purpose:
+*
+* Release file list memory.
+*
+*/
+VOID BatchFreeFileList(
+    _In_ PBATCH_FILE_LIST FileList
+)
+{
+    ULONG i;
+
+    if (FileList->Items) {
+        for (i = 0; i < FileList->Count; i++)
+            supHeapFree(FileList->Items[i]);
+        supHeapFree(FileList->Items);
+    }
+
+    FileList->Items = NULL;
+    FileList->Count = 0;
+    FileList->Capacity = 0;
+}
+
+/*
+* BatchpPopLocal
+*
+* Purpose:
+*
+* Take next file from the worker own queue.
+*
+*/
+ULONG BatchpPopLocal(
+    _In_ PBATCH_QUEUE Queue,
+    _In_ ULONG MaxCount,
+    _Out_ PULONG Index
+)
+{
+    ULONG cItems = 0;
+
+    AcquireSRWLockExclusive(&Queue->Lock);
+    if (Queue->Head < Queue->Tail) {
+        cItems = min(Queue->Tail - Queue->Head, MaxCount);
+        *Index = Queue->Head;
+        Queue->Head += cItems;
+    }
+    ReleaseSRWLockExclusive(&Queue->Lock);
+
+    return cItems;
+}
+
+/*
+* BatchpSteal
+*
+* Purpose:
+*
+* Move upper half of the most loaded queue to the worker own queue.
+*
+*/
+BOOLEAN BatchpSteal(
+    _In_ PBATCH_CONTEXT Context,
+    _In_ ULONG WorkerId
+)
+{
+    ULONG i, victimId, remaining, best, cSteal, head, tail = 0;
+    PBATCH_QUEUE victim, own = &Context->Queues[WorkerId];
+
+    for (;;) {
+
+        //
+        // Pick victim by unsynchronized view of queue sizes.
+        //
+        best = 0;
+        victimId = WorkerId;
+
+        for (i = 1; i < Context->WorkerCount; i++) {
+            ULONG id = (WorkerId + i) % Context->WorkerCount;
+            head = *(volatile ULONG*)&Context->Queues[id].Head;
+            tail = *(volatile ULONG*)&Context->Queues[id].Tail;
+            remaining = (tail > head) ? tail - head : 0;
+            if (remaining > best) {
+                best = remaining;
+                victimId = id;
+            }
+        }
+
+        if (victimId == WorkerId)
+            return FALSE;
+
+        victim = &Context->Queues[victimId];
+
+        AcquireSRWLockExclusive(&victim->Lock);
+
+        cSteal = 0;
+        if (victim->Tail > victim->Head) {
+            cSteal = (victim->Tail - victim->Head + 1) / 2;
+            tail = victim->Tail;
+            victim->Tail -= cSteal;
+        }
+
+        ReleaseSRWLockExclusive(&victim->Lock);
+
+        if (cSteal) {
+            AcquireSRWLockExclusive(&own->Lock);
+            own->Head = tail - cSteal;
+            own->Tail = tail;
+            ReleaseSRWLockExclusive(&own->Lock);
+            return TRUE;
+        }
+
+        //
+        // Victim drained meanwhile, rescan.
+        //
+    }
+}
+
+/*
+* BatchpWorker
+*
+* Purpose:
+*
+* Thread pool callback, processes files from own queue then steals from others.
+* With ProcessGroup callback up to GroupSize consecutive files are taken at once.
+*
+*/
+VOID CALLBACK BatchpWorker(
+    _Inout_ PTP_CALLBACK_INSTANCE Instance,
+    _Inout_opt_ PVOID Parameter,
+    _Inout_ PTP_WORK Work
+)
+{
+    PBATCH_CONTEXT context = (PBATCH_CONTEXT)Parameter;
+    PBATCH_CALLBACKS callbacks;
+    PVOID workerData = NULL;
+    ULONG workerId, index, i, cItems, groupSize;
+    LPCWSTR fileNames[BATCH_GROUP_MAX];
+    PVOID results[BATCH_GROUP_MAX];
+
+    UNREFERENCED_PARAMETER(Instance);
+    UNREFERENCED_PARAMETER(Work);
+
+    if (context == NULL)
+        return;
+
+    callbacks = context->Callbacks;
+    groupSize = (callbacks->ProcessGroup) ? min(max(callbacks->GroupSize, 1), BATCH_GROUP_MAX) : 1;
+    workerId = (ULONG)InterlockedIncrement(&context->NextWorkerId) - 1;
+
+    if (callbacks->WorkerStartup) {
+        if (!callbacks->WorkerStartup(callbacks->Context, &workerData))
+            workerData = NULL;
+    }
+
+    for (;;) {
+
+        cItems = BatchpPopLocal(&context->Queues[workerId], groupSize, &index);
+        if (cItems == 0) {
+            if (!BatchpSteal(context, workerId))
+                break;
+            continue;
+        }
+
+        if (groupSize > 1) {
+
+            for (i = 0; i < cItems; i++) {
+                fileNames[i] = context->FileList->Items[index + i];
+                results[i] = context->Results + ((SIZE_T)(index + i) * callbacks->ResultSize);
+            }
+
+            callbacks->ProcessGroup(callbacks->Context,
+                workerData,
+                fileNames,
+                results,
+                cItems);
+
+        }
+        else {
+
+            callbacks->ProcessFile(callbacks->Context,
+                workerData,
+                context->FileList->Items[index],
+                context->Results + ((SIZE_T)index * callbacks->ResultSize));
+
+        }
+
+        for (i = 0; i < cItems; i++)
+            InterlockedExchange(&context->Completed[index + i], TRUE);
+
+        SetEvent(context->ProgressEvent);
+    }
+
+    if (callbacks->WorkerShutdown)
+        callbacks->WorkerShutdown(callbacks->Context, workerData);
+}
+
+/*
+* BatchRun
+*
+* Purpose:
+*
+* Process every file of the list on a pool of work-stealing workers.
+* Results are passed to OutputResult on the calling thread in list order
+* as soon as all preceding files are done.
+*
+*/
+NTSTATUS BatchRun(
+    _In_ PBATCH_FILE_LIST FileList,
+    _In_ ULONG WorkerCount,
+    _In_ PBATCH_CALLBACKS Callbacks
+)
+{
+    NTSTATUS ntStatus = STATUS_INSUFFICIENT_RESOURCES;
+    ULONG i, nextOutput = 0;
+    PTP_POOL pool = NULL;
+    PTP_WORK work = NULL;
+    TP_CALLBACK_ENVIRON callbackEnviron;
+    BATCH_CONTEXT context;
+
+    if (FileList->Count == 0)
+        return STATUS_NO_MORE_FILES;
+
+    if (WorkerCount == 0)
+        WorkerCount = 1;
+    if (WorkerCount > FileList->Count)
+        WorkerCount = FileList->Count;
+
+    RtlSecureZeroMemory(&context, sizeof(context));
+    context.FileList = FileList;
+    context.Callbacks = Callbacks;
+    context.WorkerCount = WorkerCount;
+
+    InitializeThreadpoolEnvironment(&callbackEnviron);
+
+    do {
+
+        context.Results = (PUCHAR)supHeapAlloc((SIZE_T)FileList->Count * Callbacks->ResultSize);
+        if (context.Results == NULL)
+            break;
+
+        context.Completed = (volatile LONG*)supHeapAlloc((SIZE_T)FileList->Count * sizeof(LONG));
+        if (context.Completed == NULL)
+            break;
+
+        context.Queues = (PBATCH_QUEUE)supHeapAlloc((SIZE_T)WorkerCount * sizeof(BATCH_QUEUE));
+        if (context.Queues == NULL)
+            break;
+
+        context.ProgressEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+        if (context.ProgressEvent == NULL)
+            break;
+
+        //
+        // Initial distribution, contiguous block per worker.
+        //
+        for (i = 0; i < WorkerCount; i++) {
+            InitializeSRWLock(&context.Queues[i].Lock);
+            context.Queues[i].Head = (ULONG)(((ULONGLONG)FileList->Count * i) / WorkerCount);
+            context.Queues[i].Tail = (ULONG)(((ULONGLONG)FileList->Count * (i + 1)) / WorkerCount);
+        }
+
+        pool = CreateThreadpool(NULL);
+        if (pool == NULL)
+            break;
+
+        SetThreadpoolThreadMaximum(pool, WorkerCount);
+        SetThreadpoolCallbackPool(&callbackEnviron, pool);
+
+        work = CreateThreadpoolWork(BatchpWorker, &context, &callbackEnviron);
+        if (work == NULL)
+            break;
+
+        for (i = 0; i < WorkerCount; i++)
+            SubmitThreadpoolWork(work);
+
+        //
+        // Output results in stable order.
+        //
+        while (nextOutput < FileList->Count) {
+
+            if (context.Completed[nextOutput]) {
+
+                Callbacks->OutputResult(Callbacks->Context,
+                    FileList->Items[nextOutput],
+                    context.Results + ((SIZE_T)nextOutput * Callbacks->ResultSize));
+
+                nextOutput += 1;
+                continue;
+            }
+
+            WaitForSingleObject(context.ProgressEvent, INFINITE);
+        }
+
+        WaitForThreadpoolWorkCallbacks(work, FALSE);
+        ntStatus = STATUS_SUCCESS;
+
+    } while (FALSE);
+
+    if (work) CloseThreadpoolWork(work);
+    DestroyThreadpoolEnvironment(&callbackEnviron);
+    if (pool) CloseThreadpool(pool);
+    if (context.ProgressEvent) CloseHandle(context.ProgressEvent);
+    if (context.Queues) supHeapFree(context.Queues);
+    if (context.Completed) supHeapFree((PVOID)context.Completed);
+    if (context.Results) supHeapFree(context.Results);
+
+    return ntStatus;
+}
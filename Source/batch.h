@@ -0,0 +1,91 @@
+/*******************************************************************************
+*
+*  (C) COPYRIGHT AUTHORS, 2026
+*
+*  TITLE:       BATCH.H
+*
+*  VERSION:     1.05
+*
+*  DATE:        14 Oct 2026
+*
+*  Batch processing support header file.
+*
+* THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+* ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED
+* TO THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*******************************************************************************/
+#pragma once
+
+//
+// Maximum number of consecutive files passed to ProcessGroup at once.
+//
+#define BATCH_GROUP_MAX 16
+
+typedef struct _BATCH_FILE_LIST {
+    LPWSTR* Items;
+    ULONG Count;
+    ULONG Capacity;
+} BATCH_FILE_LIST, * PBATCH_FILE_LIST;
+
+typedef BOOLEAN(CALLBACK* PBATCH_WORKER_STARTUP)(
+    _In_opt_ PVOID Context,
+    _Out_ PVOID* WorkerData);
+
+typedef VOID(CALLBACK* PBATCH_WORKER_SHUTDOWN)(
+    _In_opt_ PVOID Context,
+    _In_opt_ PVOID WorkerData);
+
+typedef VOID(CALLBACK* PBATCH_PROCESS_FILE)(
+    _In_opt_ PVOID Context,
+    _In_opt_ PVOID WorkerData,
+    _In_ LPCWSTR FileName,
+    _Out_ PVOID Result);
+
+typedef VOID(CALLBACK* PBATCH_PROCESS_GROUP)(
+    _In_opt_ PVOID Context,
+    _In_opt_ PVOID WorkerData,
+    _In_reads_(Count) LPCWSTR* FileNames,
+    _Out_writes_(Count) PVOID* Results,
+    _In_ ULONG Count);
+
+typedef VOID(CALLBACK* PBATCH_OUTPUT_RESULT)(
+    _In_opt_ PVOID Context,
+    _In_ LPCWSTR FileName,
+    _In_ PVOID Result);
+
+typedef struct _BATCH_CALLBACKS {
+    PVOID Context;
+    ULONG ResultSize;
+    PBATCH_WORKER_STARTUP WorkerStartup;
+    PBATCH_WORKER_SHUTDOWN WorkerShutdown;
+    PBATCH_PROCESS_FILE ProcessFile;
+    PBATCH_OUTPUT_RESULT OutputResult;
+
+    //
+    // Optional, used instead of ProcessFile when GroupSize is above one.
+    //
+    ULONG GroupSize;
+    PBATCH_PROCESS_GROUP ProcessGroup;
+} BATCH_CALLBACKS, * PBATCH_CALLBACKS;
+
+BOOLEAN BatchIsBatchInput(
+    _In_ LPCWSTR lpInput);
+
+BOOLEAN BatchBuildFileList(
+    _In_ LPCWSTR lpInput,
+    _In_ BOOLEAN Recursive,
+    _Inout_ PBATCH_FILE_LIST FileList);
+
+BOOLEAN BatchAddFile(
+    _Inout_ PBATCH_FILE_LIST FileList,
+    _In_ LPCWSTR FileName);
+
+VOID BatchFreeFileList(
+    _In_ PBATCH_FILE_LIST FileList);
+
+NTSTATUS BatchRun(
+    _In_ PBATCH_FILE_LIST FileList,
+    _In_ ULONG WorkerCount,
+    _In_ PBATCH_CALLBACKS Callbacks);
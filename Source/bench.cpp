@@ -0,0 +1,411 @@
+/*******************************************************************************
+*
+*  (C) COPYRIGHT AUTHORS, 2026
+*
+*  TITLE:       BENCH.CPP
+*
+*  VERSION:     1.05
+*
+*  DATE:        14 Oct 2026
+*
+*  Hash pipeline benchmark.
+*
+*  Files are processed one after another so stage latencies are not skewed
+*  by other files in flight, worker count applies to digests of one file.
+*
+* THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+* ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED
+* TO THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*******************************************************************************/
+
+#include "global.h"
+
+#define BENCH_DIGEST_MAX 64
+
+typedef struct _BENCH_DIGEST {
+    ULONG Size;
+    UCHAR Data[BENCH_DIGEST_MAX];
+} BENCH_DIGEST, * PBENCH_DIGEST;
+
+static LPCSTR g_BenchStageNames[BENCH_STAGE_COUNT] = {
+    "open", "map", "validate", "hash", "format"
+};
+
+static const ULONG g_BenchPercentiles[] = { 50, 90, 99, 100 };
+
+/*
+* BenchpSaveDigest
+*
+* Purpose:
+*
+* Copy context digest, contexts are shared by authenticode and page hashes.
+*
+*/
+BOOLEAN BenchpSaveDigest(
+    _In_ PCNG_CTX HashContext,
+    _Out_ PBENCH_DIGEST Digest
+)
+{
+    if (HashContext->HashSize > BENCH_DIGEST_MAX)
+        return FALSE;
+
+    Digest->Size = HashContext->HashSize;
+    RtlCopyMemory(Digest->Data, HashContext->Hash, HashContext->HashSize);
+    return TRUE;
+}
+
+/*
+* BenchpElapsed
+*
+* Purpose:
+*
+* Store ticks elapsed since Start and restart it.
+*
+*/
+FORCEINLINE VOID BenchpElapsed(
+    _Inout_ PLARGE_INTEGER Start,
+    _Out_ PULONGLONG Ticks
+)
+{
+    LARGE_INTEGER now;
+
+    QueryPerformanceCounter(&now);
+    *Ticks = (ULONGLONG)(now.QuadPart - Start->QuadPart);
+    *Start = now;
+}
+
+/*
+* BenchpProcessFile
+*
+* Purpose:
+*
+* Run the pipeline once for the file, StageTicks receive QPC ticks per stage.
+*
+*/
+BOOLEAN BenchpProcessFile(
+    _In_ PHASH_CONTEXT_CACHE ContextCache,
+    _In_opt_ PHASH_THREAD_POOL ThreadPool,
+    _In_ LPCWSTR lpFileName,
+    _In_ PBENCH_PARAMS Params,
+    _Out_writes_(BENCH_STAGE_COUNT) PULONGLONG StageTicks,
+    _Out_ PULONGLONG FileSize
+)
+{
+    BOOLEAN bResult = FALSE, bComputed = TRUE;
+    ULONG i, cDigests = 0;
+    WCHAR szHash[BENCH_DIGEST_MAX * 2 + 1];
+    LARGE_INTEGER start;
+    FILE_VIEW_INFO fvi;
+    PCNG_CTX hashContexts[BENCH_MAX_ALGORITHMS];
+    BENCH_DIGEST digests[BENCH_MAX_ALGORITHMS * 2];
+
+    *FileSize = 0;
+    RtlSecureZeroMemory(StageTicks, BENCH_STAGE_COUNT * sizeof(ULONGLONG));
+    RtlSecureZeroMemory(&fvi, sizeof(fvi));
+
+    fvi.FileName = lpFileName;
+    fvi.IoBackend = Params->IoBackend;
+
+    QueryPerformanceCounter(&start);
+
+    do {
+
+        if (!NT_SUCCESS(supOpenInputFile(&fvi)))
+            break;
+
+        BenchpElapsed(&start, &StageTicks[BENCH_STAGE_OPEN]);
+
+        if (!NT_SUCCESS(supMapInputFileForRead(&fvi, Params->FirstPageOnly)))
+            break;
+
+        BenchpElapsed(&start, &StageTicks[BENCH_STAGE_MAP]);
+
+        if (!NT_SUCCESS(HashValidateFile(&fvi)))
+            break;
+
+        BenchpElapsed(&start, &StageTicks[BENCH_STAGE_VALIDATE]);
+
+        if (!Params->FirstPageOnly) {
+
+            for (i = 0; i < Params->AuthenticodeCount; i++) {
+                if (!NT_SUCCESS(HashAcquireContext(ContextCache,
+                    Params->AuthenticodeAlgorithms[i],
+                    &hashContexts[i])))
+                {
+                    bComputed = FALSE;
+                    break;
+                }
+            }
+
+            if (bComputed) {
+
+                if (Params->PerAlgorithm) {
+                    for (i = 0; i < Params->AuthenticodeCount && bComputed; i++)
+                        bComputed = CalculateAuthenticodeHash(&fvi, hashContexts[i]);
+                }
+                else if (ThreadPool) {
+                    bComputed = CalculateAuthenticodeHashParallel(&fvi,
+                        hashContexts,
+                        Params->AuthenticodeCount,
+                        ThreadPool);
+                }
+                else {
+                    bComputed = CalculateAuthenticodeHashMulti(&fvi,
+                        hashContexts,
+                        Params->AuthenticodeCount,
+                        NULL);
+                }
+            }
+
+            for (i = 0; i < Params->AuthenticodeCount && bComputed; i++)
+                bComputed = BenchpSaveDigest(hashContexts[i], &digests[cDigests++]);
+
+            if (!bComputed)
+                break;
+        }
+
+        for (i = 0; i < Params->PageHashCount && bComputed; i++) {
+            bComputed = NT_SUCCESS(HashAcquireContext(ContextCache,
+                Params->PageHashAlgorithms[i],
+                &hashContexts[0])) &&
+                CalculateFirstPageHash(Params->PageSize, &fvi, hashContexts[0]) &&
+                BenchpSaveDigest(hashContexts[0], &digests[cDigests++]);
+        }
+
+        if (!bComputed)
+            break;
+
+        BenchpElapsed(&start, &StageTicks[BENCH_STAGE_HASH]);
+
+        for (i = 0; i < cDigests && bComputed; i++) {
+            if (!supHexEncodeW(digests[i].Data, digests[i].Size, TRUE, szHash, RTL_NUMBER_OF(szHash)))
+                bComputed = FALSE;
+        }
+
+        if (!bComputed)
+            break;
+
+        BenchpElapsed(&start, &StageTicks[BENCH_STAGE_FORMAT]);
+
+        *FileSize = (ULONGLONG)fvi.FileSize.QuadPart;
+        bResult = TRUE;
+
+    } while (FALSE);
+
+    supDestroyFileViewInfo(&fvi);
+    return bResult;
+}
+
+/*
+* BenchpCompareTicks
+*
+* Purpose:
+*
+* qsort callback.
+*
+*/
+INT __cdecl BenchpCompareTicks(
+    _In_ const void* First,
+    _In_ const void* Second
+)
+{
+    ULONGLONG a = *(const ULONGLONG*)First;
+    ULONGLONG b = *(const ULONGLONG*)Second;
+
+    return (a < b) ? -1 : (a > b) ? 1 : 0;
+}
+
+/*
+* BenchpPrintReport
+*
+* Purpose:
+*
+* Output throughput and per stage latency percentiles.
+*
+*/
+VOID BenchpPrintReport(
+    _In_ FILE* lpOutStream,
+    _In_ PBENCH_PARAMS Params,
+    _In_ ULONG FileCount,
+    _In_ ULONG SamplesCount,
+    _In_ ULONG FailedCount,
+    _In_ ULONGLONG TotalBytes,
+    _In_ ULONGLONG TotalTicks,
+    _In_ ULONGLONG Frequency,
+    _In_reads_(BENCH_STAGE_COUNT) PULONGLONG* Samples
+)
+{
+    ULONG stage, i, index;
+    LPCSTR lpMode;
+    double seconds, elapsedUs;
+
+    if (Params->FirstPageOnly)
+        lpMode = "first page only";
+    else if (Params->PerAlgorithm)
+        lpMode = "pass per algorithm";
+    else if (Params->Parallel && Params->WorkerCount > 1)
+        lpMode = "parallel";
+    else
+        lpMode = "single pass";
+
+    seconds = (double)TotalTicks / (double)Frequency;
+
+    fprintf_s(lpOutStream, "Benchmark: %lu files, %lu iterations, io %s, %s, %lu workers\n",
+        FileCount,
+        Params->Iterations,
+        (Params->IoBackend == FILE_IO_BACKEND_UNBUFFERED) ? "unbuffered" : "mapped",
+        lpMode,
+        Params->WorkerCount);
+
+    fprintf_s(lpOutStream, "Hash backend: SHA1/SHA256 %s, other algorithms CNG\n",
+        (HashQueryNativeAlgorithm(BCRYPT_SHA256_ALGORITHM) != SHA_NATIVE_NONE) ?
+        "SHA extensions" : "CNG");
+
+    fprintf_s(lpOutStream, "Passes: %lu succeeded, %lu failed\n", SamplesCount, FailedCount);
+
+    if (SamplesCount == 0 || seconds <= 0.0)
+        return;
+
+    fprintf_s(lpOutStream, "Elapsed: %.3f s, %.2f MB/s, %.2f files/s\n",
+        seconds,
+        (double)TotalBytes / (double)RTL_MEG / seconds,
+        (double)SamplesCount / seconds);
+
+    fprintf_s(lpOutStream, "\nStage latency, us:\nstage\t\tp50\tp90\tp99\tmax\n");
+
+    for (stage = 0; stage < BENCH_STAGE_COUNT; stage++) {
+
+        qsort(Samples[stage], SamplesCount, sizeof(ULONGLONG), BenchpCompareTicks);
+
+        fprintf_s(lpOutStream, "%-8s", g_BenchStageNames[stage]);
+
+        for (i = 0; i < RTL_NUMBER_OF(g_BenchPercentiles); i++) {
+            index = (ULONG)(((ULONGLONG)(SamplesCount - 1) * g_BenchPercentiles[i]) / 100);
+            elapsedUs = (double)Samples[stage][index] * 1000000.0 / (double)Frequency;
+            fprintf_s(lpOutStream, "\t%.1f", elapsedUs);
+        }
+
+        fprintf_s(lpOutStream, "\n");
+    }
+}
+
+/*
+* BenchRun
+*
+* Purpose:
+*
+* Run hash pipeline over the file list for given number of iterations
+* and report throughput and stage latencies.
+*
+*/
+NTSTATUS BenchRun(
+    _In_ PBATCH_FILE_LIST FileList,
+    _In_ PBENCH_PARAMS Params,
+    _In_ FILE* lpOutStream
+)
+{
+    NTSTATUS ntStatus = STATUS_INSUFFICIENT_RESOURCES;
+    ULONG iteration, i, stage, cSamples = 0, cFailed = 0;
+    ULONGLONG cMaxSamples, fileSize, cbTotal = 0;
+    ULONGLONG stageTicks[BENCH_STAGE_COUNT];
+    PULONGLONG samples[BENCH_STAGE_COUNT];
+    LARGE_INTEGER frequency, start, stop;
+    PHASH_CONTEXT_CACHE contextCache = NULL;
+    PHASH_THREAD_POOL threadPool = NULL;
+
+    if (FileList->Count == 0)
+        return STATUS_NO_MORE_FILES;
+
+    cMaxSamples = (ULONGLONG)FileList->Count * Params->Iterations;
+
+    if (Params->Iterations == 0 ||
+        cMaxSamples > MAXULONG ||
+        Params->AuthenticodeCount > BENCH_MAX_ALGORITHMS ||
+        Params->PageHashCount > BENCH_MAX_ALGORITHMS)
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    RtlSecureZeroMemory(samples, sizeof(samples));
+
+    do {
+
+        for (stage = 0; stage < BENCH_STAGE_COUNT; stage++) {
+            samples[stage] = (PULONGLONG)supHeapAlloc((SIZE_T)cMaxSamples * sizeof(ULONGLONG));
+            if (samples[stage] == NULL)
+                break;
+        }
+
+        if (stage != BENCH_STAGE_COUNT)
+            break;
+
+        ntStatus = HashCreateContextCache(Params->HeapHandle, &contextCache);
+        if (!NT_SUCCESS(ntStatus))
+            break;
+
+        //
+        // Pool threads are started before timing, iterations only submit work.
+        //
+        if (Params->Parallel && !Params->PerAlgorithm && Params->WorkerCount > 1) {
+            ntStatus = HashCreateThreadPool(Params->HeapHandle, Params->WorkerCount, &threadPool);
+            if (!NT_SUCCESS(ntStatus))
+                break;
+        }
+
+        QueryPerformanceFrequency(&frequency);
+        QueryPerformanceCounter(&start);
+
+        for (iteration = 0; iteration < Params->Iterations; iteration++) {
+
+            for (i = 0; i < FileList->Count; i++) {
+
+                if (BenchpProcessFile(contextCache,
+                    threadPool,
+                    FileList->Items[i],
+                    Params,
+                    stageTicks,
+                    &fileSize))
+                {
+                    for (stage = 0; stage < BENCH_STAGE_COUNT; stage++)
+                        samples[stage][cSamples] = stageTicks[stage];
+
+                    cSamples += 1;
+                    cbTotal += fileSize;
+                }
+                else {
+                    cFailed += 1;
+                }
+            }
+        }
+
+        QueryPerformanceCounter(&stop);
+
+        BenchpPrintReport(lpOutStream,
+            Params,
+            FileList->Count,
+            cSamples,
+            cFailed,
+            cbTotal,
+            (ULONGLONG)(stop.QuadPart - start.QuadPart),
+            (ULONGLONG)frequency.QuadPart,
+            samples);
+
+        ntStatus = STATUS_SUCCESS;
+
+    } while (FALSE);
+
+    if (threadPool)
+        HashDestroyThreadPool(Params->HeapHandle, threadPool);
+
+    if (contextCache)
+        HashDestroyContextCache(contextCache);
+
+    for (stage = 0; stage < BENCH_STAGE_COUNT; stage++) {
+        if (samples[stage])
+            supHeapFree(samples[stage]);
+    }
+
+    return ntStatus;
+}
@@ -0,0 +1,48 @@
+/*******************************************************************************
+*
+*  (C) COPYRIGHT AUTHORS, 2026
+*
+*  TITLE:       BENCH.H
+*
+*  VERSION:     1.05
+*
+*  DATE:        14 Oct 2026
+*
+*  Hash pipeline benchmark header file.
+*
+* THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+* ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED
+* TO THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*******************************************************************************/
+#pragma once
+
+#define BENCH_STAGE_OPEN        0
+#define BENCH_STAGE_MAP         1
+#define BENCH_STAGE_VALIDATE    2
+#define BENCH_STAGE_HASH        3
+#define BENCH_STAGE_FORMAT      4
+#define BENCH_STAGE_COUNT       5
+
+#define BENCH_MAX_ALGORITHMS    8
+
+typedef struct _BENCH_PARAMS {
+    HANDLE HeapHandle;
+    ULONG PageSize;
+    ULONG Iterations;
+    ULONG IoBackend;
+    ULONG WorkerCount;
+    LPCWSTR* AuthenticodeAlgorithms;
+    ULONG AuthenticodeCount;
+    LPCWSTR* PageHashAlgorithms;
+    ULONG PageHashCount;
+    BOOLEAN Parallel;
+    BOOLEAN PerAlgorithm;
+    BOOLEAN FirstPageOnly;
+} BENCH_PARAMS, * PBENCH_PARAMS;
+
+NTSTATUS BenchRun(
+    _In_ PBATCH_FILE_LIST FileList,
+    _In_ PBENCH_PARAMS Params,
+    _In_ FILE* lpOutStream);
@@ -1,12 +1,12 @@
 /*******************************************************************************
 *
-*  (C) COPYRIGHT AUTHORS, 2021
+*  (C) COPYRIGHT AUTHORS, 2021 - 2026
 *
 *  TITLE:       GLOBAL.H
 *
-*  VERSION:     1.03
+*  VERSION:     1.05
 *
-*  DATE:        26 Oct 2021
+*  DATE:        14 Oct 2026
 *
 *  Common include header file.
 *
@@ -31,6 +31,7 @@
 #include <bcrypt.h>
 #include <commctrl.h>
 #include <shlobj.h>
+#include <Shlwapi.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <VersionHelpers.h>
@@ -40,7 +41,14 @@
 
 #pragma comment(lib, "Bcrypt.lib")
 #pragma comment(lib, "Comctl32.lib")
+#pragma comment(lib, "Shlwapi.lib")
 
+typedef struct _SHA_NATIVE_STATE SHA_NATIVE_STATE, * PSHA_NATIVE_STATE;
+
+//
+// Hash context, Native is set when the digest is computed in process
+// instead of a CNG hash object.
+//
 typedef struct _CNG_CTX {
     PVOID Hash;
     PVOID HashObject;
@@ -49,16 +57,83 @@ typedef struct _CNG_CTX {
     BCRYPT_ALG_HANDLE AlgHandle;
     BCRYPT_HASH_HANDLE HashHandle;
     HANDLE HeapHandle;
+    PVOID TemplateObject;
+    BCRYPT_HASH_HANDLE TemplateHandle;
+    PSHA_NATIVE_STATE Native;
+    BOOLEAN Reusable;
+    BOOLEAN Pristine;
 } CNG_CTX, * PCNG_CTX;
 
-typedef struct _FILE_EXCLUDE_DATA {
+//
+// MD5, SHA1, SHA256, SHA384, SHA512.
+//
+#define HASH_PROVIDERS_COUNT 5
+
+typedef struct _HASH_CONTEXT_CACHE {
+    HANDLE HeapHandle;
+    PCNG_CTX Contexts[HASH_PROVIDERS_COUNT];
+
+    //
+    // Flat file digest is computed next to authenticode digest of the
+    // same algorithm, it needs a context of its own.
+    //
+    PCNG_CTX FileContext;
+} HASH_CONTEXT_CACHE, * PHASH_CONTEXT_CACHE;
+
+typedef struct _PAGE_HASH_TABLE {
+    HANDLE HeapHandle;
+    ULONG HashSize;
+    ULONG EntrySize;
+    ULONG EntryCount;
+    UCHAR Entries[ANYSIZE_ARRAY];
+} PAGE_HASH_TABLE, * PPAGE_HASH_TABLE;
+
+#define PAGE_HASH_TABLE_ENTRY(Table, Index) \
+    ((PUCHAR)&(Table)->Entries[(SIZE_T)(Index) * (Table)->EntrySize])
+
+typedef struct _HASH_RANGE {
+    ULONGLONG Offset;
+    ULONGLONG Length;
+} HASH_RANGE, * PHASH_RANGE;
+
+//
+// Hash layout of validated image, built once by supIsValidImage.
+// Ranges are hashed in order and followed by PadSize zero bytes.
+//
+#define IMAGE_HASH_RANGES_MAX 3
+
+typedef struct _IMAGE_HASH_LAYOUT {
+    ULONG SizeOfHeaders;
     ULONG ChecksumOffset;
     ULONG SecurityOffset;
-    PIMAGE_DATA_DIRECTORY SecurityDirectory;
-} FILE_EXCLUDE_DATA, * PFILE_EXCLUDE_DATA;
+    ULONG PadSize;
+    ULONG RangeCount;
+    HASH_RANGE Ranges[IMAGE_HASH_RANGES_MAX];
+} IMAGE_HASH_LAYOUT, * PIMAGE_HASH_LAYOUT;
+
+//
+// File data access method for everything outside of headers view.
+// Buffer backend views caller memory, there is no file or section behind it.
+//
+#define FILE_IO_BACKEND_MAPPED      0
+#define FILE_IO_BACKEND_UNBUFFERED  1
+#define FILE_IO_BACKEND_BUFFER      2
+
+typedef struct _FILE_READER* PFILE_READER;
+typedef struct _ARENA* PARENA;
+
+//
+// Optional progress sink of the authenticode hash loop.
+// Loop adds consumed bytes and stops between chunks once Cancel is set.
+//
+typedef struct _HASH_PROGRESS {
+    volatile LONG64 BytesHashed;
+    volatile LONG Cancel;
+} HASH_PROGRESS, * PHASH_PROGRESS;
 
 typedef struct _FILE_VIEW_INFO {
     DWORD LastError;
+    ULONG IoBackend;
     LPCWSTR FileName;
     HANDLE FileHandle;
     HANDLE SectionHandle;
@@ -66,8 +141,40 @@ typedef struct _FILE_VIEW_INFO {
     SIZE_T ViewSize;
     LARGE_INTEGER FileSize;
     PIMAGE_NT_HEADERS NtHeaders;
-    FILE_EXCLUDE_DATA ExcludeData;
+    PFILE_READER Reader;
+    PHASH_PROGRESS Progress;
+    PARENA Arena;
+    IMAGE_HASH_LAYOUT Layout;
 } FILE_VIEW_INFO, * PFILE_VIEW_INFO;
 
+typedef struct _FILE_IDENTITY {
+    ULONGLONG VolumeSerialNumber;
+    FILE_ID_128 FileId;
+    ULONGLONG FileSize;
+    ULONGLONG LastWriteTime;
+} FILE_IDENTITY, * PFILE_IDENTITY;
+
+typedef struct _FILE_WINDOW {
+    PVOID Base;
+    ULONGLONG Offset;
+    SIZE_T Size;
+} FILE_WINDOW, * PFILE_WINDOW;
+
 #include "sup.h"
+#include "numa.h"
+#include "arena.h"
+#include "image.h"
+#include "stats.h"
+#include "sha.h"
+#include "reader.h"
+#include "store.h"
 #include "hash.h"
+#include "batch.h"
+#include "inflate.h"
+#include "archive.h"
+#include "usn.h"
+#include "bench.h"
+#include "output.h"
+#include "policy.h"
+#include "allow.h"
+#include "serve.h"
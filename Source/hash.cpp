@@ -1,12 +1,12 @@
 /*******************************************************************************
 *
-*  (C) COPYRIGHT AUTHORS, 2021 - 2024
+*  (C) COPYRIGHT AUTHORS, 2021 - 2026
 *
 *  TITLE:       HASH.CPP
 *
-*  VERSION:     1.04
+*  VERSION:     1.05
 *
-*  DATE:        22 Feb 2024
+*  DATE:        14 Oct 2026
 *
 *  Hash support routines.
 *
@@ -19,14 +19,231 @@
 
 #include "global.h"
 
-#define DEFAULT_ALIGN_BYTES 8
+//
+// Portion of data fed to all digests at once, must fit in L2.
+//
+#define HASH_CHUNK_SIZE (64 * 1024)
+
+//
+// Number of chunks producer may read ahead of the slowest worker.
+//
+#define HASH_RING_SLOTS 16
+#define HASH_READ_AHEAD_STRIDE 0x1000
+
+//
+// Sliding window size for page hash workers, each worker walks own windows.
+//
+#define HASH_PAGE_WINDOW_SIZE (4 * RTL_MEG)
+
+//
+// Largest pad fed with single hash call, covers 4K and 64K page hashing.
+//
+#define HASH_PAD_MAX_SIZE (64 * 1024)
+
+typedef struct _HASH_RING_SLOT {
+    PUCHAR Data;
+    ULONG Size;
+    ULONG Pending;
+} HASH_RING_SLOT, * PHASH_RING_SLOT;
+
+typedef struct _HASH_RING {
+    SRWLOCK Lock;
+    CONDITION_VARIABLE DataReady;
+    CONDITION_VARIABLE SlotFree;
+    ULONG Produced;
+    BOOLEAN Finished;
+    BOOLEAN Aborted;
+    volatile BOOLEAN ExceptionCaught;
+    NTSTATUS Status;
+    ULONG PadSize;
+    ULONG WorkerCount;
+    volatile LONG NextWorkerId;
+    ULONG ContextCount;
+    PCNG_CTX* HashContexts;
+    HASH_RING_SLOT Slots[HASH_RING_SLOTS];
+} HASH_RING, * PHASH_RING;
+
+typedef struct _HASH_STREAM {
+    PFILE_VIEW_INFO ViewInformation;
+    PFILE_READER Reader;
+    PHASH_RING Ring;
+    SIZE_T WindowSize;
+    ULONG WindowChunks;
+    FILE_WINDOW Previous;
+    FILE_WINDOW Current;
+    FILE_WINDOW Next;
+} HASH_STREAM, * PHASH_STREAM;
+
+//
+// Incremental authenticode hash state, file data is pushed in file order.
+// First bytes up to headers view size are collected to validate image and
+// build hash layout, everything after is hashed straight from input.
+// Headers view grows like partial file view when headers extend past it.
+//
+struct _HASH_PUSH {
+    HANDLE HeapHandle;
+    PUCHAR Headers;
+    ULONGLONG Offset;
+    NTSTATUS Status;
+    BOOLEAN Finished;
+    ULONG ContextCount;
+    PCNG_CTX HashContexts[HASH_PROVIDERS_COUNT];
+    FILE_VIEW_INFO ViewInformation;
+};
+
+//
+// Threads shared by parallel hashing calls of one run. Ring workers block
+// on each other, so all threads are created upfront and kept.
+//
+struct _HASH_THREAD_POOL {
+    PTP_POOL Pool;
+    ULONG ThreadCount;
+    TP_CALLBACK_ENVIRON CallbackEnviron;
+};
+
+typedef struct _PAGE_HASH_JOB {
+    ULONG Offset;
+    ULONG Length;
+} PAGE_HASH_JOB, * PPAGE_HASH_JOB;
+
+typedef struct _PAGE_HASH_WORK {
+    PFILE_VIEW_INFO ViewInformation;
+    PPAGE_HASH_TABLE Table;
+    PPAGE_HASH_JOB Jobs;
+    ULONG JobCount;
+    ULONG PageSize;
+    PCWSTR AlgId;
+    volatile LONG NextJob;
+    volatile LONG Failed;
+    volatile LONG ExceptionCaught;
+} PAGE_HASH_WORK, * PPAGE_HASH_WORK;
+
+#ifndef BCRYPT_HASH_REUSABLE_FLAG
+#define BCRYPT_HASH_REUSABLE_FLAG 0x00000020
+#endif
+
+typedef struct _HASH_PROVIDER {
+    PCWSTR AlgId;
+    INIT_ONCE InitOnce;
+    BCRYPT_ALG_HANDLE AlgHandle;
+    ULONG HashObjectSize;
+    ULONG HashSize;
+    BOOLEAN Reusable;
+} HASH_PROVIDER, * PHASH_PROVIDER;
+
+//
+// Process wide algorithm providers, opened once on first use.
+//
+static HASH_PROVIDER g_HashProviders[HASH_PROVIDERS_COUNT] = {
+    { BCRYPT_MD5_ALGORITHM, INIT_ONCE_STATIC_INIT },
+    { BCRYPT_SHA1_ALGORITHM, INIT_ONCE_STATIC_INIT },
+    { BCRYPT_SHA256_ALGORITHM, INIT_ONCE_STATIC_INIT },
+    { BCRYPT_SHA384_ALGORITHM, INIT_ONCE_STATIC_INIT },
+    { BCRYPT_SHA512_ALGORITHM, INIT_ONCE_STATIC_INIT }
+};
+
+//
+// Native SHA-1/SHA-256 contexts are created when CPU supports them, unless disabled.
+//
+static BOOLEAN g_HashNativeDisabled = FALSE;
+
+//
+// Source of pad bytes, never written. Not const to keep it out of the image.
+//
+static UCHAR g_HashZeroPage[HASH_PAD_MAX_SIZE];
+
+/*
+* HashpMarkFinished
+*
+* Purpose:
+*
+* Remember context state after successful BCryptFinishHash.
+* Only reusable objects are ready for next input, others need reset.
+*
+*/
+FORCEINLINE VOID HashpMarkFinished(
+    _In_ PCNG_CTX HashContext
+)
+{
+    HashContext->Pristine = HashContext->Reusable;
+}
+
+/*
+* HashpHashData
+*
+* Purpose:
+*
+* Feed data to native or CNG hash object.
+*
+*/
+FORCEINLINE NTSTATUS HashpHashData(
+    _In_ PCNG_CTX HashContext,
+    _In_reads_bytes_(Length) PUCHAR Data,
+    _In_ ULONG Length
+)
+{
+    if (HashContext->Native) {
+        ShaNativeUpdate(HashContext->Native, Data, Length);
+        return STATUS_SUCCESS;
+    }
+
+    return BCryptHashData(HashContext->HashHandle, Data, Length, 0);
+}
+
+/*
+* HashpFinishHash
+*
+* Purpose:
+*
+* Store digest of native or CNG hash object to context Hash buffer.
+*
+*/
+FORCEINLINE NTSTATUS HashpFinishHash(
+    _In_ PCNG_CTX HashContext
+)
+{
+    if (HashContext->Native) {
+        ShaNativeFinish(HashContext->Native, (PUCHAR)HashContext->Hash);
+        return STATUS_SUCCESS;
+    }
+
+    return BCryptFinishHash(HashContext->HashHandle,
+        (PUCHAR)HashContext->Hash,
+        HashContext->HashSize,
+        0);
+}
+
+/*
+* HashpUpdateProgress
+*
+* Purpose:
+*
+* Account chunk in progress sink of the view, fails if cancellation was requested.
+*
+*/
+FORCEINLINE NTSTATUS HashpUpdateProgress(
+    _In_ PFILE_VIEW_INFO ViewInformation,
+    _In_ ULONG Length
+)
+{
+    PHASH_PROGRESS progress = ViewInformation->Progress;
+
+    if (progress) {
+        if (progress->Cancel)
+            return STATUS_CANCELLED;
+        InterlockedExchangeAdd64(&progress->BytesHashed, Length);
+    }
+
+    return STATUS_SUCCESS;
+}
 
 /*
 * HashpAddPad
 *
 * Purpose:
 *
-* Calculate hash for pad bytes
+* Calculate hash for pad bytes.
+* Pads up to HASH_PAD_MAX_SIZE take a single hash call.
 *
 */
 NTSTATUS HashpAddPad(
@@ -34,146 +251,258 @@ NTSTATUS HashpAddPad(
     _In_ PCNG_CTX HashContext)
 {
     NTSTATUS ntStatus = STATUS_SUCCESS;
-    ULONG cbPad = PaddingSize, i;
-    UCHAR pbInput[DEFAULT_ALIGN_BYTES] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+    ULONG cbPad = PaddingSize, cbChunk;
 
-    if (cbPad >= DEFAULT_ALIGN_BYTES) {
+    while (cbPad) {
 
-        i = (cbPad >> 3);
-        do {
+        cbChunk = (cbPad > HASH_PAD_MAX_SIZE) ? HASH_PAD_MAX_SIZE : cbPad;
 
-            ntStatus = BCryptHashData(HashContext->HashHandle,
-                (PUCHAR)pbInput, DEFAULT_ALIGN_BYTES, 0);
+        ntStatus = HashpHashData(HashContext, g_HashZeroPage, cbChunk);
+        if (!NT_SUCCESS(ntStatus))
+            break;
 
-            cbPad -= DEFAULT_ALIGN_BYTES;
-            --i;
+        cbPad -= cbChunk;
+    }
 
-        } while (i);
+    return ntStatus;
+}
 
-    }
+/*
+* HashpRingDrain
+*
+* Purpose:
+*
+* Wait until every published ring chunk is consumed by all workers.
+*
+*/
+VOID HashpRingDrain(
+    _In_ PHASH_RING Ring
+)
+{
+    ULONG i = 0;
 
-    if (cbPad) {
-        ntStatus = BCryptHashData(HashContext->HashHandle,
-            (PUCHAR)pbInput, cbPad, 0);
+    AcquireSRWLockExclusive(&Ring->Lock);
+
+    while (i < HASH_RING_SLOTS && !Ring->Aborted) {
+        if (Ring->Slots[i].Pending)
+            SleepConditionVariableSRW(&Ring->SlotFree, &Ring->Lock, INFINITE, 0);
+        else
+            i++;
     }
 
-    return ntStatus;
+    ReleaseSRWLockExclusive(&Ring->Lock);
 }
 
 /*
-* HashpGetSizeOfHeaders
+* HashpStreamInit
 *
 * Purpose:
 *
-* Return PE OptionalHeader size of headers
+* Prepare sliding window walker for the file.
+* If Ring is given, windows are not released while ring workers may still use them.
+* File reader is sequential, only single walker per file may use it.
 *
 */
-DWORD HashpGetSizeOfHeaders(
-    _In_ PIMAGE_NT_HEADERS NtHeaders
+VOID HashpStreamInit(
+    _Out_ PHASH_STREAM Stream,
+    _In_ PFILE_VIEW_INFO ViewInformation,
+    _In_ SIZE_T WindowSize,
+    _In_opt_ PHASH_RING Ring,
+    _In_ BOOLEAN UseReader
 )
 {
-    PIMAGE_OPTIONAL_HEADER64 opt64;
-    PIMAGE_OPTIONAL_HEADER32 opt32;
+    RtlSecureZeroMemory(Stream, sizeof(HASH_STREAM));
+    Stream->ViewInformation = ViewInformation;
+    Stream->WindowSize = WindowSize;
+    Stream->Ring = Ring;
+    if (UseReader)
+        Stream->Reader = ViewInformation->Reader;
+}
 
-    switch (NtHeaders->OptionalHeader.Magic) {
-    case IMAGE_NT_OPTIONAL_HDR64_MAGIC:
-        opt64 = (PIMAGE_OPTIONAL_HEADER64)&NtHeaders->OptionalHeader;
-        return opt64->SizeOfHeaders;
-    case IMAGE_NT_OPTIONAL_HDR32_MAGIC:
-        opt32 = (PIMAGE_OPTIONAL_HEADER32)&NtHeaders->OptionalHeader;
-        return opt32->SizeOfHeaders;
+/*
+* HashpStreamClose
+*
+* Purpose:
+*
+* Release all windows of the walker.
+*
+*/
+VOID HashpStreamClose(
+    _In_ PHASH_STREAM Stream
+)
+{
+    //
+    // Next window is never handed out, only the other two can be in use.
+    //
+    if (Stream->Ring && (Stream->Previous.Base || Stream->Current.Base))
+        HashpRingDrain(Stream->Ring);
+
+    //
+    // Reader blocks are owned by the reader.
+    //
+    if (Stream->Reader) {
+        RtlSecureZeroMemory(&Stream->Current, sizeof(FILE_WINDOW));
+        return;
     }
 
-    return 0;
+    supUnmapFileWindow(&Stream->Previous);
+    supUnmapFileWindow(&Stream->Current);
+    supUnmapFileWindow(&Stream->Next);
 }
 
 /*
-* HashpGetExcludeRange
+* HashpStreamWindowContains
 *
 * Purpose:
 *
-* Retrieve data and offsets to be skipped during hash calculation
+* Return TRUE if file offset is inside of the given window.
 *
 */
-BOOLEAN HashpGetExcludeRange(
-    _In_ PFILE_VIEW_INFO ViewInformation
+FORCEINLINE BOOLEAN HashpStreamWindowContains(
+    _In_ PFILE_WINDOW Window,
+    _In_ ULONGLONG Offset
 )
 {
-    ULONG securityOffset = 0, checksumOffset = 0, c, numberOfSections;
-    PIMAGE_DATA_DIRECTORY dataDirectory = NULL;
-
-    PIMAGE_SECTION_HEADER sectionTableEntry;
-    PIMAGE_OPTIONAL_HEADER64 opt64 = NULL;
-    PIMAGE_OPTIONAL_HEADER32 opt32 = NULL;
-    PIMAGE_DOS_HEADER dosHeader = (PIMAGE_DOS_HEADER)ViewInformation->ViewBase;
+    return (Window->Base != NULL &&
+        Offset >= Window->Offset &&
+        Offset < Window->Offset + Window->Size);
+}
 
-    switch (ViewInformation->NtHeaders->OptionalHeader.Magic) {
+/*
+* HashpStreamAcquire
+*
+* Purpose:
+*
+* Return pointer to file data at given offset.
+*
+* Data inside headers view is used in place, otherwise it comes from the
+* current window, Length is clipped by the window end. Moving into the
+* next window releases the previous one and maps plus prefetches the
+* following, so at most three windows are mapped at once.
+* With file reader the current window is reader block, reader keeps the
+* previous block valid the same way.
+*
+*/
+NTSTATUS HashpStreamAcquire(
+    _In_ PHASH_STREAM Stream,
+    _In_ ULONGLONG Offset,
+    _Inout_ PULONG Length,
+    _Out_ PUCHAR* Data
+)
+{
+    NTSTATUS ntStatus;
+    PFILE_VIEW_INFO viewInfo = Stream->ViewInformation;
+    ULONGLONG windowEnd;
 
-    case IMAGE_NT_OPTIONAL_HDR64_MAGIC:
+    *Data = NULL;
 
-        checksumOffset = dosHeader->e_lfanew +
-            UFIELD_OFFSET(IMAGE_NT_HEADERS64, OptionalHeader.CheckSum);
-        securityOffset = dosHeader->e_lfanew +
-            UFIELD_OFFSET(IMAGE_NT_HEADERS64, OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_SECURITY]);
+    if (Offset + *Length <= viewInfo->ViewSize) {
+        *Data = (PUCHAR)RtlOffsetToPointer(viewInfo->ViewBase, (ULONG_PTR)Offset);
+        return STATUS_SUCCESS;
+    }
 
-        opt64 = (PIMAGE_OPTIONAL_HEADER64)&ViewInformation->NtHeaders->OptionalHeader;
-        dataDirectory = &opt64->DataDirectory[IMAGE_DIRECTORY_ENTRY_SECURITY];
+    if (!HashpStreamWindowContains(&Stream->Current, Offset)) {
 
-        break;
+        if (Stream->Ring && Stream->Ring->Aborted)
+            return STATUS_CANCELLED;
 
-    case IMAGE_NT_OPTIONAL_HDR32_MAGIC:
+        if (Stream->Reader) {
 
-        checksumOffset = dosHeader->e_lfanew +
-            UFIELD_OFFSET(IMAGE_NT_HEADERS32, OptionalHeader.CheckSum);
-        securityOffset = dosHeader->e_lfanew +
-            UFIELD_OFFSET(IMAGE_NT_HEADERS32, OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_SECURITY]);
+            //
+            // Non sequential move restarts reader and drops all its blocks.
+            //
+            if (Stream->Ring && Stream->Current.Base &&
+                (Stream->WindowChunks < HASH_RING_SLOTS ||
+                    Offset != Stream->Current.Offset + Stream->Current.Size))
+            {
+                HashpRingDrain(Stream->Ring);
+            }
 
-        opt32 = (PIMAGE_OPTIONAL_HEADER32)&ViewInformation->NtHeaders->OptionalHeader;
-        dataDirectory = &opt32->DataDirectory[IMAGE_DIRECTORY_ENTRY_SECURITY];
+            ntStatus = ReaderAcquire(Stream->Reader, Offset, &Stream->Current);
+            if (!NT_SUCCESS(ntStatus))
+                return ntStatus;
 
-        break;
+        }
+        else if (HashpStreamWindowContains(&Stream->Next, Offset)) {
 
-    default:
-        ViewInformation->LastError = IMAGE_VERIFY_BAD_OPTIONAL_HEADER_MAGIC;
-        return FALSE;
-    }
+            //
+            // Ring holds HASH_RING_SLOTS chunks at most, once that many were
+            // taken from current window, previous one is no longer referenced.
+            //
+            if (Stream->Ring && Stream->WindowChunks < HASH_RING_SLOTS)
+                HashpRingDrain(Stream->Ring);
 
-    if (dataDirectory->VirtualAddress) {
+            supUnmapFileWindow(&Stream->Previous);
+            Stream->Previous = Stream->Current;
+            Stream->Current = Stream->Next;
+            RtlSecureZeroMemory(&Stream->Next, sizeof(FILE_WINDOW));
 
-        numberOfSections = ViewInformation->NtHeaders->FileHeader.NumberOfSections;
-        if (numberOfSections == 0) {
-            ViewInformation->LastError = IMAGE_VERIFY_BAD_SECTION_COUNT;
-            return FALSE;
         }
+        else {
 
-        sectionTableEntry = IMAGE_FIRST_SECTION(ViewInformation->NtHeaders);
+            HashpStreamClose(Stream);
 
-        c = sectionTableEntry[numberOfSections - 1].PointerToRawData +
-            sectionTableEntry[numberOfSections - 1].SizeOfRawData;
+            ntStatus = supMapFileWindow(viewInfo, Offset, Stream->WindowSize, &Stream->Current);
+            if (!NT_SUCCESS(ntStatus))
+                return ntStatus;
 
-        if (dataDirectory->VirtualAddress < c) {
-            ViewInformation->LastError = IMAGE_VERIFY_BAD_SECURITY_DIRECTORY_VA;
-            return FALSE;
         }
 
-        if (dataDirectory->VirtualAddress >= ViewInformation->FileSize.LowPart) {
-            ViewInformation->LastError = IMAGE_VERIFY_BAD_SECURITY_DIRECTORY_VA;
-            return FALSE;
-        }
+        Stream->WindowChunks = 0;
 
-        c = ViewInformation->FileSize.LowPart - dataDirectory->VirtualAddress;
-        if (dataDirectory->Size > c) {
-            ViewInformation->LastError = IMAGE_VERIFY_BAD_SECURITY_DIRECTORY_SIZE;
-            return FALSE;
+        //
+        // Failure is not fatal here, next window will be mapped on demand.
+        //
+        windowEnd = Stream->Current.Offset + Stream->Current.Size;
+        if (Stream->Reader == NULL &&
+            windowEnd < (ULONGLONG)viewInfo->FileSize.QuadPart)
+        {
+            supMapFileWindow(viewInfo, windowEnd, Stream->WindowSize, &Stream->Next);
         }
+    }
+
+    Stream->WindowChunks += 1;
 
+    windowEnd = Stream->Current.Offset + Stream->Current.Size;
+    if (Offset + *Length > windowEnd)
+        *Length = (ULONG)(windowEnd - Offset);
+
+    *Data = (PUCHAR)RtlOffsetToPointer(Stream->Current.Base, (ULONG_PTR)(Offset - Stream->Current.Offset));
+    return STATUS_SUCCESS;
+}
+
+/*
+* HashValidateFile
+*
+* Purpose:
+*
+* Validate structure of the mapped PE file and locate excluded fields.
+*
+*/
+NTSTATUS HashValidateFile(
+    _In_ PFILE_VIEW_INFO ViewInformation
+)
+{
+    NTSTATUS ntStatus = STATUS_INVALID_IMAGE_FORMAT;
+    ULONGLONG startTicks = StatsStageBegin();
+
+    if (supIsValidImage(ViewInformation)) {
+
+        ViewInformation->NtHeaders = RtlImageNtHeader(ViewInformation->ViewBase);
+        if (ViewInformation->NtHeaders) {
+            ntStatus = STATUS_SUCCESS;
+        }
+        else {
+            ViewInformation->LastError = IMAGE_VERIFY_BAD_NTHEADERS;
+        }
     }
 
-    ViewInformation->ExcludeData.ChecksumOffset = checksumOffset;
-    ViewInformation->ExcludeData.SecurityOffset = securityOffset;
-    ViewInformation->ExcludeData.SecurityDirectory = dataDirectory;
+    StatsStageEnd(STATS_STAGE_VALIDATE, startTicks);
 
-    return TRUE;
+    if (!NT_SUCCESS(ntStatus))
+        StatsFileRejected(ViewInformation->FileName, ViewInformation->LastError);
+
+    return ntStatus;
 }
 
 /*
@@ -182,6 +511,7 @@ BOOLEAN HashpGetExcludeRange(
 * Purpose:
 *
 * Load PE file in memory and validate it structure
+* PartialMap maps headers only, enough for validation and first page hash.
 *
 */
 NTSTATUS HashLoadFile(
@@ -194,69 +524,94 @@ NTSTATUS HashLoadFile(
     ntStatus = supMapInputFileForRead(ViewInformation, PartialMap);
     if (NT_SUCCESS(ntStatus)) {
 
-        ntStatus = STATUS_INVALID_IMAGE_FORMAT;
+        ntStatus = HashValidateFile(ViewInformation);
+        if (NT_SUCCESS(ntStatus))
+            return STATUS_SUCCESS;
 
-        if (supIsValidImage(ViewInformation)) {
+    }
 
-            ViewInformation->NtHeaders = RtlImageNtHeader(ViewInformation->ViewBase);
-            if (ViewInformation->NtHeaders) {
+    supDestroyFileViewInfo(ViewInformation);
+    return ntStatus;
+}
 
-                if (HashpGetExcludeRange(ViewInformation)) {
-                    return STATUS_SUCCESS;
-                }
+/*
+* HashLoadBuffer
+*
+* Purpose:
+*
+* Validate PE file image held in caller memory, no file or section is used.
+* View can be passed to every hash routine, unload does not free the buffer.
+*
+*/
+NTSTATUS HashLoadBuffer(
+    _In_ PFILE_VIEW_INFO ViewInformation,
+    _In_reads_bytes_(Size) const VOID* Buffer,
+    _In_ SIZE_T Size
+)
+{
+    NTSTATUS ntStatus;
 
-            }
-            else {
-                ViewInformation->LastError = IMAGE_VERIFY_BAD_NTHEADERS;
-            }
-        }
+    supInitBufferViewInfo(ViewInformation, Buffer, Size, Size);
 
-    }
+    ntStatus = HashValidateFile(ViewInformation);
+    if (!NT_SUCCESS(ntStatus))
+        supDestroyFileViewInfo(ViewInformation);
 
-    supDestroyFileViewInfo(ViewInformation);
     return ntStatus;
 }
 
 /*
-* CreateHashContext
+* HashpInitProvider
 *
 * Purpose:
 *
-* Allocate CNG context for given algorithm
+* INIT_ONCE callback, open algorithm provider and query object sizes.
+* Reusable hash objects are requested first (Windows 8+), plain provider otherwise.
 *
 */
-NTSTATUS CreateHashContext(
-    _In_ HANDLE HeapHandle,
-    _In_ PCWSTR AlgId,
-    _Out_ PCNG_CTX* Context
+BOOL CALLBACK HashpInitProvider(
+    _Inout_ PINIT_ONCE InitOnce,
+    _Inout_opt_ PVOID Parameter,
+    _Out_opt_ PVOID* Context
 )
 {
     NTSTATUS ntStatus;
     ULONG cbResult = 0;
-    PCNG_CTX context;
+    PHASH_PROVIDER provider = (PHASH_PROVIDER)Parameter;
 
-    *Context = NULL;
+    UNREFERENCED_PARAMETER(InitOnce);
 
-    context = (PCNG_CTX)HeapAlloc(HeapHandle,
-        HEAP_ZERO_MEMORY, sizeof(CNG_CTX));
+    if (Context)
+        *Context = NULL;
 
-    if (context == NULL) {
-        return STATUS_INSUFFICIENT_RESOURCES;
-    }
+    if (provider == NULL)
+        return FALSE;
 
-    do {
+    provider->Reusable = TRUE;
+
+    ntStatus = BCryptOpenAlgorithmProvider(&provider->AlgHandle,
+        provider->AlgId,
+        NULL,
+        BCRYPT_HASH_REUSABLE_FLAG);
+
+    if (!NT_SUCCESS(ntStatus)) {
+
+        provider->Reusable = FALSE;
 
-        ntStatus = BCryptOpenAlgorithmProvider(&context->AlgHandle,
-            AlgId,
+        ntStatus = BCryptOpenAlgorithmProvider(&provider->AlgHandle,
+            provider->AlgId,
             NULL,
             0);
 
         if (!NT_SUCCESS(ntStatus))
-            break;
+            return FALSE;
+    }
+
+    do {
 
-        ntStatus = BCryptGetProperty(context->AlgHandle,
+        ntStatus = BCryptGetProperty(provider->AlgHandle,
             BCRYPT_OBJECT_LENGTH,
-            (PUCHAR)&context->HashObjectSize,
+            (PUCHAR)&provider->HashObjectSize,
             sizeof(ULONG),
             &cbResult,
             0);
@@ -264,146 +619,1491 @@ NTSTATUS CreateHashContext(
         if (!NT_SUCCESS(ntStatus))
             break;
 
-        ntStatus = BCryptGetProperty(context->AlgHandle,
+        ntStatus = BCryptGetProperty(provider->AlgHandle,
             BCRYPT_HASH_LENGTH,
-            (PUCHAR)&context->HashSize,
+            (PUCHAR)&provider->HashSize,
             sizeof(ULONG),
             &cbResult,
             0);
 
-        if (!NT_SUCCESS(ntStatus))
-            break;
+    } while (FALSE);
 
-        context->HashObject = (PVOID)HeapAlloc(HeapHandle,
-            HEAP_ZERO_MEMORY,
-            context->HashObjectSize);
+    if (!NT_SUCCESS(ntStatus)) {
+        BCryptCloseAlgorithmProvider(provider->AlgHandle, 0);
+        provider->AlgHandle = NULL;
+        return FALSE;
+    }
 
-        if (context->HashObject == NULL) {
-            ntStatus = STATUS_INSUFFICIENT_RESOURCES;
-            break;
-        }
+    return TRUE;
+}
 
+/*
+* HashpQueryProvider
+*
+* Purpose:
+*
+* Return process wide provider for given algorithm, open it on first use.
+*
+*/
+PHASH_PROVIDER HashpQueryProvider(
+    _In_ PCWSTR AlgId,
+    _Out_opt_ PULONG ProviderIndex
+)
+{
+    ULONG i;
+    PHASH_PROVIDER provider;
 
-        context->Hash = (PVOID)HeapAlloc(HeapHandle,
-            HEAP_ZERO_MEMORY,
-            context->HashSize);
+    for (i = 0; i < HASH_PROVIDERS_COUNT; i++) {
 
-        if (context->Hash == NULL) {
-            ntStatus = STATUS_INSUFFICIENT_RESOURCES;
-            break;
-        }
+        provider = &g_HashProviders[i];
 
-        ntStatus = BCryptCreateHash(context->AlgHandle,
-            &context->HashHandle,
-            (PUCHAR)context->HashObject,
-            context->HashObjectSize,
-            NULL,
-            0,
-            0);
+        if (_wcsicmp(provider->AlgId, AlgId) == 0) {
 
-        if (!NT_SUCCESS(ntStatus))
-            break;
+            if (!InitOnceExecuteOnce(&provider->InitOnce,
+                HashpInitProvider,
+                provider,
+                NULL))
+            {
+                return NULL;
+            }
 
-        context->HeapHandle = HeapHandle;
+            if (ProviderIndex)
+                *ProviderIndex = i;
 
-        *Context = context;
-        return STATUS_SUCCESS;
+            return provider;
+        }
 
-    } while (FALSE);
+    }
+
+    return NULL;
+}
 
-    if (context->Hash) HeapFree(HeapHandle, 0, context->Hash);
-    if (context->HashObject) HeapFree(HeapHandle, 0, context->HashObject);
-    HeapFree(HeapHandle, 0, context);
+/*
+* HashReleaseProviders
+*
+* Purpose:
+*
+* Close cached algorithm providers, call only when no contexts are in use.
+*
+*/
+VOID HashReleaseProviders(
+    VOID
+)
+{
+    ULONG i;
 
-    return ntStatus;
+    for (i = 0; i < HASH_PROVIDERS_COUNT; i++) {
+        if (g_HashProviders[i].AlgHandle) {
+            BCryptCloseAlgorithmProvider(g_HashProviders[i].AlgHandle, 0);
+            g_HashProviders[i].AlgHandle = NULL;
+        }
+        InitOnceInitialize(&g_HashProviders[i].InitOnce);
+    }
 }
 
 /*
-* DestroyHashContext
+* HashDisableNativeBackend
 *
 * Purpose:
 *
-* Release all resources allocated for CNG context
+* Use CNG for all algorithms, call before any context is created.
 *
 */
-VOID DestroyHashContext(
-    _In_ PCNG_CTX Context
+VOID HashDisableNativeBackend(
+    VOID
 )
 {
-    HANDLE heapHandle = Context->HeapHandle;
+    g_HashNativeDisabled = TRUE;
+}
+
+/*
+* HashQueryNativeAlgorithm
+*
+* Purpose:
+*
+* Return native implementation id used for the algorithm, SHA_NATIVE_NONE if CNG is used.
+*
+*/
+ULONG HashQueryNativeAlgorithm(
+    _In_ PCWSTR AlgId
+)
+{
+    if (g_HashNativeDisabled || !ShaNativeIsSupported())
+        return SHA_NATIVE_NONE;
 
-    BCryptCloseAlgorithmProvider(Context->AlgHandle, 0);
+    if (_wcsicmp(AlgId, BCRYPT_SHA1_ALGORITHM) == 0)
+        return SHA_NATIVE_SHA1;
 
-    if (Context->HashHandle)
-        BCryptDestroyHash(Context->HashHandle);
-    if (Context->Hash)
-        HeapFree(heapHandle, 0, Context->Hash);
-    if (Context->HashObject)
-        HeapFree(heapHandle, 0, Context->HashObject);
+    if (_wcsicmp(AlgId, BCRYPT_SHA256_ALGORITHM) == 0)
+        return SHA_NATIVE_SHA256;
 
-    HeapFree(heapHandle, 0, Context);
+    return SHA_NATIVE_NONE;
 }
 
 /*
-* CalculateFirstPageHash
+* HashpCreateNativeContext
 *
 * Purpose:
 *
-* Compute page hash for PE headers (WDAC compliant)
+* Allocate context backed by native implementation, it is always reusable.
 *
 */
-BOOLEAN CalculateFirstPageHash(
-    _In_ ULONG PageSize,
-    _In_ PFILE_VIEW_INFO ViewInformation,
-    _In_ PCNG_CTX HashContext
+NTSTATUS HashpCreateNativeContext(
+    _In_ HANDLE HeapHandle,
+    _In_ ULONG Algorithm,
+    _Out_ PCNG_CTX* Context
 )
 {
-    ULONG offset;
-    NTSTATUS ntStatus = STATUS_INVALID_IMAGE_FORMAT;
-    ULONG sizeOfHeaders = HashpGetSizeOfHeaders(ViewInformation->NtHeaders);
-    PVOID pvImage = ViewInformation->ViewBase;
+    SIZE_T cbContext;
+    PCNG_CTX context;
 
-    __try {
+    cbContext = ALIGN_UP_BY(sizeof(CNG_CTX), MEMORY_ALLOCATION_ALIGNMENT) +
+        ALIGN_UP_BY(sizeof(SHA_NATIVE_STATE), MEMORY_ALLOCATION_ALIGNMENT) +
+        ShaNativeDigestSize(Algorithm);
 
-        offset = 0;
+    context = (PCNG_CTX)HeapAlloc(HeapHandle, HEAP_ZERO_MEMORY, cbContext);
+    if (context == NULL) {
+        *Context = NULL;
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
 
-        while (offset < PageSize) {
+    context->HashSize = ShaNativeDigestSize(Algorithm);
+    context->Reusable = TRUE;
+    context->HeapHandle = HeapHandle;
 
-            if (offset == ViewInformation->ExcludeData.ChecksumOffset)
-                offset += RTL_FIELD_SIZE(IMAGE_OPTIONAL_HEADER, CheckSum);
-            else if (offset == ViewInformation->ExcludeData.SecurityOffset)
-                offset += sizeof(IMAGE_DATA_DIRECTORY);
+    context->Native = (PSHA_NATIVE_STATE)RtlOffsetToPointer(context,
+        ALIGN_UP_BY(sizeof(CNG_CTX), MEMORY_ALLOCATION_ALIGNMENT));
 
-            if (offset >= sizeOfHeaders)
-                break;
+    context->Hash = RtlOffsetToPointer(context->Native,
+        ALIGN_UP_BY(sizeof(SHA_NATIVE_STATE), MEMORY_ALLOCATION_ALIGNMENT));
 
-            ntStatus = BCryptHashData(HashContext->HashHandle,
-                (PUCHAR)RtlOffsetToPointer(pvImage, offset), sizeof(BYTE), 0);
+    ShaNativeInit(context->Native, Algorithm);
 
-            if (!NT_SUCCESS(ntStatus))
-                return FALSE;
+    context->Pristine = TRUE;
+    *Context = context;
+    return STATUS_SUCCESS;
+}
 
-            offset += 1;
-        }
+/*
+* CreateHashContext
+*
+* Purpose:
+*
+* Allocate hash context for given algorithm.
+* SHA-1/SHA-256 use native implementation when available, CNG otherwise.
+* Provider is shared process wide, context memory is a single heap block.
+*
+*/
+NTSTATUS CreateHashContext(
+    _In_ HANDLE HeapHandle,
+    _In_ PCWSTR AlgId,
+    _Out_ PCNG_CTX* Context
+)
+{
+    NTSTATUS ntStatus;
+    ULONG cbObject, nativeAlgorithm;
+    SIZE_T cbContext;
+    PCNG_CTX context;
+    PHASH_PROVIDER provider;
+
+    *Context = NULL;
+
+    nativeAlgorithm = HashQueryNativeAlgorithm(AlgId);
+    if (nativeAlgorithm != SHA_NATIVE_NONE)
+        return HashpCreateNativeContext(HeapHandle, nativeAlgorithm, Context);
+
+    provider = HashpQueryProvider(AlgId, NULL);
+    if (provider == NULL)
+        return STATUS_NOT_SUPPORTED;
+
+    //
+    // Non reusable objects are restored from pristine template copy.
+    //
+    cbObject = (ULONG)ALIGN_UP_BY(provider->HashObjectSize, MEMORY_ALLOCATION_ALIGNMENT);
+
+    cbContext = ALIGN_UP_BY(sizeof(CNG_CTX), MEMORY_ALLOCATION_ALIGNMENT) +
+        cbObject +
+        ((provider->Reusable) ? 0 : cbObject) +
+        provider->HashSize;
+
+    context = (PCNG_CTX)HeapAlloc(HeapHandle, HEAP_ZERO_MEMORY, cbContext);
+    if (context == NULL) {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    context->AlgHandle = provider->AlgHandle;
+    context->HashObjectSize = provider->HashObjectSize;
+    context->HashSize = provider->HashSize;
+    context->Reusable = provider->Reusable;
+    context->HeapHandle = HeapHandle;
+
+    context->HashObject = RtlOffsetToPointer(context,
+        ALIGN_UP_BY(sizeof(CNG_CTX), MEMORY_ALLOCATION_ALIGNMENT));
+
+    if (context->Reusable) {
+        context->Hash = RtlOffsetToPointer(context->HashObject, cbObject);
+    }
+    else {
+        context->TemplateObject = RtlOffsetToPointer(context->HashObject, cbObject);
+        context->Hash = RtlOffsetToPointer(context->TemplateObject, cbObject);
+    }
+
+    do {
+
+        if (context->Reusable) {
+
+            ntStatus = BCryptCreateHash(context->AlgHandle,
+                &context->HashHandle,
+                (PUCHAR)context->HashObject,
+                context->HashObjectSize,
+                NULL,
+                0,
+                BCRYPT_HASH_REUSABLE_FLAG);
+
+            break;
+        }
+
+        ntStatus = BCryptCreateHash(context->AlgHandle,
+            &context->TemplateHandle,
+            (PUCHAR)context->TemplateObject,
+            context->HashObjectSize,
+            NULL,
+            0,
+            0);
+
+        if (!NT_SUCCESS(ntStatus))
+            break;
+
+        ntStatus = BCryptDuplicateHash(context->TemplateHandle,
+            &context->HashHandle,
+            (PUCHAR)context->HashObject,
+            context->HashObjectSize,
+            0);
+
+    } while (FALSE);
+
+    if (!NT_SUCCESS(ntStatus)) {
+        if (context->TemplateHandle) BCryptDestroyHash(context->TemplateHandle);
+        HeapFree(HeapHandle, 0, context);
+        return ntStatus;
+    }
+
+    context->Pristine = TRUE;
+    *Context = context;
+    return STATUS_SUCCESS;
+}
+
+/*
+* HashResetContext
+*
+* Purpose:
+*
+* Bring context to initial state so it can be used for next input.
+*
+*/
+NTSTATUS HashResetContext(
+    _In_ PCNG_CTX Context
+)
+{
+    NTSTATUS ntStatus = STATUS_SUCCESS;
+
+    if (!Context->Pristine) {
+
+        if (Context->Reusable) {
+
+            //
+            // Discard partial state, reusable object is reset on finish.
+            //
+            ntStatus = HashpFinishHash(Context);
+
+        }
+        else {
+
+            if (Context->HashHandle) {
+                BCryptDestroyHash(Context->HashHandle);
+                Context->HashHandle = NULL;
+            }
+
+            ntStatus = BCryptDuplicateHash(Context->TemplateHandle,
+                &Context->HashHandle,
+                (PUCHAR)Context->HashObject,
+                Context->HashObjectSize,
+                0);
+
+        }
+
+        if (!NT_SUCCESS(ntStatus))
+            return ntStatus;
+    }
+
+    Context->Pristine = FALSE;
+    return ntStatus;
+}
+
+/*
+* DestroyHashContext
+*
+* Purpose:
+*
+* Release all resources allocated for CNG context
+*
+*/
+VOID DestroyHashContext(
+    _In_ PCNG_CTX Context
+)
+{
+    if (Context->HashHandle)
+        BCryptDestroyHash(Context->HashHandle);
+    if (Context->TemplateHandle)
+        BCryptDestroyHash(Context->TemplateHandle);
+
+    HeapFree(Context->HeapHandle, 0, Context);
+}
+
+/*
+* HashCreateContextCache
+*
+* Purpose:
+*
+* Allocate per thread set of hash contexts.
+*
+*/
+NTSTATUS HashCreateContextCache(
+    _In_ HANDLE HeapHandle,
+    _Out_ PHASH_CONTEXT_CACHE* Cache
+)
+{
+    PHASH_CONTEXT_CACHE cache;
+
+    cache = (PHASH_CONTEXT_CACHE)HeapAlloc(HeapHandle,
+        HEAP_ZERO_MEMORY,
+        sizeof(HASH_CONTEXT_CACHE));
+
+    *Cache = cache;
+
+    if (cache == NULL)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    cache->HeapHandle = HeapHandle;
+    return STATUS_SUCCESS;
+}
+
+/*
+* HashDestroyContextCache
+*
+* Purpose:
+*
+* Release context cache and all its contexts.
+*
+*/
+VOID HashDestroyContextCache(
+    _In_ PHASH_CONTEXT_CACHE Cache
+)
+{
+    ULONG i;
+
+    for (i = 0; i < HASH_PROVIDERS_COUNT; i++) {
+        if (Cache->Contexts[i])
+            DestroyHashContext(Cache->Contexts[i]);
+    }
+
+    if (Cache->FileContext)
+        DestroyHashContext(Cache->FileContext);
+
+    HeapFree(Cache->HeapHandle, 0, Cache);
+}
+
+/*
+* HashCreateThreadPool
+*
+* Purpose:
+*
+* Create pool of ThreadCount threads for parallel hashing calls.
+*
+*/
+NTSTATUS HashCreateThreadPool(
+    _In_ HANDLE HeapHandle,
+    _In_ ULONG ThreadCount,
+    _Out_ PHASH_THREAD_POOL* ThreadPool
+)
+{
+    PHASH_THREAD_POOL threadPool;
+
+    *ThreadPool = NULL;
+
+    if (ThreadCount < 2)
+        return STATUS_INVALID_PARAMETER;
+
+    threadPool = (PHASH_THREAD_POOL)HeapAlloc(HeapHandle,
+        HEAP_ZERO_MEMORY,
+        sizeof(HASH_THREAD_POOL));
+
+    if (threadPool == NULL)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    threadPool->Pool = CreateThreadpool(NULL);
+    if (threadPool->Pool == NULL) {
+        HeapFree(HeapHandle, 0, threadPool);
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    SetThreadpoolThreadMaximum(threadPool->Pool, ThreadCount);
+    if (!SetThreadpoolThreadMinimum(threadPool->Pool, ThreadCount)) {
+        CloseThreadpool(threadPool->Pool);
+        HeapFree(HeapHandle, 0, threadPool);
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    InitializeThreadpoolEnvironment(&threadPool->CallbackEnviron);
+    SetThreadpoolCallbackPool(&threadPool->CallbackEnviron, threadPool->Pool);
+
+    threadPool->ThreadCount = ThreadCount;
+    *ThreadPool = threadPool;
+
+    return STATUS_SUCCESS;
+}
+
+/*
+* HashDestroyThreadPool
+*
+* Purpose:
+*
+* Release pool created by HashCreateThreadPool, no work may be pending.
+*
+*/
+VOID HashDestroyThreadPool(
+    _In_ HANDLE HeapHandle,
+    _In_ PHASH_THREAD_POOL ThreadPool
+)
+{
+    DestroyThreadpoolEnvironment(&ThreadPool->CallbackEnviron);
+    CloseThreadpool(ThreadPool->Pool);
+    HeapFree(HeapHandle, 0, ThreadPool);
+}
+
+/*
+* HashAcquireContext
+*
+* Purpose:
+*
+* Return ready to use context for given algorithm from the cache.
+* Context is owned by the cache and stays valid until next acquire
+* of the same algorithm.
+*
+*/
+NTSTATUS HashAcquireContext(
+    _In_ PHASH_CONTEXT_CACHE Cache,
+    _In_ PCWSTR AlgId,
+    _Out_ PCNG_CTX* Context
+)
+{
+    NTSTATUS ntStatus;
+    ULONG providerIndex = 0;
+    PCNG_CTX context;
+
+    *Context = NULL;
+
+    if (HashpQueryProvider(AlgId, &providerIndex) == NULL)
+        return STATUS_NOT_SUPPORTED;
+
+    context = Cache->Contexts[providerIndex];
+    if (context == NULL) {
+
+        ntStatus = CreateHashContext(Cache->HeapHandle, AlgId, &context);
+        if (!NT_SUCCESS(ntStatus))
+            return ntStatus;
+
+        Cache->Contexts[providerIndex] = context;
+    }
+
+    ntStatus = HashResetContext(context);
+    if (!NT_SUCCESS(ntStatus)) {
+
+        //
+        // Context is broken, recreate it next time.
+        //
+        DestroyHashContext(context);
+        Cache->Contexts[providerIndex] = NULL;
+        return ntStatus;
+    }
+
+    *Context = context;
+    return STATUS_SUCCESS;
+}
+
+/*
+* HashAcquireFileContext
+*
+* Purpose:
+*
+* Return ready to use HASH_FILE_ALGORITHM context for flat file digest.
+* It is separate from the context HashAcquireContext returns for the same
+* algorithm, both may be used in one pass.
+*
+*/
+NTSTATUS HashAcquireFileContext(
+    _In_ PHASH_CONTEXT_CACHE Cache,
+    _Out_ PCNG_CTX* Context
+)
+{
+    NTSTATUS ntStatus;
+    PCNG_CTX context;
+
+    *Context = NULL;
+
+    context = Cache->FileContext;
+    if (context == NULL) {
+
+        ntStatus = CreateHashContext(Cache->HeapHandle, HASH_FILE_ALGORITHM, &context);
+        if (!NT_SUCCESS(ntStatus))
+            return ntStatus;
+
+        Cache->FileContext = context;
+    }
+
+    ntStatus = HashResetContext(context);
+    if (!NT_SUCCESS(ntStatus)) {
+        DestroyHashContext(context);
+        Cache->FileContext = NULL;
+        return ntStatus;
+    }
+
+    *Context = context;
+    return STATUS_SUCCESS;
+}
+
+/*
+* CalculateFirstPageHash
+*
+* Purpose:
+*
+* Compute page hash for PE headers (WDAC compliant)
+*
+* Header bytes up to page end or SizeOfHeaders are fed by hash layout
+* ranges, exclusions are the gaps between them. Last range is open ended,
+* header bytes behind certificate table are still hashed. Result is the
+* same as for byte by byte walk.
+* Header bytes past the view are hashed as zeros, as mapped page remainder
+* past file end reads, so buffer and pushed views give the same digest.
+*
+*/
+BOOLEAN CalculateFirstPageHash(
+    _In_ ULONG PageSize,
+    _In_ PFILE_VIEW_INFO ViewInformation,
+    _In_ PCNG_CTX HashContext
+)
+{
+    ULONG i, offset = 0, runEnd, stopOffset, dataEnd, cbData;
+    NTSTATUS ntStatus = STATUS_INVALID_IMAGE_FORMAT;
+    PIMAGE_HASH_LAYOUT layout = &ViewInformation->Layout;
+    PVOID pvImage = ViewInformation->ViewBase;
+
+    stopOffset = (PageSize < layout->SizeOfHeaders) ? PageSize : layout->SizeOfHeaders;
+    dataEnd = ((ULONGLONG)ViewInformation->ViewSize < stopOffset) ?
+        (ULONG)ViewInformation->ViewSize : stopOffset;
+
+    __try {
+
+        for (i = 0; i < layout->RangeCount; i++) {
+
+            //
+            // Skip exclusion in front of the range, it may end beyond stop.
+            //
+            offset = (ULONG)layout->Ranges[i].Offset;
+            if (offset >= stopOffset)
+                break;
+
+            runEnd = stopOffset;
+            if (i + 1 < layout->RangeCount &&
+                layout->Ranges[i].Offset + layout->Ranges[i].Length < stopOffset)
+            {
+                runEnd = (ULONG)(layout->Ranges[i].Offset + layout->Ranges[i].Length);
+            }
+
+            cbData = (offset < dataEnd) ? min(runEnd, dataEnd) - offset : 0;
+
+            if (cbData) {
+                ntStatus = HashpHashData(HashContext,
+                    (PUCHAR)RtlOffsetToPointer(pvImage, offset), cbData);
+
+                if (!NT_SUCCESS(ntStatus))
+                    return FALSE;
+            }
+
+            if (runEnd - offset > cbData) {
+                ntStatus = HashpAddPad(runEnd - offset - cbData, HashContext);
+                if (!NT_SUCCESS(ntStatus))
+                    return FALSE;
+            }
+
+            StatsAddBytesHashed(runEnd - offset);
+
+            offset = runEnd;
+            if (offset >= stopOffset)
+                break;
+        }
+
+        if (offset < PageSize) {
+            ntStatus = HashpAddPad(PageSize - offset, HashContext);
+            if (!NT_SUCCESS(ntStatus))
+                return FALSE;
+        }
+
+        ntStatus = HashpFinishHash(HashContext);
+
+        if (NT_SUCCESS(ntStatus))
+            HashpMarkFinished(HashContext);
+
+    }
+    __except (EXCEPTION_EXECUTE_HANDLER) {
+        StatsExceptionCaught();
+        ViewInformation->LastError = IMAGE_VERIFY_EXCEPTION_IN_PROCESS;
+        return FALSE;
+    }
+
+    return NT_SUCCESS(ntStatus);
+}
+
+/*
+* HashpHashDataMulti
+*
+* Purpose:
+*
+* Feed memory block to every given hash context.
+* Input is split by HASH_CHUNK_SIZE so each chunk remains in cache while
+* all digests consume it.
+*
+*/
+NTSTATUS HashpHashDataMulti(
+    _In_reads_(Count) PCNG_CTX* HashContexts,
+    _In_ ULONG Count,
+    _In_reads_bytes_(Length) PUCHAR Data,
+    _In_ ULONG Length
+)
+{
+    NTSTATUS ntStatus = STATUS_SUCCESS;
+    ULONG cbChunk, i;
+
+    StatsAddBytesHashed((ULONGLONG)Length * Count);
+
+    while (Length) {
+
+        cbChunk = (Length > HASH_CHUNK_SIZE) ? HASH_CHUNK_SIZE : Length;
+
+        for (i = 0; i < Count; i++) {
+
+            ntStatus = HashpHashData(HashContexts[i],
+                Data, cbChunk);
+
+            if (!NT_SUCCESS(ntStatus))
+                return ntStatus;
+
+        }
+
+        Data += cbChunk;
+        Length -= cbChunk;
+    }
+
+    return ntStatus;
+}
+
+/*
+* HashpFinishHashMulti
+*
+* Purpose:
+*
+* Add trailing pad and finalize given hash contexts.
+*
+*/
+NTSTATUS HashpFinishHashMulti(
+    _In_reads_(Count) PCNG_CTX* HashContexts,
+    _In_ ULONG Count,
+    _In_ ULONG Stride,
+    _In_ ULONG PadSize
+)
+{
+    NTSTATUS ntStatus = STATUS_SUCCESS;
+    ULONG i;
+
+    for (i = 0; i < Count; i += Stride) {
+
+        if (PadSize) {
+            ntStatus = HashpAddPad(PadSize, HashContexts[i]);
+            if (!NT_SUCCESS(ntStatus))
+                break;
+        }
+
+        ntStatus = HashpFinishHash(HashContexts[i]);
+
+        if (!NT_SUCCESS(ntStatus))
+            break;
+
+        HashpMarkFinished(HashContexts[i]);
+    }
+
+    return ntStatus;
+}
+
+/*
+* HashpWalkMulti
+*
+* Purpose:
+*
+* Feed file bytes from Offset to all given contexts and to optional file
+* hash context, chunks are at most MaxChunk bytes.
+*
+*/
+NTSTATUS HashpWalkMulti(
+    _In_ PHASH_STREAM Stream,
+    _In_ ULONGLONG Offset,
+    _In_ ULONGLONG Length,
+    _In_ ULONG MaxChunk,
+    _In_reads_opt_(Count) PCNG_CTX* HashContexts,
+    _In_ ULONG Count,
+    _In_opt_ PCNG_CTX FileHashContext
+)
+{
+    NTSTATUS ntStatus = STATUS_SUCCESS;
+    ULONG cbChunk;
+    PUCHAR data;
+
+    while (Length) {
+
+        cbChunk = (Length > MaxChunk) ? MaxChunk : (ULONG)Length;
+
+        ntStatus = HashpStreamAcquire(Stream, Offset, &cbChunk, &data);
+        if (!NT_SUCCESS(ntStatus))
+            break;
+
+        ntStatus = HashpUpdateProgress(Stream->ViewInformation, cbChunk);
+        if (!NT_SUCCESS(ntStatus))
+            break;
+
+        if (Count) {
+            ntStatus = HashpHashDataMulti(HashContexts, Count, data, cbChunk);
+            if (!NT_SUCCESS(ntStatus))
+                break;
+        }
+
+        if (FileHashContext) {
+            ntStatus = HashpHashDataMulti(&FileHashContext, 1, data, cbChunk);
+            if (!NT_SUCCESS(ntStatus))
+                break;
+        }
+
+        Offset += cbChunk;
+        Length -= cbChunk;
+    }
+
+    return ntStatus;
+}
+
+/*
+* CalculateAuthenticodeHashMulti
+*
+* Purpose:
+*
+* Compute authenticode hashes for image file using several digests at once.
+* Image is walked only once, every chunk is passed to all given contexts.
+* Ranges outside of headers view are walked by sliding windows.
+* With progress sink data is taken by HASH_CHUNK_SIZE to keep cancellation prompt.
+*
+* If FileHashContext is given, it gets every byte of the file in the same
+* walk: excluded fields and certificate table are fed to it alone, chunks
+* are HASH_CHUNK_SIZE so data stays in cache for both digests.
+*
+*/
+BOOLEAN CalculateAuthenticodeHashMulti(
+    _In_ PFILE_VIEW_INFO ViewInformation,
+    _In_reads_(Count) PCNG_CTX* HashContexts,
+    _In_ ULONG Count,
+    _In_opt_ PCNG_CTX FileHashContext
+)
+{
+    NTSTATUS ntStatus = STATUS_INVALID_IMAGE_FORMAT;
+    ULONG i, cbMaxChunk;
+    ULONGLONG offset, cbInput, fileOffset = 0;
+    PIMAGE_HASH_LAYOUT layout = &ViewInformation->Layout;
+    HASH_STREAM stream;
+
+    if (Count == 0 && FileHashContext == NULL)
+        return FALSE;
+
+    cbMaxChunk = (ViewInformation->Progress || FileHashContext) ?
+        HASH_CHUNK_SIZE : SUP_MAP_WINDOW_SIZE;
+
+    HashpStreamInit(&stream, ViewInformation, SUP_MAP_WINDOW_SIZE, NULL, TRUE);
+
+    __try {
+
+        ntStatus = STATUS_SUCCESS;
+
+        //
+        // Ranges are ascending, the extra step after them is file tail.
+        //
+        for (i = 0; i <= layout->RangeCount && NT_SUCCESS(ntStatus); i++) {
+
+            if (i < layout->RangeCount) {
+                offset = layout->Ranges[i].Offset;
+                cbInput = layout->Ranges[i].Length;
+            }
+            else {
+                offset = (ULONGLONG)ViewInformation->FileSize.QuadPart;
+                cbInput = 0;
+            }
+
+            if (FileHashContext && offset > fileOffset) {
+                ntStatus = HashpWalkMulti(&stream,
+                    fileOffset,
+                    offset - fileOffset,
+                    cbMaxChunk,
+                    NULL,
+                    0,
+                    FileHashContext);
+
+                if (!NT_SUCCESS(ntStatus))
+                    break;
+            }
+
+            ntStatus = HashpWalkMulti(&stream,
+                offset,
+                cbInput,
+                cbMaxChunk,
+                HashContexts,
+                Count,
+                FileHashContext);
+
+            fileOffset = offset + cbInput;
+        }
+
+        if (NT_SUCCESS(ntStatus))
+            ntStatus = HashpFinishHashMulti(HashContexts, Count, 1, layout->PadSize);
+
+        if (NT_SUCCESS(ntStatus) && FileHashContext)
+            ntStatus = HashpFinishHashMulti(&FileHashContext, 1, 1, 0);
+
+    }
+    __except (EXCEPTION_EXECUTE_HANDLER) {
+        StatsExceptionCaught();
+        ViewInformation->LastError = IMAGE_VERIFY_EXCEPTION_IN_PROCESS;
+        ntStatus = STATUS_IN_PAGE_ERROR;
+    }
+
+    HashpStreamClose(&stream);
+
+    return NT_SUCCESS(ntStatus);
+}
+
+/*
+* HashpPushRanges
+*
+* Purpose:
+*
+* Hash parts of the file data block that fall into authenticode ranges.
+*
+*/
+NTSTATUS HashpPushRanges(
+    _In_ PHASH_PUSH Push,
+    _In_ ULONGLONG Offset,
+    _In_reads_bytes_(Length) PUCHAR Data,
+    _In_ ULONG Length
+)
+{
+    NTSTATUS ntStatus = STATUS_SUCCESS;
+    ULONG i;
+    ULONGLONG start, end;
+    PIMAGE_HASH_LAYOUT layout = &Push->ViewInformation.Layout;
+
+    if (Push->ContextCount == 0)
+        return STATUS_SUCCESS;
+
+    for (i = 0; i < layout->RangeCount; i++) {
+
+        start = layout->Ranges[i].Offset;
+        end = start + layout->Ranges[i].Length;
+
+        if (start < Offset)
+            start = Offset;
+        if (end > Offset + Length)
+            end = Offset + Length;
+
+        if (start >= end)
+            continue;
+
+        ntStatus = HashpHashDataMulti(Push->HashContexts,
+            Push->ContextCount,
+            Data + (start - Offset),
+            (ULONG)(end - start));
+
+        if (!NT_SUCCESS(ntStatus))
+            break;
+    }
+
+    return ntStatus;
+}
+
+/*
+* HashpPushGrowHeaders
+*
+* Purpose:
+*
+* Enlarge headers buffer when collected headers extend past it, with the
+* same extent as file headers view gets. Grown is TRUE if more bytes are
+* to be collected before validation.
+*
+*/
+NTSTATUS HashpPushGrowHeaders(
+    _In_ PHASH_PUSH Push,
+    _Out_ PBOOLEAN Grown
+)
+{
+    ULONGLONG extent;
+    PUCHAR headers;
+    PFILE_VIEW_INFO viewInfo = &Push->ViewInformation;
+
+    *Grown = FALSE;
+
+    extent = supQueryHeadersExtent(viewInfo);
+    if (extent <= viewInfo->ViewSize)
+        return STATUS_SUCCESS;
+
+    headers = (PUCHAR)HeapReAlloc(Push->HeapHandle, 0, Push->Headers, (SIZE_T)extent);
+    if (headers == NULL)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    Push->Headers = headers;
+    viewInfo->ViewBase = headers;
+    viewInfo->ViewSize = (SIZE_T)extent;
+
+    *Grown = TRUE;
+    return STATUS_SUCCESS;
+}
+
+/*
+* HashpPushHeaders
+*
+* Purpose:
+*
+* Validate collected headers view and hash it by the resulting layout.
+* Must be called under exception handler.
+*
+*/
+NTSTATUS HashpPushHeaders(
+    _In_ PHASH_PUSH Push
+)
+{
+    NTSTATUS ntStatus;
+    PFILE_VIEW_INFO viewInfo = &Push->ViewInformation;
+
+    ntStatus = HashValidateFile(viewInfo);
+    if (!NT_SUCCESS(ntStatus))
+        return ntStatus;
+
+    return HashpPushRanges(Push, 0, Push->Headers, (ULONG)viewInfo->ViewSize);
+}
+
+/*
+* HashPushCreate
+*
+* Purpose:
+*
+* Start incremental authenticode hash of the file with known size.
+* Contexts must be freshly acquired, they hold digests after HashPushFinish.
+* Without contexts file headers are only collected and validated.
+*
+*/
+NTSTATUS HashPushCreate(
+    _In_ HANDLE HeapHandle,
+    _In_opt_ LPCWSTR FileName,
+    _In_ ULONGLONG FileSize,
+    _In_reads_opt_(Count) PCNG_CTX* HashContexts,
+    _In_ ULONG Count,
+    _Out_ PHASH_PUSH* Push
+)
+{
+    SIZE_T viewSize;
+    PHASH_PUSH push;
+
+    *Push = NULL;
+
+    if (FileSize == 0 || FileSize > MAXLONGLONG || Count > HASH_PROVIDERS_COUNT)
+        return STATUS_INVALID_PARAMETER;
+
+    viewSize = (FileSize < SUP_HEADERS_VIEW_SIZE) ? (SIZE_T)FileSize : SUP_HEADERS_VIEW_SIZE;
+
+    push = (PHASH_PUSH)HeapAlloc(HeapHandle, HEAP_ZERO_MEMORY, sizeof(HASH_PUSH));
+    if (push == NULL)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    push->Headers = (PUCHAR)HeapAlloc(HeapHandle, 0, viewSize);
+    if (push->Headers == NULL) {
+        HeapFree(HeapHandle, 0, push);
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    push->HeapHandle = HeapHandle;
+    push->ContextCount = Count;
+    if (Count)
+        RtlCopyMemory(push->HashContexts, HashContexts, Count * sizeof(PCNG_CTX));
+
+    push->ViewInformation.FileName = FileName;
+    supInitBufferViewInfo(&push->ViewInformation, push->Headers, viewSize, FileSize);
+    push->ViewInformation.LastError = IMAGE_VERIFY_UNKNOWN_ERROR;
+
+    *Push = push;
+    return STATUS_SUCCESS;
+}
+
+/*
+* HashPushData
+*
+* Purpose:
+*
+* Consume next block of file data, blocks may have any size.
+* Headers view is validated once it is complete and holds all headers,
+* failure is sticky and returned by all further calls.
+*
+*/
+NTSTATUS HashPushData(
+    _In_ PHASH_PUSH Push,
+    _In_reads_bytes_(Length) const VOID* Data,
+    _In_ SIZE_T Length
+)
+{
+    NTSTATUS ntStatus = Push->Status;
+    PFILE_VIEW_INFO viewInfo = &Push->ViewInformation;
+    PUCHAR data = (PUCHAR)Data;
+    SIZE_T cbChunk;
+    BOOLEAN bGrown;
+
+    if (!NT_SUCCESS(ntStatus))
+        return ntStatus;
+
+    if (Push->Finished)
+        return STATUS_INVALID_DEVICE_STATE;
+
+    if (Length > (ULONGLONG)viewInfo->FileSize.QuadPart - Push->Offset) {
+        Push->Status = STATUS_INVALID_BUFFER_SIZE;
+        return Push->Status;
+    }
+
+    __try {
+
+        while (Length && NT_SUCCESS(ntStatus)) {
+
+            if (Push->Offset < viewInfo->ViewSize) {
+
+                cbChunk = viewInfo->ViewSize - (SIZE_T)Push->Offset;
+                if (cbChunk > Length)
+                    cbChunk = Length;
+
+                RtlCopyMemory(Push->Headers + Push->Offset, data, cbChunk);
+                Push->Offset += cbChunk;
+
+                if (Push->Offset == viewInfo->ViewSize) {
+                    ntStatus = HashpPushGrowHeaders(Push, &bGrown);
+                    if (NT_SUCCESS(ntStatus) && !bGrown)
+                        ntStatus = HashpPushHeaders(Push);
+                }
+
+            }
+            else {
+
+                cbChunk = (Length > SUP_MAP_WINDOW_SIZE) ? SUP_MAP_WINDOW_SIZE : Length;
+
+                ntStatus = HashpPushRanges(Push, Push->Offset, data, (ULONG)cbChunk);
+                Push->Offset += cbChunk;
+
+            }
+
+            data += cbChunk;
+            Length -= cbChunk;
+        }
+
+    }
+    __except (EXCEPTION_EXECUTE_HANDLER) {
+        StatsExceptionCaught();
+        viewInfo->LastError = IMAGE_VERIFY_EXCEPTION_IN_PROCESS;
+        ntStatus = STATUS_IN_PAGE_ERROR;
+    }
+
+    Push->Status = ntStatus;
+    return ntStatus;
+}
+
+/*
+* HashPushFinish
+*
+* Purpose:
+*
+* Add trailing pad and finalize digests, whole file must be pushed.
+*
+*/
+NTSTATUS HashPushFinish(
+    _In_ PHASH_PUSH Push
+)
+{
+    NTSTATUS ntStatus = Push->Status;
+
+    if (!NT_SUCCESS(ntStatus))
+        return ntStatus;
+
+    if (Push->Finished)
+        return STATUS_INVALID_DEVICE_STATE;
+
+    if (Push->Offset != (ULONGLONG)Push->ViewInformation.FileSize.QuadPart) {
+        Push->Status = STATUS_END_OF_FILE;
+        return Push->Status;
+    }
+
+    ntStatus = HashpFinishHashMulti(Push->HashContexts,
+        Push->ContextCount,
+        1,
+        Push->ViewInformation.Layout.PadSize);
+    if (NT_SUCCESS(ntStatus))
+        Push->Finished = TRUE;
+    else
+        Push->Status = ntStatus;
+
+    return ntStatus;
+}
+
+/*
+* HashPushQueryView
+*
+* Purpose:
+*
+* Return headers view of the pushed file, it holds image error and once
+* headers are pushed can be used for first page hash.
+*
+*/
+PFILE_VIEW_INFO HashPushQueryView(
+    _In_ PHASH_PUSH Push
+)
+{
+    return &Push->ViewInformation;
+}
+
+/*
+* HashPushDestroy
+*
+* Purpose:
+*
+* Free incremental hash state, contexts are not touched.
+*
+*/
+VOID HashPushDestroy(
+    _In_ PHASH_PUSH Push
+)
+{
+    HeapFree(Push->HeapHandle, 0, Push->Headers);
+    HeapFree(Push->HeapHandle, 0, Push);
+}
+
+/*
+* HashpRingSignalAbort
+*
+* Purpose:
+*
+* Stop both producer and consumers of the chunk ring.
+*
+*/
+VOID HashpRingSignalAbort(
+    _In_ PHASH_RING Ring,
+    _In_ NTSTATUS Status
+)
+{
+    AcquireSRWLockExclusive(&Ring->Lock);
+    if (!Ring->Aborted) {
+        Ring->Aborted = TRUE;
+        Ring->Status = Status;
+    }
+    WakeAllConditionVariable(&Ring->DataReady);
+    WakeAllConditionVariable(&Ring->SlotFree);
+    ReleaseSRWLockExclusive(&Ring->Lock);
+}
+
+/*
+* HashpRingPublish
+*
+* Purpose:
+*
+* Place next chunk into the ring, wait for a free slot if needed.
+*
+*/
+BOOLEAN HashpRingPublish(
+    _In_ PHASH_RING Ring,
+    _In_ PUCHAR Data,
+    _In_ ULONG Size
+)
+{
+    BOOLEAN bResult;
+    PHASH_RING_SLOT slot;
+
+    AcquireSRWLockExclusive(&Ring->Lock);
+
+    slot = &Ring->Slots[Ring->Produced % HASH_RING_SLOTS];
+
+    while (slot->Pending && !Ring->Aborted)
+        SleepConditionVariableSRW(&Ring->SlotFree, &Ring->Lock, INFINITE, 0);
+
+    bResult = (Ring->Aborted == FALSE);
+    if (bResult) {
+        slot->Data = Data;
+        slot->Size = Size;
+        slot->Pending = Ring->WorkerCount;
+        Ring->Produced += 1;
+        WakeAllConditionVariable(&Ring->DataReady);
+    }
+
+    ReleaseSRWLockExclusive(&Ring->Lock);
+
+    return bResult;
+}
+
+/*
+* HashpReadAhead
+*
+* Purpose:
+*
+* Fault in pages of the chunk on producer thread so workers hash resident data.
+*
+*/
+UCHAR HashpReadAhead(
+    _In_reads_bytes_(Size) PUCHAR Data,
+    _In_ ULONG Size
+)
+{
+    volatile UCHAR* p = (volatile UCHAR*)Data;
+    UCHAR x = 0;
+    ULONG i;
+
+    for (i = 0; i < Size; i += HASH_READ_AHEAD_STRIDE)
+        x ^= p[i];
+
+    return x;
+}
+
+/*
+* HashpRingWorker
+*
+* Purpose:
+*
+* Thread pool callback, consumes ring chunks with a subset of hash contexts.
+*
+*/
+VOID CALLBACK HashpRingWorker(
+    _Inout_ PTP_CALLBACK_INSTANCE Instance,
+    _Inout_opt_ PVOID Context,
+    _Inout_ PTP_WORK Work
+)
+{
+    NTSTATUS ntStatus = STATUS_SUCCESS;
+    PHASH_RING ring = (PHASH_RING)Context;
+    PHASH_RING_SLOT slot;
+    PUCHAR data;
+    ULONG workerId, consumed = 0, size, i;
+
+    UNREFERENCED_PARAMETER(Instance);
+    UNREFERENCED_PARAMETER(Work);
+
+    if (ring == NULL)
+        return;
+
+    workerId = (ULONG)InterlockedIncrement(&ring->NextWorkerId) - 1;
+
+    for (;;) {
+
+        AcquireSRWLockExclusive(&ring->Lock);
+
+        while (consumed == ring->Produced && !ring->Finished && !ring->Aborted)
+            SleepConditionVariableSRW(&ring->DataReady, &ring->Lock, INFINITE, 0);
+
+        if (ring->Aborted || consumed == ring->Produced) {
+            ReleaseSRWLockExclusive(&ring->Lock);
+            break;
+        }
+
+        slot = &ring->Slots[consumed % HASH_RING_SLOTS];
+        data = slot->Data;
+        size = slot->Size;
+
+        ReleaseSRWLockExclusive(&ring->Lock);
+
+        __try {
+
+            for (i = workerId; i < ring->ContextCount; i += ring->WorkerCount) {
+
+                ntStatus = HashpHashData(ring->HashContexts[i],
+                    data, size);
+
+                if (!NT_SUCCESS(ntStatus))
+                    break;
+
+                StatsAddBytesHashed(size);
+            }
+
+        }
+        __except (EXCEPTION_EXECUTE_HANDLER) {
+            StatsExceptionCaught();
+            ntStatus = STATUS_IN_PAGE_ERROR;
+            ring->ExceptionCaught = TRUE;
+        }
+
+        if (!NT_SUCCESS(ntStatus)) {
+            HashpRingSignalAbort(ring, ntStatus);
+            return;
+        }
+
+        AcquireSRWLockExclusive(&ring->Lock);
+        slot->Pending -= 1;
+        if (slot->Pending == 0)
+            WakeAllConditionVariable(&ring->SlotFree);
+        ReleaseSRWLockExclusive(&ring->Lock);
+
+        consumed += 1;
+    }
+
+    if (ring->Aborted)
+        return;
+
+    ntStatus = HashpFinishHashMulti(&ring->HashContexts[workerId],
+        ring->ContextCount - workerId,
+        ring->WorkerCount,
+        ring->PadSize);
+
+    if (!NT_SUCCESS(ntStatus))
+        HashpRingSignalAbort(ring, ntStatus);
+}
 
-        if (offset < PageSize) {
-            ntStatus = HashpAddPad(PageSize - offset, HashContext);
-            if (!NT_SUCCESS(ntStatus))
-                return FALSE;
+/*
+* CalculateAuthenticodeHashParallel
+*
+* Purpose:
+*
+* Compute authenticode hashes with contexts distributed among thread pool workers.
+* Pool is owned by the caller and serves one call at a time.
+* Calling thread walks the image once and publishes read-ahead chunks to
+* the ring shared by all workers. Data outside of headers view is walked by
+* sliding windows, so address space use does not depend on file size.
+*
+*/
+BOOLEAN CalculateAuthenticodeHashParallel(
+    _In_ PFILE_VIEW_INFO ViewInformation,
+    _In_reads_(Count) PCNG_CTX* HashContexts,
+    _In_ ULONG Count,
+    _In_opt_ PHASH_THREAD_POOL ThreadPool
+)
+{
+    BOOLEAN bAborted = FALSE, bException = FALSE;
+    NTSTATUS ntStatus;
+    ULONG i, cbChunk, workerCount;
+    ULONGLONG offset, cbInput;
+    PUCHAR data;
+    PTP_WORK work = NULL;
+    PIMAGE_HASH_LAYOUT layout = &ViewInformation->Layout;
+    HASH_STREAM stream;
+    HASH_RING ring;
+
+    workerCount = (ThreadPool) ? ThreadPool->ThreadCount : 1;
+    if (workerCount > Count)
+        workerCount = Count;
+
+    //
+    // Every worker blocks on the ring, all of them must run at the same time.
+    // Pool threads are precreated, so submitted workers never wait for them.
+    //
+    if (workerCount < 2)
+        return CalculateAuthenticodeHashMulti(ViewInformation, HashContexts, Count, NULL);
+
+    RtlSecureZeroMemory(&ring, sizeof(ring));
+    InitializeSRWLock(&ring.Lock);
+    InitializeConditionVariable(&ring.DataReady);
+    InitializeConditionVariable(&ring.SlotFree);
+    ring.HashContexts = HashContexts;
+    ring.ContextCount = Count;
+    ring.WorkerCount = workerCount;
+    ring.PadSize = layout->PadSize;
+    ring.Status = STATUS_SUCCESS;
+
+    HashpStreamInit(&stream, ViewInformation, SUP_MAP_WINDOW_SIZE, &ring, TRUE);
+
+    do {
+
+        work = CreateThreadpoolWork(HashpRingWorker, &ring, &ThreadPool->CallbackEnviron);
+        if (work == NULL) {
+            bAborted = TRUE;
+            break;
         }
 
-        ntStatus = BCryptFinishHash(HashContext->HashHandle,
-            (PUCHAR)HashContext->Hash,
-            HashContext->HashSize,
-            0);
+        for (i = 0; i < workerCount; i++)
+            SubmitThreadpoolWork(work);
 
-    }
-    __except (EXCEPTION_EXECUTE_HANDLER) {
+        __try {
+
+            for (i = 0; i < layout->RangeCount && !bAborted; i++) {
+
+                offset = layout->Ranges[i].Offset;
+                cbInput = layout->Ranges[i].Length;
+
+                while (cbInput) {
+
+                    cbChunk = (cbInput > HASH_CHUNK_SIZE) ? HASH_CHUNK_SIZE : (ULONG)cbInput;
+
+                    ntStatus = HashpStreamAcquire(&stream, offset, &cbChunk, &data);
+                    if (!NT_SUCCESS(ntStatus)) {
+                        HashpRingSignalAbort(&ring, ntStatus);
+                        bAborted = TRUE;
+                        break;
+                    }
+
+                    HashpReadAhead(data, cbChunk);
+
+                    if (!HashpRingPublish(&ring, data, cbChunk)) {
+                        bAborted = TRUE;
+                        break;
+                    }
+
+                    offset += cbChunk;
+                    cbInput -= cbChunk;
+                }
+
+            }
+
+        }
+        __except (EXCEPTION_EXECUTE_HANDLER) {
+            StatsExceptionCaught();
+            bException = TRUE;
+        }
+
+        if (bException)
+            HashpRingSignalAbort(&ring, STATUS_IN_PAGE_ERROR);
+
+        AcquireSRWLockExclusive(&ring.Lock);
+        ring.Finished = TRUE;
+        WakeAllConditionVariable(&ring.DataReady);
+        ReleaseSRWLockExclusive(&ring.Lock);
+
+        WaitForThreadpoolWorkCallbacks(work, FALSE);
+        CloseThreadpoolWork(work);
+
+    } while (FALSE);
+
+    //
+    // Workers are gone, windows may be released without drain.
+    //
+    stream.Ring = NULL;
+    HashpStreamClose(&stream);
+
+    if (work == NULL)
+        return CalculateAuthenticodeHashMulti(ViewInformation, HashContexts, Count, NULL);
+
+    if (bException || ring.ExceptionCaught) {
         ViewInformation->LastError = IMAGE_VERIFY_EXCEPTION_IN_PROCESS;
         return FALSE;
     }
 
-    return NT_SUCCESS(ntStatus);
+    return (ring.Aborted == FALSE && NT_SUCCESS(ring.Status));
 }
 
 /*
@@ -419,79 +2119,523 @@ BOOLEAN CalculateAuthenticodeHash(
     _In_ PCNG_CTX HashContext
 )
 {
-    NTSTATUS ntStatus = STATUS_INVALID_IMAGE_FORMAT;
-    ULONG securityOffset, checksumOffset, cbInput, sz, cbPad;
-    ULONG fileOffset = 0;
-    PVOID imageBase;
-    PIMAGE_DATA_DIRECTORY dataDirectory;
+    return CalculateAuthenticodeHashMulti(ViewInformation, &HashContext, 1, NULL);
+}
+
+/*
+* HashQueryMultiBufferAlgorithm
+*
+* Purpose:
+*
+* Return multi-buffer implementation id for the algorithm, SHA_NATIVE_NONE if
+* files must be hashed one by one. Single buffer SHA extensions are faster than
+* SIMD lanes, so multi-buffer engine is used only on CPUs without them.
+*
+*/
+ULONG HashQueryMultiBufferAlgorithm(
+    _In_ PCWSTR AlgId
+)
+{
+    if (g_HashNativeDisabled || ShaNativeIsSupported() || !ShaMultiIsSupported())
+        return SHA_NATIVE_NONE;
+
+    if (_wcsicmp(AlgId, BCRYPT_SHA1_ALGORITHM) == 0)
+        return SHA_NATIVE_SHA1;
+
+    if (_wcsicmp(AlgId, BCRYPT_SHA256_ALGORITHM) == 0)
+        return SHA_NATIVE_SHA256;
+
+    return SHA_NATIVE_NONE;
+}
+
+/*
+* CalculateAuthenticodeHashBatch
+*
+* Purpose:
+*
+* Compute authenticode digest of several images at once, one image per SIMD lane.
+* Only images covered entirely by headers view take part, the rest as well as
+* NULL entries are left with Computed set to FALSE for the per-file path.
+* Algorithm must be returned by HashQueryMultiBufferAlgorithm.
+* Lane descriptors come from the arena of the first view, views of one
+* batch belong to one worker.
+* Returns number of computed digests.
+*
+*/
+ULONG CalculateAuthenticodeHashBatch(
+    _In_reads_(Count) PFILE_VIEW_INFO* ViewInformation,
+    _In_ ULONG Count,
+    _In_ ULONG Algorithm,
+    _Out_writes_(Count) PUCHAR* Digests,
+    _Out_writes_(Count) PBOOLEAN Computed
+)
+{
+    ULONG i, j, cMessages = 0;
+    ULONGLONG cbTotal = 0;
+    PFILE_VIEW_INFO viewInfo;
+    PIMAGE_HASH_LAYOUT layout;
+    PSHA_MB_MESSAGE message, messages;
+    PARENA arena = NULL;
+
+    C_ASSERT(IMAGE_HASH_RANGES_MAX < SHA_MB_SEGMENTS_MAX);
+
+    RtlSecureZeroMemory(Computed, Count * sizeof(BOOLEAN));
+
+    if (Count == 0)
+        return 0;
+
+    for (i = 0; i < Count && arena == NULL; i++) {
+        if (ViewInformation[i])
+            arena = ViewInformation[i]->Arena;
+    }
+
+    messages = (PSHA_MB_MESSAGE)ArenaHeapAlloc(arena, Count * sizeof(SHA_MB_MESSAGE));
+    if (messages == NULL)
+        return 0;
 
     __try {
 
-        imageBase = ViewInformation->ViewBase;
-        checksumOffset = ViewInformation->ExcludeData.ChecksumOffset;
-        securityOffset = ViewInformation->ExcludeData.SecurityOffset;
-        dataDirectory = ViewInformation->ExcludeData.SecurityDirectory;
+        for (i = 0; i < Count; i++) {
+
+            viewInfo = ViewInformation[i];
+            if (viewInfo == NULL)
+                continue;
+
+            layout = &viewInfo->Layout;
+
+            for (j = 0; j < layout->RangeCount; j++) {
+                if (layout->Ranges[j].Length > viewInfo->ViewSize ||
+                    layout->Ranges[j].Offset > viewInfo->ViewSize - layout->Ranges[j].Length)
+                {
+                    break;
+                }
+            }
+
+            if (j < layout->RangeCount)
+                continue;
+
+            message = &messages[cMessages++];
+            message->Digest = Digests[i];
+
+            for (j = 0; j < layout->RangeCount; j++) {
+                message->Segments[j].Data = (const UCHAR*)RtlOffsetToPointer(viewInfo->ViewBase,
+                    (ULONG_PTR)layout->Ranges[j].Offset);
+                message->Segments[j].Length = (SIZE_T)layout->Ranges[j].Length;
+                cbTotal += layout->Ranges[j].Length;
+            }
+
+            message->Segments[j].Data = g_HashZeroPage;
+            message->Segments[j].Length = layout->PadSize;
+            message->SegmentCount = layout->RangeCount + 1;
+            cbTotal += layout->PadSize;
+
+            Computed[i] = TRUE;
+        }
+
+        if (cMessages) {
+            ShaMultiHash(Algorithm, messages, cMessages);
+            StatsAddBytesHashed(cbTotal);
+        }
+
+    }
+    __except (EXCEPTION_EXECUTE_HANDLER) {
+        StatsExceptionCaught();
+        RtlSecureZeroMemory(Computed, Count * sizeof(BOOLEAN));
+        cMessages = 0;
+    }
+
+    ArenaHeapFree(arena, messages);
+
+    return cMessages;
+}
+
+/*
+* HashpPageWorkerRoutine
+*
+* Purpose:
+*
+* Hash section pages taken from shared job counter until none left.
+* Pool workers pass no context and create their own.
+*
+*/
+VOID HashpPageWorkerRoutine(
+    _In_ PPAGE_HASH_WORK Work,
+    _In_opt_ PCNG_CTX HashContext
+)
+{
+    NTSTATUS ntStatus = STATUS_SUCCESS;
+    PCNG_CTX hashContext;
+    PPAGE_HASH_JOB job;
+    PUCHAR entry, data;
+    ULONG jobIndex, cbHashed, cbChunk = 0;
+    HASH_STREAM stream;
+
+    if (HashContext) {
+        hashContext = HashContext;
+    }
+    else {
+        ntStatus = CreateHashContext(Work->Table->HeapHandle, Work->AlgId, &hashContext);
+        if (!NT_SUCCESS(ntStatus)) {
+            InterlockedExchange(&Work->Failed, TRUE);
+            return;
+        }
+    }
+
+    //
+    // Workers walk pages concurrently, shared sequential reader cannot serve them.
+    //
+    HashpStreamInit(&stream, Work->ViewInformation, HASH_PAGE_WINDOW_SIZE, NULL, FALSE);
+
+    for (;;) {
+
+        jobIndex = (ULONG)InterlockedIncrement(&Work->NextJob) - 1;
+        if (jobIndex >= Work->JobCount || Work->Failed)
+            break;
+
+        job = &Work->Jobs[jobIndex];
 
         //
-        // Handle checksum offset.
+        // Entry 0 is header page.
         //
-        cbInput = checksumOffset;
+        entry = PAGE_HASH_TABLE_ENTRY(Work->Table, jobIndex + 1);
 
-        ntStatus = BCryptHashData(HashContext->HashHandle,
-            (PUCHAR)imageBase, cbInput, 0);
+        ntStatus = HashResetContext(hashContext);
+        if (!NT_SUCCESS(ntStatus))
+            break;
 
-        if (NT_SUCCESS(ntStatus)) {
+        __try {
 
             //
-            // Handle security offset.
+            // Page may cross window boundary.
             //
-            fileOffset = checksumOffset + RTL_FIELD_SIZE(IMAGE_OPTIONAL_HEADER, CheckSum);
+            for (cbHashed = 0; cbHashed < job->Length && NT_SUCCESS(ntStatus); cbHashed += cbChunk) {
+
+                cbChunk = job->Length - cbHashed;
 
-            cbInput = securityOffset - fileOffset;
+                ntStatus = HashpStreamAcquire(&stream,
+                    (ULONGLONG)job->Offset + cbHashed,
+                    &cbChunk,
+                    &data);
 
-            ntStatus = BCryptHashData(HashContext->HashHandle,
-                (PUCHAR)RtlOffsetToPointer(imageBase, fileOffset), cbInput, 0);
+                if (NT_SUCCESS(ntStatus)) {
+                    ntStatus = HashpHashData(hashContext, data, cbChunk);
+                    StatsAddBytesHashed(cbChunk);
+                }
+            }
+
+            if (NT_SUCCESS(ntStatus) && job->Length < Work->PageSize)
+                ntStatus = HashpAddPad(Work->PageSize - job->Length, hashContext);
 
             if (NT_SUCCESS(ntStatus)) {
+                ntStatus = HashpFinishHash(hashContext);
+            }
 
-                fileOffset = securityOffset + sizeof(IMAGE_DATA_DIRECTORY);
+        }
+        __except (EXCEPTION_EXECUTE_HANDLER) {
+            StatsExceptionCaught();
+            InterlockedExchange(&Work->ExceptionCaught, TRUE);
+            ntStatus = STATUS_IN_PAGE_ERROR;
+        }
 
-                if (dataDirectory->VirtualAddress == 0)
-                {
-                    cbInput = ViewInformation->FileSize.LowPart - fileOffset;
-                }
-                else
-                {
-                    cbInput = dataDirectory->VirtualAddress - fileOffset;
-                }
+        if (!NT_SUCCESS(ntStatus))
+            break;
 
-                ntStatus = BCryptHashData(HashContext->HashHandle,
-                    (PUCHAR)RtlOffsetToPointer(imageBase, fileOffset), cbInput, 0);
+        HashpMarkFinished(hashContext);
 
-                if (NT_SUCCESS(ntStatus)) {
+        *(PULONG)entry = job->Offset;
+        RtlCopyMemory(entry + sizeof(ULONG), hashContext->Hash, hashContext->HashSize);
+    }
 
-                    sz = (cbInput % DEFAULT_ALIGN_BYTES);
-                    if (sz) {
+    if (!NT_SUCCESS(ntStatus))
+        InterlockedExchange(&Work->Failed, TRUE);
 
-                        cbPad = (DEFAULT_ALIGN_BYTES - sz);
-                        ntStatus = HashpAddPad(cbPad, HashContext);
-                        if (!NT_SUCCESS(ntStatus))
-                            return FALSE;
-                    }
+    HashpStreamClose(&stream);
 
-                    ntStatus = BCryptFinishHash(HashContext->HashHandle,
-                        (PUCHAR)HashContext->Hash,
-                        HashContext->HashSize,
-                        0);
+    if (hashContext != HashContext)
+        DestroyHashContext(hashContext);
+}
 
-                }
-            }
+/*
+* HashpPageWorker
+*
+* Purpose:
+*
+* Thread pool callback for page hash table workers.
+*
+*/
+VOID CALLBACK HashpPageWorker(
+    _Inout_ PTP_CALLBACK_INSTANCE Instance,
+    _Inout_opt_ PVOID Context,
+    _Inout_ PTP_WORK Work
+)
+{
+    UNREFERENCED_PARAMETER(Instance);
+    UNREFERENCED_PARAMETER(Work);
+
+    if (Context)
+        HashpPageWorkerRoutine((PPAGE_HASH_WORK)Context, NULL);
+}
+
+/*
+* HashpBuildPageJobs
+*
+* Purpose:
+*
+* Split raw data of sections sorted by file offset into page sized jobs.
+* Buffer is taken from the view arena if there is one, otherwise from
+* the heap and must be freed with HeapFree when no longer needed.
+*
+*/
+BOOLEAN HashpBuildPageJobs(
+    _In_ HANDLE HeapHandle,
+    _In_ ULONG PageSize,
+    _In_ PFILE_VIEW_INFO ViewInformation,
+    _Out_ PPAGE_HASH_JOB* Jobs,
+    _Out_ PULONG JobCount,
+    _Out_ PULONG LastOffset
+)
+{
+    ULONG i, j, c, cbRaw, rawOffset, numberOfSections, cJobs = 0;
+    ULONGLONG cbAvailable, fileSize = (ULONGLONG)ViewInformation->FileSize.QuadPart;
+    PIMAGE_SECTION_HEADER sectionTable;
+    PPAGE_HASH_JOB jobs = NULL;
+    HASH_RANGE sections[MM_MAXIMUM_IMAGE_SECTIONS], range;
+
+    *Jobs = NULL;
+    *JobCount = 0;
+    *LastOffset = 0;
+
+    numberOfSections = ViewInformation->NtHeaders->FileHeader.NumberOfSections;
+    if (numberOfSections > MM_MAXIMUM_IMAGE_SECTIONS)
+        return FALSE;
+
+    sectionTable = IMAGE_FIRST_SECTION(ViewInformation->NtHeaders);
+
+    //
+    // Sort sections with raw data by PointerToRawData.
+    //
+    for (i = 0, c = 0; i < numberOfSections; i++) {
+
+        if (sectionTable[i].SizeOfRawData == 0)
+            continue;
+
+        range.Offset = sectionTable[i].PointerToRawData;
+        range.Length = sectionTable[i].SizeOfRawData;
+
+        for (j = c; j > 0 && sections[j - 1].Offset > range.Offset; j--)
+            sections[j] = sections[j - 1];
+
+        sections[j] = range;
+        c += 1;
+    }
+
+    //
+    // Serialized form keeps 32-bit offsets, raw data must end below 4 GB.
+    //
+    for (i = 0; i < c; i++) {
+        if (sections[i].Offset + sections[i].Length > MAXULONG)
+            return FALSE;
+        cJobs += (ULONG)((sections[i].Length + PageSize - 1) / PageSize);
+    }
+
+    if (cJobs) {
+        jobs = (PPAGE_HASH_JOB)ArenaAlloc(ViewInformation->Arena,
+            (SIZE_T)cJobs * sizeof(PAGE_HASH_JOB),
+            ARENA_ALIGN);
+
+        if (jobs == NULL) {
+            jobs = (PPAGE_HASH_JOB)HeapAlloc(HeapHandle, HEAP_ZERO_MEMORY,
+                (SIZE_T)cJobs * sizeof(PAGE_HASH_JOB));
+
+            if (jobs == NULL)
+                return FALSE;
         }
     }
+
+    for (i = 0, j = 0; i < c; i++) {
+
+        for (cbRaw = 0; cbRaw < sections[i].Length; cbRaw += PageSize, j++) {
+
+            rawOffset = (ULONG)sections[i].Offset + cbRaw;
+
+            jobs[j].Offset = rawOffset;
+            jobs[j].Length = (ULONG)sections[i].Length - cbRaw;
+            if (jobs[j].Length > PageSize)
+                jobs[j].Length = PageSize;
+
+            //
+            // Raw data beyond end of file is treated as zero bytes.
+            //
+            cbAvailable = (rawOffset < fileSize) ? fileSize - rawOffset : 0;
+            if (jobs[j].Length > cbAvailable)
+                jobs[j].Length = (ULONG)cbAvailable;
+        }
+
+        *LastOffset = (ULONG)(sections[i].Offset + sections[i].Length);
+    }
+
+    *Jobs = jobs;
+    *JobCount = cJobs;
+    return TRUE;
+}
+
+/*
+* CalculatePageHashTable
+*
+* Purpose:
+*
+* Compute page hash table for the whole image (WDAC/CI compliant).
+*
+* Table layout is the serialized page hashes form: sequence of
+* { ULONG FileOffset; UCHAR Hash[HashSize] } entries, header page first,
+* then every page of section raw data in file order, terminated by entry
+* with offset of the raw data end and zero hash.
+* Section pages are hashed by calling thread and, when ThreadPool is given,
+* by its threads, one less than pool size.
+* Calling thread takes its context from the optional cache.
+* Returned table must be freed with FreePageHashTable.
+*
+*/
+BOOLEAN CalculatePageHashTable(
+    _In_ HANDLE HeapHandle,
+    _In_ ULONG PageSize,
+    _In_ PFILE_VIEW_INFO ViewInformation,
+    _In_ PCWSTR AlgId,
+    _In_opt_ PHASH_THREAD_POOL ThreadPool,
+    _In_opt_ PHASH_CONTEXT_CACHE ContextCache,
+    _Out_ PPAGE_HASH_TABLE* Table
+)
+{
+    BOOLEAN bResult = FALSE;
+    ULONG i, cJobs = 0, lastOffset = 0, workerCount;
+    SIZE_T cbTable;
+    PHASH_PROVIDER provider;
+    PCNG_CTX hashContext = NULL;
+    PPAGE_HASH_JOB jobs = NULL;
+    PPAGE_HASH_TABLE table = NULL;
+    PTP_WORK work = NULL;
+    PAGE_HASH_WORK pageWork;
+
+    *Table = NULL;
+
+    provider = HashpQueryProvider(AlgId, NULL);
+    if (provider == NULL || PageSize == 0)
+        return FALSE;
+
+    __try {
+        if (!HashpBuildPageJobs(HeapHandle, PageSize, ViewInformation, &jobs, &cJobs, &lastOffset))
+            return FALSE;
+    }
     __except (EXCEPTION_EXECUTE_HANDLER) {
+        StatsExceptionCaught();
         ViewInformation->LastError = IMAGE_VERIFY_EXCEPTION_IN_PROCESS;
         return FALSE;
     }
 
-    return NT_SUCCESS(ntStatus);
+    do {
+
+        cbTable = FIELD_OFFSET(PAGE_HASH_TABLE, Entries) +
+            ((SIZE_T)cJobs + 2) * (sizeof(ULONG) + provider->HashSize);
+
+        table = (PPAGE_HASH_TABLE)HeapAlloc(HeapHandle, HEAP_ZERO_MEMORY, cbTable);
+        if (table == NULL)
+            break;
+
+        table->HeapHandle = HeapHandle;
+        table->HashSize = provider->HashSize;
+        table->EntrySize = sizeof(ULONG) + provider->HashSize;
+        table->EntryCount = cJobs + 2;
+
+        //
+        // Header page.
+        //
+        if (ContextCache) {
+            if (!NT_SUCCESS(HashAcquireContext(ContextCache, AlgId, &hashContext)))
+                break;
+        }
+        else {
+            if (!NT_SUCCESS(CreateHashContext(HeapHandle, AlgId, &hashContext)))
+                break;
+        }
+
+        if (!CalculateFirstPageHash(PageSize, ViewInformation, hashContext))
+            break;
+
+        RtlCopyMemory(PAGE_HASH_TABLE_ENTRY(table, 0) + sizeof(ULONG),
+            hashContext->Hash,
+            hashContext->HashSize);
+
+        //
+        // Section pages, calling thread works too.
+        //
+        RtlSecureZeroMemory(&pageWork, sizeof(pageWork));
+        pageWork.ViewInformation = ViewInformation;
+        pageWork.Table = table;
+        pageWork.Jobs = jobs;
+        pageWork.JobCount = cJobs;
+        pageWork.PageSize = PageSize;
+        pageWork.AlgId = AlgId;
+
+        workerCount = (ThreadPool) ? ThreadPool->ThreadCount : 1;
+        if (workerCount > cJobs)
+            workerCount = cJobs;
+
+        if (workerCount > 1) {
+            work = CreateThreadpoolWork(HashpPageWorker, &pageWork, &ThreadPool->CallbackEnviron);
+            if (work) {
+                for (i = 1; i < workerCount; i++)
+                    SubmitThreadpoolWork(work);
+            }
+        }
+
+        if (cJobs)
+            HashpPageWorkerRoutine(&pageWork, hashContext);
+
+        if (work) {
+            WaitForThreadpoolWorkCallbacks(work, FALSE);
+            CloseThreadpoolWork(work);
+            work = NULL;
+        }
+
+        if (pageWork.ExceptionCaught)
+            ViewInformation->LastError = IMAGE_VERIFY_EXCEPTION_IN_PROCESS;
+
+        if (pageWork.Failed)
+            break;
+
+        //
+        // Terminating entry, hash is zero.
+        //
+        *(PULONG)PAGE_HASH_TABLE_ENTRY(table, cJobs + 1) = lastOffset;
+
+        bResult = TRUE;
+
+    } while (FALSE);
+
+    if (hashContext && ContextCache == NULL) DestroyHashContext(hashContext);
+    if (jobs && !ArenaContains(ViewInformation->Arena, jobs)) HeapFree(HeapHandle, 0, jobs);
+
+    if (bResult) {
+        *Table = table;
+    }
+    else {
+        if (table) HeapFree(HeapHandle, 0, table);
+    }
+
+    return bResult;
+}
+
+/*
+* FreePageHashTable
+*
+* Purpose:
+*
+* Release page hash table allocated by CalculatePageHashTable.
+*
+*/
+VOID FreePageHashTable(
+    _In_ PPAGE_HASH_TABLE Table
+)
+{
+    HeapFree(Table->HeapHandle, 0, Table);
 }
@@ -1,12 +1,12 @@
 /*******************************************************************************
 *
-*  (C) COPYRIGHT AUTHORS, 2021
+*  (C) COPYRIGHT AUTHORS, 2021 - 2026
 *
 *  TITLE:       HASH.H
 *
-*  VERSION:     1.03
+*  VERSION:     1.05
 *
-*  DATE:        26 Oct 2021
+*  DATE:        14 Oct 2026
 *
 *  Hash support routines header file.
 *
@@ -18,6 +18,20 @@
 *******************************************************************************/
 #pragma once
 
+typedef struct _HASH_PUSH HASH_PUSH, * PHASH_PUSH;
+typedef struct _HASH_THREAD_POOL HASH_THREAD_POOL, * PHASH_THREAD_POOL;
+
+//
+// Algorithm of flat whole file digest.
+//
+#define HASH_FILE_ALGORITHM BCRYPT_SHA256_ALGORITHM
+
+VOID HashDisableNativeBackend(
+    VOID);
+
+ULONG HashQueryNativeAlgorithm(
+    _In_ PCWSTR AlgId);
+
 NTSTATUS CreateHashContext(
     _In_ HANDLE HeapHandle,
     _In_ PCWSTR AlgId,
@@ -26,6 +40,37 @@ NTSTATUS CreateHashContext(
 VOID DestroyHashContext(
     _In_ PCNG_CTX Context);
 
+NTSTATUS HashResetContext(
+    _In_ PCNG_CTX Context);
+
+NTSTATUS HashCreateContextCache(
+    _In_ HANDLE HeapHandle,
+    _Out_ PHASH_CONTEXT_CACHE* Cache);
+
+VOID HashDestroyContextCache(
+    _In_ PHASH_CONTEXT_CACHE Cache);
+
+NTSTATUS HashCreateThreadPool(
+    _In_ HANDLE HeapHandle,
+    _In_ ULONG ThreadCount,
+    _Out_ PHASH_THREAD_POOL* ThreadPool);
+
+VOID HashDestroyThreadPool(
+    _In_ HANDLE HeapHandle,
+    _In_ PHASH_THREAD_POOL ThreadPool);
+
+NTSTATUS HashAcquireContext(
+    _In_ PHASH_CONTEXT_CACHE Cache,
+    _In_ PCWSTR AlgId,
+    _Out_ PCNG_CTX* Context);
+
+NTSTATUS HashAcquireFileContext(
+    _In_ PHASH_CONTEXT_CACHE Cache,
+    _Out_ PCNG_CTX* Context);
+
+VOID HashReleaseProviders(
+    VOID);
+
 BOOLEAN CalculateFirstPageHash(
     _In_ ULONG PageSize,
     _In_ PFILE_VIEW_INFO ViewInformation,
@@ -35,10 +80,74 @@ BOOLEAN CalculateAuthenticodeHash(
     _In_ PFILE_VIEW_INFO ViewInformation,
     _In_ PCNG_CTX HashContext);
 
+BOOLEAN CalculateAuthenticodeHashMulti(
+    _In_ PFILE_VIEW_INFO ViewInformation,
+    _In_reads_(Count) PCNG_CTX* HashContexts,
+    _In_ ULONG Count,
+    _In_opt_ PCNG_CTX FileHashContext);
+
+BOOLEAN CalculateAuthenticodeHashParallel(
+    _In_ PFILE_VIEW_INFO ViewInformation,
+    _In_reads_(Count) PCNG_CTX* HashContexts,
+    _In_ ULONG Count,
+    _In_opt_ PHASH_THREAD_POOL ThreadPool);
+
+NTSTATUS HashPushCreate(
+    _In_ HANDLE HeapHandle,
+    _In_opt_ LPCWSTR FileName,
+    _In_ ULONGLONG FileSize,
+    _In_reads_opt_(Count) PCNG_CTX* HashContexts,
+    _In_ ULONG Count,
+    _Out_ PHASH_PUSH* Push);
+
+NTSTATUS HashPushData(
+    _In_ PHASH_PUSH Push,
+    _In_reads_bytes_(Length) const VOID* Data,
+    _In_ SIZE_T Length);
+
+NTSTATUS HashPushFinish(
+    _In_ PHASH_PUSH Push);
+
+PFILE_VIEW_INFO HashPushQueryView(
+    _In_ PHASH_PUSH Push);
+
+VOID HashPushDestroy(
+    _In_ PHASH_PUSH Push);
+
+ULONG HashQueryMultiBufferAlgorithm(
+    _In_ PCWSTR AlgId);
+
+ULONG CalculateAuthenticodeHashBatch(
+    _In_reads_(Count) PFILE_VIEW_INFO* ViewInformation,
+    _In_ ULONG Count,
+    _In_ ULONG Algorithm,
+    _Out_writes_(Count) PUCHAR* Digests,
+    _Out_writes_(Count) PBOOLEAN Computed);
+
+BOOLEAN CalculatePageHashTable(
+    _In_ HANDLE HeapHandle,
+    _In_ ULONG PageSize,
+    _In_ PFILE_VIEW_INFO ViewInformation,
+    _In_ PCWSTR AlgId,
+    _In_opt_ PHASH_THREAD_POOL ThreadPool,
+    _In_opt_ PHASH_CONTEXT_CACHE ContextCache,
+    _Out_ PPAGE_HASH_TABLE* Table);
+
+VOID FreePageHashTable(
+    _In_ PPAGE_HASH_TABLE Table);
+
+NTSTATUS HashValidateFile(
+    _In_ PFILE_VIEW_INFO ViewInformation);
+
 NTSTATUS HashLoadFile(
     _In_ PFILE_VIEW_INFO ViewInformation,
     _In_ BOOLEAN PartialMap);
 
+NTSTATUS HashLoadBuffer(
+    _In_ PFILE_VIEW_INFO ViewInformation,
+    _In_reads_bytes_(Size) const VOID* Buffer,
+    _In_ SIZE_T Size);
+
 FORCEINLINE VOID HashUnloadFile(
     _In_ PFILE_VIEW_INFO ViewInformation
 )
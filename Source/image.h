@@ -0,0 +1,254 @@
+/*******************************************************************************
+*
+*  (C) COPYRIGHT AUTHORS, 2026
+*
+*  TITLE:       IMAGE.H
+*
+*  VERSION:     1.05
+*
+*  DATE:        14 Oct 2026
+*
+*  PE32/PE32+ header validation and hash layout templates.
+*
+*  Optional header flavor is dispatched on Magic once, everything after that
+*  works on the concrete IMAGE_NT_HEADERS32/IMAGE_NT_HEADERS64 type.
+*
+* THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+* ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED
+* TO THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*******************************************************************************/
+#pragma once
+
+//
+// Authenticode hashed data length is padded to multiple of this.
+//
+#define IMAGE_HASH_PAD_ALIGN 8
+
+template <typename T>
+struct IMAGE_NT_TRAITS;
+
+template <>
+struct IMAGE_NT_TRAITS<IMAGE_NT_HEADERS64> {
+    static constexpr WORD Magic = IMAGE_NT_OPTIONAL_HDR64_MAGIC;
+
+    static constexpr bool IsSupportedMachine(WORD Machine)
+    {
+        return Machine == IMAGE_FILE_MACHINE_IA64 ||
+            Machine == IMAGE_FILE_MACHINE_AMD64 ||
+            Machine == IMAGE_FILE_MACHINE_ARM64;
+    }
+};
+
+template <>
+struct IMAGE_NT_TRAITS<IMAGE_NT_HEADERS32> {
+    static constexpr WORD Magic = IMAGE_NT_OPTIONAL_HDR32_MAGIC;
+
+    static constexpr bool IsSupportedMachine(WORD Machine)
+    {
+        return Machine == IMAGE_FILE_MACHINE_I386 ||
+            Machine == IMAGE_FILE_MACHINE_ARMNT;
+    }
+};
+
+#pragma warning(push)
+#pragma warning(disable: 4319)
+
+/*
+* ImageValidateNtHeaders
+*
+* Purpose:
+*
+* Validate optional header and section layout of the image.
+*
+*/
+template <typename T>
+BOOLEAN ImageValidateNtHeaders(
+    _In_ const T* NtHeaders,
+    _Out_ PDWORD ErrorCode
+)
+{
+    ULONG i, fileAlignment, sectionAlignment;
+    ULONG64 lastSectionVA;
+    const IMAGE_SECTION_HEADER* pSection;
+
+    fileAlignment = NtHeaders->OptionalHeader.FileAlignment;
+    sectionAlignment = NtHeaders->OptionalHeader.SectionAlignment;
+
+    if (((fileAlignment & 511) != 0) && (fileAlignment != sectionAlignment)) {
+        *ErrorCode = IMAGE_VERIFY_BAD_FILE_ALIGNMENT;
+        return FALSE;
+    }
+
+    if (fileAlignment == 0) {
+        *ErrorCode = IMAGE_VERIFY_BAD_FILE_ALIGNMENT;
+        return FALSE;
+    }
+
+    if (((sectionAlignment - 1) & sectionAlignment) != 0) {
+        *ErrorCode = IMAGE_VERIFY_BAD_SECTION_ALIGNMENT;
+        return FALSE;
+    }
+
+    if (((fileAlignment - 1) & fileAlignment) != 0) {
+        *ErrorCode = IMAGE_VERIFY_BAD_FILE_ALIGNMENT;
+        return FALSE;
+    }
+
+    if (sectionAlignment < fileAlignment) {
+        *ErrorCode = IMAGE_VERIFY_BAD_SECTION_ALIGNMENT;
+        return FALSE;
+    }
+
+    if (NtHeaders->OptionalHeader.SizeOfImage > MM_SIZE_OF_LARGEST_IMAGE) {
+        *ErrorCode = IMAGE_VERIFY_BAD_SIZEOFIMAGE;
+        return FALSE;
+    }
+
+    if (NtHeaders->FileHeader.NumberOfSections > MM_MAXIMUM_IMAGE_SECTIONS) {
+        *ErrorCode = IMAGE_VERIFY_BAD_SECTION_COUNT;
+        return FALSE;
+    }
+
+    if (!IMAGE_NT_TRAITS<T>::IsSupportedMachine(NtHeaders->FileHeader.Machine)) {
+        *ErrorCode = IMAGE_VERIFY_BAD_FILE_HEADER_MACHINE;
+        return FALSE;
+    }
+
+    pSection = IMAGE_FIRST_SECTION(NtHeaders);
+
+    lastSectionVA = (ULONG64)pSection->VirtualAddress;
+
+    for (i = 0; i < NtHeaders->FileHeader.NumberOfSections; i++, pSection++) {
+
+        if (pSection->VirtualAddress != lastSectionVA) {
+            *ErrorCode = IMAGE_VERIFY_BAD_NTHEADERS;
+            return FALSE;
+        }
+
+        lastSectionVA += ALIGN_UP_BY(pSection->Misc.VirtualSize, sectionAlignment);
+    }
+
+    if (lastSectionVA != NtHeaders->OptionalHeader.SizeOfImage) {
+        *ErrorCode = IMAGE_VERIFY_BAD_NTHEADERS;
+        return FALSE;
+    }
+
+    *ErrorCode = IMAGE_VERIFY_OK;
+    return TRUE;
+}
+
+#pragma warning(pop)
+
+/*
+* ImageBuildHashLayout
+*
+* Purpose:
+*
+* Validate security directory and build list of authenticode hashed ranges:
+* data before CheckSum, between CheckSum and security directory entry, and
+* after the entry up to certificate table or end of file, plus trailing pad.
+*
+*/
+template <typename T>
+BOOLEAN ImageBuildHashLayout(
+    _In_ const T* NtHeaders,
+    _In_ ULONG NtOffset,
+    _In_ ULONGLONG FileSize,
+    _Out_ PIMAGE_HASH_LAYOUT Layout,
+    _Out_ PDWORD ErrorCode
+)
+{
+    ULONG checksumOffset, securityOffset, dataOffset, numberOfSections, cbTail;
+    ULONGLONG c, endOffset = FileSize;
+    const IMAGE_DATA_DIRECTORY* dataDirectory;
+    const IMAGE_SECTION_HEADER* sectionTable;
+
+    RtlSecureZeroMemory(Layout, sizeof(IMAGE_HASH_LAYOUT));
+
+    checksumOffset = NtOffset + UFIELD_OFFSET(T, OptionalHeader.CheckSum);
+    securityOffset = NtOffset +
+        UFIELD_OFFSET(T, OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_SECURITY]);
+    dataOffset = securityOffset + sizeof(IMAGE_DATA_DIRECTORY);
+
+    dataDirectory = &NtHeaders->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_SECURITY];
+
+    if (dataDirectory->VirtualAddress) {
+
+        numberOfSections = NtHeaders->FileHeader.NumberOfSections;
+        if (numberOfSections == 0) {
+            *ErrorCode = IMAGE_VERIFY_BAD_SECTION_COUNT;
+            return FALSE;
+        }
+
+        sectionTable = IMAGE_FIRST_SECTION(NtHeaders);
+
+        c = (ULONGLONG)sectionTable[numberOfSections - 1].PointerToRawData +
+            sectionTable[numberOfSections - 1].SizeOfRawData;
+
+        if (dataDirectory->VirtualAddress < c ||
+            dataDirectory->VirtualAddress < dataOffset ||
+            dataDirectory->VirtualAddress >= FileSize)
+        {
+            *ErrorCode = IMAGE_VERIFY_BAD_SECURITY_DIRECTORY_VA;
+            return FALSE;
+        }
+
+        c = FileSize - dataDirectory->VirtualAddress;
+        if (dataDirectory->Size > c) {
+            *ErrorCode = IMAGE_VERIFY_BAD_SECURITY_DIRECTORY_SIZE;
+            return FALSE;
+        }
+
+        endOffset = dataDirectory->VirtualAddress;
+    }
+    else if (FileSize < dataOffset) {
+        *ErrorCode = IMAGE_VERIFY_BAD_OPTIONAL_HEADER;
+        return FALSE;
+    }
+
+    Layout->SizeOfHeaders = NtHeaders->OptionalHeader.SizeOfHeaders;
+    Layout->ChecksumOffset = checksumOffset;
+    Layout->SecurityOffset = securityOffset;
+
+    Layout->Ranges[0].Offset = 0;
+    Layout->Ranges[0].Length = checksumOffset;
+
+    Layout->Ranges[1].Offset = checksumOffset + RTL_FIELD_SIZE(IMAGE_OPTIONAL_HEADER, CheckSum);
+    Layout->Ranges[1].Length = securityOffset - Layout->Ranges[1].Offset;
+
+    Layout->Ranges[2].Offset = dataOffset;
+    Layout->Ranges[2].Length = endOffset - dataOffset;
+
+    Layout->RangeCount = IMAGE_HASH_RANGES_MAX;
+
+    cbTail = (ULONG)(Layout->Ranges[2].Length % IMAGE_HASH_PAD_ALIGN);
+    Layout->PadSize = (cbTail) ? (IMAGE_HASH_PAD_ALIGN - cbTail) : 0;
+
+    *ErrorCode = IMAGE_VERIFY_OK;
+    return TRUE;
+}
+
+/*
+* ImageValidate
+*
+* Purpose:
+*
+* Validate headers of given flavor and build hash layout.
+*
+*/
+template <typename T>
+BOOLEAN ImageValidate(
+    _In_ const T* NtHeaders,
+    _In_ ULONG NtOffset,
+    _In_ ULONGLONG FileSize,
+    _Out_ PIMAGE_HASH_LAYOUT Layout,
+    _Out_ PDWORD ErrorCode
+)
+{
+    if (!ImageValidateNtHeaders(NtHeaders, ErrorCode))
+        return FALSE;
+
+    return ImageBuildHashLayout(NtHeaders, NtOffset, FileSize, Layout, ErrorCode);
+}
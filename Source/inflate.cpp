@@ -0,0 +1,555 @@
+/*******************************************************************************
+*
+*  (C) COPYRIGHT AUTHORS, 2026
+*
+*  TITLE:       INFLATE.CPP
+*
+*  VERSION:     1.05
+*
+*  DATE:        14 Oct 2026
+*
+*  Raw DEFLATE (RFC 1951) decoder.
+*
+*  Whole stream is decoded from memory into memory of known size, as ZIP
+*  members are. Huffman codes up to INFLATE_FAST_BITS long are resolved by
+*  table lookup, longer ones canonically bit by bit.
+*
+* THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+* ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED
+* TO THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*******************************************************************************/
+
+#include "global.h"
+
+#define INFLATE_MAX_BITS        15
+#define INFLATE_FAST_BITS       10
+#define INFLATE_FAST_SIZE       (1 << INFLATE_FAST_BITS)
+#define INFLATE_LITLEN_CODES    288
+#define INFLATE_DIST_CODES      30
+#define INFLATE_CODELEN_CODES   19
+
+//
+// Fast table entry is code length in upper bits and symbol in lower,
+// zero when code is longer than the table.
+//
+#define INFLATE_FAST_LENGTH_SHIFT 12
+#define INFLATE_FAST_SYMBOL_MASK  0x0FFF
+
+typedef struct _INFLATE_HUFFMAN {
+    USHORT Count[INFLATE_MAX_BITS + 1];
+    USHORT Symbol[INFLATE_LITLEN_CODES];
+    USHORT Fast[INFLATE_FAST_SIZE];
+} INFLATE_HUFFMAN, * PINFLATE_HUFFMAN;
+
+typedef struct _INFLATE_STATE {
+    const UCHAR* In;
+    const UCHAR* InEnd;
+    ULONGLONG BitBuffer;
+    ULONG BitCount;
+    PUCHAR Out;
+    SIZE_T OutSize;
+    SIZE_T OutPos;
+    INFLATE_HUFFMAN LitLen;
+    INFLATE_HUFFMAN Dist;
+} INFLATE_STATE, * PINFLATE_STATE;
+
+static const USHORT g_InflateLengthBase[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+
+static const UCHAR g_InflateLengthExtra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+
+static const USHORT g_InflateDistBase[INFLATE_DIST_CODES] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+    8193, 12289, 16385, 24577
+};
+
+static const UCHAR g_InflateDistExtra[INFLATE_DIST_CODES] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+static const UCHAR g_InflateCodeLengthOrder[INFLATE_CODELEN_CODES] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+};
+
+/*
+* InflatepRefill
+*
+* Purpose:
+*
+* Fill bit buffer from input as far as it goes.
+*
+*/
+FORCEINLINE VOID InflatepRefill(
+    _Inout_ PINFLATE_STATE State
+)
+{
+    while (State->BitCount <= 56 && State->In < State->InEnd) {
+        State->BitBuffer |= (ULONGLONG)*State->In++ << State->BitCount;
+        State->BitCount += 8;
+    }
+}
+
+/*
+* InflatepBits
+*
+* Purpose:
+*
+* Take Count (at most 16) bits from the stream, FALSE if input ended.
+*
+*/
+FORCEINLINE BOOLEAN InflatepBits(
+    _Inout_ PINFLATE_STATE State,
+    _In_ ULONG Count,
+    _Out_ PULONG Value
+)
+{
+    if (State->BitCount < Count) {
+        InflatepRefill(State);
+        if (State->BitCount < Count) {
+            *Value = 0;
+            return FALSE;
+        }
+    }
+
+    *Value = (ULONG)(State->BitBuffer & ((1ULL << Count) - 1));
+    State->BitBuffer >>= Count;
+    State->BitCount -= Count;
+    return TRUE;
+}
+
+/*
+* InflatepBuild
+*
+* Purpose:
+*
+* Build canonical decoding tables from code lengths. Over-subscribed
+* lengths are rejected, incomplete codes fail when unused code is met.
+*
+*/
+BOOLEAN InflatepBuild(
+    _Out_ PINFLATE_HUFFMAN Huffman,
+    _In_reads_(Count) const UCHAR* Lengths,
+    _In_ ULONG Count
+)
+{
+    LONG left = 1;
+    ULONG i, len, code, index, reversed, fill, symbol;
+    USHORT offsets[INFLATE_MAX_BITS + 1];
+
+    RtlSecureZeroMemory(Huffman, sizeof(INFLATE_HUFFMAN));
+
+    for (i = 0; i < Count; i++)
+        Huffman->Count[Lengths[i]] += 1;
+
+    if (Huffman->Count[0] == Count)
+        return TRUE;
+
+    for (len = 1; len <= INFLATE_MAX_BITS; len++) {
+        left <<= 1;
+        left -= Huffman->Count[len];
+        if (left < 0)
+            return FALSE;
+    }
+
+    offsets[1] = 0;
+    for (len = 1; len < INFLATE_MAX_BITS; len++)
+        offsets[len + 1] = offsets[len] + Huffman->Count[len];
+
+    for (i = 0; i < Count; i++) {
+        if (Lengths[i])
+            Huffman->Symbol[offsets[Lengths[i]]++] = (USHORT)i;
+    }
+
+    //
+    // Codes are assigned in symbol table order, stream carries them
+    // starting from the most significant bit.
+    //
+    code = 0;
+    index = 0;
+    for (len = 1; len <= INFLATE_FAST_BITS; len++) {
+
+        for (i = 0; i < Huffman->Count[len]; i++) {
+
+            symbol = Huffman->Symbol[index++];
+
+            reversed = 0;
+            for (fill = 0; fill < len; fill++)
+                reversed |= ((code >> fill) & 1) << (len - 1 - fill);
+
+            for (fill = reversed; fill < INFLATE_FAST_SIZE; fill += (1UL << len))
+                Huffman->Fast[fill] = (USHORT)((len << INFLATE_FAST_LENGTH_SHIFT) | symbol);
+
+            code += 1;
+        }
+
+        code <<= 1;
+    }
+
+    return TRUE;
+}
+
+/*
+* InflatepDecode
+*
+* Purpose:
+*
+* Decode one symbol.
+*
+*/
+BOOLEAN InflatepDecode(
+    _Inout_ PINFLATE_STATE State,
+    _In_ PINFLATE_HUFFMAN Huffman,
+    _Out_ PULONG Symbol
+)
+{
+    ULONG entry, len, count;
+    LONG code = 0, first = 0, index = 0;
+    ULONGLONG bits;
+
+    *Symbol = 0;
+
+    if (State->BitCount < INFLATE_MAX_BITS)
+        InflatepRefill(State);
+
+    entry = Huffman->Fast[State->BitBuffer & (INFLATE_FAST_SIZE - 1)];
+    if (entry) {
+
+        len = entry >> INFLATE_FAST_LENGTH_SHIFT;
+        if (len > State->BitCount)
+            return FALSE;
+
+        State->BitBuffer >>= len;
+        State->BitCount -= len;
+        *Symbol = entry & INFLATE_FAST_SYMBOL_MASK;
+        return TRUE;
+    }
+
+    bits = State->BitBuffer;
+
+    for (len = 1; len <= INFLATE_MAX_BITS && len <= State->BitCount; len++) {
+
+        code |= (LONG)(bits & 1);
+        bits >>= 1;
+
+        count = Huffman->Count[len];
+        if (code - (LONG)count < first) {
+            State->BitBuffer >>= len;
+            State->BitCount -= len;
+            *Symbol = Huffman->Symbol[index + (code - first)];
+            return TRUE;
+        }
+
+        index += count;
+        first += count;
+        first <<= 1;
+        code <<= 1;
+    }
+
+    return FALSE;
+}
+
+/*
+* InflatepStored
+*
+* Purpose:
+*
+* Copy stored block. Whole bytes already in bit buffer are given back to
+* input before block header is read.
+*
+*/
+BOOLEAN InflatepStored(
+    _Inout_ PINFLATE_STATE State
+)
+{
+    ULONG length, nlength;
+
+    State->In -= State->BitCount / 8;
+    State->BitBuffer = 0;
+    State->BitCount = 0;
+
+    if (State->InEnd - State->In < 4)
+        return FALSE;
+
+    length = (ULONG)State->In[0] | ((ULONG)State->In[1] << 8);
+    nlength = (ULONG)State->In[2] | ((ULONG)State->In[3] << 8);
+    State->In += 4;
+
+    if (length != (~nlength & 0xFFFF))
+        return FALSE;
+
+    if ((SIZE_T)(State->InEnd - State->In) < length ||
+        State->OutSize - State->OutPos < length)
+    {
+        return FALSE;
+    }
+
+    RtlCopyMemory(State->Out + State->OutPos, State->In, length);
+    State->OutPos += length;
+    State->In += length;
+
+    return TRUE;
+}
+
+/*
+* InflatepCodes
+*
+* Purpose:
+*
+* Decode compressed block with current literal/length and distance codes.
+*
+*/
+BOOLEAN InflatepCodes(
+    _Inout_ PINFLATE_STATE State
+)
+{
+    ULONG symbol, extra;
+    SIZE_T length, distance;
+    PUCHAR dst;
+    const UCHAR* src;
+
+    for (;;) {
+
+        if (!InflatepDecode(State, &State->LitLen, &symbol))
+            return FALSE;
+
+        if (symbol < 256) {
+            if (State->OutPos >= State->OutSize)
+                return FALSE;
+            State->Out[State->OutPos++] = (UCHAR)symbol;
+            continue;
+        }
+
+        if (symbol == 256)
+            return TRUE;
+
+        symbol -= 257;
+        if (symbol >= RTL_NUMBER_OF(g_InflateLengthBase))
+            return FALSE;
+
+        if (!InflatepBits(State, g_InflateLengthExtra[symbol], &extra))
+            return FALSE;
+
+        length = (SIZE_T)g_InflateLengthBase[symbol] + extra;
+
+        if (!InflatepDecode(State, &State->Dist, &symbol) ||
+            symbol >= INFLATE_DIST_CODES)
+        {
+            return FALSE;
+        }
+
+        if (!InflatepBits(State, g_InflateDistExtra[symbol], &extra))
+            return FALSE;
+
+        distance = (SIZE_T)g_InflateDistBase[symbol] + extra;
+
+        if (distance > State->OutPos || length > State->OutSize - State->OutPos)
+            return FALSE;
+
+        dst = State->Out + State->OutPos;
+        src = dst - distance;
+        State->OutPos += length;
+
+        //
+        // Overlapping copy repeats the last distance bytes.
+        //
+        if (distance >= length) {
+            RtlCopyMemory(dst, src, length);
+        }
+        else {
+            while (length--)
+                *dst++ = *src++;
+        }
+    }
+}
+
+/*
+* InflatepFixed
+*
+* Purpose:
+*
+* Decode block with fixed codes.
+*
+*/
+BOOLEAN InflatepFixed(
+    _Inout_ PINFLATE_STATE State
+)
+{
+    ULONG i;
+    UCHAR lengths[INFLATE_LITLEN_CODES];
+
+    for (i = 0; i < 144; i++) lengths[i] = 8;
+    for (; i < 256; i++) lengths[i] = 9;
+    for (; i < 280; i++) lengths[i] = 7;
+    for (; i < INFLATE_LITLEN_CODES; i++) lengths[i] = 8;
+
+    InflatepBuild(&State->LitLen, lengths, INFLATE_LITLEN_CODES);
+
+    for (i = 0; i < INFLATE_DIST_CODES; i++) lengths[i] = 5;
+
+    InflatepBuild(&State->Dist, lengths, INFLATE_DIST_CODES);
+
+    return InflatepCodes(State);
+}
+
+/*
+* InflatepDynamic
+*
+* Purpose:
+*
+* Read code lengths of dynamic block and decode it.
+*
+*/
+BOOLEAN InflatepDynamic(
+    _Inout_ PINFLATE_STATE State
+)
+{
+    ULONG i, index, symbol, repeat, value, cLitLen, cDist, cCodeLen;
+    UCHAR fill;
+    UCHAR lengths[INFLATE_LITLEN_CODES + INFLATE_DIST_CODES + 2];
+
+    if (!InflatepBits(State, 5, &cLitLen) ||
+        !InflatepBits(State, 5, &cDist) ||
+        !InflatepBits(State, 4, &cCodeLen))
+    {
+        return FALSE;
+    }
+
+    cLitLen += 257;
+    cDist += 1;
+    cCodeLen += 4;
+
+    if (cLitLen > 286 || cDist > INFLATE_DIST_CODES)
+        return FALSE;
+
+    RtlSecureZeroMemory(lengths, sizeof(lengths));
+
+    for (i = 0; i < cCodeLen; i++) {
+        if (!InflatepBits(State, 3, &value))
+            return FALSE;
+        lengths[g_InflateCodeLengthOrder[i]] = (UCHAR)value;
+    }
+
+    //
+    // Code length code is decoded through literal/length table.
+    //
+    if (!InflatepBuild(&State->LitLen, lengths, INFLATE_CODELEN_CODES))
+        return FALSE;
+
+    index = 0;
+    while (index < cLitLen + cDist) {
+
+        if (!InflatepDecode(State, &State->LitLen, &symbol))
+            return FALSE;
+
+        if (symbol < 16) {
+            lengths[index++] = (UCHAR)symbol;
+            continue;
+        }
+
+        if (symbol == 16) {
+            if (index == 0 || !InflatepBits(State, 2, &value))
+                return FALSE;
+            fill = lengths[index - 1];
+            repeat = 3 + value;
+        }
+        else if (symbol == 17) {
+            if (!InflatepBits(State, 3, &value))
+                return FALSE;
+            fill = 0;
+            repeat = 3 + value;
+        }
+        else {
+            if (!InflatepBits(State, 7, &value))
+                return FALSE;
+            fill = 0;
+            repeat = 11 + value;
+        }
+
+        if (index + repeat > cLitLen + cDist)
+            return FALSE;
+
+        while (repeat--)
+            lengths[index++] = fill;
+    }
+
+    if (lengths[256] == 0)
+        return FALSE;
+
+    if (!InflatepBuild(&State->LitLen, lengths, cLitLen) ||
+        !InflatepBuild(&State->Dist, lengths + cLitLen, cDist))
+    {
+        return FALSE;
+    }
+
+    return InflatepCodes(State);
+}
+
+/*
+* InflateBuffer
+*
+* Purpose:
+*
+* Decode raw DEFLATE stream. Output larger than OutputSize or malformed
+* stream fail with STATUS_DATA_ERROR.
+*
+*/
+NTSTATUS InflateBuffer(
+    _In_reads_bytes_(InputSize) const UCHAR* Input,
+    _In_ SIZE_T InputSize,
+    _Out_writes_bytes_to_(OutputSize, *Written) PUCHAR Output,
+    _In_ SIZE_T OutputSize,
+    _Out_ PSIZE_T Written
+)
+{
+    BOOLEAN bResult;
+    ULONG final, type;
+    PINFLATE_STATE state;
+
+    *Written = 0;
+
+    state = (PINFLATE_STATE)supHeapAlloc(sizeof(INFLATE_STATE));
+    if (state == NULL)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    state->In = Input;
+    state->InEnd = Input + InputSize;
+    state->Out = Output;
+    state->OutSize = OutputSize;
+
+    do {
+
+        bResult = InflatepBits(state, 1, &final) && InflatepBits(state, 2, &type);
+        if (!bResult)
+            break;
+
+        switch (type) {
+        case 0:
+            bResult = InflatepStored(state);
+            break;
+        case 1:
+            bResult = InflatepFixed(state);
+            break;
+        case 2:
+            bResult = InflatepDynamic(state);
+            break;
+        default:
+            bResult = FALSE;
+            break;
+        }
+
+    } while (bResult && !final);
+
+    *Written = state->OutPos;
+    supHeapFree(state);
+
+    return (bResult) ? STATUS_SUCCESS : STATUS_DATA_ERROR;
+}
@@ -0,0 +1,26 @@
+/*******************************************************************************
+*
+*  (C) COPYRIGHT AUTHORS, 2026
+*
+*  TITLE:       INFLATE.H
+*
+*  VERSION:     1.05
+*
+*  DATE:        14 Oct 2026
+*
+*  Raw DEFLATE decoder header file.
+*
+* THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+* ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED
+* TO THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*******************************************************************************/
+#pragma once
+
+NTSTATUS InflateBuffer(
+    _In_reads_bytes_(InputSize) const UCHAR* Input,
+    _In_ SIZE_T InputSize,
+    _Out_writes_bytes_to_(OutputSize, *Written) PUCHAR Output,
+    _In_ SIZE_T OutputSize,
+    _Out_ PSIZE_T Written);
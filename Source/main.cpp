@@ -1,12 +1,12 @@
 /*******************************************************************************
 *
-*  (C) COPYRIGHT AUTHORS, 2021 - 2024
+*  (C) COPYRIGHT AUTHORS, 2021 - 2026
 *
 *  TITLE:       MAIN.CPP
 *
-*  VERSION:     1.04
+*  VERSION:     1.05
 *
-*  DATE:        22 Feb 2024
+*  DATE:        14 Oct 2026
 *
 *  AuthHashCalc main logic and entrypoint.
 *
@@ -43,32 +43,234 @@ static DLG_HASH_CTRL g_UserHashControls[] = {
 
 #define PROGRAM_VERSION_MAJOR       1
 #define PROGRAM_VERSION_MINOR       0
-#define PROGRAM_VERSION_REVISION    4
-#define PROGRAM_VERSION_BUILD       2402
+#define PROGRAM_VERSION_REVISION    5
+#define PROGRAM_VERSION_BUILD       2610
+
+//
+// Background calculation of the dialog, worker posts these to the dialog.
+//
+#define GUI_MSG_FILE_START  (WM_APP + 1)    // lParam is file name, valid until GUI_MSG_DONE
+#define GUI_MSG_HASH        (WM_APP + 2)    // wParam is control index, lParam is heap text
+#define GUI_MSG_HASH_TEXT   (WM_APP + 3)    // wParam is control index, lParam is static text
+#define GUI_MSG_FILE_ERROR  (WM_APP + 4)    // lParam is heap text
+#define GUI_MSG_DONE        (WM_APP + 5)
+
+#define GUI_PROGRESS_TIMER_ID       1
+#define GUI_PROGRESS_TIMER_PERIOD   100
+#define GUI_PROGRESS_RANGE          1000
+
+//
+// Queue is shared with worker thread under Lock, Thread is owned by dialog thread.
+// SelectedMasks holds digest selection of every queued file, same index as Queue.
+//
+typedef struct _GUI_WORKER {
+    SRWLOCK Lock;
+    BATCH_FILE_LIST Queue;
+    ULONG Next;
+    PULONG SelectedMasks;
+    ULONG MasksCapacity;
+    HANDLE Thread;
+    HWND Dialog;
+    volatile LONG64 FileSize;
+    HASH_PROGRESS Progress;
+} GUI_WORKER, * PGUI_WORKER;
+
+static GUI_WORKER g_GuiWorker = { SRWLOCK_INIT };
 
 static HANDLE g_Heap;
+static PHASH_CONTEXT_CACHE g_HashCache;
 static HINSTANCE g_hInstance;
 static SYSTEM_INFO g_SystemInfo;
+static NUMA_TOPOLOGY g_Topology;
+
+static LPCWSTR g_AuthenticodeAlgorithms[] = {
+    BCRYPT_MD5_ALGORITHM,
+    BCRYPT_SHA1_ALGORITHM,
+    BCRYPT_SHA256_ALGORITHM,
+    BCRYPT_SHA384_ALGORITHM,
+    BCRYPT_SHA512_ALGORITHM
+};
+
+#define AUTHENTICODE_ALGORITHMS_COUNT RTL_NUMBER_OF(g_AuthenticodeAlgorithms)
+
+static LPCWSTR g_PageHashAlgorithms[] = {
+    BCRYPT_SHA1_ALGORITHM,
+    BCRYPT_SHA256_ALGORITHM
+};
+
+#define PAGE_HASH_ALGORITHMS_COUNT RTL_NUMBER_OF(g_PageHashAlgorithms)
+
+//
+// Digest in binary form, zero length if not computed.
+//
+#define HASH_DIGEST_MAX 64
+
+typedef struct _HASH_DIGEST {
+    UCHAR Length;
+    UCHAR Data[HASH_DIGEST_MAX];
+} HASH_DIGEST, * PHASH_DIGEST;
 
 #define T_EMPTY_STRING TEXT("")
 
+#define CLI_SWITCH_PARALLEL TEXT("-mt")
+#define CLI_SWITCH_RECURSIVE TEXT("-r")
+#define CLI_SWITCH_THREADS TEXT("-threads")
+#define CLI_SWITCH_PAGE_HASHES TEXT("-pagehashes")
+#define CLI_SWITCH_IO TEXT("-io")
+#define CLI_SWITCH_PAGE_ONLY TEXT("-pageonly")
+#define CLI_SWITCH_CACHE TEXT("-cache")
+#define CLI_SWITCH_CACHE_VERIFY TEXT("-cacheverify")
+#define CLI_SWITCH_INCREMENTAL TEXT("-usn")
+#define CLI_SWITCH_BENCH TEXT("-bench")
+#define CLI_SWITCH_PER_ALGORITHM TEXT("-peralg")
+#define CLI_SWITCH_STATS TEXT("-stats")
+#define CLI_SWITCH_FORMAT TEXT("-format")
+#define CLI_SWITCH_CNG TEXT("-cng")
+#define CLI_SWITCH_ARCHIVE TEXT("-archive")
+#define CLI_SWITCH_ALLOW TEXT("-allow")
+#define CLI_SWITCH_ALLOW_BUILD TEXT("-allowbuild")
+#define CLI_SWITCH_SERVE TEXT("-serve")
+#define CLI_SWITCH_FILE_HASH TEXT("-filehash")
+#define CLI_SWITCH_LARGE_PAGES TEXT("-largepages")
+
+#define CLI_IO_MAPPED TEXT("mapped")
+#define CLI_IO_UNBUFFERED TEXT("unbuffered")
+
+#define CLI_FORMAT_TEXT TEXT("text")
+#define CLI_FORMAT_JSONL TEXT("jsonl")
+#define CLI_FORMAT_CSV TEXT("csv")
+#define CLI_FORMAT_WDAC TEXT("wdac")
+
+#define CLI_MAX_THREADS 512
+
+//
+// Files per batch work item with multi-buffer hashing, two per SIMD lane.
+//
+#define CLI_BATCH_GROUP_SIZE (2 * SHA_MB_LANES)
+
+typedef struct _CLI_PARAMS {
+    LPCWSTR FileName;
+    LPCWSTR LogFileName;
+    LPCWSTR CacheFileName;
+    PHASH_STORE Store;
+    POUTPUT_WRITER Writer;
+    PPOLICY_WRITER Policy;
+    LPCWSTR AllowFileName;
+    PALLOW_LIST AllowList;
+    ULONG CacheVerifyPercent;
+    ULONG ThreadCount;
+    ULONG BenchIterations;
+    ULONG IoBackend;
+    ULONG OutputFormat;
+    BOOLEAN Parallel;
+    BOOLEAN Recursive;
+    BOOLEAN PageHashTable;
+    BOOLEAN FirstPageOnly;
+    BOOLEAN Incremental;
+    BOOLEAN PerAlgorithm;
+    BOOLEAN Stats;
+    BOOLEAN CngOnly;
+    BOOLEAN Archive;
+    BOOLEAN AllowBuild;
+    BOOLEAN Serve;
+    BOOLEAN FileHash;
+    BOOLEAN LargePages;
+} CLI_PARAMS, * PCLI_PARAMS;
+
+typedef struct _CLI_FILE_RESULT {
+    NTSTATUS Status;
+    DWORD LastError;
+    HASH_DIGEST AuthenticodeHashes[AUTHENTICODE_ALGORITHMS_COUNT];
+    HASH_DIGEST PageHashes[PAGE_HASH_ALGORITHMS_COUNT];
+    PPAGE_HASH_TABLE PageHashTables[PAGE_HASH_ALGORITHMS_COUNT];
+    HASH_DIGEST FileHash;
+    USHORT Subsystem;
+    BOOLEAN AuthenticodeRequested;
+    BOOLEAN FileHashRequested;
+    BOOLEAN PageHashTablesRequested;
+    BOOLEAN StoreMismatch;
+} CLI_FILE_RESULT, * PCLI_FILE_RESULT;
+
+//
+// Persistent store value, same digest layout as the result.
+// Subsystem is zero in entries written before it was stored.
+//
+typedef struct _CLI_STORE_VALUE {
+    HASH_DIGEST AuthenticodeHashes[AUTHENTICODE_ALGORITHMS_COUNT];
+    HASH_DIGEST PageHashes[PAGE_HASH_ALGORITHMS_COUNT];
+    USHORT Subsystem;
+} CLI_STORE_VALUE, * PCLI_STORE_VALUE;
+
+C_ASSERT(sizeof(CLI_STORE_VALUE) <= STORE_VALUE_SIZE);
+
+//
+// File state between load and store update steps of ComputeFileResultCLI.
+//
+typedef struct _CLI_FILE_JOB {
+    FILE_VIEW_INFO ViewInfo;
+    FILE_IDENTITY Identity;
+    CLI_FILE_RESULT StoredResult;
+    BOOLEAN UseStore;
+    BOOLEAN Verify;
+    BOOLEAN Loaded;
+} CLI_FILE_JOB, * PCLI_FILE_JOB;
+
+//
+// Batch worker data, scratch arena is reset after every file.
+// Bound workers keep thread affinity to restore on shutdown.
+//
+typedef struct _CLI_WORKER {
+    PHASH_CONTEXT_CACHE ContextCache;
+    ARENA Arena;
+    BOOLEAN Bound;
+    GROUP_AFFINITY PreviousAffinity;
+} CLI_WORKER, * PCLI_WORKER;
+
+//
+// Workers take sequential NextWorker indices to spread over NUMA nodes.
+//
+typedef struct _CLI_BATCH_CONTEXT {
+    FILE* OutStream;
+    PCLI_PARAMS Params;
+    ULONG FilesProcessed;
+    ULONG FilesFailed;
+    ULONG FilesRejected;
+    ULONG WorkerCount;
+    volatile LONG NextWorker;
+} CLI_BATCH_CONTEXT, * PCLI_BATCH_CONTEXT;
+
+
 VOID OnBrowseClick(
     _In_ HWND hwndDlg);
 
 VOID OnCalculateClick(
     _In_ HWND hwndDlg);
 
-LPWSTR ComputeHashForFile(
+/*
+* ComputeDigestForFile
+*
+* Purpose:
+*
+* Compute authenticode or first page hash of the file in binary form.
+*
+*/
+BOOLEAN ComputeDigestForFile(
+    _In_ PHASH_CONTEXT_CACHE ContextCache,
     _In_ PFILE_VIEW_INFO ViewInformation,
     _In_ LPCWSTR lpAlgId,
-    _In_ BOOLEAN FirstPageHashOnly
+    _In_ BOOLEAN FirstPageHashOnly,
+    _Out_ PHASH_DIGEST Digest
 )
 {
-    BOOLEAN bComputed;
+    BOOLEAN bComputed = FALSE;
     PCNG_CTX hashContext;
-    LPWSTR lpszHash = NULL;
+    ULONGLONG startTicks;
+
+    RtlSecureZeroMemory(Digest, sizeof(HASH_DIGEST));
 
-    if (NT_SUCCESS(CreateHashContext(g_Heap, lpAlgId, &hashContext))) {
+    if (NT_SUCCESS(HashAcquireContext(ContextCache, lpAlgId, &hashContext))) {
+
+        startTicks = StatsStageBegin();
 
         if (FirstPageHashOnly) {
 
@@ -86,19 +288,172 @@ LPWSTR ComputeHashForFile(
 
         }
 
+        StatsStageEnd(STATS_STAGE_HASH, startTicks);
 
-        if (bComputed) {
-            lpszHash = (LPWSTR)supPrintHash((PUCHAR)hashContext->Hash,
-                hashContext->HashSize,
-                TRUE);
+        if (bComputed && hashContext->HashSize <= HASH_DIGEST_MAX) {
+            RtlCopyMemory(Digest->Data, hashContext->Hash, hashContext->HashSize);
+            Digest->Length = (UCHAR)hashContext->HashSize;
+        }
+        else {
+            bComputed = FALSE;
         }
 
-        DestroyHashContext(hashContext);
+    }
+
+    return bComputed;
+}
+
+LPWSTR ComputeHashForFile(
+    _In_ PHASH_CONTEXT_CACHE ContextCache,
+    _In_ PFILE_VIEW_INFO ViewInformation,
+    _In_ LPCWSTR lpAlgId,
+    _In_ BOOLEAN FirstPageHashOnly
+)
+{
+    LPWSTR lpszHash = NULL;
+    ULONGLONG startTicks;
+    HASH_DIGEST digest;
+
+    if (ComputeDigestForFile(ContextCache,
+        ViewInformation,
+        lpAlgId,
+        FirstPageHashOnly,
+        &digest))
+    {
+        startTicks = StatsStageBegin();
+        lpszHash = (LPWSTR)supPrintHash(digest.Data, digest.Length, TRUE);
+        StatsStageEnd(STATS_STAGE_FORMAT, startTicks);
     }
 
     return lpszHash;
 }
 
+/*
+* ComputeAuthenticodeDigests
+*
+* Purpose:
+*
+* Compute authenticode digests for several algorithms in a single image pass.
+* With ThreadPool digests are spread among its threads.
+* With FileDigest the flat whole file digest is computed in the same pass,
+* single threaded. Digests that cannot be computed are left with zero length.
+*
+*/
+VOID ComputeAuthenticodeDigests(
+    _In_ PHASH_CONTEXT_CACHE ContextCache,
+    _In_ PFILE_VIEW_INFO ViewInformation,
+    _In_reads_(Count) LPCWSTR* AlgIds,
+    _In_ ULONG Count,
+    _In_opt_ PHASH_THREAD_POOL ThreadPool,
+    _Out_writes_(Count) PHASH_DIGEST Digests,
+    _Out_opt_ PHASH_DIGEST FileDigest
+)
+{
+    BOOLEAN bComputed;
+    ULONG i, cContexts = 0;
+    ULONGLONG startTicks;
+    PCNG_CTX fileContext = NULL;
+    PCNG_CTX hashContexts[AUTHENTICODE_ALGORITHMS_COUNT];
+    ULONG contextIndex[AUTHENTICODE_ALGORITHMS_COUNT];
+
+    if (FileDigest) {
+        RtlSecureZeroMemory(FileDigest, sizeof(HASH_DIGEST));
+        if (!NT_SUCCESS(HashAcquireFileContext(ContextCache, &fileContext)))
+            fileContext = NULL;
+    }
+
+    for (i = 0; i < Count; i++) {
+
+        RtlSecureZeroMemory(&Digests[i], sizeof(HASH_DIGEST));
+
+        if (cContexts < AUTHENTICODE_ALGORITHMS_COUNT &&
+            NT_SUCCESS(HashAcquireContext(ContextCache, AlgIds[i], &hashContexts[cContexts])))
+        {
+            contextIndex[cContexts++] = i;
+        }
+    }
+
+    if (cContexts == 0 && fileContext == NULL)
+        return;
+
+    startTicks = StatsStageBegin();
+
+    if (ThreadPool && fileContext == NULL) {
+        bComputed = CalculateAuthenticodeHashParallel(ViewInformation,
+            hashContexts,
+            cContexts,
+            ThreadPool);
+    }
+    else {
+        bComputed = CalculateAuthenticodeHashMulti(ViewInformation,
+            hashContexts,
+            cContexts,
+            fileContext);
+    }
+
+    StatsStageEnd(STATS_STAGE_HASH, startTicks);
+
+    if (bComputed) {
+        for (i = 0; i < cContexts; i++) {
+            if (hashContexts[i]->HashSize <= HASH_DIGEST_MAX) {
+                RtlCopyMemory(Digests[contextIndex[i]].Data,
+                    hashContexts[i]->Hash,
+                    hashContexts[i]->HashSize);
+                Digests[contextIndex[i]].Length = (UCHAR)hashContexts[i]->HashSize;
+            }
+        }
+
+        if (fileContext && fileContext->HashSize <= HASH_DIGEST_MAX) {
+            RtlCopyMemory(FileDigest->Data, fileContext->Hash, fileContext->HashSize);
+            FileDigest->Length = (UCHAR)fileContext->HashSize;
+        }
+    }
+}
+
+/*
+* ComputeAuthenticodeHashes
+*
+* Purpose:
+*
+* Compute authenticode hashes for several algorithms in a single image pass.
+* With ThreadPool digests are spread among its threads.
+* Every non NULL entry of Hashes must be freed with supHeapFree.
+*
+*/
+VOID ComputeAuthenticodeHashes(
+    _In_ PHASH_CONTEXT_CACHE ContextCache,
+    _In_ PFILE_VIEW_INFO ViewInformation,
+    _In_reads_(Count) LPCWSTR* AlgIds,
+    _In_ ULONG Count,
+    _In_opt_ PHASH_THREAD_POOL ThreadPool,
+    _Out_writes_(Count) LPWSTR* Hashes
+)
+{
+    ULONG i;
+    ULONGLONG startTicks;
+    HASH_DIGEST digests[AUTHENTICODE_ALGORITHMS_COUNT];
+
+    if (Count > AUTHENTICODE_ALGORITHMS_COUNT)
+        Count = AUTHENTICODE_ALGORITHMS_COUNT;
+
+    ComputeAuthenticodeDigests(ContextCache,
+        ViewInformation,
+        AlgIds,
+        Count,
+        ThreadPool,
+        digests,
+        NULL);
+
+    startTicks = StatsStageBegin();
+
+    for (i = 0; i < Count; i++) {
+        Hashes[i] = (digests[i].Length) ?
+            supPrintHash(digests[i].Data, digests[i].Length, TRUE) : NULL;
+    }
+
+    StatsStageEnd(STATS_STAGE_FORMAT, startTicks);
+}
+
 VOID ResetUserHashControls()
 {
     for (UINT i = 0; i < UserHashControlsCount; i++)
@@ -123,247 +478,525 @@ VOID OnBrowseClick(
     }
 }
 
-VOID ProcessFile(
+/*
+* GuiPostText
+*
+* Purpose:
+*
+* Pass heap allocated text to the dialog, text is released if message cannot be posted.
+*
+*/
+VOID GuiPostText(
     _In_ HWND hwndDlg,
-    _In_ LPCWSTR lpFileName
+    _In_ UINT uMsg,
+    _In_ WPARAM wParam,
+    _In_ LPWSTR lpText
+)
+{
+    if (!PostMessage(hwndDlg, uMsg, wParam, (LPARAM)lpText))
+        supHeapFree(lpText);
+}
+
+/*
+* GuiProcessFile
+*
+* Purpose:
+*
+* Compute selected digests of the file on worker thread.
+* Every digest is posted to the dialog as soon as it is ready.
+*
+*/
+VOID GuiProcessFile(
+    _In_ PGUI_WORKER Worker,
+    _In_ LPCWSTR lpFileName,
+    _In_ ULONG SelectedMask
 )
 {
     NTSTATUS ntStatus;
-    LPWSTR lpszHash;
+    ULONG cSelected = 0;
+    SIZE_T sz;
+    LPWSTR lpszHash, lpMsg;
     LPCWSTR lpError;
-    LPCWSTR cryptAlgoIdRef[] = {
-        BCRYPT_MD5_ALGORITHM,
-        BCRYPT_SHA1_ALGORITHM,
-        BCRYPT_SHA256_ALGORITHM,
-        BCRYPT_SHA384_ALGORITHM,
-        BCRYPT_SHA512_ALGORITHM
-    };
+    LPCWSTR selectedAlgIds[AUTHENTICODE_ALGORITHMS_COUNT];
+    LPWSTR selectedHashes[AUTHENTICODE_ALGORITHMS_COUNT];
+    UINT selectedControls[AUTHENTICODE_ALGORITHMS_COUNT];
+    FILE_VIEW_INFO fvi;
 
-    WCHAR szTextMsg[100];
+    PostMessage(Worker->Dialog, GUI_MSG_FILE_START, 0, (LPARAM)lpFileName);
 
-    FILE_VIEW_INFO fvi;
+    for (UINT i = 0; i < UserHashControlPageHashSha1; i++) {
+        if (SelectedMask & (1 << i)) {
+            selectedAlgIds[cSelected] = g_AuthenticodeAlgorithms[i];
+            selectedControls[cSelected] = i;
+            cSelected += 1;
+        }
+    }
 
-    ResetUserHashControls();
+    RtlSecureZeroMemory(&fvi, sizeof(fvi));
+
+    fvi.FileName = lpFileName;
+    fvi.Progress = &Worker->Progress;
 
     //
-    // Disable controls.
+    // Page hashes only need headers.
     //
-    __try {
-        EnableWindow(GetDlgItem(hwndDlg, IDC_BROWSE), FALSE);
-        EnableWindow(GetDlgItem(hwndDlg, IDOK), FALSE);
+    ntStatus = HashLoadFile(&fvi, (cSelected == 0));
+
+    if (!NT_SUCCESS(ntStatus)) {
 
-        RtlSecureZeroMemory(&fvi, sizeof(fvi));
+        if (ntStatus == STATUS_INVALID_IMAGE_FORMAT) {
+            lpError = supImageVerifyErrorToString(fvi.LastError);
+            sz = (100 + wcslen(lpError)) * sizeof(WCHAR);
+            lpMsg = (LPWSTR)supHeapAlloc(sz);
+            if (lpMsg)
+                StringCbPrintf(lpMsg, sz, TEXT("Error while processing file\n%ws"), lpError);
+        }
+        else {
+            sz = 100 * sizeof(WCHAR);
+            lpMsg = (LPWSTR)supHeapAlloc(sz);
+            if (lpMsg)
+                StringCbPrintf(lpMsg, sz, TEXT("Failed to load input file, HashLoadFile: 0x%X"), ntStatus);
+        }
 
-        fvi.FileName = lpFileName;
+        if (lpMsg)
+            GuiPostText(Worker->Dialog, GUI_MSG_FILE_ERROR, 0, lpMsg);
 
-        ntStatus = HashLoadFile(&fvi, FALSE);
+        return;
+    }
 
-        if (NT_SUCCESS(ntStatus)) {
+    InterlockedExchange64(&Worker->FileSize, fvi.FileSize.QuadPart);
 
-            for (UINT i = 0; i < UserHashControlPageHashSha1; i++) {
-                if (Button_GetCheck(g_UserHashControls[i].CheckBoxControl)) {
-                    lpszHash = ComputeHashForFile(&fvi, cryptAlgoIdRef[i], FALSE);
-                    if (lpszHash) {
-                        SetWindowText(g_UserHashControls[i].EditControl, lpszHash);
-                        supHeapFree(lpszHash);
-                    }
-                    else {
-                        SetWindowText(g_UserHashControls[i].EditControl, T_EMPTY_STRING);
-                    }
-                }
-            }
+    //
+    // Authenticode hashes, all selected algorithms in one pass.
+    //
+    if (cSelected) {
 
+        ComputeAuthenticodeHashes(g_HashCache, &fvi, selectedAlgIds, cSelected, NULL, selectedHashes);
 
-            //
-            // Page hashes (WDAC compliant, header only hash).
-            //
+        for (ULONG i = 0; i < cSelected; i++) {
+            lpszHash = selectedHashes[i];
+            if (lpszHash)
+                GuiPostText(Worker->Dialog, GUI_MSG_HASH, selectedControls[i], lpszHash);
+        }
 
-            if (Button_GetCheck(g_UserHashControls[UserHashControlPageHashSha1].CheckBoxControl)) {
+    }
 
-                lpszHash = ComputeHashForFile(&fvi, BCRYPT_SHA1_ALGORITHM, TRUE);
-                if (lpszHash) {
+    //
+    // Page hashes (WDAC compliant, header only hash).
+    //
+    for (UINT i = UserHashControlPageHashSha1; i <= UserHashControlPageHashSha256; i++) {
 
-                    SetWindowText(g_UserHashControls[UserHashControlPageHashSha1].EditControl,
-                        lpszHash);
+        if (Worker->Progress.Cancel)
+            break;
 
-                    supHeapFree(lpszHash);
-                }
-                else {
-                    SetWindowText(g_UserHashControls[UserHashControlPageHashSha1].EditControl,
-                        supImageVerifyErrorToString(fvi.LastError));
-                }
+        if ((SelectedMask & (1 << i)) == 0)
+            continue;
 
-            }
+        lpszHash = ComputeHashForFile(g_HashCache,
+            &fvi,
+            g_PageHashAlgorithms[i - UserHashControlPageHashSha1],
+            TRUE);
 
-            if (Button_GetCheck(g_UserHashControls[UserHashControlPageHashSha256].CheckBoxControl)) {
+        if (lpszHash) {
+            GuiPostText(Worker->Dialog, GUI_MSG_HASH, i, lpszHash);
+        }
+        else {
+            PostMessage(Worker->Dialog, GUI_MSG_HASH_TEXT, i,
+                (LPARAM)supImageVerifyErrorToString(fvi.LastError));
+        }
+    }
 
-                lpszHash = ComputeHashForFile(&fvi, BCRYPT_SHA256_ALGORITHM, TRUE);
-                if (lpszHash) {
+    HashUnloadFile(&fvi);
+}
 
-                    SetWindowText(g_UserHashControls[UserHashControlPageHashSha256].EditControl,
-                        lpszHash);
+/*
+* GuiWorkerThread
+*
+* Purpose:
+*
+* Background calculation thread, processes queued files until queue is empty.
+*
+*/
+DWORD WINAPI GuiWorkerThread(
+    _In_ PVOID Parameter
+)
+{
+    PGUI_WORKER worker = (PGUI_WORKER)Parameter;
+    LPCWSTR lpFileName;
+    ULONG selectedMask = 0;
 
-                    supHeapFree(lpszHash);
-                }
-                else {
-                    SetWindowText(g_UserHashControls[UserHashControlPageHashSha256].EditControl,
-                        supImageVerifyErrorToString(fvi.LastError));
-                }
+    for (;;) {
 
-            }
+        lpFileName = NULL;
 
-            HashUnloadFile(&fvi);
+        AcquireSRWLockExclusive(&worker->Lock);
+        if (worker->Next < worker->Queue.Count) {
+            selectedMask = worker->SelectedMasks[worker->Next];
+            lpFileName = worker->Queue.Items[worker->Next++];
+            worker->Progress.Cancel = FALSE;
+            worker->Progress.BytesHashed = 0;
+            worker->FileSize = 0;
         }
-        else {
-            if (ntStatus == STATUS_INVALID_IMAGE_FORMAT) {
+        ReleaseSRWLockExclusive(&worker->Lock);
 
-                LPWSTR lpMsg;
-                SIZE_T sz;
+        if (lpFileName == NULL)
+            break;
 
-                lpError = supImageVerifyErrorToString(fvi.LastError);
+        GuiProcessFile(worker, lpFileName, selectedMask);
+    }
 
-                sz = (100 + wcslen(lpError)) * sizeof(WCHAR);
-                lpMsg = (LPWSTR)supHeapAlloc(sz);
-                if (lpMsg) {
-                    StringCbPrintf(lpMsg, sz, TEXT("Error while processing file\n%ws"), lpError);
-                    MessageBox(hwndDlg, lpMsg, NULL, MB_ICONERROR);
-                    supHeapFree(lpMsg);
-                }
-            }
-            else {
-                StringCchPrintf(szTextMsg,
-                    _countof(szTextMsg),
-                    TEXT("Failed to load input file, HashLoadFile: 0x%X"), ntStatus);
-                MessageBox(hwndDlg, szTextMsg, NULL, MB_ICONERROR);
-            }
-        }
+    PostMessage(worker->Dialog, GUI_MSG_DONE, 0, 0);
+    return 0;
+}
 
-    }
-    __finally {
+/*
+* GuiSetBusy
+*
+* Purpose:
+*
+* Switch dialog controls between idle and calculation state.
+*
+*/
+VOID GuiSetBusy(
+    _In_ HWND hwndDlg,
+    _In_ BOOLEAN Busy
+)
+{
+    EnableWindow(GetDlgItem(hwndDlg, IDC_BROWSE), !Busy);
+    EnableWindow(GetDlgItem(hwndDlg, IDOK), !Busy);
+    EnableWindow(GetDlgItem(hwndDlg, IDC_BUTTON_CANCEL), Busy);
 
-        //
-        // Re-enable controls.
-        //
-        EnableWindow(GetDlgItem(hwndDlg, IDC_BROWSE), TRUE);
-        EnableWindow(GetDlgItem(hwndDlg, IDOK), TRUE);
+    SendDlgItemMessage(hwndDlg, IDC_PROGRESS, PBM_SETPOS, 0, 0);
+
+    if (Busy)
+        SetTimer(hwndDlg, GUI_PROGRESS_TIMER_ID, GUI_PROGRESS_TIMER_PERIOD, NULL);
+    else
+        KillTimer(hwndDlg, GUI_PROGRESS_TIMER_ID);
+}
+
+/*
+* GuiFreeQueue
+*
+* Purpose:
+*
+* Release queued files and their selections, caller holds the lock.
+*
+*/
+VOID GuiFreeQueue(
+    VOID
+)
+{
+    BatchFreeFileList(&g_GuiWorker.Queue);
+    g_GuiWorker.Next = 0;
+
+    if (g_GuiWorker.SelectedMasks) {
+        supHeapFree(g_GuiWorker.SelectedMasks);
+        g_GuiWorker.SelectedMasks = NULL;
     }
+    g_GuiWorker.MasksCapacity = 0;
 }
 
-VOID OnCalculateClick(
+/*
+* GuiStartWorker
+*
+* Purpose:
+*
+* Start worker thread for queued files, queue is dropped on failure.
+*
+*/
+BOOLEAN GuiStartWorker(
     _In_ HWND hwndDlg
 )
 {
-    WCHAR szFileName[MAX_PATH + 1];
+    g_GuiWorker.Dialog = hwndDlg;
+    g_GuiWorker.Thread = CreateThread(NULL, 0, GuiWorkerThread, &g_GuiWorker, 0, NULL);
 
-    RtlSecureZeroMemory(szFileName, sizeof(szFileName));
-    if (!GetDlgItemText(hwndDlg, IDC_EDIT_FILE, szFileName, RTL_NUMBER_OF(szFileName))) {
-        OnBrowseClick(hwndDlg);
-        return;
+    if (g_GuiWorker.Thread == NULL) {
+
+        AcquireSRWLockExclusive(&g_GuiWorker.Lock);
+        GuiFreeQueue();
+        ReleaseSRWLockExclusive(&g_GuiWorker.Lock);
+
+        MessageBox(hwndDlg, TEXT("Failed to start calculation thread"), NULL, MB_ICONERROR);
+        return FALSE;
     }
 
-    ProcessFile(hwndDlg, szFileName);
+    GuiSetBusy(hwndDlg, TRUE);
+    return TRUE;
 }
 
 /*
-* OnDragAndDrop
+* GuiQueueFile
 *
 * Purpose:
 *
-* WM_DROPFILES handler
+* Add file to calculation queue, start worker if it is not running.
+* Digest selection is taken at the moment file is queued.
 *
 */
-VOID OnDragAndDrop(
+VOID GuiQueueFile(
     _In_ HWND hwndDlg,
-    _In_ HDROP fDrop
+    _In_ LPCWSTR lpFileName
 )
 {
-    WCHAR szFileName[MAX_PATH + 1];
-    WCHAR szTargetName[MAX_PATH + 1];
-    WCHAR* pszExt;
-
-    RtlSecureZeroMemory(szFileName, sizeof(szFileName));
-    if (DragQueryFile(fDrop, 0, szFileName, MAX_PATH)) {
+    BOOLEAN bStart;
+    ULONG selectedMask = 0, newCapacity;
+    PULONG newMasks;
 
-        pszExt = supGetFileExt(szFileName);
-        if (pszExt) {
+    for (UINT i = 0; i < UserHashControlsCount; i++) {
+        if (Button_GetCheck(g_UserHashControls[i].CheckBoxControl))
+            selectedMask |= (1 << i);
+    }
 
-            if (_wcsicmp(pszExt, TEXT(".lnk")) == 0) {
+    AcquireSRWLockExclusive(&g_GuiWorker.Lock);
 
-                szTargetName[0] = 0;
-                if (supDragAndDropResolveTarget(hwndDlg,
-                    szFileName,
-                    szTargetName,
-                    MAX_PATH))
-                {
-                    SetDlgItemText(hwndDlg, IDC_EDIT_FILE, szTargetName);
-                    ProcessFile(hwndDlg, szTargetName);
-                    goto DoFinish;
-                }
+    //
+    // Selection array is grown ahead, file is queued only with its selection.
+    //
+    if (g_GuiWorker.Queue.Count == g_GuiWorker.MasksCapacity) {
+
+        newCapacity = (g_GuiWorker.MasksCapacity) ? g_GuiWorker.MasksCapacity * 2 : 16;
+        newMasks = (PULONG)supHeapAlloc(newCapacity * sizeof(ULONG));
+        if (newMasks) {
+            if (g_GuiWorker.SelectedMasks) {
+                RtlCopyMemory(newMasks, g_GuiWorker.SelectedMasks,
+                    g_GuiWorker.Queue.Count * sizeof(ULONG));
+                supHeapFree(g_GuiWorker.SelectedMasks);
             }
+            g_GuiWorker.SelectedMasks = newMasks;
+            g_GuiWorker.MasksCapacity = newCapacity;
         }
+    }
 
-        SetDlgItemText(hwndDlg, IDC_EDIT_FILE, szFileName);
-        ProcessFile(hwndDlg, szFileName);
+    if (g_GuiWorker.Queue.Count < g_GuiWorker.MasksCapacity &&
+        BatchAddFile(&g_GuiWorker.Queue, lpFileName))
+    {
+        g_GuiWorker.SelectedMasks[g_GuiWorker.Queue.Count - 1] = selectedMask;
     }
 
-DoFinish:
-    DragFinish(fDrop);
+    bStart = (g_GuiWorker.Thread == NULL && g_GuiWorker.Next < g_GuiWorker.Queue.Count);
+    ReleaseSRWLockExclusive(&g_GuiWorker.Lock);
+
+    if (bStart)
+        GuiStartWorker(hwndDlg);
 }
 
 /*
-* OnCopyHashText
+* GuiCancel
 *
 * Purpose:
 *
-* WM_COMMAND -> IDC_BUTTON_COPY_* shared handler
+* Drop queued files and stop current file between chunks.
 *
 */
-VOID OnCopyHashText(
-    _In_ UINT uidControl
+VOID GuiCancel(
+    VOID
 )
 {
-    for (UINT i = 0; i < UserHashControlsCount; i++) {
-        if (g_UserHashControls[i].CopyControlId == uidControl) {
-
-            INT cch = GetWindowTextLength(g_UserHashControls[i].EditControl);
+    AcquireSRWLockExclusive(&g_GuiWorker.Lock);
+    g_GuiWorker.Next = g_GuiWorker.Queue.Count;
+    g_GuiWorker.Progress.Cancel = TRUE;
+    ReleaseSRWLockExclusive(&g_GuiWorker.Lock);
+}
 
-            if (cch) {
+/*
+* GuiWaitWorker
+*
+* Purpose:
+*
+* Wait for worker thread exit. Returns TRUE if queue got new files meanwhile,
+* otherwise queue is released.
+*
+*/
+BOOLEAN GuiWaitWorker(
+    VOID
+)
+{
+    BOOLEAN bPending;
 
-                LPWSTR lpText = (LPWSTR)supHeapAlloc((1 + (SIZE_T)cch) * sizeof(WCHAR));
-                if (lpText) {
-                    if (GetWindowText(g_UserHashControls[i].EditControl, lpText, 1 + cch))
-                    {
-                        supClipboardCopy(lpText, (cch * sizeof(WCHAR)));
-                    }
-                    supHeapFree(lpText);
-                }
+    if (g_GuiWorker.Thread) {
+        WaitForSingleObject(g_GuiWorker.Thread, INFINITE);
+        CloseHandle(g_GuiWorker.Thread);
+        g_GuiWorker.Thread = NULL;
+    }
 
-            }
+    AcquireSRWLockExclusive(&g_GuiWorker.Lock);
+    bPending = (g_GuiWorker.Next < g_GuiWorker.Queue.Count);
+    if (!bPending)
+        GuiFreeQueue();
+    ReleaseSRWLockExclusive(&g_GuiWorker.Lock);
 
-            break;
-        }
-    }
+    return bPending;
 }
 
 /*
-* OnInitDialog
+* OnWorkerDone
 *
 * Purpose:
 *
-* WM_INITDIALOG handler
+* GUI_MSG_DONE handler
 *
 */
-VOID OnInitDialog(
+VOID OnWorkerDone(
     _In_ HWND hwndDlg
 )
 {
-    SendMessage(GetDlgItem(hwndDlg, IDC_EDIT_FILE), EM_SETLIMITTEXT, MAX_PATH, 0);
-    DragAcceptFiles(hwndDlg, TRUE);
-    SetFocus(GetDlgItem(hwndDlg, IDOK));
+    //
+    // Files dropped after worker saw empty queue need a new worker.
+    //
+    if (GuiWaitWorker() && GuiStartWorker(hwndDlg))
+        return;
 
-    for (UINT i = 0; i < UserHashControlsCount; i++) {
+    GuiSetBusy(hwndDlg, FALSE);
+}
 
-        g_UserHashControls[i].EditControl =
+/*
+* OnProgressTimer
+*
+* Purpose:
+*
+* WM_TIMER handler, show bytes hashed of the current file.
+*
+*/
+VOID OnProgressTimer(
+    _In_ HWND hwndDlg
+)
+{
+    LONG64 fileSize, bytesHashed;
+    ULONG position = 0;
+
+    fileSize = g_GuiWorker.FileSize;
+    bytesHashed = g_GuiWorker.Progress.BytesHashed;
+
+    if (fileSize > 0) {
+        if (bytesHashed >= fileSize)
+            position = GUI_PROGRESS_RANGE;
+        else
+            position = (ULONG)((bytesHashed * GUI_PROGRESS_RANGE) / fileSize);
+    }
+
+    SendDlgItemMessage(hwndDlg, IDC_PROGRESS, PBM_SETPOS, position, 0);
+}
+
+VOID OnCalculateClick(
+    _In_ HWND hwndDlg
+)
+{
+    WCHAR szFileName[MAX_PATH + 1];
+
+    RtlSecureZeroMemory(szFileName, sizeof(szFileName));
+    if (!GetDlgItemText(hwndDlg, IDC_EDIT_FILE, szFileName, RTL_NUMBER_OF(szFileName))) {
+        OnBrowseClick(hwndDlg);
+        return;
+    }
+
+    GuiQueueFile(hwndDlg, szFileName);
+}
+
+/*
+* OnDragAndDrop
+*
+* Purpose:
+*
+* WM_DROPFILES handler, every dropped file is queued.
+*
+*/
+VOID OnDragAndDrop(
+    _In_ HWND hwndDlg,
+    _In_ HDROP fDrop
+)
+{
+    UINT i, cFiles;
+    LPCWSTR lpFileName;
+    WCHAR szFileName[MAX_PATH + 1];
+    WCHAR szTargetName[MAX_PATH + 1];
+    WCHAR* pszExt;
+
+    cFiles = DragQueryFile(fDrop, 0xFFFFFFFF, NULL, 0);
+
+    for (i = 0; i < cFiles; i++) {
+
+        RtlSecureZeroMemory(szFileName, sizeof(szFileName));
+        if (!DragQueryFile(fDrop, i, szFileName, MAX_PATH))
+            continue;
+
+        lpFileName = szFileName;
+
+        pszExt = supGetFileExt(szFileName);
+        if (pszExt && _wcsicmp(pszExt, TEXT(".lnk")) == 0) {
+
+            szTargetName[0] = 0;
+            if (supDragAndDropResolveTarget(hwndDlg,
+                szFileName,
+                szTargetName,
+                MAX_PATH))
+            {
+                lpFileName = szTargetName;
+            }
+        }
+
+        GuiQueueFile(hwndDlg, lpFileName);
+    }
+
+    DragFinish(fDrop);
+}
+
+/*
+* OnCopyHashText
+*
+* Purpose:
+*
+* WM_COMMAND -> IDC_BUTTON_COPY_* shared handler
+*
+*/
+VOID OnCopyHashText(
+    _In_ UINT uidControl
+)
+{
+    for (UINT i = 0; i < UserHashControlsCount; i++) {
+        if (g_UserHashControls[i].CopyControlId == uidControl) {
+
+            INT cch = GetWindowTextLength(g_UserHashControls[i].EditControl);
+
+            if (cch) {
+
+                LPWSTR lpText = (LPWSTR)supHeapAlloc((1 + (SIZE_T)cch) * sizeof(WCHAR));
+                if (lpText) {
+                    if (GetWindowText(g_UserHashControls[i].EditControl, lpText, 1 + cch))
+                    {
+                        supClipboardCopy(lpText, (cch * sizeof(WCHAR)));
+                    }
+                    supHeapFree(lpText);
+                }
+
+            }
+
+            break;
+        }
+    }
+}
+
+/*
+* OnInitDialog
+*
+* Purpose:
+*
+* WM_INITDIALOG handler
+*
+*/
+VOID OnInitDialog(
+    _In_ HWND hwndDlg
+)
+{
+    SendMessage(GetDlgItem(hwndDlg, IDC_EDIT_FILE), EM_SETLIMITTEXT, MAX_PATH, 0);
+    SendDlgItemMessage(hwndDlg, IDC_PROGRESS, PBM_SETRANGE32, 0, GUI_PROGRESS_RANGE);
+    EnableWindow(GetDlgItem(hwndDlg, IDC_BUTTON_CANCEL), FALSE);
+    DragAcceptFiles(hwndDlg, TRUE);
+    SetFocus(GetDlgItem(hwndDlg, IDOK));
+
+    for (UINT i = 0; i < UserHashControlsCount; i++) {
+
+        g_UserHashControls[i].EditControl =
             GetDlgItem(hwndDlg, g_UserHashControls[i].EditControlId);
 
         g_UserHashControls[i].CheckBoxControl =
@@ -386,228 +1019,2173 @@ VOID OnInitDialog(
 }
 
 /*
-* OnShowWindow
+* OnShowWindow
+*
+* Purpose:
+*
+* WM_SHOWWINDOW handler
+*
+*/
+VOID OnShowWindow(
+    _In_ HWND hwndDlg
+)
+{
+    SetFocus(GetDlgItem(hwndDlg, IDOK));
+}
+
+INT_PTR CALLBACK MainWindowProc(
+    _In_ HWND hwndDlg,
+    _In_ UINT uMsg,
+    _In_ WPARAM wParam,
+    _In_ LPARAM lParam
+)
+{
+    switch (uMsg) {
+
+    case WM_INITDIALOG:
+
+        OnInitDialog(hwndDlg);
+        break;
+
+    case WM_SHOWWINDOW:
+        if (wParam)
+            OnShowWindow(hwndDlg);
+        break;
+
+    case WM_COMMAND:
+
+        switch (GET_WM_COMMAND_ID(wParam, lParam)) {
+
+        case IDOK:
+            OnCalculateClick(hwndDlg);
+            break;
+
+        case IDCANCEL:
+            SendMessage(hwndDlg, WM_CLOSE, 0, 0);
+            break;
+
+        case IDC_BROWSE:
+            OnBrowseClick(hwndDlg);
+            break;
+
+        case IDC_BUTTON_CANCEL:
+            GuiCancel();
+            break;
+
+        case IDC_BUTTON_COPY_MD5:
+        case IDC_BUTTON_COPY_SHA1:
+        case IDC_BUTTON_COPY_SHA256:
+        case IDC_BUTTON_COPY_SHA384:
+        case IDC_BUTTON_COPY_SHA512:
+        case IDC_BUTTON_COPY_PHSHA1:
+        case IDC_BUTTON_COPY_PHSHA256:
+            OnCopyHashText(LOWORD(wParam));
+            break;
+
+        default:
+            break;
+        }
+        break;
+
+    case WM_DROPFILES:
+        OnDragAndDrop(hwndDlg, (HDROP)wParam);
+        break;
+
+    case WM_TIMER:
+        if (wParam == GUI_PROGRESS_TIMER_ID)
+            OnProgressTimer(hwndDlg);
+        break;
+
+    case GUI_MSG_FILE_START:
+        ResetUserHashControls();
+        SetDlgItemText(hwndDlg, IDC_EDIT_FILE, (LPCWSTR)lParam);
+        SendDlgItemMessage(hwndDlg, IDC_PROGRESS, PBM_SETPOS, 0, 0);
+        break;
+
+    case GUI_MSG_HASH:
+        SetWindowText(g_UserHashControls[wParam].EditControl, (LPCWSTR)lParam);
+        supHeapFree((PVOID)lParam);
+        break;
+
+    case GUI_MSG_HASH_TEXT:
+        SetWindowText(g_UserHashControls[wParam].EditControl, (LPCWSTR)lParam);
+        break;
+
+    case GUI_MSG_FILE_ERROR:
+        MessageBox(hwndDlg, (LPCWSTR)lParam, NULL, MB_ICONERROR);
+        supHeapFree((PVOID)lParam);
+        break;
+
+    case GUI_MSG_DONE:
+        OnWorkerDone(hwndDlg);
+        break;
+
+    case WM_CLOSE:
+        if (g_GuiWorker.Thread) {
+            GuiCancel();
+            GuiWaitWorker();
+        }
+        PostQuitMessage(0);
+        break;
+
+    default:
+        return FALSE;
+
+    }
+
+    return TRUE;
+}
+
+/*
+* RunGUI
+*
+* Purpose:
+*
+* GUI version launch handler.
+*
+*/
+UINT RunGUI(
+    _In_ HINSTANCE hInstance
+)
+{
+    BOOL rv;
+    UINT uResult = ERROR_SUCCESS;
+    INITCOMMONCONTROLSEX ccex;
+    MSG msg;
+    HWND hwndDlg;
+
+    ccex.dwSize = sizeof(INITCOMMONCONTROLSEX);
+    ccex.dwICC = ICC_STANDARD_CLASSES | ICC_PROGRESS_CLASS;
+
+    if (!InitCommonControlsEx(&ccex)) {
+        return GetLastError();
+    }
+
+    hwndDlg = CreateDialogParam(hInstance,
+        MAKEINTRESOURCE(IDD_MAINDLG),
+        NULL,
+        MainWindowProc,
+        0);
+
+    if (hwndDlg) {
+
+        do {
+            rv = GetMessage(&msg, NULL, 0, 0);
+
+            if (rv == -1)
+                break;
+
+            if (!IsDialogMessage(hwndDlg, &msg)) {
+                TranslateMessage(&msg);
+                DispatchMessage(&msg);
+            }
+
+        } while (rv != 0);
+
+    }
+    else {
+        uResult = GetLastError();
+    }
+
+    return uResult;
+}
+
+/*
+* UnpackStoreValueCLI
+*
+* Purpose:
+*
+* Fill result from store value, fails if any requested digest is absent.
+*
+*/
+BOOLEAN UnpackStoreValueCLI(
+    _In_ PCLI_STORE_VALUE Value,
+    _In_ PCLI_PARAMS Params,
+    _Inout_ PCLI_FILE_RESULT Result
+)
+{
+    PHASH_DIGEST digest;
+
+    if (!Params->FirstPageOnly) {
+
+        for (UINT i = 0; i < AUTHENTICODE_ALGORITHMS_COUNT; i++) {
+            digest = &Value->AuthenticodeHashes[i];
+            if (digest->Length == 0 || digest->Length > HASH_DIGEST_MAX)
+                return FALSE;
+        }
+
+        RtlCopyMemory(Result->AuthenticodeHashes,
+            Value->AuthenticodeHashes,
+            sizeof(Result->AuthenticodeHashes));
+
+        Result->AuthenticodeRequested = TRUE;
+    }
+
+    for (UINT i = 0; i < PAGE_HASH_ALGORITHMS_COUNT; i++) {
+        digest = &Value->PageHashes[i];
+        if (digest->Length == 0 || digest->Length > HASH_DIGEST_MAX)
+            return FALSE;
+    }
+
+    RtlCopyMemory(Result->PageHashes,
+        Value->PageHashes,
+        sizeof(Result->PageHashes));
+
+    Result->Subsystem = Value->Subsystem;
+
+    return TRUE;
+}
+
+/*
+* PackStoreValueCLI
+*
+* Purpose:
+*
+* Build store value from result, only complete results are stored.
+*
+*/
+BOOLEAN PackStoreValueCLI(
+    _In_ PCLI_FILE_RESULT Result,
+    _Out_writes_bytes_(STORE_VALUE_SIZE) PUCHAR Value
+)
+{
+    PCLI_STORE_VALUE storeValue = (PCLI_STORE_VALUE)Value;
+
+    RtlSecureZeroMemory(Value, STORE_VALUE_SIZE);
+
+    if (!Result->AuthenticodeRequested)
+        return FALSE;
+
+    for (UINT i = 0; i < AUTHENTICODE_ALGORITHMS_COUNT; i++) {
+        if (Result->AuthenticodeHashes[i].Length == 0)
+            return FALSE;
+    }
+
+    for (UINT i = 0; i < PAGE_HASH_ALGORITHMS_COUNT; i++) {
+        if (Result->PageHashes[i].Length == 0)
+            return FALSE;
+    }
+
+    RtlCopyMemory(storeValue->AuthenticodeHashes,
+        Result->AuthenticodeHashes,
+        sizeof(storeValue->AuthenticodeHashes));
+
+    RtlCopyMemory(storeValue->PageHashes,
+        Result->PageHashes,
+        sizeof(storeValue->PageHashes));
+
+    storeValue->Subsystem = Result->Subsystem;
+
+    return TRUE;
+}
+
+/*
+* CompareDigestCLI
+*
+* Purpose:
+*
+* Return TRUE if stored digest is absent or equal to computed one.
+*
+*/
+BOOLEAN CompareDigestCLI(
+    _In_ PHASH_DIGEST Stored,
+    _In_ PHASH_DIGEST Computed
+)
+{
+    if (Stored->Length == 0)
+        return TRUE;
+
+    return (Stored->Length == Computed->Length &&
+        RtlEqualMemory(Stored->Data, Computed->Data, Stored->Length));
+}
+
+/*
+* CompareFileResultsCLI
+*
+* Purpose:
+*
+* Return TRUE if every digest of stored result matches computed one.
+*
+*/
+BOOLEAN CompareFileResultsCLI(
+    _In_ PCLI_FILE_RESULT Stored,
+    _In_ PCLI_FILE_RESULT Computed
+)
+{
+    for (UINT i = 0; i < AUTHENTICODE_ALGORITHMS_COUNT; i++) {
+        if (!CompareDigestCLI(&Stored->AuthenticodeHashes[i], &Computed->AuthenticodeHashes[i]))
+            return FALSE;
+    }
+
+    for (UINT i = 0; i < PAGE_HASH_ALGORITHMS_COUNT; i++) {
+        if (!CompareDigestCLI(&Stored->PageHashes[i], &Computed->PageHashes[i]))
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+/*
+* BeginFileResultCLI
+*
+* Purpose:
+*
+* Open and load file for ComputeFileResultCLI.
+* With persistent store, unchanged files are looked up right after open
+* and neither mapped nor hashed unless selected for verification.
+* Returns FALSE when Result is already final, otherwise caller hashes
+* loaded file and completes the job with EndFileResultCLI.
+* Per-file scratch is taken from the optional worker arena.
+*
+*/
+BOOLEAN BeginFileResultCLI(
+    _In_ LPCWSTR lpFileName,
+    _In_ PCLI_PARAMS Params,
+    _In_opt_ PARENA Arena,
+    _Out_ PCLI_FILE_JOB Job,
+    _Out_ PCLI_FILE_RESULT Result
+)
+{
+    UCHAR storeValue[STORE_VALUE_SIZE];
+
+    RtlSecureZeroMemory(Result, sizeof(CLI_FILE_RESULT));
+    RtlSecureZeroMemory(Job, sizeof(CLI_FILE_JOB));
+
+    Job->ViewInfo.FileName = lpFileName;
+    Job->ViewInfo.IoBackend = Params->IoBackend;
+    Job->ViewInfo.Arena = Arena;
+
+    //
+    // Page hash table and file hash are not stored, they always need the file.
+    //
+    Job->UseStore = (Params->Store != NULL && !Params->PageHashTable && !Params->FileHash);
+
+    if (Job->UseStore) {
+
+        Result->Status = supOpenInputFile(&Job->ViewInfo);
+        if (!NT_SUCCESS(Result->Status)) {
+            Result->LastError = Job->ViewInfo.LastError;
+            return FALSE;
+        }
+
+        Job->UseStore = supQueryFileIdentity(&Job->ViewInfo, &Job->Identity);
+
+        if (Job->UseStore &&
+            StoreLookup(Params->Store, &Job->Identity, storeValue) &&
+            UnpackStoreValueCLI((PCLI_STORE_VALUE)storeValue, Params, &Job->StoredResult))
+        {
+            if (!StoreShouldVerify(Params->Store)) {
+                supDestroyFileViewInfo(&Job->ViewInfo);
+                *Result = Job->StoredResult;
+                Result->Status = STATUS_SUCCESS;
+                Result->LastError = IMAGE_VERIFY_OK;
+                return FALSE;
+            }
+
+            Job->Verify = TRUE;
+        }
+    }
+
+    //
+    // First page hash alone is computed from headers view.
+    //
+    Result->Status = HashLoadFile(&Job->ViewInfo,
+        (Params->FirstPageOnly && !Params->PageHashTable));
+
+    Job->Loaded = NT_SUCCESS(Result->Status);
+    return TRUE;
+}
+
+/*
+* HashFileResultCLI
+*
+* Purpose:
+*
+* Compute all CLI digests of the loaded file.
+* Authenticode digests with bit set in DoneMask are already in Result.
+*
+*/
+VOID HashFileResultCLI(
+    _In_ PHASH_CONTEXT_CACHE ContextCache,
+    _In_ PCLI_FILE_JOB Job,
+    _In_ PCLI_PARAMS Params,
+    _In_opt_ PHASH_THREAD_POOL ThreadPool,
+    _In_ ULONG DoneMask,
+    _Inout_ PCLI_FILE_RESULT Result
+)
+{
+    ULONG i, cAlgs = 0;
+    ULONGLONG startTicks;
+    LPCWSTR algIds[AUTHENTICODE_ALGORITHMS_COUNT];
+    ULONG algIndex[AUTHENTICODE_ALGORITHMS_COUNT];
+    HASH_DIGEST digests[AUTHENTICODE_ALGORITHMS_COUNT];
+
+    //
+    // Field has the same offset in PE32 and PE32+ optional headers,
+    // headers are validated by load.
+    //
+    if (Job->ViewInfo.NtHeaders)
+        Result->Subsystem = Job->ViewInfo.NtHeaders->OptionalHeader.Subsystem;
+
+    if (!Params->FirstPageOnly) {
+
+        Result->AuthenticodeRequested = TRUE;
+
+        for (i = 0; i < AUTHENTICODE_ALGORITHMS_COUNT; i++) {
+            if ((DoneMask & (1 << i)) == 0) {
+                algIndex[cAlgs] = i;
+                algIds[cAlgs++] = g_AuthenticodeAlgorithms[i];
+            }
+        }
+
+        Result->FileHashRequested = Params->FileHash;
+
+        if (cAlgs || Params->FileHash) {
+            ComputeAuthenticodeDigests(ContextCache,
+                &Job->ViewInfo,
+                algIds,
+                cAlgs,
+                (Params->Parallel) ? ThreadPool : NULL,
+                digests,
+                (Params->FileHash) ? &Result->FileHash : NULL);
+
+            for (i = 0; i < cAlgs; i++)
+                Result->AuthenticodeHashes[algIndex[i]] = digests[i];
+        }
+    }
+
+    for (i = 0; i < PAGE_HASH_ALGORITHMS_COUNT; i++) {
+        ComputeDigestForFile(ContextCache,
+            &Job->ViewInfo,
+            g_PageHashAlgorithms[i],
+            TRUE,
+            &Result->PageHashes[i]);
+    }
+
+    if (Params->PageHashTable) {
+        Result->PageHashTablesRequested = TRUE;
+        startTicks = StatsStageBegin();
+        for (i = 0; i < PAGE_HASH_ALGORITHMS_COUNT; i++) {
+            CalculatePageHashTable(g_Heap,
+                g_SystemInfo.dwPageSize,
+                &Job->ViewInfo,
+                g_PageHashAlgorithms[i],
+                ThreadPool,
+                ContextCache,
+                &Result->PageHashTables[i]);
+        }
+        StatsStageEnd(STATS_STAGE_HASH, startTicks);
+    }
+}
+
+/*
+* EndFileResultCLI
+*
+* Purpose:
+*
+* Unload file, verify against store entry and update the store.
+*
+*/
+VOID EndFileResultCLI(
+    _In_ PCLI_FILE_JOB Job,
+    _In_ PCLI_PARAMS Params,
+    _Inout_ PCLI_FILE_RESULT Result
+)
+{
+    UCHAR storeValue[STORE_VALUE_SIZE];
+
+    if (Job->Loaded) {
+        HashUnloadFile(&Job->ViewInfo);
+        Job->Loaded = FALSE;
+    }
+
+    Result->LastError = Job->ViewInfo.LastError;
+
+    if (Job->Verify) {
+        InterlockedIncrement(&Params->Store->Statistics.Verified);
+        if (!CompareFileResultsCLI(&Job->StoredResult, Result)) {
+            InterlockedIncrement(&Params->Store->Statistics.Mismatched);
+            Result->StoreMismatch = TRUE;
+        }
+    }
+
+    if (Job->UseStore &&
+        NT_SUCCESS(Result->Status) &&
+        (!Job->Verify || Result->StoreMismatch) &&
+        PackStoreValueCLI(Result, storeValue))
+    {
+        StoreInsert(Params->Store, &Job->Identity, storeValue);
+    }
+}
+
+/*
+* ComputeFileResultCLI
+*
+* Purpose:
+*
+* Load file and compute all CLI digests.
+* ThreadPool is shared by the run, NULL keeps the file single threaded.
+* Result must be released by OutputFileResultCLI.
+*
+*/
+VOID ComputeFileResultCLI(
+    _In_ PHASH_CONTEXT_CACHE ContextCache,
+    _In_opt_ PARENA Arena,
+    _In_ LPCWSTR lpFileName,
+    _In_ PCLI_PARAMS Params,
+    _In_opt_ PHASH_THREAD_POOL ThreadPool,
+    _Out_ PCLI_FILE_RESULT Result
+)
+{
+    CLI_FILE_JOB job;
+
+    if (!BeginFileResultCLI(lpFileName, Params, Arena, &job, Result))
+        return;
+
+    if (job.Loaded)
+        HashFileResultCLI(ContextCache, &job, Params, ThreadPool, 0, Result);
+
+    EndFileResultCLI(&job, Params, Result);
+}
+
+/*
+* ComputeBufferResultCLI
+*
+* Purpose:
+*
+* Compute all CLI digests of the image in memory, single threaded.
+* Result must be released by OutputFileResultCLI.
+*
+*/
+VOID ComputeBufferResultCLI(
+    _In_ PHASH_CONTEXT_CACHE ContextCache,
+    _In_opt_ PARENA Arena,
+    _In_ LPCWSTR lpName,
+    _In_reads_bytes_(Size) const VOID* Data,
+    _In_ SIZE_T Size,
+    _In_ PCLI_PARAMS Params,
+    _Out_ PCLI_FILE_RESULT Result
+)
+{
+    CLI_FILE_JOB job;
+
+    RtlSecureZeroMemory(Result, sizeof(CLI_FILE_RESULT));
+    RtlSecureZeroMemory(&job, sizeof(job));
+
+    job.ViewInfo.FileName = lpName;
+    job.ViewInfo.Arena = Arena;
+
+    Result->Status = HashLoadBuffer(&job.ViewInfo, Data, Size);
+    job.Loaded = NT_SUCCESS(Result->Status);
+
+    if (job.Loaded)
+        HashFileResultCLI(ContextCache, &job, Params, NULL, 0, Result);
+
+    EndFileResultCLI(&job, Params, Result);
+}
+
+/*
+* ReleaseFileResultCLI
+*
+* Purpose:
+*
+* Free page hash tables of the result.
+*
+*/
+VOID ReleaseFileResultCLI(
+    _In_ PCLI_FILE_RESULT Result
+)
+{
+    for (UINT i = 0; i < PAGE_HASH_ALGORITHMS_COUNT; i++) {
+        if (Result->PageHashTables[i]) {
+            FreePageHashTable(Result->PageHashTables[i]);
+            Result->PageHashTables[i] = NULL;
+        }
+    }
+}
+
+/*
+* OutputTextHashCLI
+*
+* Purpose:
+*
+* Write single digest line of text output.
+*
+*/
+VOID OutputTextHashCLI(
+    _In_ FILE* lpOutStream,
+    _In_ LPCWSTR lpAlgId,
+    _In_ PHASH_DIGEST Digest,
+    _In_ LPCSTR lpEmptyName
+)
+{
+    WCHAR szHash[HASH_DIGEST_MAX * 2 + 1];
+
+    if (Digest->Length &&
+        supHexEncodeW(Digest->Data, Digest->Length, TRUE, szHash, RTL_NUMBER_OF(szHash)))
+    {
+        fprintf_s(lpOutStream, "%ws:\t%ws\n", lpAlgId, szHash);
+    }
+    else {
+        fprintf_s(lpOutStream, "Error: empty %s %ws value\n", lpEmptyName, lpAlgId);
+    }
+}
+
+/*
+* OutputTextResultCLI
+*
+* Purpose:
+*
+* Write file digests as human readable text.
+*
+*/
+VOID OutputTextResultCLI(
+    _In_ FILE* lpOutStream,
+    _In_ LPCWSTR lpFileName,
+    _In_ PCLI_FILE_RESULT Result,
+    _In_ BOOLEAN Batch
+)
+{
+    PPAGE_HASH_TABLE pageTable;
+    PUCHAR pageEntry;
+    WCHAR szHash[HASH_DIGEST_MAX * 2 + 1];
+
+    if (NT_SUCCESS(Result->Status)) {
+
+        //
+        // Authenticode
+        //
+
+        fprintf_s(lpOutStream, "File: %ws\n", lpFileName);
+
+        if (Result->StoreMismatch)
+            fprintf_s(lpOutStream, "Warning: cached result does not match file data, cache updated\n");
+
+        if (Result->AuthenticodeRequested) {
+            fprintf_s(lpOutStream, "\nAuthenticode hashes:\n");
+
+            for (UINT i = 0; i < AUTHENTICODE_ALGORITHMS_COUNT; i++) {
+                OutputTextHashCLI(lpOutStream,
+                    g_AuthenticodeAlgorithms[i],
+                    &Result->AuthenticodeHashes[i],
+                    "hash");
+            }
+        }
+
+        if (Result->FileHashRequested) {
+            fprintf_s(lpOutStream, "\nFile hash:\n");
+            OutputTextHashCLI(lpOutStream, HASH_FILE_ALGORITHM, &Result->FileHash, "file hash");
+        }
+
+        //
+        // Page hash
+        //
+
+        fprintf_s(lpOutStream, "\nFirst page hash:\n");
+
+        for (UINT i = 0; i < PAGE_HASH_ALGORITHMS_COUNT; i++) {
+            OutputTextHashCLI(lpOutStream,
+                g_PageHashAlgorithms[i],
+                &Result->PageHashes[i],
+                "page hash");
+        }
+
+        //
+        // Page hash table, only when requested.
+        //
+
+        for (UINT i = 0; i < PAGE_HASH_ALGORITHMS_COUNT; i++) {
+
+            pageTable = Result->PageHashTables[i];
+            if (pageTable == NULL) {
+                if (Result->PageHashTablesRequested)
+                    fprintf_s(lpOutStream, "\nError: empty page hash table %ws value\n", g_PageHashAlgorithms[i]);
+                continue;
+            }
+
+            fprintf_s(lpOutStream, "\nPage hash table %ws:\n", g_PageHashAlgorithms[i]);
+
+            for (ULONG j = 0; j < pageTable->EntryCount; j++) {
+                pageEntry = PAGE_HASH_TABLE_ENTRY(pageTable, j);
+                if (supHexEncodeW(pageEntry + sizeof(ULONG),
+                    pageTable->HashSize,
+                    TRUE,
+                    szHash,
+                    RTL_NUMBER_OF(szHash)))
+                {
+                    fprintf_s(lpOutStream, "%08X:\t%ws\n", *(PULONG)pageEntry, szHash);
+                }
+            }
+        }
+
+    }
+    else {
+        if (Batch)
+            fprintf_s(lpOutStream, "File: %ws\n", lpFileName);
+
+        if (Result->Status == STATUS_INVALID_IMAGE_FORMAT)
+            fprintf_s(lpOutStream, "Error: %ws\n",
+                supImageVerifyErrorToString(Result->LastError));
+        else {
+            fprintf_s(lpOutStream, "Error: failed to load input file, HashLoadFile: 0x%X\n", Result->Status);
+        }
+    }
+
+    if (Batch)
+        fprintf_s(lpOutStream, "\n");
+}
+
+/*
+* OutputJsonDigestsCLI
+*
+* Purpose:
+*
+* Write JSON object of digests keyed by algorithm, absent digests are null.
+*
+*/
+VOID OutputJsonDigestsCLI(
+    _In_ POUTPUT_WRITER Writer,
+    _In_ LPCSTR lpName,
+    _In_reads_(Count) LPCWSTR* AlgIds,
+    _In_reads_(Count) PHASH_DIGEST Digests,
+    _In_ ULONG Count
+)
+{
+    OutputWriteString(Writer, ",\"");
+    OutputWriteString(Writer, lpName);
+    OutputWriteString(Writer, "\":{");
+
+    for (ULONG i = 0; i < Count; i++) {
+
+        if (i)
+            OutputWrite(Writer, ",", 1);
+
+        OutputWriteJsonString(Writer, AlgIds[i]);
+
+        if (Digests[i].Length) {
+            OutputWrite(Writer, ":\"", 2);
+            OutputWriteHex(Writer, Digests[i].Data, Digests[i].Length);
+            OutputWrite(Writer, "\"", 1);
+        }
+        else {
+            OutputWriteString(Writer, ":null");
+        }
+    }
+
+    OutputWrite(Writer, "}", 1);
+}
+
+/*
+* OutputJsonResultCLI
+*
+* Purpose:
+*
+* Write file digests as single JSON Lines record.
+*
+*/
+VOID OutputJsonResultCLI(
+    _In_ POUTPUT_WRITER Writer,
+    _In_ LPCWSTR lpFileName,
+    _In_ PCLI_FILE_RESULT Result
+)
+{
+    LPCWSTR lpAlgId;
+    PPAGE_HASH_TABLE pageTable;
+    PUCHAR pageEntry;
+
+    OutputWriteString(Writer, "{\"file\":");
+    OutputWriteJsonString(Writer, lpFileName);
+
+    if (!NT_SUCCESS(Result->Status)) {
+
+        OutputWriteString(Writer, ",\"status\":\"error\",\"error\":");
+
+        if (Result->Status == STATUS_INVALID_IMAGE_FORMAT)
+            OutputWriteJsonString(Writer, supImageVerifyErrorToString(Result->LastError));
+        else
+            OutputWriteString(Writer, "\"failed to load input file\"");
+
+        OutputWriteString(Writer, ",\"ntstatus\":\"0x");
+        OutputWriteUlongHex(Writer, (ULONG)Result->Status);
+        OutputWriteString(Writer, "\"}\n");
+        return;
+    }
+
+    OutputWriteString(Writer, ",\"status\":\"ok\"");
+
+    if (Result->StoreMismatch)
+        OutputWriteString(Writer, ",\"cacheMismatch\":true");
+
+    if (Result->AuthenticodeRequested) {
+        OutputJsonDigestsCLI(Writer,
+            "authenticode",
+            g_AuthenticodeAlgorithms,
+            Result->AuthenticodeHashes,
+            AUTHENTICODE_ALGORITHMS_COUNT);
+    }
+
+    if (Result->FileHashRequested) {
+        lpAlgId = HASH_FILE_ALGORITHM;
+        OutputJsonDigestsCLI(Writer, "fileHash", &lpAlgId, &Result->FileHash, 1);
+    }
+
+    OutputJsonDigestsCLI(Writer,
+        "firstPageHash",
+        g_PageHashAlgorithms,
+        Result->PageHashes,
+        PAGE_HASH_ALGORITHMS_COUNT);
+
+    if (Result->PageHashTablesRequested) {
+
+        OutputWriteString(Writer, ",\"pageHashTable\":{");
+
+        for (UINT i = 0; i < PAGE_HASH_ALGORITHMS_COUNT; i++) {
+
+            if (i)
+                OutputWrite(Writer, ",", 1);
+
+            OutputWriteJsonString(Writer, g_PageHashAlgorithms[i]);
+
+            pageTable = Result->PageHashTables[i];
+            if (pageTable == NULL) {
+                OutputWriteString(Writer, ":null");
+                continue;
+            }
+
+            OutputWrite(Writer, ":[", 2);
+
+            for (ULONG j = 0; j < pageTable->EntryCount; j++) {
+                pageEntry = PAGE_HASH_TABLE_ENTRY(pageTable, j);
+                OutputWriteString(Writer, (j) ? ",[\"" : "[\"");
+                OutputWriteUlongHex(Writer, *(PULONG)pageEntry);
+                OutputWriteString(Writer, "\",\"");
+                OutputWriteHex(Writer, pageEntry + sizeof(ULONG), pageTable->HashSize);
+                OutputWriteString(Writer, "\"]");
+            }
+
+            OutputWrite(Writer, "]", 1);
+        }
+
+        OutputWrite(Writer, "}", 1);
+    }
+
+    OutputWriteString(Writer, "}\n");
+}
+
+/*
+* OutputCsvHeaderCLI
+*
+* Purpose:
+*
+* Write CSV header row.
+*
+*/
+VOID OutputCsvHeaderCLI(
+    _In_ POUTPUT_WRITER Writer,
+    _In_ BOOLEAN FileHash
+)
+{
+    OutputWriteString(Writer, "file,status,error");
+
+    for (UINT i = 0; i < AUTHENTICODE_ALGORITHMS_COUNT; i++) {
+        OutputWrite(Writer, ",", 1);
+        OutputWriteCsvField(Writer, g_AuthenticodeAlgorithms[i]);
+    }
+
+    for (UINT i = 0; i < PAGE_HASH_ALGORITHMS_COUNT; i++) {
+        OutputWriteString(Writer, ",Page");
+        OutputWriteCsvField(Writer, g_PageHashAlgorithms[i]);
+    }
+
+    if (FileHash) {
+        OutputWriteString(Writer, ",File");
+        OutputWriteCsvField(Writer, HASH_FILE_ALGORITHM);
+    }
+
+    OutputWrite(Writer, "\n", 1);
+}
+
+/*
+* OutputCsvResultCLI
+*
+* Purpose:
+*
+* Write file digests as single CSV row, page hash table is not included.
+* FileHash must match the value given to OutputCsvHeaderCLI.
+*
+*/
+VOID OutputCsvResultCLI(
+    _In_ POUTPUT_WRITER Writer,
+    _In_ LPCWSTR lpFileName,
+    _In_ PCLI_FILE_RESULT Result,
+    _In_ BOOLEAN FileHash
+)
+{
+    BOOLEAN bSuccess = NT_SUCCESS(Result->Status);
+    PHASH_DIGEST digest;
+
+    OutputWriteCsvField(Writer, lpFileName);
+
+    if (bSuccess) {
+        OutputWriteString(Writer, (Result->StoreMismatch) ? ",mismatch," : ",ok,");
+    }
+    else {
+        OutputWriteString(Writer, ",error,");
+        if (Result->Status == STATUS_INVALID_IMAGE_FORMAT)
+            OutputWriteCsvField(Writer, supImageVerifyErrorToString(Result->LastError));
+        else
+            OutputWriteString(Writer, "failed to load input file");
+    }
+
+    for (UINT i = 0; i < AUTHENTICODE_ALGORITHMS_COUNT; i++) {
+        OutputWrite(Writer, ",", 1);
+        digest = &Result->AuthenticodeHashes[i];
+        if (bSuccess && digest->Length)
+            OutputWriteHex(Writer, digest->Data, digest->Length);
+    }
+
+    for (UINT i = 0; i < PAGE_HASH_ALGORITHMS_COUNT; i++) {
+        OutputWrite(Writer, ",", 1);
+        digest = &Result->PageHashes[i];
+        if (bSuccess && digest->Length)
+            OutputWriteHex(Writer, digest->Data, digest->Length);
+    }
+
+    if (FileHash) {
+        OutputWrite(Writer, ",", 1);
+        digest = &Result->FileHash;
+        if (bSuccess && digest->Length)
+            OutputWriteHex(Writer, digest->Data, digest->Length);
+    }
+
+    OutputWrite(Writer, "\n", 1);
+}
+
+/*
+* IsKernelModeResultCLI
+*
+* Purpose:
+*
+* Return TRUE if file is a kernel mode image: native subsystem or .sys
+* extension, the latter covers results without known subsystem.
+*
+*/
+BOOLEAN IsKernelModeResultCLI(
+    _In_ LPCWSTR lpFileName,
+    _In_ PCLI_FILE_RESULT Result
+)
+{
+    LPCWSTR lpExt;
+
+    if (Result->Subsystem == IMAGE_SUBSYSTEM_NATIVE)
+        return TRUE;
+
+    lpExt = wcsrchr(lpFileName, L'.');
+    return (lpExt != NULL && _wcsicmp(lpExt, L".sys") == 0);
+}
+
+/*
+* OutputPolicyResultCLI
+*
+* Purpose:
+*
+* Add file hashes to WDAC policy file rules, failed files are left out.
+*
+*/
+VOID OutputPolicyResultCLI(
+    _In_ PPOLICY_WRITER Policy,
+    _In_ LPCWSTR lpFileName,
+    _In_ PCLI_FILE_RESULT Result
+)
+{
+    ULONG kind, scenario;
+    PHASH_DIGEST digest;
+
+    if (!NT_SUCCESS(Result->Status))
+        return;
+
+    scenario = IsKernelModeResultCLI(lpFileName, Result) ?
+        POLICY_SCENARIO_KERNEL : POLICY_SCENARIO_USER;
+
+    for (UINT i = 0; i < AUTHENTICODE_ALGORITHMS_COUNT; i++) {
+        kind = PolicyQueryHashKind(g_AuthenticodeAlgorithms[i], FALSE);
+        digest = &Result->AuthenticodeHashes[i];
+        if (kind != POLICY_HASH_NONE && digest->Length)
+            PolicyAddHash(Policy, lpFileName, scenario, kind, digest->Data, digest->Length);
+    }
+
+    for (UINT i = 0; i < PAGE_HASH_ALGORITHMS_COUNT; i++) {
+        kind = PolicyQueryHashKind(g_PageHashAlgorithms[i], TRUE);
+        digest = &Result->PageHashes[i];
+        if (kind != POLICY_HASH_NONE && digest->Length)
+            PolicyAddHash(Policy, lpFileName, scenario, kind, digest->Data, digest->Length);
+    }
+}
+
+/*
+* IsAllowedResultCLI
+*
+* Purpose:
+*
+* Return TRUE if authenticode digest of the list digest size is in the
+* known good list. Failed files are never allowed.
+*
+*/
+BOOLEAN IsAllowedResultCLI(
+    _In_ PALLOW_LIST List,
+    _In_ PCLI_FILE_RESULT Result
+)
+{
+    PHASH_DIGEST digest;
+
+    if (!NT_SUCCESS(Result->Status))
+        return FALSE;
+
+    for (UINT i = 0; i < AUTHENTICODE_ALGORITHMS_COUNT; i++) {
+        digest = &Result->AuthenticodeHashes[i];
+        if (digest->Length == List->DigestSize)
+            return AllowListContains(List, digest->Data, digest->Length);
+    }
+
+    return AllowListContains(List, NULL, 0);
+}
+
+/*
+* OutputFileResultCLI
+*
+* Purpose:
+*
+* Write file digests in selected output format and release result.
+* With known good list only files missing from it are written.
+*
+*/
+VOID OutputFileResultCLI(
+    _In_ PCLI_PARAMS Params,
+    _In_ FILE* lpOutStream,
+    _In_ LPCWSTR lpFileName,
+    _In_ PCLI_FILE_RESULT Result,
+    _In_ BOOLEAN Batch
+)
+{
+    ULONGLONG startTicks = StatsStageBegin();
+
+    if (Params->AllowList == NULL || !IsAllowedResultCLI(Params->AllowList, Result)) {
+
+        switch ((Params->Writer) ? Params->OutputFormat : OUTPUT_FORMAT_TEXT) {
+
+        case OUTPUT_FORMAT_JSONL:
+            OutputJsonResultCLI(Params->Writer, lpFileName, Result);
+            break;
+
+        case OUTPUT_FORMAT_CSV:
+            OutputCsvResultCLI(Params->Writer, lpFileName, Result, Params->FileHash);
+            break;
+
+        case OUTPUT_FORMAT_WDAC:
+            OutputPolicyResultCLI(Params->Policy, lpFileName, Result);
+            break;
+
+        default:
+            OutputTextResultCLI(lpOutStream, lpFileName, Result, Batch);
+            break;
+        }
+    }
+
+    ReleaseFileResultCLI(Result);
+
+    StatsStageEnd(STATS_STAGE_FORMAT, startTicks);
+}
+
+UINT ProcessFileCLI(
+    _In_ PCLI_PARAMS Params,
+    _In_opt_ PHASH_THREAD_POOL ThreadPool,
+    _In_ FILE* lpOutStream
+)
+{
+    CLI_FILE_RESULT result;
+
+    ComputeFileResultCLI(g_HashCache, NULL, Params->FileName, Params, ThreadPool, &result);
+    OutputFileResultCLI(Params, lpOutStream, Params->FileName, &result, FALSE);
+
+    return ERROR_SUCCESS;
+}
+
+BOOLEAN CALLBACK BatchWorkerStartupCLI(
+    _In_opt_ PVOID Context,
+    _Out_ PVOID* WorkerData
+)
+{
+    ULONG workerId = 0, workerCount = 1, nodeNumber = NUMA_NO_PREFERRED_NODE, affinityIndex;
+    BOOLEAN bLargePages = FALSE;
+    PCLI_BATCH_CONTEXT batchContext = (PCLI_BATCH_CONTEXT)Context;
+    PNUMA_NODE_INFO node;
+    PCLI_WORKER worker;
+
+    *WorkerData = NULL;
+
+    worker = (PCLI_WORKER)supHeapAlloc(sizeof(CLI_WORKER));
+    if (worker == NULL)
+        return FALSE;
+
+    if (batchContext) {
+        workerId = (ULONG)InterlockedIncrement(&batchContext->NextWorker) - 1;
+        workerCount = batchContext->WorkerCount;
+        bLargePages = batchContext->Params->LargePages;
+    }
+
+    //
+    // On multi-node hosts bind worker before anything is allocated,
+    // so its contexts, arena and reader buffers are node local.
+    //
+    if (g_Topology.NodeCount > 1) {
+        node = NumaSelectNode(&g_Topology, workerId, workerCount, &affinityIndex);
+        worker->Bound = NumaBindThread(node, affinityIndex, &worker->PreviousAffinity);
+        if (worker->Bound)
+            nodeNumber = node->NodeNumber;
+    }
+
+    if (!NT_SUCCESS(HashCreateContextCache(g_Heap, &worker->ContextCache))) {
+        if (worker->Bound)
+            NumaRestoreThread(&worker->PreviousAffinity);
+        supHeapFree(worker);
+        return FALSE;
+    }
+
+    //
+    // Worker without arena falls back to heap allocations,
+    // reservation may fail with many workers in 32-bit address space.
+    //
+    ArenaCreate(&worker->Arena, ARENA_RESERVE_SIZE, nodeNumber, bLargePages);
+
+    *WorkerData = worker;
+    return TRUE;
+}
+
+VOID CALLBACK BatchWorkerShutdownCLI(
+    _In_opt_ PVOID Context,
+    _In_opt_ PVOID WorkerData
+)
+{
+    PCLI_WORKER worker = (PCLI_WORKER)WorkerData;
+
+    UNREFERENCED_PARAMETER(Context);
+
+    if (worker) {
+        ArenaDestroy(&worker->Arena);
+        HashDestroyContextCache(worker->ContextCache);
+        if (worker->Bound)
+            NumaRestoreThread(&worker->PreviousAffinity);
+        supHeapFree(worker);
+    }
+}
+
+VOID CALLBACK BatchProcessFileCLI(
+    _In_opt_ PVOID Context,
+    _In_opt_ PVOID WorkerData,
+    _In_ LPCWSTR FileName,
+    _Out_ PVOID Result
+)
+{
+    PCLI_FILE_RESULT fileResult = (PCLI_FILE_RESULT)Result;
+    PCLI_BATCH_CONTEXT batchContext = (PCLI_BATCH_CONTEXT)Context;
+    PCLI_WORKER worker = (PCLI_WORKER)WorkerData;
+
+    if (worker == NULL || batchContext == NULL) {
+        RtlSecureZeroMemory(fileResult, sizeof(CLI_FILE_RESULT));
+        fileResult->Status = STATUS_INSUFFICIENT_RESOURCES;
+        return;
+    }
+
+    //
+    // Files are already spread across workers, keep each file single threaded.
+    //
+    ComputeFileResultCLI(worker->ContextCache,
+        &worker->Arena,
+        FileName,
+        batchContext->Params,
+        NULL,
+        fileResult);
+
+    ArenaReset(&worker->Arena);
+}
+
+/*
+* BatchProcessGroupCLI
+*
+* Purpose:
+*
+* Process consecutive files of the batch together.
+* Authenticode digests with multi-buffer implementation are computed for
+* all loaded files at once, everything else is done per file.
+*
+*/
+VOID CALLBACK BatchProcessGroupCLI(
+    _In_opt_ PVOID Context,
+    _In_opt_ PVOID WorkerData,
+    _In_reads_(Count) LPCWSTR* FileNames,
+    _Out_writes_(Count) PVOID* Results,
+    _In_ ULONG Count
+)
+{
+    ULONG i, j, algorithm, doneMask[BATCH_GROUP_MAX];
+    ULONGLONG startTicks;
+    PCLI_FILE_JOB jobs;
+    PCLI_FILE_RESULT fileResult;
+    PCLI_BATCH_CONTEXT batchContext = (PCLI_BATCH_CONTEXT)Context;
+    PCLI_WORKER worker = (PCLI_WORKER)WorkerData;
+    PFILE_VIEW_INFO views[BATCH_GROUP_MAX];
+    PUCHAR digests[BATCH_GROUP_MAX];
+    BOOLEAN bPending[BATCH_GROUP_MAX], bComputed[BATCH_GROUP_MAX];
+
+    jobs = (worker && batchContext && Count <= BATCH_GROUP_MAX) ?
+        (PCLI_FILE_JOB)ArenaHeapAlloc(&worker->Arena, Count * sizeof(CLI_FILE_JOB)) : NULL;
+
+    if (jobs == NULL) {
+        for (i = 0; i < Count; i++)
+            BatchProcessFileCLI(Context, WorkerData, FileNames[i], Results[i]);
+        return;
+    }
+
+    for (i = 0; i < Count; i++) {
+
+        bPending[i] = BeginFileResultCLI(FileNames[i],
+            batchContext->Params,
+            &worker->Arena,
+            &jobs[i],
+            (PCLI_FILE_RESULT)Results[i]);
+
+        views[i] = (bPending[i] && jobs[i].Loaded && !batchContext->Params->FirstPageOnly) ?
+            &jobs[i].ViewInfo : NULL;
+
+        doneMask[i] = 0;
+    }
+
+    for (j = 0; j < AUTHENTICODE_ALGORITHMS_COUNT; j++) {
+
+        algorithm = HashQueryMultiBufferAlgorithm(g_AuthenticodeAlgorithms[j]);
+        if (algorithm == SHA_NATIVE_NONE)
+            continue;
+
+        for (i = 0; i < Count; i++)
+            digests[i] = ((PCLI_FILE_RESULT)Results[i])->AuthenticodeHashes[j].Data;
+
+        startTicks = StatsStageBegin();
+        CalculateAuthenticodeHashBatch(views, Count, algorithm, digests, bComputed);
+        StatsStageEnd(STATS_STAGE_HASH, startTicks);
+
+        for (i = 0; i < Count; i++) {
+            if (bComputed[i]) {
+                ((PCLI_FILE_RESULT)Results[i])->AuthenticodeHashes[j].Length =
+                    (UCHAR)ShaNativeDigestSize(algorithm);
+                doneMask[i] |= (1 << j);
+            }
+        }
+    }
+
+    for (i = 0; i < Count; i++) {
+
+        if (!bPending[i])
+            continue;
+
+        fileResult = (PCLI_FILE_RESULT)Results[i];
+
+        if (jobs[i].Loaded) {
+            HashFileResultCLI(worker->ContextCache,
+                &jobs[i],
+                batchContext->Params,
+                NULL,
+                doneMask[i],
+                fileResult);
+        }
+
+        EndFileResultCLI(&jobs[i], batchContext->Params, fileResult);
+    }
+
+    ArenaHeapFree(&worker->Arena, jobs);
+    ArenaReset(&worker->Arena);
+}
+
+VOID CALLBACK BatchOutputResultCLI(
+    _In_opt_ PVOID Context,
+    _In_ LPCWSTR FileName,
+    _In_ PVOID Result
+)
+{
+    PCLI_BATCH_CONTEXT batchContext = (PCLI_BATCH_CONTEXT)Context;
+
+    if (batchContext) {
+        OutputFileResultCLI(batchContext->Params,
+            batchContext->OutStream,
+            FileName,
+            (PCLI_FILE_RESULT)Result,
+            TRUE);
+        batchContext->FilesProcessed += 1;
+        if (!NT_SUCCESS(((PCLI_FILE_RESULT)Result)->Status)) {
+            batchContext->FilesFailed += 1;
+            if (((PCLI_FILE_RESULT)Result)->Status == STATUS_INVALID_IMAGE_FORMAT)
+                batchContext->FilesRejected += 1;
+        }
+    }
+}
+
+/*
+* OpenStoreCLI
+*
+* Purpose:
+*
+* Open persistent store if requested, processing continues without it on failure.
+*
+*/
+VOID OpenStoreCLI(
+    _In_ PCLI_PARAMS Params,
+    _In_ ULONG ExpectedEntries,
+    _In_ FILE* lpOutStream
+)
+{
+    NTSTATUS ntStatus;
+
+    if (Params->CacheFileName == NULL)
+        return;
+
+    ntStatus = StoreOpen(Params->CacheFileName,
+        ExpectedEntries,
+        Params->CacheVerifyPercent,
+        &Params->Store);
+
+    if (!NT_SUCCESS(ntStatus)) {
+        fprintf_s(lpOutStream, "Warning: cache %ws cannot be opened, StoreOpen: 0x%X\n\n",
+            Params->CacheFileName, ntStatus);
+    }
+}
+
+/*
+* CloseStoreCLI
+*
+* Purpose:
+*
+* Report store statistics and close it.
+*
+*/
+VOID CloseStoreCLI(
+    _In_ PCLI_PARAMS Params,
+    _In_ FILE* lpOutStream
+)
+{
+    PSTORE_STATISTICS stats;
+
+    if (Params->Store == NULL)
+        return;
+
+    stats = &Params->Store->Statistics;
+
+    if (Params->OutputFormat == OUTPUT_FORMAT_TEXT) {
+        fprintf_s(lpOutStream, "Cache hits: %ld, misses: %ld, verified: %ld, mismatched: %ld\n",
+            stats->Hits,
+            stats->Misses,
+            stats->Verified,
+            stats->Mismatched);
+    }
+
+    StoreClose(Params->Store);
+    Params->Store = NULL;
+}
+
+/*
+* OpenAllowListCLI
+*
+* Purpose:
+*
+* Open known good list if requested, verification cannot run without it.
+*
+*/
+BOOLEAN OpenAllowListCLI(
+    _In_ PCLI_PARAMS Params,
+    _In_ FILE* lpOutStream
+)
+{
+    NTSTATUS ntStatus;
+
+    if (Params->AllowFileName == NULL)
+        return TRUE;
+
+    ntStatus = AllowListOpen(Params->AllowFileName, &Params->AllowList);
+    if (!NT_SUCCESS(ntStatus)) {
+        fprintf_s(lpOutStream, "Error: known good list %ws cannot be opened, AllowListOpen: 0x%X\n",
+            Params->AllowFileName, ntStatus);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/*
+* CloseAllowListCLI
+*
+* Purpose:
+*
+* Report known good list statistics and close it.
+*
+*/
+VOID CloseAllowListCLI(
+    _In_ PCLI_PARAMS Params,
+    _In_ FILE* lpOutStream
+)
+{
+    PALLOW_STATISTICS stats;
+
+    if (Params->AllowList == NULL)
+        return;
+
+    stats = &Params->AllowList->Statistics;
+
+    if (Params->OutputFormat == OUTPUT_FORMAT_TEXT) {
+        fprintf_s(lpOutStream, "\nKnown good digests: %lu, files checked: %ld, not in list: %ld\n",
+            Params->AllowList->Count,
+            stats->Checked,
+            stats->Missing);
+    }
+
+    AllowListClose(Params->AllowList);
+    Params->AllowList = NULL;
+}
+
+/*
+* ProcessAllowBuildCLI
+*
+* Purpose:
+*
+* Convert text list of digests given as input to known good list file.
+*
+*/
+UINT ProcessAllowBuildCLI(
+    _In_ PCLI_PARAMS Params,
+    _In_ FILE* lpOutStream
+)
+{
+    NTSTATUS ntStatus;
+    ULONG count;
+
+    if (Params->AllowFileName == NULL) {
+        fprintf_s(lpOutStream, "Error: %ws requires %ws\n", CLI_SWITCH_ALLOW_BUILD, CLI_SWITCH_ALLOW);
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    ntStatus = AllowListBuild(Params->FileName, Params->AllowFileName, &count);
+
+    if (ntStatus == STATUS_NO_MORE_ENTRIES) {
+        fprintf_s(lpOutStream, "Error: no digests found in %ws\n", Params->FileName);
+        return ERROR_INVALID_DATA;
+    }
+
+    if (!NT_SUCCESS(ntStatus)) {
+        fprintf_s(lpOutStream, "Error: known good list %ws cannot be built, AllowListBuild: 0x%X\n",
+            Params->AllowFileName, ntStatus);
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    fprintf_s(lpOutStream, "Known good list %ws: %lu distinct digests\n",
+        Params->AllowFileName, count);
+
+    return ERROR_SUCCESS;
+}
+
+/*
+* BuildIncrementalListCLI
+*
+* Purpose:
+*
+* Build list of executables changed since the previous scan from change journal.
+* Return FALSE if full scan is required. Volume is left opened when journal
+* is available, so its position can be recorded after the scan.
+*
+*/
+BOOLEAN BuildIncrementalListCLI(
+    _In_ PCLI_PARAMS Params,
+    _Out_ PUSN_VOLUME Volume,
+    _Inout_ PBATCH_FILE_LIST FileList,
+    _In_ FILE* lpOutStream
+)
+{
+    NTSTATUS ntStatus;
+    DWORD dwAttributes;
+    STORE_JOURNAL journal;
+
+    RtlSecureZeroMemory(Volume, sizeof(USN_VOLUME));
+
+    dwAttributes = GetFileAttributes(Params->FileName);
+    if (dwAttributes == INVALID_FILE_ATTRIBUTES ||
+        (dwAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0)
+    {
+        fprintf_s(lpOutStream, "Warning: incremental scan requires directory input, full scan\n\n");
+        return FALSE;
+    }
+
+    ntStatus = UsnOpenVolume(Params->FileName, Volume);
+    if (!NT_SUCCESS(ntStatus)) {
+        fprintf_s(lpOutStream, "Warning: change journal is not available, UsnOpenVolume: 0x%X, full scan\n\n", ntStatus);
+        return FALSE;
+    }
+
+    StoreQueryJournal(Params->Store, &journal);
+    if (!UsnCanResume(Volume, &journal)) {
+        fprintf_s(lpOutStream, "Journal position is not recorded or expired, full scan\n\n");
+        return FALSE;
+    }
+
+    ntStatus = UsnBuildChangedFileList(Volume, journal.NextUsn, Params->FileName, FileList);
+    if (!NT_SUCCESS(ntStatus)) {
+        BatchFreeFileList(FileList);
+        fprintf_s(lpOutStream, "Warning: change journal read failed, UsnBuildChangedFileList: 0x%X, full scan\n\n", ntStatus);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/*
+* ProcessBatchCLI
+*
+* Purpose:
+*
+* Expand batch input and process all files on worker threads.
+* Incremental mode takes files changed since the previous scan from
+* change journal instead of walking the input tree.
+*
+*/
+UINT ProcessBatchCLI(
+    _In_ PCLI_PARAMS Params,
+    _In_ FILE* lpOutStream
+)
+{
+    NTSTATUS ntStatus;
+    BOOLEAN bIncremental = FALSE;
+    BATCH_FILE_LIST fileList;
+    BATCH_CALLBACKS callbacks;
+    CLI_BATCH_CONTEXT batchContext;
+    USN_VOLUME volume;
+
+    RtlSecureZeroMemory(&fileList, sizeof(fileList));
+    RtlSecureZeroMemory(&volume, sizeof(volume));
+
+    if (Params->Incremental && Params->CacheFileName == NULL) {
+        fprintf_s(lpOutStream, "Error: %ws requires %ws\n", CLI_SWITCH_INCREMENTAL, CLI_SWITCH_CACHE);
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    //
+    // Store is grown to the list size once it is known.
+    //
+    OpenStoreCLI(Params, 0, lpOutStream);
+
+    if (Params->Incremental && Params->Store)
+        bIncremental = BuildIncrementalListCLI(Params, &volume, &fileList, lpOutStream);
+
+    if (!bIncremental &&
+        !BatchBuildFileList(Params->FileName, Params->Recursive, &fileList))
+    {
+        fprintf_s(lpOutStream, "Error: failed to enumerate input %ws\n", Params->FileName);
+        BatchFreeFileList(&fileList);
+        UsnCloseVolume(&volume);
+        CloseStoreCLI(Params, lpOutStream);
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    if (Params->Store)
+        StoreReserve(Params->Store, fileList.Count);
+
+    RtlSecureZeroMemory(&batchContext, sizeof(batchContext));
+    batchContext.OutStream = lpOutStream;
+    batchContext.Params = Params;
+    batchContext.WorkerCount = (Params->ThreadCount) ? Params->ThreadCount : g_Topology.ProcessorCount;
+
+    RtlSecureZeroMemory(&callbacks, sizeof(callbacks));
+    callbacks.Context = &batchContext;
+    callbacks.ResultSize = sizeof(CLI_FILE_RESULT);
+    callbacks.WorkerStartup = BatchWorkerStartupCLI;
+    callbacks.WorkerShutdown = BatchWorkerShutdownCLI;
+    callbacks.ProcessFile = BatchProcessFileCLI;
+    callbacks.OutputResult = BatchOutputResultCLI;
+
+    //
+    // Group files only when there is a multi-buffer engine to feed.
+    // Lanes take authenticode ranges only, file hash needs the regular pass.
+    //
+    if (!Params->FirstPageOnly && !Params->FileHash &&
+        (HashQueryMultiBufferAlgorithm(BCRYPT_SHA1_ALGORITHM) != SHA_NATIVE_NONE ||
+            HashQueryMultiBufferAlgorithm(BCRYPT_SHA256_ALGORITHM) != SHA_NATIVE_NONE))
+    {
+        callbacks.GroupSize = CLI_BATCH_GROUP_SIZE;
+        callbacks.ProcessGroup = BatchProcessGroupCLI;
+    }
+
+    if (bIncremental && fileList.Count == 0) {
+        if (Params->OutputFormat == OUTPUT_FORMAT_TEXT)
+            fprintf_s(lpOutStream, "No changes since the previous scan\n");
+        ntStatus = STATUS_SUCCESS;
+    }
+    else {
+        ntStatus = BatchRun(&fileList, batchContext.WorkerCount, &callbacks);
+    }
+
+    //
+    // Records must reach the stream before any trailing messages.
+    //
+    if (Params->Writer)
+        OutputFlush(Params->Writer);
+
+    BatchFreeFileList(&fileList);
+
+    //
+    // Journal position was queried before the input was listed,
+    // changes made during the scan are picked up next time.
+    // Files that failed for other reason than image validation (locked,
+    // access denied, I/O error) have no store entry and would not be seen
+    // again after the position moves, so it is kept for them.
+    //
+    if (NT_SUCCESS(ntStatus) && volume.VolumeHandle && Params->Store) {
+        if (batchContext.FilesFailed == batchContext.FilesRejected) {
+            StoreSetJournal(Params->Store, &volume.Journal);
+        }
+        else {
+            fprintf_s(lpOutStream, "Warning: %lu files failed, change journal position is kept for the next scan\n",
+                batchContext.FilesFailed - batchContext.FilesRejected);
+        }
+    }
+
+    UsnCloseVolume(&volume);
+    CloseStoreCLI(Params, lpOutStream);
+
+    if (ntStatus == STATUS_NO_MORE_FILES) {
+        fprintf_s(lpOutStream, "Error: no files found for %ws\n", Params->FileName);
+        return ERROR_FILE_NOT_FOUND;
+    }
+
+    if (!NT_SUCCESS(ntStatus)) {
+        fprintf_s(lpOutStream, "Error: batch processing failed, BatchRun: 0x%X\n", ntStatus);
+        return ERROR_NOT_ENOUGH_MEMORY;
+    }
+
+    if (Params->OutputFormat == OUTPUT_FORMAT_TEXT) {
+        fprintf_s(lpOutStream, "Files processed: %lu, failed: %lu\n",
+            batchContext.FilesProcessed,
+            batchContext.FilesFailed);
+    }
+
+    return ERROR_SUCCESS;
+}
+
+/*
+* ArchiveProcessEntryCLI
+*
+* Purpose:
+*
+* Compute all CLI digests of the decompressed archive member.
+*
+*/
+VOID CALLBACK ArchiveProcessEntryCLI(
+    _In_opt_ PVOID Context,
+    _In_opt_ PVOID WorkerData,
+    _In_ LPCWSTR EntryName,
+    _In_reads_bytes_(Size) const VOID* Data,
+    _In_ SIZE_T Size,
+    _Out_ PVOID Result
+)
+{
+    PCLI_FILE_RESULT fileResult = (PCLI_FILE_RESULT)Result;
+    PCLI_BATCH_CONTEXT batchContext = (PCLI_BATCH_CONTEXT)Context;
+    PCLI_WORKER worker = (PCLI_WORKER)WorkerData;
+
+    if (worker == NULL || batchContext == NULL) {
+        RtlSecureZeroMemory(fileResult, sizeof(CLI_FILE_RESULT));
+        fileResult->Status = STATUS_INSUFFICIENT_RESOURCES;
+        return;
+    }
+
+    ComputeBufferResultCLI(worker->ContextCache,
+        &worker->Arena,
+        EntryName,
+        Data,
+        Size,
+        batchContext->Params,
+        fileResult);
+
+    ArenaReset(&worker->Arena);
+}
+
+/*
+* ArchiveOutputFailureCLI
 *
 * Purpose:
 *
-* WM_SHOWWINDOW handler
+* Report archive that could not be opened or decompressed as failed file.
 *
 */
-VOID OnShowWindow(
-    _In_ HWND hwndDlg
+VOID CALLBACK ArchiveOutputFailureCLI(
+    _In_opt_ PVOID Context,
+    _In_ LPCWSTR ArchiveName,
+    _In_ NTSTATUS Status
 )
 {
-    SetFocus(GetDlgItem(hwndDlg, IDOK));
+    CLI_FILE_RESULT result;
+
+    RtlSecureZeroMemory(&result, sizeof(result));
+    result.Status = Status;
+    result.LastError = IMAGE_VERIFY_UNKNOWN_ERROR;
+
+    BatchOutputResultCLI(Context, ArchiveName, &result);
 }
 
-INT_PTR CALLBACK MainWindowProc(
-    _In_ HWND hwndDlg,
-    _In_ UINT uMsg,
-    _In_ WPARAM wParam,
-    _In_ LPARAM lParam
+/*
+* ProcessArchiveCLI
+*
+* Purpose:
+*
+* Hash PE members of the input archives.
+* Half of the threads decompress archives, all threads hash members.
+*
+*/
+UINT ProcessArchiveCLI(
+    _In_ PCLI_PARAMS Params,
+    _In_ FILE* lpOutStream
 )
 {
-    UNREFERENCED_PARAMETER(lParam);
-
-    switch (uMsg) {
-
-    case WM_INITDIALOG:
-
-        OnInitDialog(hwndDlg);
-        break;
+    NTSTATUS ntStatus;
+    BOOLEAN bListed;
+    ULONG workerCount;
+    BATCH_FILE_LIST archiveList;
+    ARCHIVE_CALLBACKS callbacks;
+    CLI_BATCH_CONTEXT batchContext;
+
+    RtlSecureZeroMemory(&archiveList, sizeof(archiveList));
+
+    if (BatchIsBatchInput(Params->FileName))
+        bListed = BatchBuildFileList(Params->FileName, Params->Recursive, &archiveList);
+    else
+        bListed = BatchAddFile(&archiveList, Params->FileName);
+
+    if (!bListed) {
+        fprintf_s(lpOutStream, "Error: failed to enumerate input %ws\n", Params->FileName);
+        BatchFreeFileList(&archiveList);
+        return ERROR_INVALID_PARAMETER;
+    }
 
-    case WM_SHOWWINDOW:
-        if (wParam)
-            OnShowWindow(hwndDlg);
-        break;
+    RtlSecureZeroMemory(&batchContext, sizeof(batchContext));
+    batchContext.OutStream = lpOutStream;
+    batchContext.Params = Params;
 
-    case WM_COMMAND:
+    RtlSecureZeroMemory(&callbacks, sizeof(callbacks));
+    callbacks.Context = &batchContext;
+    callbacks.ResultSize = sizeof(CLI_FILE_RESULT);
+    callbacks.WorkerStartup = BatchWorkerStartupCLI;
+    callbacks.WorkerShutdown = BatchWorkerShutdownCLI;
+    callbacks.ProcessEntry = ArchiveProcessEntryCLI;
+    callbacks.OutputResult = BatchOutputResultCLI;
+    callbacks.OutputFailure = ArchiveOutputFailureCLI;
 
-        switch (GET_WM_COMMAND_ID(wParam, lParam)) {
+    workerCount = (Params->ThreadCount) ? Params->ThreadCount : g_Topology.ProcessorCount;
+    batchContext.WorkerCount = workerCount;
 
-        case IDOK:
-            OnCalculateClick(hwndDlg);
-            break;
+    ntStatus = ArchiveRun(&archiveList, max(workerCount / 2, 1), workerCount, &callbacks);
 
-        case IDCANCEL:
-            SendMessage(hwndDlg, WM_CLOSE, 0, 0);
-            break;
+    if (Params->Writer)
+        OutputFlush(Params->Writer);
 
-        case IDC_BROWSE:
-            OnBrowseClick(hwndDlg);
-            break;
+    BatchFreeFileList(&archiveList);
 
-        case IDC_BUTTON_COPY_MD5:
-        case IDC_BUTTON_COPY_SHA1:
-        case IDC_BUTTON_COPY_SHA256:
-        case IDC_BUTTON_COPY_SHA384:
-        case IDC_BUTTON_COPY_SHA512:
-        case IDC_BUTTON_COPY_PHSHA1:
-        case IDC_BUTTON_COPY_PHSHA256:
-            OnCopyHashText(LOWORD(wParam));
-            break;
+    if (ntStatus == STATUS_NO_MORE_FILES) {
+        fprintf_s(lpOutStream, "Error: no files found for %ws\n", Params->FileName);
+        return ERROR_FILE_NOT_FOUND;
+    }
 
-        default:
-            break;
-        }
-        break;
+    if (!NT_SUCCESS(ntStatus)) {
+        fprintf_s(lpOutStream, "Error: archive processing failed, ArchiveRun: 0x%X\n", ntStatus);
+        return ERROR_NOT_ENOUGH_MEMORY;
+    }
 
-    case WM_DROPFILES:
-        OnDragAndDrop(hwndDlg, (HDROP)wParam);
-        break;
+    if (Params->OutputFormat == OUTPUT_FORMAT_TEXT) {
+        fprintf_s(lpOutStream, "Files processed: %lu, failed: %lu\n",
+            batchContext.FilesProcessed,
+            batchContext.FilesFailed);
+    }
 
-    case WM_CLOSE:
-        PostQuitMessage(0);
-        break;
+    return ERROR_SUCCESS;
+}
 
-    default:
-        return FALSE;
+/*
+* ServeProcessRequestCLI
+*
+* Purpose:
+*
+* Compute digests of requested file or in-line image and write JSON record.
+*
+*/
+VOID CALLBACK ServeProcessRequestCLI(
+    _In_opt_ PVOID Context,
+    _In_opt_ PVOID WorkerData,
+    _In_ PSERVE_REQUEST Request,
+    _In_ POUTPUT_WRITER Writer
+)
+{
+    CLI_FILE_RESULT result;
+    PCLI_BATCH_CONTEXT batchContext = (PCLI_BATCH_CONTEXT)Context;
+    PCLI_WORKER worker = (PCLI_WORKER)WorkerData;
 
+    if (worker == NULL || batchContext == NULL) {
+        RtlSecureZeroMemory(&result, sizeof(result));
+        result.Status = STATUS_INSUFFICIENT_RESOURCES;
+    }
+    else if (Request->Data) {
+        ComputeBufferResultCLI(worker->ContextCache,
+            &worker->Arena,
+            Request->Name,
+            Request->Data,
+            Request->Size,
+            batchContext->Params,
+            &result);
+    }
+    else {
+        ComputeFileResultCLI(worker->ContextCache,
+            &worker->Arena,
+            Request->Name,
+            batchContext->Params,
+            NULL,
+            &result);
     }
 
-    return TRUE;
+    if (worker)
+        ArenaReset(&worker->Arena);
+
+    OutputJsonResultCLI(Writer, Request->Name, &result);
+    ReleaseFileResultCLI(&result);
 }
 
 /*
-* RunGUI
+* ProcessServeCLI
 *
 * Purpose:
 *
-* GUI version launch handler.
+* Serve hash requests on named pipe, input if given is the pipe name.
 *
 */
-UINT RunGUI(
-    _In_ HINSTANCE hInstance
+UINT ProcessServeCLI(
+    _In_ PCLI_PARAMS Params,
+    _In_ FILE* lpOutStream
 )
 {
-    BOOL rv;
-    UINT uResult = ERROR_SUCCESS;
-    INITCOMMONCONTROLSEX ccex;
-    MSG msg;
-    HWND hwndDlg;
+    NTSTATUS ntStatus;
+    ULONG instanceCount;
+    LPCWSTR lpPipeName;
+    SERVE_CALLBACKS callbacks;
+    CLI_BATCH_CONTEXT batchContext;
 
-    ccex.dwSize = sizeof(INITCOMMONCONTROLSEX);
-    ccex.dwICC = ICC_STANDARD_CLASSES;
+    lpPipeName = (Params->FileName) ? Params->FileName : SERVE_DEFAULT_PIPE_NAME;
 
-    if (!InitCommonControlsEx(&ccex)) {
-        return GetLastError();
-    }
+    instanceCount = (Params->ThreadCount) ? Params->ThreadCount : g_Topology.ProcessorCount;
+    if (instanceCount > SERVE_MAX_INSTANCES)
+        instanceCount = SERVE_MAX_INSTANCES;
 
-    hwndDlg = CreateDialogParam(hInstance,
-        MAKEINTRESOURCE(IDD_MAINDLG),
-        NULL,
-        MainWindowProc,
-        0);
+    RtlSecureZeroMemory(&batchContext, sizeof(batchContext));
+    batchContext.OutStream = lpOutStream;
+    batchContext.Params = Params;
+    batchContext.WorkerCount = instanceCount;
 
-    if (hwndDlg) {
+    RtlSecureZeroMemory(&callbacks, sizeof(callbacks));
+    callbacks.Context = &batchContext;
+    callbacks.WorkerStartup = BatchWorkerStartupCLI;
+    callbacks.WorkerShutdown = BatchWorkerShutdownCLI;
+    callbacks.ProcessRequest = ServeProcessRequestCLI;
 
-        do {
-            rv = GetMessage(&msg, NULL, 0, 0);
+    OpenStoreCLI(Params, 0, lpOutStream);
 
-            if (rv == -1)
-                break;
+    fprintf_s(lpOutStream, "Listening on %ws, %lu instances, send %hs or press Ctrl+C to stop\n",
+        lpPipeName, instanceCount, SERVE_COMMAND_STOP);
+    fflush(lpOutStream);
 
-            if (!IsDialogMessage(hwndDlg, &msg)) {
-                TranslateMessage(&msg);
-                DispatchMessage(&msg);
-            }
+    ntStatus = ServeRun(lpPipeName, instanceCount, &callbacks);
 
-        } while (rv != 0);
+    CloseStoreCLI(Params, lpOutStream);
 
-    }
-    else {
-        uResult = GetLastError();
+    if (!NT_SUCCESS(ntStatus)) {
+        fprintf_s(lpOutStream, "Error: pipe %ws cannot be served, ServeRun: 0x%X\n",
+            lpPipeName, ntStatus);
+        return ERROR_PIPE_BUSY;
     }
 
-    return uResult;
+    return ERROR_SUCCESS;
 }
 
-UINT ProcessFileCLI(
-    _In_ LPCWSTR lpFileName,
+/*
+* ProcessBenchCLI
+*
+* Purpose:
+*
+* Run benchmark over input files.
+*
+*/
+UINT ProcessBenchCLI(
+    _In_ PCLI_PARAMS Params,
     _In_ FILE* lpOutStream
 )
 {
     NTSTATUS ntStatus;
-    UINT uResult = ERROR_SUCCESS;
-    LPWSTR lpszHash;
-    LPCWSTR cryptAlgoIdRef[] = {
-        BCRYPT_MD5_ALGORITHM,
-        BCRYPT_SHA1_ALGORITHM,
-        BCRYPT_SHA256_ALGORITHM,
-        BCRYPT_SHA384_ALGORITHM,
-        BCRYPT_SHA512_ALGORITHM
-    };
+    BOOLEAN bListed;
+    BATCH_FILE_LIST fileList;
+    BENCH_PARAMS benchParams;
 
-    FILE_VIEW_INFO fvi;
+    RtlSecureZeroMemory(&fileList, sizeof(fileList));
 
-    RtlSecureZeroMemory(&fvi, sizeof(fvi));
+    if (BatchIsBatchInput(Params->FileName))
+        bListed = BatchBuildFileList(Params->FileName, Params->Recursive, &fileList);
+    else
+        bListed = BatchAddFile(&fileList, Params->FileName);
 
-    fvi.FileName = lpFileName;
+    if (!bListed) {
+        fprintf_s(lpOutStream, "Error: failed to enumerate input %ws\n", Params->FileName);
+        BatchFreeFileList(&fileList);
+        return ERROR_INVALID_PARAMETER;
+    }
 
-    ntStatus = HashLoadFile(&fvi, FALSE);
+    RtlSecureZeroMemory(&benchParams, sizeof(benchParams));
+    benchParams.HeapHandle = g_Heap;
+    benchParams.PageSize = g_SystemInfo.dwPageSize;
+    benchParams.Iterations = Params->BenchIterations;
+    benchParams.IoBackend = Params->IoBackend;
+    benchParams.WorkerCount = (Params->ThreadCount) ?
+        Params->ThreadCount : g_Topology.ProcessorCount;
+    benchParams.AuthenticodeAlgorithms = g_AuthenticodeAlgorithms;
+    benchParams.AuthenticodeCount = AUTHENTICODE_ALGORITHMS_COUNT;
+    benchParams.PageHashAlgorithms = g_PageHashAlgorithms;
+    benchParams.PageHashCount = PAGE_HASH_ALGORITHMS_COUNT;
+    benchParams.Parallel = Params->Parallel;
+    benchParams.PerAlgorithm = Params->PerAlgorithm;
+    benchParams.FirstPageOnly = Params->FirstPageOnly;
+
+    ntStatus = BenchRun(&fileList, &benchParams, lpOutStream);
+
+    BatchFreeFileList(&fileList);
+
+    if (ntStatus == STATUS_NO_MORE_FILES) {
+        fprintf_s(lpOutStream, "Error: no files found for %ws\n", Params->FileName);
+        return ERROR_FILE_NOT_FOUND;
+    }
 
-    if (NT_SUCCESS(ntStatus)) {
+    if (!NT_SUCCESS(ntStatus)) {
+        fprintf_s(lpOutStream, "Error: benchmark failed, BenchRun: 0x%X\n", ntStatus);
+        return ERROR_INVALID_PARAMETER;
+    }
 
-        //
-        // Authenticode
-        //
+    return ERROR_SUCCESS;
+}
 
-        fprintf_s(lpOutStream, "File: %ws\n\nAuthenticode hashes:\n", lpFileName);
+/*
+* ProcessInputCLI
+*
+* Purpose:
+*
+* Dispatch CLI input to single file, batch or benchmark processing.
+*
+*/
+UINT ProcessInputCLI(
+    _In_ PCLI_PARAMS Params,
+    _In_ FILE* lpOutStream
+)
+{
+    UINT uResult;
+    ULONG workerCount;
+    PHASH_THREAD_POOL threadPool = NULL;
+    OUTPUT_WRITER writer;
+    POLICY_WRITER policy;
 
-        for (UINT i = 0; i < ARRAYSIZE(cryptAlgoIdRef); i++) {
-            lpszHash = ComputeHashForFile(&fvi, cryptAlgoIdRef[i], FALSE);
-            if (lpszHash) {
-                fprintf_s(lpOutStream, "%ws:\t%ws\n", cryptAlgoIdRef[i], lpszHash);
-                supHeapFree(lpszHash);
-            }
-            else {
-                fprintf_s(lpOutStream, "Error: empty hash %ws value\n", cryptAlgoIdRef[i]);
-            }
-        }
+    if (Params->AllowBuild)
+        return ProcessAllowBuildCLI(Params, lpOutStream);
 
-        //
-        // Page hash
-        //
+    if (Params->CngOnly)
+        HashDisableNativeBackend();
 
-        fprintf_s(lpOutStream, "\nFirst page hash:\n");
+    if (Params->LargePages && !NumaEnableLargePages()) {
+        fprintf_s(lpOutStream, "Warning: large pages are not available, %ws privilege is required\n\n",
+            SE_LOCK_MEMORY_NAME);
+        Params->LargePages = FALSE;
+    }
 
-        LPCWSTR lpAlgId = BCRYPT_SHA1_ALGORITHM;
+    //
+    // Server replies through its own per connection writers.
+    //
+    if (Params->Serve) {
+        uResult = ProcessServeCLI(Params, lpOutStream);
+        StatsReportSummary((Params->Stats) ? lpOutStream : NULL);
+        return uResult;
+    }
 
-        lpszHash = ComputeHashForFile(&fvi, lpAlgId, TRUE);
-        if (lpszHash) {
-            fprintf_s(lpOutStream, "%ws:\t%ws\n", lpAlgId, lpszHash);
-            supHeapFree(lpszHash);
-        }
-        else {
-            fprintf_s(lpOutStream, "Error: empty page hash %ws value\n", lpAlgId);
-        }
+    if (Params->BenchIterations == 0 && !OpenAllowListCLI(Params, lpOutStream))
+        return ERROR_FILE_NOT_FOUND;
 
-        lpAlgId = BCRYPT_SHA256_ALGORITHM;
+    //
+    // Structured records are assembled in the writer buffer,
+    // batch mode feeds it from the thread that runs BatchRun.
+    //
+    if (Params->OutputFormat != OUTPUT_FORMAT_TEXT && Params->BenchIterations == 0) {
 
-        lpszHash = ComputeHashForFile(&fvi, lpAlgId, TRUE);
-        if (lpszHash) {
-            fprintf_s(lpOutStream, "%ws:\t%ws\n", lpAlgId, lpszHash);
-            supHeapFree(lpszHash);
-        }
-        else {
-            fprintf_s(lpOutStream, "Error: empty page hash %ws value\n", lpAlgId);
+        if (!OutputInitialize(&writer, lpOutStream, OUTPUT_BUFFER_SIZE)) {
+            CloseAllowListCLI(Params, lpOutStream);
+            fprintf_s(lpOutStream, "Error: cannot allocate output buffer\n");
+            return ERROR_NOT_ENOUGH_MEMORY;
         }
 
-        HashUnloadFile(&fvi);
+        Params->Writer = &writer;
+
+        if (Params->OutputFormat == OUTPUT_FORMAT_CSV)
+            OutputCsvHeaderCLI(&writer, Params->FileHash);
+
+        if (Params->OutputFormat == OUTPUT_FORMAT_WDAC) {
+            if (!PolicyBegin(&policy, &writer)) {
+                OutputRelease(&writer);
+                Params->Writer = NULL;
+                CloseAllowListCLI(Params, lpOutStream);
+                fprintf_s(lpOutStream, "Error: cannot allocate policy hash set\n");
+                return ERROR_NOT_ENOUGH_MEMORY;
+            }
+            Params->Policy = &policy;
+        }
+    }
 
+    if (Params->BenchIterations) {
+        uResult = ProcessBenchCLI(Params, lpOutStream);
+    }
+    else if (Params->Archive) {
+        uResult = ProcessArchiveCLI(Params, lpOutStream);
+    }
+    else if (BatchIsBatchInput(Params->FileName)) {
+        uResult = ProcessBatchCLI(Params, lpOutStream);
     }
     else {
-        if (ntStatus == STATUS_INVALID_IMAGE_FORMAT)
-            fprintf_s(lpOutStream, "Error: %ws\n",
-                supImageVerifyErrorToString(fvi.LastError));
-        else {
-            fprintf_s(lpOutStream, "Error: failed to load input file, HashLoadFile: 0x%X\n", ntStatus);
-        }
+        workerCount = (Params->ThreadCount) ?
+            Params->ThreadCount : g_Topology.ProcessorCount;
+
+        //
+        // Pool threads are started once, before the file is hashed.
+        // Without pool the file is hashed single threaded.
+        //
+        if (workerCount > 1 && (Params->Parallel || Params->PageHashTable))
+            HashCreateThreadPool(g_Heap, workerCount, &threadPool);
+
+        OpenStoreCLI(Params, 1, lpOutStream);
+        uResult = ProcessFileCLI(Params, threadPool, lpOutStream);
+        CloseStoreCLI(Params, lpOutStream);
+
+        if (threadPool)
+            HashDestroyThreadPool(g_Heap, threadPool);
+    }
+
+    if (Params->Policy) {
+        PolicyEnd(Params->Policy);
+        Params->Policy = NULL;
+    }
+
+    if (Params->Writer) {
+        OutputRelease(Params->Writer);
+        Params->Writer = NULL;
     }
 
+    CloseAllowListCLI(Params, lpOutStream);
+
+    //
+    // Summary event is always written, printed only on request.
+    //
+    StatsReportSummary((Params->Stats) ? lpOutStream : NULL);
+
     return uResult;
 }
 
+/*
+* PrintUsageCLI
+*
+* Purpose:
+*
+* Output command line usage.
+*
+*/
+VOID PrintUsageCLI(
+    _In_ FILE* lpOutStream
+)
+{
+    fprintf_s(lpOutStream, "Usage: ahc [options] input [outputfile]\n\n"
+        "Input:\n"
+        "  file\t\tsingle PE file\n"
+        "  directory\tall files of the directory tree\n"
+        "  mask\t\tfiles matching wildcard mask, e.g. c:\\windows\\system32\\*.sys\n"
+        "  @listfile\tfiles, directories or masks listed one per line\n\n"
+        "Options:\n"
+        "  %ws\t\tcompute authenticode digests in parallel, one worker per digest\n"
+        "  %ws\t\twalk subdirectories when input is a mask\n"
+        "  %ws N\tnumber of worker threads\n"
+        "  %ws\toutput full page hash table (WDAC compatible)\n"
+        "  %ws %ws|%ws\tfile read method, default is %ws\n"
+        "  %ws\tfirst page hashes only, file headers are mapped only\n"
+        "  %ws file\tpersistent result cache, unchanged files are not hashed again\n"
+        "  %ws N\tpercent of cache hits verified by hashing the file again\n"
+        "  %ws\t\tdirectory input: hash only executables changed since previous scan,\n"
+        "\t\tbased on NTFS change journal, requires %ws\n"
+        "  %ws N\trun hash pipeline over input N times and report throughput\n"
+        "\t\tand stage latencies, combine with %ws, %ws, %ws, %ws\n"
+        "  %ws\t\tbenchmark: separate file pass for every authenticode digest\n"
+        "  %ws\t\toutput stage timings and counters at the end of run\n"
+        "  %ws %ws|%ws|%ws|%ws\toutput format, default is %ws; %ws omits page hash table,\n"
+        "\t\t%ws writes policy file rules for distinct SHA1/SHA256 and page hashes\n"
+        "  %ws\t\tuse CNG for all digests, by default SHA1/SHA256 use CPU SHA extensions if present\n"
+        "  %ws\tinput lists archives, members are hashed in memory without extraction\n"
+        "\t\tto disk; CAB and ZIP are supported, cache options are ignored\n"
+        "  %ws file\tknown good list, only files whose authenticode digest is not\n"
+        "\t\tin the list are written, in any output format\n"
+        "  %ws\tinput is text file with one hex digest per line, convert it to\n"
+        "\t\tknown good list file given by %ws\n"
+        "  %ws\t\tserve requests on named pipe given as input, default %ws;\n"
+        "\t\tJSON Lines record is returned for every file name line sent\n"
+        "  %ws\tflat %ws of the whole file computed in the authenticode pass,\n"
+        "\t\tcache is not used, %ws is ignored\n"
+        "  %ws\tread buffers of batch workers in large pages, requires\n"
+        "\t\tlock pages in memory privilege\n",
+        CLI_SWITCH_PARALLEL,
+        CLI_SWITCH_RECURSIVE,
+        CLI_SWITCH_THREADS,
+        CLI_SWITCH_PAGE_HASHES,
+        CLI_SWITCH_IO,
+        CLI_IO_MAPPED,
+        CLI_IO_UNBUFFERED,
+        CLI_IO_MAPPED,
+        CLI_SWITCH_PAGE_ONLY,
+        CLI_SWITCH_CACHE,
+        CLI_SWITCH_CACHE_VERIFY,
+        CLI_SWITCH_INCREMENTAL,
+        CLI_SWITCH_CACHE,
+        CLI_SWITCH_BENCH,
+        CLI_SWITCH_IO,
+        CLI_SWITCH_THREADS,
+        CLI_SWITCH_PARALLEL,
+        CLI_SWITCH_PER_ALGORITHM,
+        CLI_SWITCH_PER_ALGORITHM,
+        CLI_SWITCH_STATS,
+        CLI_SWITCH_FORMAT,
+        CLI_FORMAT_TEXT,
+        CLI_FORMAT_JSONL,
+        CLI_FORMAT_CSV,
+        CLI_FORMAT_WDAC,
+        CLI_FORMAT_TEXT,
+        CLI_FORMAT_CSV,
+        CLI_FORMAT_WDAC,
+        CLI_SWITCH_CNG,
+        CLI_SWITCH_ARCHIVE,
+        CLI_SWITCH_ALLOW,
+        CLI_SWITCH_ALLOW_BUILD,
+        CLI_SWITCH_ALLOW,
+        CLI_SWITCH_SERVE,
+        SERVE_DEFAULT_PIPE_NAME,
+        CLI_SWITCH_FILE_HASH,
+        HASH_FILE_ALGORITHM,
+        CLI_SWITCH_PARALLEL,
+        CLI_SWITCH_LARGE_PAGES);
+}
+
 /*
 * RunCLI
 *
@@ -617,8 +3195,7 @@ UINT ProcessFileCLI(
 *
 */
 UINT RunCLI(
-    _In_ LPCWSTR lpFileName,
-    _In_opt_ LPCWSTR lpLogFileName
+    _In_ PCLI_PARAMS Params
 )
 {
     UINT uResult;
@@ -636,8 +3213,8 @@ UINT RunCLI(
     FILE* outStream;
     errno_t err;
 
-    if (lpLogFileName) {
-        err = _wfopen_s(&outStream, lpLogFileName, L"wt");
+    if (Params->LogFileName) {
+        err = _wfopen_s(&outStream, Params->LogFileName, L"wt");
     }
     else {
         err = freopen_s(&outStream, "CONOUT$", "w", stdout);
@@ -647,29 +3224,166 @@ UINT RunCLI(
         return (UINT)-3;
     }
 
-    if (lpLogFileName) {
-        uResult = ProcessFileCLI(lpFileName, outStream);
+    if (Params->LogFileName) {
+        if (Params->FileName || Params->Serve) {
+            uResult = ProcessInputCLI(Params, outStream);
+        }
+        else {
+            PrintUsageCLI(outStream);
+            uResult = ERROR_INVALID_PARAMETER;
+        }
         fclose(outStream);
         return uResult;
     }
 
     fflush(stdout);
 
-    fprintf_s(stdout, "\nAuthHashCalc v%u.%u.%u.%u built at %s\n\n",
-        PROGRAM_VERSION_MAJOR,
-        PROGRAM_VERSION_MINOR,
-        PROGRAM_VERSION_REVISION,
-        PROGRAM_VERSION_BUILD,
-        __TIMESTAMP__);
+    //
+    // Structured output to console is kept free of banner lines.
+    //
+    if (Params->OutputFormat == OUTPUT_FORMAT_TEXT) {
+        fprintf_s(stdout, "\nAuthHashCalc v%u.%u.%u.%u built at %s\n\n",
+            PROGRAM_VERSION_MAJOR,
+            PROGRAM_VERSION_MINOR,
+            PROGRAM_VERSION_REVISION,
+            PROGRAM_VERSION_BUILD,
+            __TIMESTAMP__);
+    }
 
-    uResult = ProcessFileCLI(lpFileName, stdout);
+    if (Params->FileName || Params->Serve) {
+        uResult = ProcessInputCLI(Params, stdout);
+    }
+    else {
+        PrintUsageCLI(stdout);
+        uResult = ERROR_INVALID_PARAMETER;
+    }
 
-    fprintf_s(stdout, "\nCompleted.");
+    if (Params->OutputFormat == OUTPUT_FORMAT_TEXT)
+        fprintf_s(stdout, "\nCompleted.");
 
     FreeConsole();
     return uResult;
 }
 
+/*
+* ParseCommandLine
+*
+* Purpose:
+*
+* Convert command line arguments to CLI parameters.
+* First non switch argument is input file, second is output file.
+*
+*/
+VOID ParseCommandLine(
+    _In_ INT nArgs,
+    _In_reads_(nArgs) LPWSTR* szArglist,
+    _Out_ PCLI_PARAMS Params
+)
+{
+    LPCWSTR lpArg;
+
+    RtlSecureZeroMemory(Params, sizeof(CLI_PARAMS));
+
+    for (INT i = 1; i < nArgs; i++) {
+
+        lpArg = szArglist[i];
+
+        if (_wcsicmp(lpArg, CLI_SWITCH_PARALLEL) == 0) {
+            Params->Parallel = TRUE;
+        }
+        else if (_wcsicmp(lpArg, CLI_SWITCH_RECURSIVE) == 0) {
+            Params->Recursive = TRUE;
+        }
+        else if (_wcsicmp(lpArg, CLI_SWITCH_PAGE_HASHES) == 0) {
+            Params->PageHashTable = TRUE;
+        }
+        else if (_wcsicmp(lpArg, CLI_SWITCH_PAGE_ONLY) == 0) {
+            Params->FirstPageOnly = TRUE;
+        }
+        else if (_wcsicmp(lpArg, CLI_SWITCH_IO) == 0) {
+            if (i + 1 < nArgs) {
+                lpArg = szArglist[++i];
+                if (_wcsicmp(lpArg, CLI_IO_UNBUFFERED) == 0)
+                    Params->IoBackend = FILE_IO_BACKEND_UNBUFFERED;
+                else
+                    Params->IoBackend = FILE_IO_BACKEND_MAPPED;
+            }
+        }
+        else if (_wcsicmp(lpArg, CLI_SWITCH_FORMAT) == 0) {
+            if (i + 1 < nArgs) {
+                lpArg = szArglist[++i];
+                if (_wcsicmp(lpArg, CLI_FORMAT_JSONL) == 0)
+                    Params->OutputFormat = OUTPUT_FORMAT_JSONL;
+                else if (_wcsicmp(lpArg, CLI_FORMAT_CSV) == 0)
+                    Params->OutputFormat = OUTPUT_FORMAT_CSV;
+                else if (_wcsicmp(lpArg, CLI_FORMAT_WDAC) == 0)
+                    Params->OutputFormat = OUTPUT_FORMAT_WDAC;
+                else
+                    Params->OutputFormat = OUTPUT_FORMAT_TEXT;
+            }
+        }
+        else if (_wcsicmp(lpArg, CLI_SWITCH_CNG) == 0) {
+            Params->CngOnly = TRUE;
+        }
+        else if (_wcsicmp(lpArg, CLI_SWITCH_ARCHIVE) == 0) {
+            Params->Archive = TRUE;
+        }
+        else if (_wcsicmp(lpArg, CLI_SWITCH_ALLOW) == 0) {
+            if (i + 1 < nArgs)
+                Params->AllowFileName = szArglist[++i];
+        }
+        else if (_wcsicmp(lpArg, CLI_SWITCH_ALLOW_BUILD) == 0) {
+            Params->AllowBuild = TRUE;
+        }
+        else if (_wcsicmp(lpArg, CLI_SWITCH_SERVE) == 0) {
+            Params->Serve = TRUE;
+        }
+        else if (_wcsicmp(lpArg, CLI_SWITCH_FILE_HASH) == 0) {
+            Params->FileHash = TRUE;
+        }
+        else if (_wcsicmp(lpArg, CLI_SWITCH_LARGE_PAGES) == 0) {
+            Params->LargePages = TRUE;
+        }
+        else if (_wcsicmp(lpArg, CLI_SWITCH_STATS) == 0) {
+            Params->Stats = TRUE;
+        }
+        else if (_wcsicmp(lpArg, CLI_SWITCH_PER_ALGORITHM) == 0) {
+            Params->PerAlgorithm = TRUE;
+        }
+        else if (_wcsicmp(lpArg, CLI_SWITCH_BENCH) == 0) {
+            if (i + 1 < nArgs)
+                Params->BenchIterations = wcstoul(szArglist[++i], NULL, 10);
+        }
+        else if (_wcsicmp(lpArg, CLI_SWITCH_INCREMENTAL) == 0) {
+            Params->Incremental = TRUE;
+        }
+        else if (_wcsicmp(lpArg, CLI_SWITCH_CACHE) == 0) {
+            if (i + 1 < nArgs)
+                Params->CacheFileName = szArglist[++i];
+        }
+        else if (_wcsicmp(lpArg, CLI_SWITCH_CACHE_VERIFY) == 0) {
+            if (i + 1 < nArgs) {
+                Params->CacheVerifyPercent = wcstoul(szArglist[++i], NULL, 10);
+                if (Params->CacheVerifyPercent > 100)
+                    Params->CacheVerifyPercent = 100;
+            }
+        }
+        else if (_wcsicmp(lpArg, CLI_SWITCH_THREADS) == 0) {
+            if (i + 1 < nArgs) {
+                Params->ThreadCount = wcstoul(szArglist[++i], NULL, 10);
+                if (Params->ThreadCount > CLI_MAX_THREADS)
+                    Params->ThreadCount = CLI_MAX_THREADS;
+            }
+        }
+        else if (Params->FileName == NULL) {
+            Params->FileName = lpArg;
+        }
+        else if (Params->LogFileName == NULL) {
+            Params->LogFileName = lpArg;
+        }
+    }
+}
+
 BOOLEAN InitializeGlobals(
     _In_ HINSTANCE hInstance
 )
@@ -684,9 +3398,16 @@ BOOLEAN InitializeGlobals(
 
     HeapSetInformation(g_Heap, HeapEnableTerminationOnCorruption, NULL, 0);
 
+    if (!NT_SUCCESS(HashCreateContextCache(g_Heap, &g_HashCache)))
+        return FALSE;
+
+    StatsInitialize();
+
     RtlSecureZeroMemory(&g_SystemInfo, sizeof(g_SystemInfo));
     GetSystemInfo(&g_SystemInfo);
 
+    NumaQueryTopology(&g_Topology);
+
     return TRUE;
 }
 
@@ -708,7 +3429,7 @@ int CALLBACK WinMain(
     LPWSTR* szArglist;
     INT nArgs = 0;
     ULONG nRet = 0;
-    LPCWSTR lpLogFile = NULL;
+    CLI_PARAMS cliParams;
 
     UNREFERENCED_PARAMETER(hPrevInstance);
     UNREFERENCED_PARAMETER(lpCmdLine);
@@ -724,10 +3445,8 @@ int CALLBACK WinMain(
 
         if (nArgs > 1) {
 
-            if (nArgs > 2)
-                lpLogFile = szArglist[2];
-
-            nRet = RunCLI(szArglist[1], lpLogFile);
+            ParseCommandLine(nArgs, szArglist, &cliParams);
+            nRet = RunCLI(&cliParams);
 
         }
         else {
@@ -743,6 +3462,9 @@ int CALLBACK WinMain(
         nRet = RunGUI(hInstance);
     }
 
+    HashDestroyContextCache(g_HashCache);
+    HashReleaseProviders();
+    StatsShutdown();
     HeapDestroy(g_Heap);
 
 ExitProgram:
@@ -0,0 +1,310 @@
+/*******************************************************************************
+*
+*  (C) COPYRIGHT AUTHORS, 2026
+*
+*  TITLE:       NUMA.CPP
+*
+*  VERSION:     1.05
+*
+*  DATE:        14 Oct 2026
+*
+*  Processor topology and large page support.
+*
+*  Workers are spread over NUMA nodes in proportion to node processor
+*  counts and bound to their node group affinity, which also lets them run
+*  in processor groups other than the one of the process. Memory reserved
+*  by a bound worker prefers its node.
+*
+* THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+* ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED
+* TO THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*******************************************************************************/
+
+#include "global.h"
+
+/*
+* NumapCountBits
+*
+* Purpose:
+*
+* Return number of processors in affinity mask.
+*
+*/
+ULONG NumapCountBits(
+    _In_ KAFFINITY Mask
+)
+{
+    ULONG count = 0;
+
+    while (Mask) {
+        Mask &= Mask - 1;
+        count += 1;
+    }
+
+    return count;
+}
+
+/*
+* NumapQueryNodes
+*
+* Purpose:
+*
+* Read NUMA node relationship records of given kind.
+*
+*/
+PUCHAR NumapQueryNodes(
+    _In_ LOGICAL_PROCESSOR_RELATIONSHIP Relationship,
+    _Out_ PDWORD BufferSize
+)
+{
+    DWORD cbBuffer = 0;
+    PUCHAR buffer;
+
+    *BufferSize = 0;
+
+    if (GetLogicalProcessorInformationEx(Relationship, NULL, &cbBuffer) ||
+        GetLastError() != ERROR_INSUFFICIENT_BUFFER)
+    {
+        return NULL;
+    }
+
+    buffer = (PUCHAR)supHeapAlloc(cbBuffer);
+    if (buffer == NULL)
+        return NULL;
+
+    if (!GetLogicalProcessorInformationEx(Relationship,
+        (PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX)buffer,
+        &cbBuffer))
+    {
+        supHeapFree(buffer);
+        return NULL;
+    }
+
+    *BufferSize = cbBuffer;
+    return buffer;
+}
+
+/*
+* NumaQueryTopology
+*
+* Purpose:
+*
+* Enumerate NUMA nodes with all their processor groups. On failure topology
+* describes single unbound node with all active processors and FALSE is
+* returned.
+*
+*/
+BOOLEAN NumaQueryTopology(
+    _Out_ PNUMA_TOPOLOGY Topology
+)
+{
+    BOOLEAN bResult = FALSE;
+    DWORD cbBuffer = 0, offset;
+    ULONG i, groupCount;
+    PUCHAR buffer;
+    PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX info;
+    PNUMA_NODE_INFO node;
+    PGROUP_AFFINITY affinity;
+
+    RtlSecureZeroMemory(Topology, sizeof(NUMA_TOPOLOGY));
+
+    //
+    // Since Windows Server 2022 plain node records carry primary group only,
+    // extended records list every group. Older systems reject extended kind.
+    //
+    buffer = NumapQueryNodes(RelationNumaNodeEx, &cbBuffer);
+    if (buffer == NULL)
+        buffer = NumapQueryNodes(RelationNumaNode, &cbBuffer);
+
+    if (buffer) {
+
+        for (offset = 0; offset < cbBuffer && Topology->NodeCount < NUMA_NODES_MAX; ) {
+
+            info = (PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX)(buffer + offset);
+            if (info->Size == 0)
+                break;
+
+            offset += info->Size;
+
+            if (info->Relationship != RelationNumaNode &&
+                info->Relationship != RelationNumaNodeEx)
+            {
+                continue;
+            }
+
+            //
+            // Systems before group count was introduced leave it zero.
+            //
+            groupCount = info->NumaNode.GroupCount;
+            if (groupCount == 0)
+                groupCount = 1;
+
+            if (groupCount > NUMA_NODE_GROUPS_MAX)
+                groupCount = NUMA_NODE_GROUPS_MAX;
+
+            node = &Topology->Nodes[Topology->NodeCount];
+            node->NodeNumber = info->NumaNode.NodeNumber;
+
+            for (i = 0; i < groupCount; i++) {
+
+                if (info->NumaNode.GroupMasks[i].Mask == 0)
+                    continue;
+
+                affinity = &node->Affinity[node->AffinityCount++];
+                affinity->Mask = info->NumaNode.GroupMasks[i].Mask;
+                affinity->Group = info->NumaNode.GroupMasks[i].Group;
+                node->ProcessorCount += NumapCountBits(affinity->Mask);
+            }
+
+            if (node->AffinityCount == 0) {
+                RtlSecureZeroMemory(node, sizeof(NUMA_NODE_INFO));
+                continue;
+            }
+
+            Topology->NodeCount += 1;
+            Topology->ProcessorCount += node->ProcessorCount;
+        }
+
+        bResult = (Topology->NodeCount != 0);
+
+        supHeapFree(buffer);
+    }
+
+    if (!bResult) {
+        RtlSecureZeroMemory(Topology, sizeof(NUMA_TOPOLOGY));
+        Topology->NodeCount = 1;
+        Topology->Nodes[0].NodeNumber = NUMA_NO_PREFERRED_NODE;
+        Topology->Nodes[0].ProcessorCount = GetActiveProcessorCount(ALL_PROCESSOR_GROUPS);
+        Topology->ProcessorCount = Topology->Nodes[0].ProcessorCount;
+    }
+
+    if (Topology->ProcessorCount == 0) {
+        Topology->Nodes[0].ProcessorCount = 1;
+        Topology->ProcessorCount = 1;
+    }
+
+    return bResult;
+}
+
+/*
+* NumaSelectNode
+*
+* Purpose:
+*
+* Return node of the worker and its processor group within the node,
+* consecutive workers fill group after group and node after node in
+* proportion to processor counts.
+*
+*/
+PNUMA_NODE_INFO NumaSelectNode(
+    _In_ PNUMA_TOPOLOGY Topology,
+    _In_ ULONG WorkerId,
+    _In_ ULONG WorkerCount,
+    _Out_ PULONG AffinityIndex
+)
+{
+    ULONG i, j, position, first = 0;
+    PNUMA_NODE_INFO node;
+
+    if (WorkerCount == 0)
+        WorkerCount = 1;
+
+    position = (ULONG)(((ULONGLONG)(WorkerId % WorkerCount) * Topology->ProcessorCount) / WorkerCount);
+
+    for (i = 0; i + 1 < Topology->NodeCount; i++) {
+        if (position < first + Topology->Nodes[i].ProcessorCount)
+            break;
+        first += Topology->Nodes[i].ProcessorCount;
+    }
+
+    node = &Topology->Nodes[i];
+
+    for (j = 0; j + 1 < node->AffinityCount; j++) {
+        first += NumapCountBits(node->Affinity[j].Mask);
+        if (position < first)
+            break;
+    }
+
+    *AffinityIndex = j;
+    return node;
+}
+
+/*
+* NumaBindThread
+*
+* Purpose:
+*
+* Restrict calling thread to the node processors of one group, threads
+* cannot span groups.
+*
+*/
+BOOLEAN NumaBindThread(
+    _In_ PNUMA_NODE_INFO Node,
+    _In_ ULONG AffinityIndex,
+    _Out_ PGROUP_AFFINITY Previous
+)
+{
+    RtlSecureZeroMemory(Previous, sizeof(GROUP_AFFINITY));
+
+    if (AffinityIndex >= Node->AffinityCount || Node->Affinity[AffinityIndex].Mask == 0)
+        return FALSE;
+
+    return (SetThreadGroupAffinity(GetCurrentThread(),
+        &Node->Affinity[AffinityIndex],
+        Previous) != FALSE);
+}
+
+/*
+* NumaRestoreThread
+*
+* Purpose:
+*
+* Return thread to affinity saved by NumaBindThread, thread pool threads
+* outlive the work that bound them.
+*
+*/
+VOID NumaRestoreThread(
+    _In_ PGROUP_AFFINITY Previous
+)
+{
+    if (Previous->Mask)
+        SetThreadGroupAffinity(GetCurrentThread(), Previous, NULL);
+}
+
+/*
+* NumaEnableLargePages
+*
+* Purpose:
+*
+* Enable SeLockMemoryPrivilege in process token, large pages cannot be
+* allocated without it. Fails if account does not hold the privilege.
+*
+*/
+BOOLEAN NumaEnableLargePages(
+    VOID
+)
+{
+    BOOL bResult;
+    HANDLE tokenHandle;
+    TOKEN_PRIVILEGES privileges;
+
+    if (GetLargePageMinimum() == 0)
+        return FALSE;
+
+    if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &tokenHandle))
+        return FALSE;
+
+    privileges.PrivilegeCount = 1;
+    privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+
+    bResult = LookupPrivilegeValue(NULL, SE_LOCK_MEMORY_NAME, &privileges.Privileges[0].Luid);
+    if (bResult) {
+        bResult = AdjustTokenPrivileges(tokenHandle, FALSE, &privileges, 0, NULL, NULL) &&
+            GetLastError() == ERROR_SUCCESS;
+    }
+
+    CloseHandle(tokenHandle);
+    return (bResult != FALSE);
+}
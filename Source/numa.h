@@ -0,0 +1,61 @@
+/*******************************************************************************
+*
+*  (C) COPYRIGHT AUTHORS, 2026
+*
+*  TITLE:       NUMA.H
+*
+*  VERSION:     1.05
+*
+*  DATE:        14 Oct 2026
+*
+*  Processor topology and large page support header file.
+*
+* THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+* ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED
+* TO THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*******************************************************************************/
+#pragma once
+
+#define NUMA_NODES_MAX 64
+#define NUMA_NODE_GROUPS_MAX 32
+
+//
+// Node may span several processor groups, one affinity entry per group.
+//
+typedef struct _NUMA_NODE_INFO {
+    ULONG NodeNumber;
+    ULONG ProcessorCount;
+    ULONG AffinityCount;
+    GROUP_AFFINITY Affinity[NUMA_NODE_GROUPS_MAX];
+} NUMA_NODE_INFO, * PNUMA_NODE_INFO;
+
+//
+// Nodes are in system order, processors of all groups are counted.
+//
+typedef struct _NUMA_TOPOLOGY {
+    ULONG NodeCount;
+    ULONG ProcessorCount;
+    NUMA_NODE_INFO Nodes[NUMA_NODES_MAX];
+} NUMA_TOPOLOGY, * PNUMA_TOPOLOGY;
+
+BOOLEAN NumaQueryTopology(
+    _Out_ PNUMA_TOPOLOGY Topology);
+
+PNUMA_NODE_INFO NumaSelectNode(
+    _In_ PNUMA_TOPOLOGY Topology,
+    _In_ ULONG WorkerId,
+    _In_ ULONG WorkerCount,
+    _Out_ PULONG AffinityIndex);
+
+BOOLEAN NumaBindThread(
+    _In_ PNUMA_NODE_INFO Node,
+    _In_ ULONG AffinityIndex,
+    _Out_ PGROUP_AFFINITY Previous);
+
+VOID NumaRestoreThread(
+    _In_ PGROUP_AFFINITY Previous);
+
+BOOLEAN NumaEnableLargePages(
+    VOID);
@@ -0,0 +1,404 @@
+/*******************************************************************************
+*
+*  (C) COPYRIGHT AUTHORS, 2026
+*
+*  TITLE:       OUTPUT.CPP
+*
+*  VERSION:     1.05
+*
+*  DATE:        14 Oct 2026
+*
+*  Buffered structured output writer.
+*
+*  Records are assembled as UTF-8 directly in a large writer buffer and
+*  passed to the CRT stream only when buffer is full or on flush. Writer is
+*  single threaded, batch mode calls it from the thread that runs BatchRun.
+*
+* THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+* ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED
+* TO THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*******************************************************************************/
+
+#include "global.h"
+
+//
+// Wide characters converted per WideCharToMultiByte call, bounds the
+// buffer space reserved for a run.
+//
+#define OUTPUT_CONVERT_CHUNK 1024
+
+//
+// Maximum UTF-8 bytes produced by single UTF-16 code unit.
+//
+#define OUTPUT_UTF8_MAX_PER_WCHAR 3
+
+/*
+* OutputInitialize
+*
+* Purpose:
+*
+* Allocate writer buffer and attach stream.
+*
+*/
+BOOLEAN OutputInitialize(
+    _Out_ POUTPUT_WRITER Writer,
+    _In_ FILE* Stream,
+    _In_ SIZE_T BufferSize
+)
+{
+    RtlSecureZeroMemory(Writer, sizeof(OUTPUT_WRITER));
+
+    if (BufferSize < OUTPUT_CONVERT_CHUNK * OUTPUT_UTF8_MAX_PER_WCHAR)
+        BufferSize = OUTPUT_CONVERT_CHUNK * OUTPUT_UTF8_MAX_PER_WCHAR;
+
+    Writer->Buffer = (PCHAR)supHeapAlloc(BufferSize);
+    if (Writer->Buffer == NULL)
+        return FALSE;
+
+    Writer->Stream = Stream;
+    Writer->Size = BufferSize;
+    return TRUE;
+}
+
+/*
+* OutputFlush
+*
+* Purpose:
+*
+* Pass buffered data to the stream.
+*
+*/
+VOID OutputFlush(
+    _In_ POUTPUT_WRITER Writer
+)
+{
+    if (Writer->Used) {
+        fwrite(Writer->Buffer, 1, Writer->Used, Writer->Stream);
+        Writer->Used = 0;
+    }
+    fflush(Writer->Stream);
+}
+
+/*
+* OutputRelease
+*
+* Purpose:
+*
+* Flush pending data and free writer buffer.
+*
+*/
+VOID OutputRelease(
+    _In_ POUTPUT_WRITER Writer
+)
+{
+    if (Writer->Buffer) {
+        OutputFlush(Writer);
+        supHeapFree(Writer->Buffer);
+        Writer->Buffer = NULL;
+    }
+    Writer->Size = 0;
+}
+
+/*
+* OutputpReserve
+*
+* Purpose:
+*
+* Return pointer to at least Length free bytes of the buffer, flushing it if needed.
+* Length must not exceed buffer size.
+*
+*/
+PCHAR OutputpReserve(
+    _In_ POUTPUT_WRITER Writer,
+    _In_ SIZE_T Length
+)
+{
+    if (Writer->Size - Writer->Used < Length) {
+        fwrite(Writer->Buffer, 1, Writer->Used, Writer->Stream);
+        Writer->Used = 0;
+    }
+
+    return Writer->Buffer + Writer->Used;
+}
+
+/*
+* OutputWrite
+*
+* Purpose:
+*
+* Append raw bytes.
+*
+*/
+VOID OutputWrite(
+    _In_ POUTPUT_WRITER Writer,
+    _In_reads_bytes_(Length) LPCSTR Data,
+    _In_ SIZE_T Length
+)
+{
+    if (Length > Writer->Size) {
+        OutputFlush(Writer);
+        fwrite(Data, 1, Length, Writer->Stream);
+        return;
+    }
+
+    RtlCopyMemory(OutputpReserve(Writer, Length), Data, Length);
+    Writer->Used += Length;
+}
+
+/*
+* OutputWriteString
+*
+* Purpose:
+*
+* Append zero terminated string.
+*
+*/
+VOID OutputWriteString(
+    _In_ POUTPUT_WRITER Writer,
+    _In_ LPCSTR String
+)
+{
+    OutputWrite(Writer, String, strlen(String));
+}
+
+/*
+* OutputWriteHex
+*
+* Purpose:
+*
+* Append binary data as uppercase hex.
+*
+*/
+VOID OutputWriteHex(
+    _In_ POUTPUT_WRITER Writer,
+    _In_reads_bytes_(Length) const UCHAR* Data,
+    _In_ ULONG Length
+)
+{
+    PCHAR p;
+    ULONG chunk;
+
+    while (Length) {
+
+        //
+        // Encoder terminates the string, terminator is overwritten by next write.
+        //
+        chunk = (ULONG)min(Length, (Writer->Size - 1) / 2);
+        p = OutputpReserve(Writer, (SIZE_T)chunk * 2 + 1);
+
+        Writer->Used += supHexEncodeA(Data, chunk, TRUE, p, (SIZE_T)chunk * 2 + 1);
+        Data += chunk;
+        Length -= chunk;
+    }
+}
+
+/*
+* OutputWriteUlongHex
+*
+* Purpose:
+*
+* Append value as eight digit uppercase hex.
+*
+*/
+VOID OutputWriteUlongHex(
+    _In_ POUTPUT_WRITER Writer,
+    _In_ ULONG Value
+)
+{
+    UCHAR bytes[sizeof(ULONG)];
+
+    bytes[0] = (UCHAR)(Value >> 24);
+    bytes[1] = (UCHAR)(Value >> 16);
+    bytes[2] = (UCHAR)(Value >> 8);
+    bytes[3] = (UCHAR)Value;
+
+    OutputWriteHex(Writer, bytes, sizeof(bytes));
+}
+
+/*
+* OutputpWriteUtf8
+*
+* Purpose:
+*
+* Convert wide characters to UTF-8 directly into the buffer.
+*
+*/
+VOID OutputpWriteUtf8(
+    _In_ POUTPUT_WRITER Writer,
+    _In_reads_(Length) LPCWSTR String,
+    _In_ SIZE_T Length
+)
+{
+    PCHAR p;
+    INT chunk, cb;
+    SIZE_T space;
+
+    while (Length) {
+
+        chunk = (INT)min(Length, OUTPUT_CONVERT_CHUNK);
+
+        //
+        // Do not split surrogate pair between conversions.
+        //
+        if ((SIZE_T)chunk < Length && IS_HIGH_SURROGATE(String[chunk - 1]) && chunk > 1)
+            chunk--;
+
+        space = (SIZE_T)chunk * OUTPUT_UTF8_MAX_PER_WCHAR;
+        p = OutputpReserve(Writer, space);
+
+        cb = WideCharToMultiByte(CP_UTF8, 0, String, chunk, p, (INT)space, NULL, NULL);
+        if (cb > 0)
+            Writer->Used += (SIZE_T)cb;
+
+        String += chunk;
+        Length -= chunk;
+    }
+}
+
+/*
+* OutputWriteJsonString
+*
+* Purpose:
+*
+* Append quoted and escaped JSON string.
+*
+*/
+VOID OutputWriteJsonString(
+    _In_ POUTPUT_WRITER Writer,
+    _In_ LPCWSTR String
+)
+{
+    LPCWSTR run = String;
+    WCHAR c;
+    CHAR escape[8];
+
+    OutputWrite(Writer, "\"", 1);
+
+    while ((c = *String) != 0) {
+
+        if (c == L'"' || c == L'\\' || c < 0x20) {
+
+            OutputpWriteUtf8(Writer, run, String - run);
+
+            switch (c) {
+            case L'"':
+                OutputWrite(Writer, "\\\"", 2);
+                break;
+            case L'\\':
+                OutputWrite(Writer, "\\\\", 2);
+                break;
+            case L'\n':
+                OutputWrite(Writer, "\\n", 2);
+                break;
+            case L'\r':
+                OutputWrite(Writer, "\\r", 2);
+                break;
+            case L'\t':
+                OutputWrite(Writer, "\\t", 2);
+                break;
+            default:
+                StringCchPrintfA(escape, RTL_NUMBER_OF(escape), "\\u%04X", (ULONG)c);
+                OutputWriteString(Writer, escape);
+                break;
+            }
+
+            run = String + 1;
+        }
+
+        String++;
+    }
+
+    OutputpWriteUtf8(Writer, run, String - run);
+    OutputWrite(Writer, "\"", 1);
+}
+
+/*
+* OutputWriteCsvField
+*
+* Purpose:
+*
+* Append CSV field, quoted when it contains separator, quote or line break.
+*
+*/
+VOID OutputWriteCsvField(
+    _In_ POUTPUT_WRITER Writer,
+    _In_ LPCWSTR String
+)
+{
+    LPCWSTR p, run;
+
+    for (p = String; *p; p++) {
+        if (*p == L',' || *p == L'"' || *p == L'\r' || *p == L'\n')
+            break;
+    }
+
+    if (*p == 0) {
+        OutputpWriteUtf8(Writer, String, p - String);
+        return;
+    }
+
+    OutputWrite(Writer, "\"", 1);
+
+    for (run = p = String; *p; p++) {
+        if (*p == L'"') {
+            OutputpWriteUtf8(Writer, run, p - run + 1);
+            OutputWrite(Writer, "\"", 1);
+            run = p + 1;
+        }
+    }
+
+    OutputpWriteUtf8(Writer, run, p - run);
+    OutputWrite(Writer, "\"", 1);
+}
+
+/*
+* OutputWriteXmlString
+*
+* Purpose:
+*
+* Append string escaped for XML attribute value in double quotes.
+* Control characters not allowed in XML 1.0 are replaced with '?'.
+*
+*/
+VOID OutputWriteXmlString(
+    _In_ POUTPUT_WRITER Writer,
+    _In_ LPCWSTR String
+)
+{
+    LPCWSTR run = String;
+    WCHAR c;
+
+    while ((c = *String) != 0) {
+
+        if (c == L'&' || c == L'<' || c == L'>' || c == L'"' || c < 0x20) {
+
+            OutputpWriteUtf8(Writer, run, String - run);
+
+            switch (c) {
+            case L'&':
+                OutputWrite(Writer, "&amp;", 5);
+                break;
+            case L'<':
+                OutputWrite(Writer, "&lt;", 4);
+                break;
+            case L'>':
+                OutputWrite(Writer, "&gt;", 4);
+                break;
+            case L'"':
+                OutputWrite(Writer, "&quot;", 6);
+                break;
+            default:
+                OutputWrite(Writer, "?", 1);
+                break;
+            }
+
+            run = String + 1;
+        }
+
+        String++;
+    }
+
+    OutputpWriteUtf8(Writer, run, String - run);
+}
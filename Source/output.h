@@ -0,0 +1,74 @@
+/*******************************************************************************
+*
+*  (C) COPYRIGHT AUTHORS, 2026
+*
+*  TITLE:       OUTPUT.H
+*
+*  VERSION:     1.05
+*
+*  DATE:        14 Oct 2026
+*
+*  Buffered structured output writer header file.
+*
+* THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+* ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED
+* TO THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*******************************************************************************/
+#pragma once
+
+#define OUTPUT_FORMAT_TEXT  0
+#define OUTPUT_FORMAT_JSONL 1
+#define OUTPUT_FORMAT_CSV   2
+#define OUTPUT_FORMAT_WDAC  3
+
+#define OUTPUT_BUFFER_SIZE  RTL_MEG
+
+typedef struct _OUTPUT_WRITER {
+    FILE* Stream;
+    PCHAR Buffer;
+    SIZE_T Size;
+    SIZE_T Used;
+} OUTPUT_WRITER, * POUTPUT_WRITER;
+
+BOOLEAN OutputInitialize(
+    _Out_ POUTPUT_WRITER Writer,
+    _In_ FILE* Stream,
+    _In_ SIZE_T BufferSize);
+
+VOID OutputFlush(
+    _In_ POUTPUT_WRITER Writer);
+
+VOID OutputRelease(
+    _In_ POUTPUT_WRITER Writer);
+
+VOID OutputWrite(
+    _In_ POUTPUT_WRITER Writer,
+    _In_reads_bytes_(Length) LPCSTR Data,
+    _In_ SIZE_T Length);
+
+VOID OutputWriteString(
+    _In_ POUTPUT_WRITER Writer,
+    _In_ LPCSTR String);
+
+VOID OutputWriteHex(
+    _In_ POUTPUT_WRITER Writer,
+    _In_reads_bytes_(Length) const UCHAR* Data,
+    _In_ ULONG Length);
+
+VOID OutputWriteUlongHex(
+    _In_ POUTPUT_WRITER Writer,
+    _In_ ULONG Value);
+
+VOID OutputWriteJsonString(
+    _In_ POUTPUT_WRITER Writer,
+    _In_ LPCWSTR String);
+
+VOID OutputWriteCsvField(
+    _In_ POUTPUT_WRITER Writer,
+    _In_ LPCWSTR String);
+
+VOID OutputWriteXmlString(
+    _In_ POUTPUT_WRITER Writer,
+    _In_ LPCWSTR String);
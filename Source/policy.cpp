@@ -0,0 +1,347 @@
+/*******************************************************************************
+*
+*  (C) COPYRIGHT AUTHORS, 2026
+*
+*  TITLE:       POLICY.CPP
+*
+*  VERSION:     1.05
+*
+*  DATE:        14 Oct 2026
+*
+*  WDAC policy file rules writer.
+*
+*  Hash rules are streamed into the output writer as results arrive, one
+*  Allow rule per distinct hash and signing scenario. Rule identifiers are
+*  sequential within a scenario, so the scenario references are generated
+*  at the end without keeping the rules. Writer is used from the single
+*  output thread.
+*
+* THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+* ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED
+* TO THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*******************************************************************************/
+
+#include "global.h"
+
+static LPCSTR g_PolicyRulePrefixes[POLICY_SCENARIO_COUNT] = {
+    "\"ID_ALLOW_A_",
+    "\"ID_ALLOW_K_"
+};
+
+static LPCSTR g_PolicyHashNames[POLICY_HASH_COUNT] = {
+    " Hash Sha1",
+    " Hash Sha256",
+    " Hash Page Sha1",
+    " Hash Page Sha256"
+};
+
+/*
+* PolicyQueryHashKind
+*
+* Purpose:
+*
+* Return rule kind for digest algorithm, POLICY_HASH_NONE if policy
+* has no hash rules of this algorithm.
+*
+*/
+ULONG PolicyQueryHashKind(
+    _In_ LPCWSTR AlgId,
+    _In_ BOOLEAN PageHash
+)
+{
+    if (_wcsicmp(AlgId, BCRYPT_SHA1_ALGORITHM) == 0)
+        return (PageHash) ? POLICY_HASH_PAGE_SHA1 : POLICY_HASH_SHA1;
+
+    if (_wcsicmp(AlgId, BCRYPT_SHA256_ALGORITHM) == 0)
+        return (PageHash) ? POLICY_HASH_PAGE_SHA256 : POLICY_HASH_SHA256;
+
+    return POLICY_HASH_NONE;
+}
+
+/*
+* PolicypSlot
+*
+* Purpose:
+*
+* Return slot holding given hash or free slot where it belongs.
+* Digests are uniformly distributed, their leading bytes are the hash.
+*
+*/
+PPOLICY_SET_ENTRY PolicypSlot(
+    _In_ PPOLICY_SET_ENTRY Entries,
+    _In_ ULONG Capacity,
+    _In_ ULONG Scenario,
+    _In_ ULONG Kind,
+    _In_reads_bytes_(Length) const UCHAR* Digest,
+    _In_ ULONG Length
+)
+{
+    ULONG index, mask = Capacity - 1;
+    PPOLICY_SET_ENTRY entry;
+
+    index = ((ULONG)Digest[0] | ((ULONG)Digest[1] << 8) |
+        ((ULONG)Digest[2] << 16) | ((ULONG)Digest[3] << 24)) ^
+        ((Kind + Scenario * POLICY_HASH_COUNT) * 0x9E3779B9);
+
+    for (;; index++) {
+
+        entry = &Entries[index & mask];
+
+        if (!entry->Used)
+            return entry;
+
+        if (entry->Kind == Kind &&
+            entry->Scenario == Scenario &&
+            entry->Length == Length &&
+            RtlEqualMemory(entry->Digest, Digest, Length))
+        {
+            return entry;
+        }
+    }
+}
+
+/*
+* PolicypGrow
+*
+* Purpose:
+*
+* Double set capacity and rehash entries.
+*
+*/
+BOOLEAN PolicypGrow(
+    _In_ PPOLICY_WRITER Policy
+)
+{
+    ULONG i, capacity = Policy->Capacity * 2;
+    PPOLICY_SET_ENTRY entries, entry, slot;
+
+    entries = (PPOLICY_SET_ENTRY)supHeapAlloc((SIZE_T)capacity * sizeof(POLICY_SET_ENTRY));
+    if (entries == NULL)
+        return FALSE;
+
+    for (i = 0; i < Policy->Capacity; i++) {
+
+        entry = &Policy->Entries[i];
+        if (!entry->Used)
+            continue;
+
+        slot = PolicypSlot(entries, capacity, entry->Scenario, entry->Kind, entry->Digest, entry->Length);
+        *slot = *entry;
+    }
+
+    supHeapFree(Policy->Entries);
+    Policy->Entries = entries;
+    Policy->Capacity = capacity;
+    return TRUE;
+}
+
+/*
+* PolicypWriteRuleId
+*
+* Purpose:
+*
+* Append rule identifier.
+*
+*/
+VOID PolicypWriteRuleId(
+    _In_ POUTPUT_WRITER Writer,
+    _In_ ULONG Scenario,
+    _In_ ULONG RuleIndex
+)
+{
+    OutputWriteString(Writer, g_PolicyRulePrefixes[Scenario]);
+    OutputWriteUlongHex(Writer, RuleIndex);
+    OutputWrite(Writer, "\"", 1);
+}
+
+/*
+* PolicyBegin
+*
+* Purpose:
+*
+* Allocate hash set and write policy prologue. Rule options make the
+* policy unsigned, audit mode and user mode enforcing once audit is
+* turned off; they are meant to be adjusted with Set-RuleOption.
+*
+*/
+BOOLEAN PolicyBegin(
+    _Out_ PPOLICY_WRITER Policy,
+    _In_ POUTPUT_WRITER Writer
+)
+{
+    RtlSecureZeroMemory(Policy, sizeof(POLICY_WRITER));
+
+    Policy->Entries = (PPOLICY_SET_ENTRY)supHeapAlloc(
+        (SIZE_T)POLICY_SET_MIN_CAPACITY * sizeof(POLICY_SET_ENTRY));
+
+    if (Policy->Entries == NULL)
+        return FALSE;
+
+    Policy->Capacity = POLICY_SET_MIN_CAPACITY;
+    Policy->Writer = Writer;
+
+    OutputWriteString(Writer,
+        "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+        "<SiPolicy xmlns=\"urn:schemas-microsoft-com:sipolicy\">\n"
+        "  <VersionEx>10.0.0.0</VersionEx>\n"
+        "  <PlatformID>{2E07F7E4-194C-4D20-B7C9-6F44A6C5A234}</PlatformID>\n"
+        "  <Rules>\n"
+        "    <Rule>\n"
+        "      <Option>Enabled:Unsigned System Integrity Policy</Option>\n"
+        "    </Rule>\n"
+        "    <Rule>\n"
+        "      <Option>Enabled:Audit Mode</Option>\n"
+        "    </Rule>\n"
+        "    <Rule>\n"
+        "      <Option>Enabled:UMCI</Option>\n"
+        "    </Rule>\n"
+        "  </Rules>\n"
+        "  <EKUs />\n"
+        "  <FileRules>\n");
+
+    return TRUE;
+}
+
+/*
+* PolicyAddHash
+*
+* Purpose:
+*
+* Write Allow rule for the hash unless the same hash of this kind was
+* already written for the scenario. Returns TRUE if rule was written.
+*
+*/
+BOOLEAN PolicyAddHash(
+    _In_ PPOLICY_WRITER Policy,
+    _In_ LPCWSTR FileName,
+    _In_ ULONG Scenario,
+    _In_ ULONG Kind,
+    _In_reads_bytes_(Length) const UCHAR* Digest,
+    _In_ ULONG Length
+)
+{
+    POUTPUT_WRITER writer = Policy->Writer;
+    PPOLICY_SET_ENTRY slot;
+
+    if (Scenario >= POLICY_SCENARIO_COUNT ||
+        Kind >= POLICY_HASH_COUNT ||
+        Length == 0 ||
+        Length > POLICY_DIGEST_MAX_SIZE)
+    {
+        return FALSE;
+    }
+
+    slot = PolicypSlot(Policy->Entries, Policy->Capacity, Scenario, Kind, Digest, Length);
+    if (slot->Used) {
+        Policy->Duplicates += 1;
+        return FALSE;
+    }
+
+    if (Policy->Count >= Policy->Capacity / 2 && PolicypGrow(Policy))
+        slot = PolicypSlot(Policy->Entries, Policy->Capacity, Scenario, Kind, Digest, Length);
+
+    //
+    // Set that cannot grow stops recording, later duplicates of unrecorded
+    // hashes become separate rules which policy still accepts.
+    //
+    if (Policy->Count < Policy->Capacity / 2) {
+        slot->Used = TRUE;
+        slot->Kind = (UCHAR)Kind;
+        slot->Scenario = (UCHAR)Scenario;
+        slot->Length = (UCHAR)Length;
+        RtlCopyMemory(slot->Digest, Digest, Length);
+        Policy->Count += 1;
+    }
+
+    Policy->RuleCount[Scenario] += 1;
+
+    OutputWriteString(writer, "    <Allow ID=");
+    PolicypWriteRuleId(writer, Scenario, Policy->RuleCount[Scenario]);
+    OutputWriteString(writer, " FriendlyName=\"");
+    OutputWriteXmlString(writer, FileName);
+    OutputWriteString(writer, g_PolicyHashNames[Kind]);
+    OutputWriteString(writer, "\" Hash=\"");
+    OutputWriteHex(writer, Digest, Length);
+    OutputWriteString(writer, "\" />\n");
+
+    return TRUE;
+}
+
+/*
+* PolicypWriteScenario
+*
+* Purpose:
+*
+* Write signing scenario referencing every rule of the scenario.
+*
+*/
+VOID PolicypWriteScenario(
+    _In_ PPOLICY_WRITER Policy,
+    _In_ ULONG Scenario,
+    _In_ LPCSTR Header
+)
+{
+    ULONG i;
+    POUTPUT_WRITER writer = Policy->Writer;
+
+    OutputWriteString(writer, Header);
+    OutputWriteString(writer, "      <ProductSigners>\n");
+
+    if (Policy->RuleCount[Scenario]) {
+
+        OutputWriteString(writer, "        <FileRulesRef>\n");
+
+        for (i = 1; i <= Policy->RuleCount[Scenario]; i++) {
+            OutputWriteString(writer, "          <FileRuleRef RuleID=");
+            PolicypWriteRuleId(writer, Scenario, i);
+            OutputWriteString(writer, " />\n");
+        }
+
+        OutputWriteString(writer, "        </FileRulesRef>\n");
+    }
+
+    OutputWriteString(writer,
+        "      </ProductSigners>\n"
+        "    </SigningScenario>\n");
+}
+
+/*
+* PolicyEnd
+*
+* Purpose:
+*
+* Write kernel and user mode signing scenarios, close the policy and
+* release hash set.
+*
+*/
+VOID PolicyEnd(
+    _In_ PPOLICY_WRITER Policy
+)
+{
+    POUTPUT_WRITER writer = Policy->Writer;
+
+    OutputWriteString(writer,
+        "  </FileRules>\n"
+        "  <Signers />\n"
+        "  <SigningScenarios>\n");
+
+    PolicypWriteScenario(Policy, POLICY_SCENARIO_KERNEL,
+        "    <SigningScenario Value=\"131\" ID=\"ID_SIGNINGSCENARIO_DRIVERS_1\" FriendlyName=\"Kernel mode hash rules\">\n");
+
+    PolicypWriteScenario(Policy, POLICY_SCENARIO_USER,
+        "    <SigningScenario Value=\"12\" ID=\"ID_SIGNINGSCENARIO_WINDOWS\" FriendlyName=\"User mode hash rules\">\n");
+
+    OutputWriteString(writer,
+        "  </SigningScenarios>\n"
+        "  <UpdatePolicySigners />\n"
+        "  <CiSigners />\n"
+        "  <HvciOptions>0</HvciOptions>\n"
+        "</SiPolicy>\n");
+
+    if (Policy->Entries) {
+        supHeapFree(Policy->Entries);
+        Policy->Entries = NULL;
+    }
+}
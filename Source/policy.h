@@ -0,0 +1,80 @@
+/*******************************************************************************
+*
+*  (C) COPYRIGHT AUTHORS, 2026
+*
+*  TITLE:       POLICY.H
+*
+*  VERSION:     1.05
+*
+*  DATE:        14 Oct 2026
+*
+*  WDAC policy file rules writer header file.
+*
+* THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+* ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED
+* TO THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*******************************************************************************/
+#pragma once
+
+//
+// Hash rule kinds, named the way ConfigCI names hash rules.
+//
+#define POLICY_HASH_SHA1        0
+#define POLICY_HASH_SHA256      1
+#define POLICY_HASH_PAGE_SHA1   2
+#define POLICY_HASH_PAGE_SHA256 3
+#define POLICY_HASH_COUNT       4
+#define POLICY_HASH_NONE        ((ULONG)-1)
+
+#define POLICY_DIGEST_MAX_SIZE  32
+
+//
+// Signing scenarios, rules of kernel mode images are referenced from the
+// driver scenario, all others from the user mode scenario.
+//
+#define POLICY_SCENARIO_USER    0
+#define POLICY_SCENARIO_KERNEL  1
+#define POLICY_SCENARIO_COUNT   2
+
+//
+// Initial set capacity, power of two. Set grows at half load.
+//
+#define POLICY_SET_MIN_CAPACITY 4096
+
+typedef struct _POLICY_SET_ENTRY {
+    UCHAR Used;
+    UCHAR Kind;
+    UCHAR Length;
+    UCHAR Scenario;
+    UCHAR Digest[POLICY_DIGEST_MAX_SIZE];
+} POLICY_SET_ENTRY, * PPOLICY_SET_ENTRY;
+
+typedef struct _POLICY_WRITER {
+    POUTPUT_WRITER Writer;
+    PPOLICY_SET_ENTRY Entries;
+    ULONG Capacity;
+    ULONG Count;
+    ULONG RuleCount[POLICY_SCENARIO_COUNT];
+    ULONG Duplicates;
+} POLICY_WRITER, * PPOLICY_WRITER;
+
+ULONG PolicyQueryHashKind(
+    _In_ LPCWSTR AlgId,
+    _In_ BOOLEAN PageHash);
+
+BOOLEAN PolicyBegin(
+    _Out_ PPOLICY_WRITER Policy,
+    _In_ POUTPUT_WRITER Writer);
+
+BOOLEAN PolicyAddHash(
+    _In_ PPOLICY_WRITER Policy,
+    _In_ LPCWSTR FileName,
+    _In_ ULONG Scenario,
+    _In_ ULONG Kind,
+    _In_reads_bytes_(Length) const UCHAR* Digest,
+    _In_ ULONG Length);
+
+VOID PolicyEnd(
+    _In_ PPOLICY_WRITER Policy);
@@ -0,0 +1,378 @@
+/*******************************************************************************
+*
+*  (C) COPYRIGHT AUTHORS, 2026
+*
+*  TITLE:       READER.CPP
+*
+*  VERSION:     1.05
+*
+*  DATE:        14 Oct 2026
+*
+*  Unbuffered overlapped file reader.
+*
+*  Keeps READER_BLOCKS_COUNT aligned reads in flight ahead of the consumer,
+*  block preceding the one being consumed stays valid until next acquire.
+*
+* THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+* ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED
+* TO THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*******************************************************************************/
+
+#include "global.h"
+
+/*
+* ReaderpIssue
+*
+* Purpose:
+*
+* Start read of the block at given aligned offset.
+*
+*/
+VOID ReaderpIssue(
+    _In_ PFILE_READER Reader,
+    _In_ PREADER_BLOCK Block,
+    _In_ ULONGLONG Offset
+)
+{
+    DWORD dwError;
+
+    Block->Offset = Offset;
+    Block->Valid = 0;
+    Block->Status = STATUS_SUCCESS;
+    Block->Completed = FALSE;
+    Block->Issued = FALSE;
+
+    if (Offset >= Reader->FileSize)
+        return;
+
+    ResetEvent(Block->Overlapped.hEvent);
+    Block->Overlapped.Offset = (DWORD)Offset;
+    Block->Overlapped.OffsetHigh = (DWORD)(Offset >> 32);
+    Block->Overlapped.Internal = 0;
+    Block->Overlapped.InternalHigh = 0;
+
+    Block->Issued = TRUE;
+
+    if (!ReadFile(Reader->FileHandle,
+        Block->Buffer,
+        READER_BLOCK_SIZE,
+        NULL,
+        &Block->Overlapped))
+    {
+        dwError = GetLastError();
+        if (dwError != ERROR_IO_PENDING) {
+            Block->Completed = TRUE;
+            Block->Status = (dwError == ERROR_HANDLE_EOF) ? STATUS_END_OF_FILE : STATUS_IN_PAGE_ERROR;
+        }
+    }
+}
+
+/*
+* ReaderpWait
+*
+* Purpose:
+*
+* Wait for block read completion.
+*
+*/
+NTSTATUS ReaderpWait(
+    _In_ PFILE_READER Reader,
+    _In_ PREADER_BLOCK Block
+)
+{
+    DWORD cbRead = 0, dwError;
+
+    if (!Block->Issued)
+        return STATUS_END_OF_FILE;
+
+    if (!Block->Completed) {
+
+        Block->Completed = TRUE;
+
+        if (GetOverlappedResult(Reader->FileHandle, &Block->Overlapped, &cbRead, TRUE)) {
+            Block->Valid = cbRead;
+        }
+        else {
+            dwError = GetLastError();
+            Block->Status = (dwError == ERROR_HANDLE_EOF) ? STATUS_END_OF_FILE : STATUS_IN_PAGE_ERROR;
+        }
+    }
+
+    return Block->Status;
+}
+
+/*
+* ReaderpCancel
+*
+* Purpose:
+*
+* Cancel and wait all outstanding reads.
+*
+*/
+VOID ReaderpCancel(
+    _In_ PFILE_READER Reader
+)
+{
+    ULONG i;
+    PREADER_BLOCK block;
+
+    for (i = 0; i < READER_BLOCKS_COUNT; i++) {
+
+        block = &Reader->Blocks[i];
+        if (block->Issued && !block->Completed) {
+            CancelIoEx(Reader->FileHandle, &block->Overlapped);
+            ReaderpWait(Reader, block);
+        }
+
+        block->Issued = FALSE;
+    }
+}
+
+/*
+* ReaderpRestart
+*
+* Purpose:
+*
+* Drop all blocks and start reading at given offset.
+*
+*/
+VOID ReaderpRestart(
+    _In_ PFILE_READER Reader,
+    _In_ ULONGLONG Offset
+)
+{
+    ULONG i;
+
+    ReaderpCancel(Reader);
+
+    Offset &= ~((ULONGLONG)READER_ALIGN - 1);
+
+    for (i = 0; i < READER_BLOCKS_COUNT; i++) {
+        ReaderpIssue(Reader, &Reader->Blocks[i], Offset);
+        Offset += READER_BLOCK_SIZE;
+    }
+
+    Reader->NextOffset = Offset;
+}
+
+/*
+* ReaderpFindBlock
+*
+* Purpose:
+*
+* Return issued block containing file offset.
+*
+*/
+PREADER_BLOCK ReaderpFindBlock(
+    _In_ PFILE_READER Reader,
+    _In_ ULONGLONG Offset
+)
+{
+    ULONG i;
+    PREADER_BLOCK block;
+
+    for (i = 0; i < READER_BLOCKS_COUNT; i++) {
+        block = &Reader->Blocks[i];
+        if (block->Issued &&
+            Offset >= block->Offset &&
+            Offset < block->Offset + READER_BLOCK_SIZE)
+        {
+            return block;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+* ReaderOpen
+*
+* Purpose:
+*
+* Open file for unbuffered overlapped reading.
+* Returned reader must be released with ReaderClose.
+*
+* Reader and its buffers are taken from the optional worker arena,
+* they stay there until the arena is reset after the file. Large page
+* buffers of the arena are returned to it on close.
+*
+*/
+NTSTATUS ReaderOpen(
+    _In_ LPCWSTR FileName,
+    _In_ ULONGLONG FileSize,
+    _In_opt_ PARENA Arena,
+    _Out_ PFILE_READER* Reader
+)
+{
+    NTSTATUS ntStatus = STATUS_INSUFFICIENT_RESOURCES;
+    ULONG i;
+    PFILE_READER reader;
+
+    *Reader = NULL;
+
+    reader = (PFILE_READER)ArenaHeapAlloc(Arena, sizeof(FILE_READER));
+    if (reader == NULL)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    reader->FileSize = FileSize;
+    reader->Arena = Arena;
+
+    do {
+
+        reader->FileHandle = CreateFile(FileName,
+            GENERIC_READ,
+            FILE_SHARE_READ,
+            NULL,
+            OPEN_EXISTING,
+            FILE_FLAG_NO_BUFFERING | FILE_FLAG_OVERLAPPED | FILE_FLAG_SEQUENTIAL_SCAN,
+            NULL);
+
+        if (reader->FileHandle == INVALID_HANDLE_VALUE) {
+            reader->FileHandle = NULL;
+            ntStatus = STATUS_OBJECT_NAME_NOT_FOUND;
+            break;
+        }
+
+        //
+        // All sources are page aligned as unbuffered I/O requires. Large
+        // page block, when enabled, spares TLB misses over the whole ring.
+        //
+        reader->Buffers = (PUCHAR)ArenaAcquireLarge(Arena,
+            (SIZE_T)READER_BLOCKS_COUNT * READER_BLOCK_SIZE);
+
+        if (reader->Buffers == NULL) {
+            reader->Buffers = (PUCHAR)ArenaAlloc(Arena,
+                (SIZE_T)READER_BLOCKS_COUNT * READER_BLOCK_SIZE,
+                READER_ALIGN);
+        }
+
+        if (reader->Buffers == NULL) {
+            reader->Buffers = (PUCHAR)VirtualAllocExNuma(GetCurrentProcess(),
+                NULL,
+                (SIZE_T)READER_BLOCKS_COUNT * READER_BLOCK_SIZE,
+                MEM_COMMIT | MEM_RESERVE,
+                PAGE_READWRITE,
+                (Arena && Arena->Base) ? Arena->Node : NUMA_NO_PREFERRED_NODE);
+        }
+
+        if (reader->Buffers == NULL)
+            break;
+
+        for (i = 0; i < READER_BLOCKS_COUNT; i++) {
+            reader->Blocks[i].Buffer = reader->Buffers + (SIZE_T)i * READER_BLOCK_SIZE;
+            reader->Blocks[i].Overlapped.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+            if (reader->Blocks[i].Overlapped.hEvent == NULL)
+                break;
+        }
+
+        if (i != READER_BLOCKS_COUNT)
+            break;
+
+        *Reader = reader;
+        return STATUS_SUCCESS;
+
+    } while (FALSE);
+
+    ReaderClose(reader);
+    return ntStatus;
+}
+
+/*
+* ReaderClose
+*
+* Purpose:
+*
+* Cancel outstanding reads and release reader.
+*
+*/
+VOID ReaderClose(
+    _In_ PFILE_READER Reader
+)
+{
+    ULONG i;
+
+    if (Reader->FileHandle)
+        ReaderpCancel(Reader);
+
+    for (i = 0; i < READER_BLOCKS_COUNT; i++) {
+        if (Reader->Blocks[i].Overlapped.hEvent)
+            CloseHandle(Reader->Blocks[i].Overlapped.hEvent);
+    }
+
+    if (Reader->Buffers) {
+        if (Reader->Arena && Reader->Buffers == Reader->Arena->LargeBase)
+            ArenaReleaseLarge(Reader->Arena, Reader->Buffers);
+        else if (!ArenaContains(Reader->Arena, Reader->Buffers))
+            VirtualFree(Reader->Buffers, 0, MEM_RELEASE);
+    }
+
+    if (Reader->FileHandle)
+        CloseHandle(Reader->FileHandle);
+
+    ArenaHeapFree(Reader->Arena, Reader);
+}
+
+/*
+* ReaderAcquire
+*
+* Purpose:
+*
+* Return block holding file data at given offset.
+*
+* Blocks older than the one preceding returned block are recycled for
+* reads ahead. Offset outside of blocks in flight restarts reading there.
+*
+*/
+NTSTATUS ReaderAcquire(
+    _In_ PFILE_READER Reader,
+    _In_ ULONGLONG Offset,
+    _Out_ PFILE_WINDOW Block
+)
+{
+    NTSTATUS ntStatus;
+    ULONG i;
+    PREADER_BLOCK block, recycled;
+
+    RtlSecureZeroMemory(Block, sizeof(FILE_WINDOW));
+
+    if (Offset >= Reader->FileSize)
+        return STATUS_END_OF_FILE;
+
+    block = ReaderpFindBlock(Reader, Offset);
+    if (block == NULL) {
+        ReaderpRestart(Reader, Offset);
+        block = ReaderpFindBlock(Reader, Offset);
+        if (block == NULL)
+            return STATUS_END_OF_FILE;
+    }
+
+    //
+    // Keep previous block for consumers still referencing it.
+    //
+    for (i = 0; i < READER_BLOCKS_COUNT; i++) {
+
+        recycled = &Reader->Blocks[i];
+        if (recycled->Issued &&
+            recycled->Offset + READER_BLOCK_SIZE < block->Offset)
+        {
+            ReaderpWait(Reader, recycled);
+            ReaderpIssue(Reader, recycled, Reader->NextOffset);
+            Reader->NextOffset += READER_BLOCK_SIZE;
+        }
+    }
+
+    ntStatus = ReaderpWait(Reader, block);
+    if (!NT_SUCCESS(ntStatus))
+        return ntStatus;
+
+    if (Offset >= block->Offset + block->Valid)
+        return STATUS_END_OF_FILE;
+
+    Block->Base = block->Buffer;
+    Block->Offset = block->Offset;
+    Block->Size = block->Valid;
+
+    return STATUS_SUCCESS;
+}
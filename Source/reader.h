@@ -0,0 +1,60 @@
+/*******************************************************************************
+*
+*  (C) COPYRIGHT AUTHORS, 2026
+*
+*  TITLE:       READER.H
+*
+*  VERSION:     1.05
+*
+*  DATE:        14 Oct 2026
+*
+*  Unbuffered overlapped file reader header file.
+*
+* THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+* ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED
+* TO THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*******************************************************************************/
+#pragma once
+
+//
+// Reads in flight and size of each, offsets and sizes are kept
+// page aligned which satisfies any sector size up to 4K.
+//
+#define READER_BLOCKS_COUNT 8
+#define READER_BLOCK_SIZE   RTL_MEG
+#define READER_ALIGN        0x1000
+
+typedef struct _READER_BLOCK {
+    OVERLAPPED Overlapped;
+    PUCHAR Buffer;
+    ULONGLONG Offset;
+    ULONG Valid;
+    NTSTATUS Status;
+    BOOLEAN Issued;
+    BOOLEAN Completed;
+} READER_BLOCK, * PREADER_BLOCK;
+
+typedef struct _FILE_READER {
+    HANDLE FileHandle;
+    ULONGLONG FileSize;
+    ULONGLONG NextOffset;
+    PUCHAR Buffers;
+    PARENA Arena;
+    READER_BLOCK Blocks[READER_BLOCKS_COUNT];
+} FILE_READER, * PFILE_READER;
+
+NTSTATUS ReaderOpen(
+    _In_ LPCWSTR FileName,
+    _In_ ULONGLONG FileSize,
+    _In_opt_ PARENA Arena,
+    _Out_ PFILE_READER* Reader);
+
+VOID ReaderClose(
+    _In_ PFILE_READER Reader);
+
+NTSTATUS ReaderAcquire(
+    _In_ PFILE_READER Reader,
+    _In_ ULONGLONG Offset,
+    _Out_ PFILE_WINDOW Block);
@@ -28,6 +28,8 @@
 #define IDC_BUTTON_COPY_SHA512          1023
 #define IDC_BUTTON_COPY_PHSHA1          1024
 #define IDC_BUTTON_COPY_PHSHA256        1025
+#define IDC_PROGRESS                    1026
+#define IDC_BUTTON_CANCEL               1027
 
 // Next default values for new objects
 // 
@@ -35,7 +37,7 @@
 #ifndef APSTUDIO_READONLY_SYMBOLS
 #define _APS_NEXT_RESOURCE_VALUE        106
 #define _APS_NEXT_COMMAND_VALUE         40001
-#define _APS_NEXT_CONTROL_VALUE         1020
+#define _APS_NEXT_CONTROL_VALUE         1028
 #define _APS_NEXT_SYMED_VALUE           101
 #endif
 #endif
@@ -0,0 +1,496 @@
+/*******************************************************************************
+*
+*  (C) COPYRIGHT AUTHORS, 2026
+*
+*  TITLE:       SERVE.CPP
+*
+*  VERSION:     1.05
+*
+*  DATE:        14 Oct 2026
+*
+*  Named pipe request server.
+*
+*  Every pipe instance is served by its own thread that keeps worker data
+*  (hash contexts, scratch arena) for the whole run. Connection is a stream
+*  of request lines, each answered by one record written through the output
+*  writer and flushed to the pipe before the next request is read:
+*
+*    <file name>\n                  hash file
+*    *<size> <name>\n<size bytes>   hash image passed in-line
+*    *stop\n                        stop the server
+*
+*  Instance threads block in pipe I/O for the lifetime of a connection, so
+*  they are dedicated threads rather than thread pool work.
+*
+* THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+* ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED
+* TO THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*******************************************************************************/
+
+#include "global.h"
+#include <io.h>
+#include <fcntl.h>
+
+C_ASSERT(SERVE_MAX_INSTANCES <= MAXIMUM_WAIT_OBJECTS);
+
+//
+// Interval of waking instance threads while server stops.
+//
+#define SERVE_STOP_POLL_MS 100
+
+typedef struct _SERVE_CONTEXT {
+    PSERVE_CALLBACKS Callbacks;
+    HANDLE StopEvent;
+    volatile LONG Stop;
+} SERVE_CONTEXT, * PSERVE_CONTEXT;
+
+typedef struct _SERVE_INSTANCE {
+    PSERVE_CONTEXT Context;
+    HANDLE PipeHandle;
+    PVOID WorkerData;
+
+    //
+    // Received data not consumed yet is Line[LineStart..LineEnd).
+    //
+    PCHAR Line;
+    SIZE_T LineStart;
+    SIZE_T LineEnd;
+
+    PWCHAR Name;
+} SERVE_INSTANCE, * PSERVE_INSTANCE;
+
+static HANDLE g_ServeStopEvent;
+
+/*
+* ServepCtrlHandler
+*
+* Purpose:
+*
+* Stop server on console break.
+*
+*/
+BOOL WINAPI ServepCtrlHandler(
+    _In_ DWORD CtrlType
+)
+{
+    UNREFERENCED_PARAMETER(CtrlType);
+
+    if (g_ServeStopEvent)
+        SetEvent(g_ServeStopEvent);
+
+    return TRUE;
+}
+
+/*
+* ServepReadLine
+*
+* Purpose:
+*
+* Return next zero terminated request line without line break.
+* Fails when client disconnects or line does not fit the buffer.
+*
+*/
+BOOLEAN ServepReadLine(
+    _In_ PSERVE_INSTANCE Instance,
+    _Out_ PCHAR* Line
+)
+{
+    DWORD cbRead;
+    SIZE_T cbLine;
+    PCHAR line, p;
+
+    *Line = NULL;
+
+    for (;;) {
+
+        line = Instance->Line + Instance->LineStart;
+        p = (PCHAR)memchr(line, '\n', Instance->LineEnd - Instance->LineStart);
+
+        if (p) {
+            Instance->LineStart = (SIZE_T)(p - Instance->Line) + 1;
+
+            cbLine = (SIZE_T)(p - line);
+            if (cbLine && line[cbLine - 1] == '\r')
+                cbLine -= 1;
+
+            line[cbLine] = 0;
+            *Line = line;
+            return TRUE;
+        }
+
+        if (Instance->LineStart) {
+            memmove(Instance->Line, line, Instance->LineEnd - Instance->LineStart);
+            Instance->LineEnd -= Instance->LineStart;
+            Instance->LineStart = 0;
+        }
+
+        if (Instance->LineEnd == SERVE_LINE_MAX)
+            return FALSE;
+
+        if (!ReadFile(Instance->PipeHandle,
+            Instance->Line + Instance->LineEnd,
+            (DWORD)(SERVE_LINE_MAX - Instance->LineEnd),
+            &cbRead,
+            NULL) || cbRead == 0)
+        {
+            return FALSE;
+        }
+
+        Instance->LineEnd += cbRead;
+    }
+}
+
+/*
+* ServepReadData
+*
+* Purpose:
+*
+* Read in-line image that follows request line.
+*
+*/
+BOOLEAN ServepReadData(
+    _In_ PSERVE_INSTANCE Instance,
+    _Out_writes_bytes_(Size) PUCHAR Data,
+    _In_ SIZE_T Size
+)
+{
+    DWORD cbRead;
+    SIZE_T cbBuffered;
+
+    cbBuffered = min(Size, Instance->LineEnd - Instance->LineStart);
+    RtlCopyMemory(Data, Instance->Line + Instance->LineStart, cbBuffered);
+    Instance->LineStart += cbBuffered;
+
+    Data += cbBuffered;
+    Size -= cbBuffered;
+
+    while (Size) {
+
+        if (!ReadFile(Instance->PipeHandle, Data, (DWORD)Size, &cbRead, NULL) || cbRead == 0)
+            return FALSE;
+
+        Data += cbRead;
+        Size -= cbRead;
+    }
+
+    return TRUE;
+}
+
+/*
+* ServepParseRequest
+*
+* Purpose:
+*
+* Convert request line to request, in-line image is read from the pipe.
+* Returns FALSE when connection cannot continue.
+*
+*/
+BOOLEAN ServepParseRequest(
+    _In_ PSERVE_INSTANCE Instance,
+    _In_ PCHAR Line,
+    _Out_ PSERVE_REQUEST Request
+)
+{
+    ULONGLONG size;
+    PCHAR name = Line, p;
+    PUCHAR data;
+
+    RtlSecureZeroMemory(Request, sizeof(SERVE_REQUEST));
+
+    if (Line[0] == SERVE_COMMAND_CHAR) {
+
+        size = _strtoui64(Line + 1, &p, 10);
+        if (p == Line + 1 || *p != ' ' || size == 0 || size > SERVE_BUFFER_MAX)
+            return FALSE;
+
+        name = p + 1;
+
+        data = (PUCHAR)VirtualAlloc(NULL, (SIZE_T)size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+        if (data == NULL)
+            return FALSE;
+
+        if (!ServepReadData(Instance, data, (SIZE_T)size)) {
+            VirtualFree(data, 0, MEM_RELEASE);
+            return FALSE;
+        }
+
+        Request->Data = data;
+        Request->Size = (SIZE_T)size;
+    }
+
+    if (MultiByteToWideChar(CP_UTF8, 0, name, -1, Instance->Name, UNICODE_STRING_MAX_CHARS + 1) == 0) {
+        if (Request->Data)
+            VirtualFree((PVOID)Request->Data, 0, MEM_RELEASE);
+        Request->Data = NULL;
+        return FALSE;
+    }
+
+    Request->Name = Instance->Name;
+    return TRUE;
+}
+
+/*
+* ServepSession
+*
+* Purpose:
+*
+* Answer requests of connected client until it disconnects.
+*
+*/
+VOID ServepSession(
+    _In_ PSERVE_INSTANCE Instance
+)
+{
+    INT fd;
+    HANDLE streamHandle;
+    FILE* stream;
+    PCHAR line;
+    OUTPUT_WRITER writer;
+    SERVE_REQUEST request;
+    PSERVE_CONTEXT context = Instance->Context;
+    PSERVE_CALLBACKS callbacks = context->Callbacks;
+
+    //
+    // Stream owns a duplicate, pipe handle stays for the next client.
+    //
+    if (!DuplicateHandle(GetCurrentProcess(),
+        Instance->PipeHandle,
+        GetCurrentProcess(),
+        &streamHandle,
+        0,
+        FALSE,
+        DUPLICATE_SAME_ACCESS))
+    {
+        return;
+    }
+
+    fd = _open_osfhandle((intptr_t)streamHandle, _O_BINARY);
+    if (fd == -1) {
+        CloseHandle(streamHandle);
+        return;
+    }
+
+    stream = _fdopen(fd, "wb");
+    if (stream == NULL) {
+        _close(fd);
+        return;
+    }
+
+    if (OutputInitialize(&writer, stream, OUTPUT_BUFFER_SIZE)) {
+
+        Instance->LineStart = 0;
+        Instance->LineEnd = 0;
+
+        while (!context->Stop && ServepReadLine(Instance, &line)) {
+
+            if (line[0] == 0)
+                continue;
+
+            if (strcmp(line, SERVE_COMMAND_STOP) == 0) {
+                InterlockedExchange(&context->Stop, TRUE);
+                SetEvent(context->StopEvent);
+                break;
+            }
+
+            if (!ServepParseRequest(Instance, line, &request))
+                break;
+
+            callbacks->ProcessRequest(callbacks->Context,
+                Instance->WorkerData,
+                &request,
+                &writer);
+
+            OutputFlush(&writer);
+
+            if (request.Data)
+                VirtualFree((PVOID)request.Data, 0, MEM_RELEASE);
+        }
+
+        OutputRelease(&writer);
+    }
+
+    fclose(stream);
+}
+
+/*
+* ServepInstanceThread
+*
+* Purpose:
+*
+* Serve clients of one pipe instance one after another.
+*
+*/
+DWORD WINAPI ServepInstanceThread(
+    _In_ PVOID Parameter
+)
+{
+    PSERVE_INSTANCE instance = (PSERVE_INSTANCE)Parameter;
+    PSERVE_CONTEXT context = instance->Context;
+    PSERVE_CALLBACKS callbacks = context->Callbacks;
+
+    if (callbacks->WorkerStartup &&
+        !callbacks->WorkerStartup(callbacks->Context, &instance->WorkerData))
+    {
+        instance->WorkerData = NULL;
+    }
+
+    while (!context->Stop) {
+
+        if (!ConnectNamedPipe(instance->PipeHandle, NULL)) {
+
+            //
+            // ERROR_NO_DATA: client has gone before connection was accepted.
+            //
+            if (GetLastError() == ERROR_NO_DATA) {
+                DisconnectNamedPipe(instance->PipeHandle);
+                continue;
+            }
+
+            if (GetLastError() != ERROR_PIPE_CONNECTED)
+                break;
+        }
+
+        if (!context->Stop)
+            ServepSession(instance);
+
+        FlushFileBuffers(instance->PipeHandle);
+        DisconnectNamedPipe(instance->PipeHandle);
+    }
+
+    if (callbacks->WorkerShutdown)
+        callbacks->WorkerShutdown(callbacks->Context, instance->WorkerData);
+
+    return 0;
+}
+
+/*
+* ServeRun
+*
+* Purpose:
+*
+* Create pipe instances and serve requests until stop command or console
+* break. Fails if the pipe already exists.
+*
+*/
+NTSTATUS ServeRun(
+    _In_ LPCWSTR PipeName,
+    _In_ ULONG InstanceCount,
+    _In_ PSERVE_CALLBACKS Callbacks
+)
+{
+    NTSTATUS ntStatus = STATUS_INSUFFICIENT_RESOURCES;
+    ULONG i, cThreads = 0;
+    DWORD openMode;
+    SERVE_CONTEXT context;
+    PSERVE_INSTANCE instances = NULL, instance;
+    HANDLE threads[SERVE_MAX_INSTANCES];
+
+    if (InstanceCount == 0)
+        InstanceCount = 1;
+    if (InstanceCount > SERVE_MAX_INSTANCES)
+        InstanceCount = SERVE_MAX_INSTANCES;
+
+    RtlSecureZeroMemory(&context, sizeof(context));
+    context.Callbacks = Callbacks;
+
+    do {
+
+        context.StopEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+        if (context.StopEvent == NULL)
+            break;
+
+        instances = (PSERVE_INSTANCE)supHeapAlloc(InstanceCount * sizeof(SERVE_INSTANCE));
+        if (instances == NULL)
+            break;
+
+        for (i = 0; i < InstanceCount; i++) {
+
+            instance = &instances[i];
+            instance->Context = &context;
+
+            //
+            // First instance claims the name, pipe created by another
+            // process is never joined.
+            //
+            openMode = PIPE_ACCESS_DUPLEX;
+            if (i == 0)
+                openMode |= FILE_FLAG_FIRST_PIPE_INSTANCE;
+
+            instance->PipeHandle = CreateNamedPipe(PipeName,
+                openMode,
+                PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS,
+                InstanceCount,
+                SERVE_PIPE_BUFFER_SIZE,
+                SERVE_PIPE_BUFFER_SIZE,
+                0,
+                NULL);
+
+            if (instance->PipeHandle == INVALID_HANDLE_VALUE) {
+                instance->PipeHandle = NULL;
+                if (i == 0) {
+                    ntStatus = (GetLastError() == ERROR_ACCESS_DENIED) ?
+                        STATUS_OBJECT_NAME_COLLISION : STATUS_OBJECT_NAME_INVALID;
+                }
+                break;
+            }
+
+            instance->Line = (PCHAR)supHeapAlloc(SERVE_LINE_MAX);
+            instance->Name = (PWCHAR)supHeapAlloc((UNICODE_STRING_MAX_CHARS + 1) * sizeof(WCHAR));
+            if (instance->Line == NULL || instance->Name == NULL)
+                break;
+
+            threads[cThreads] = CreateThread(NULL, 0, ServepInstanceThread, instance, 0, NULL);
+            if (threads[cThreads] == NULL)
+                break;
+
+            cThreads += 1;
+        }
+
+        //
+        // Runs with fewer instances if not all of them could be created.
+        //
+        if (cThreads == 0)
+            break;
+
+        g_ServeStopEvent = context.StopEvent;
+        SetConsoleCtrlHandler(ServepCtrlHandler, TRUE);
+
+        WaitForSingleObject(context.StopEvent, INFINITE);
+
+        InterlockedExchange(&context.Stop, TRUE);
+
+        //
+        // Waiting connect and read fail when cancelled, requests being
+        // hashed are completed first.
+        //
+        do {
+            for (i = 0; i < cThreads; i++)
+                CancelSynchronousIo(threads[i]);
+        } while (WaitForMultipleObjects(cThreads, threads, TRUE, SERVE_STOP_POLL_MS) == WAIT_TIMEOUT);
+
+        SetConsoleCtrlHandler(ServepCtrlHandler, FALSE);
+        g_ServeStopEvent = NULL;
+
+        ntStatus = STATUS_SUCCESS;
+
+    } while (FALSE);
+
+    for (i = 0; i < cThreads; i++)
+        CloseHandle(threads[i]);
+
+    if (instances) {
+        for (i = 0; i < InstanceCount; i++) {
+            instance = &instances[i];
+            if (instance->PipeHandle) CloseHandle(instance->PipeHandle);
+            if (instance->Line) supHeapFree(instance->Line);
+            if (instance->Name) supHeapFree(instance->Name);
+        }
+        supHeapFree(instances);
+    }
+
+    if (context.StopEvent) CloseHandle(context.StopEvent);
+
+    return ntStatus;
+}
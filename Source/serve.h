@@ -0,0 +1,69 @@
+/*******************************************************************************
+*
+*  (C) COPYRIGHT AUTHORS, 2026
+*
+*  TITLE:       SERVE.H
+*
+*  VERSION:     1.05
+*
+*  DATE:        14 Oct 2026
+*
+*  Named pipe request server header file.
+*
+* THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+* ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED
+* TO THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*******************************************************************************/
+#pragma once
+
+#define SERVE_DEFAULT_PIPE_NAME L"\\\\.\\pipe\\AuthHashCalc"
+
+#define SERVE_MAX_INSTANCES     64
+#define SERVE_PIPE_BUFFER_SIZE  (64 * 1024)
+
+//
+// Request line, UTF-8 path of up to UNICODE_STRING_MAX_CHARS characters.
+//
+#define SERVE_LINE_MAX          (UNICODE_STRING_MAX_CHARS * 3 + 64)
+
+//
+// Largest image accepted as in-line buffer request.
+//
+#define SERVE_BUFFER_MAX        (256 * RTL_MEG)
+
+//
+// Request lines starting with this character are commands, it cannot
+// start a file name.
+//
+#define SERVE_COMMAND_CHAR      '*'
+#define SERVE_COMMAND_STOP      "*stop"
+
+typedef struct _SERVE_REQUEST {
+    LPCWSTR Name;
+
+    //
+    // Image passed in-line, NULL when Name is a file to hash.
+    //
+    const VOID* Data;
+    SIZE_T Size;
+} SERVE_REQUEST, * PSERVE_REQUEST;
+
+typedef VOID(CALLBACK* PSERVE_PROCESS_REQUEST)(
+    _In_opt_ PVOID Context,
+    _In_opt_ PVOID WorkerData,
+    _In_ PSERVE_REQUEST Request,
+    _In_ POUTPUT_WRITER Writer);
+
+typedef struct _SERVE_CALLBACKS {
+    PVOID Context;
+    PBATCH_WORKER_STARTUP WorkerStartup;
+    PBATCH_WORKER_SHUTDOWN WorkerShutdown;
+    PSERVE_PROCESS_REQUEST ProcessRequest;
+} SERVE_CALLBACKS, * PSERVE_CALLBACKS;
+
+NTSTATUS ServeRun(
+    _In_ LPCWSTR PipeName,
+    _In_ ULONG InstanceCount,
+    _In_ PSERVE_CALLBACKS Callbacks);
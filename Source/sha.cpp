@@ -0,0 +1,959 @@
+/*******************************************************************************
+*
+*  (C) COPYRIGHT AUTHORS, 2026
+*
+*  TITLE:       SHA.CPP
+*
+*  VERSION:     1.05
+*
+*  DATE:        14 Oct 2026
+*
+*  Native SHA-1/SHA-256 implementation.
+*
+*  Block transforms use x86 SHA extensions and are only selected when CPUID
+*  reports them together with SSSE3 and SSE4.1, otherwise CNG providers are
+*  used. Digests are identical to CNG ones.
+*
+* THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+* ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED
+* TO THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*******************************************************************************/
+
+#include "global.h"
+
+#if defined(_M_IX86) || defined(_M_X64)
+#include <intrin.h>
+#include <immintrin.h>
+#define SHA_NATIVE_X86
+#endif
+
+static INIT_ONCE g_ShaNativeInitOnce = INIT_ONCE_STATIC_INIT;
+static BOOLEAN g_ShaNativeSupported = FALSE;
+static BOOLEAN g_ShaMultiSupported = FALSE;
+
+//
+// Multi-buffer lane, Block is used when next block is not contiguous in
+// the message or carries the padding.
+//
+typedef struct _SHA_MB_LANE {
+    PSHA_MB_MESSAGE Message;
+    ULONG Segment;
+    SIZE_T Offset;
+    ULONGLONG TotalLength;
+    BOOLEAN LengthPending;
+    BOOLEAN Final;
+    UCHAR Block[SHA_NATIVE_BLOCK_SIZE];
+} SHA_MB_LANE, * PSHA_MB_LANE;
+
+static const UCHAR g_ShaMultiIdleBlock[SHA_NATIVE_BLOCK_SIZE] = { 0 };
+
+static const ULONG g_ShaInit1[5] = {
+    0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0
+};
+
+static const ULONG g_ShaInit256[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+#ifdef SHA_NATIVE_X86
+
+static const __declspec(align(16)) ULONG g_ShaK256[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+/*
+* ShapTransform1
+*
+* Purpose:
+*
+* SHA-1 block transform with SHA extensions.
+*
+*/
+VOID ShapTransform1(
+    _Inout_updates_(5) PULONG State,
+    _In_reads_bytes_(Blocks * SHA_NATIVE_BLOCK_SIZE) const UCHAR* Data,
+    _In_ SIZE_T Blocks
+)
+{
+    __m128i abcd, abcdSave, e0, e1, eSave;
+    __m128i msg0, msg1, msg2, msg3;
+    const __m128i mask = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+
+    abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)State), 0x1B);
+    e0 = _mm_set_epi32((INT)State[4], 0, 0, 0);
+
+    while (Blocks--) {
+
+        abcdSave = abcd;
+        eSave = e0;
+
+        msg0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(Data + 0)), mask);
+        e0 = _mm_add_epi32(e0, msg0);
+        e1 = abcd;
+        abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+
+        msg1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(Data + 16)), mask);
+        e1 = _mm_sha1nexte_epu32(e1, msg1);
+        e0 = abcd;
+        abcd = _mm_sha1rnds4_epu32(abcd, e1, 0);
+        msg0 = _mm_sha1msg1_epu32(msg0, msg1);
+
+        msg2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(Data + 32)), mask);
+        e0 = _mm_sha1nexte_epu32(e0, msg2);
+        e1 = abcd;
+        abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+        msg1 = _mm_sha1msg1_epu32(msg1, msg2);
+        msg0 = _mm_xor_si128(msg0, msg2);
+
+        msg3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(Data + 48)), mask);
+        e1 = _mm_sha1nexte_epu32(e1, msg3);
+        e0 = abcd;
+        msg0 = _mm_sha1msg2_epu32(msg0, msg3);
+        abcd = _mm_sha1rnds4_epu32(abcd, e1, 0);
+        msg2 = _mm_sha1msg1_epu32(msg2, msg3);
+        msg1 = _mm_xor_si128(msg1, msg3);
+
+        e0 = _mm_sha1nexte_epu32(e0, msg0);
+        e1 = abcd;
+        msg1 = _mm_sha1msg2_epu32(msg1, msg0);
+        abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+        msg3 = _mm_sha1msg1_epu32(msg3, msg0);
+        msg2 = _mm_xor_si128(msg2, msg0);
+
+        e1 = _mm_sha1nexte_epu32(e1, msg1);
+        e0 = abcd;
+        msg2 = _mm_sha1msg2_epu32(msg2, msg1);
+        abcd = _mm_sha1rnds4_epu32(abcd, e1, 1);
+        msg0 = _mm_sha1msg1_epu32(msg0, msg1);
+        msg3 = _mm_xor_si128(msg3, msg1);
+
+        e0 = _mm_sha1nexte_epu32(e0, msg2);
+        e1 = abcd;
+        msg3 = _mm_sha1msg2_epu32(msg3, msg2);
+        abcd = _mm_sha1rnds4_epu32(abcd, e0, 1);
+        msg1 = _mm_sha1msg1_epu32(msg1, msg2);
+        msg0 = _mm_xor_si128(msg0, msg2);
+
+        e1 = _mm_sha1nexte_epu32(e1, msg3);
+        e0 = abcd;
+        msg0 = _mm_sha1msg2_epu32(msg0, msg3);
+        abcd = _mm_sha1rnds4_epu32(abcd, e1, 1);
+        msg2 = _mm_sha1msg1_epu32(msg2, msg3);
+        msg1 = _mm_xor_si128(msg1, msg3);
+
+        e0 = _mm_sha1nexte_epu32(e0, msg0);
+        e1 = abcd;
+        msg1 = _mm_sha1msg2_epu32(msg1, msg0);
+        abcd = _mm_sha1rnds4_epu32(abcd, e0, 1);
+        msg3 = _mm_sha1msg1_epu32(msg3, msg0);
+        msg2 = _mm_xor_si128(msg2, msg0);
+
+        e1 = _mm_sha1nexte_epu32(e1, msg1);
+        e0 = abcd;
+        msg2 = _mm_sha1msg2_epu32(msg2, msg1);
+        abcd = _mm_sha1rnds4_epu32(abcd, e1, 1);
+        msg0 = _mm_sha1msg1_epu32(msg0, msg1);
+        msg3 = _mm_xor_si128(msg3, msg1);
+
+        e0 = _mm_sha1nexte_epu32(e0, msg2);
+        e1 = abcd;
+        msg3 = _mm_sha1msg2_epu32(msg3, msg2);
+        abcd = _mm_sha1rnds4_epu32(abcd, e0, 2);
+        msg1 = _mm_sha1msg1_epu32(msg1, msg2);
+        msg0 = _mm_xor_si128(msg0, msg2);
+
+        e1 = _mm_sha1nexte_epu32(e1, msg3);
+        e0 = abcd;
+        msg0 = _mm_sha1msg2_epu32(msg0, msg3);
+        abcd = _mm_sha1rnds4_epu32(abcd, e1, 2);
+        msg2 = _mm_sha1msg1_epu32(msg2, msg3);
+        msg1 = _mm_xor_si128(msg1, msg3);
+
+        e0 = _mm_sha1nexte_epu32(e0, msg0);
+        e1 = abcd;
+        msg1 = _mm_sha1msg2_epu32(msg1, msg0);
+        abcd = _mm_sha1rnds4_epu32(abcd, e0, 2);
+        msg3 = _mm_sha1msg1_epu32(msg3, msg0);
+        msg2 = _mm_xor_si128(msg2, msg0);
+
+        e1 = _mm_sha1nexte_epu32(e1, msg1);
+        e0 = abcd;
+        msg2 = _mm_sha1msg2_epu32(msg2, msg1);
+        abcd = _mm_sha1rnds4_epu32(abcd, e1, 2);
+        msg0 = _mm_sha1msg1_epu32(msg0, msg1);
+        msg3 = _mm_xor_si128(msg3, msg1);
+
+        e0 = _mm_sha1nexte_epu32(e0, msg2);
+        e1 = abcd;
+        msg3 = _mm_sha1msg2_epu32(msg3, msg2);
+        abcd = _mm_sha1rnds4_epu32(abcd, e0, 2);
+        msg1 = _mm_sha1msg1_epu32(msg1, msg2);
+        msg0 = _mm_xor_si128(msg0, msg2);
+
+        e1 = _mm_sha1nexte_epu32(e1, msg3);
+        e0 = abcd;
+        msg0 = _mm_sha1msg2_epu32(msg0, msg3);
+        abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+        msg2 = _mm_sha1msg1_epu32(msg2, msg3);
+        msg1 = _mm_xor_si128(msg1, msg3);
+
+        e0 = _mm_sha1nexte_epu32(e0, msg0);
+        e1 = abcd;
+        msg1 = _mm_sha1msg2_epu32(msg1, msg0);
+        abcd = _mm_sha1rnds4_epu32(abcd, e0, 3);
+        msg3 = _mm_sha1msg1_epu32(msg3, msg0);
+        msg2 = _mm_xor_si128(msg2, msg0);
+
+        e1 = _mm_sha1nexte_epu32(e1, msg1);
+        e0 = abcd;
+        msg2 = _mm_sha1msg2_epu32(msg2, msg1);
+        abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+        msg3 = _mm_xor_si128(msg3, msg1);
+
+        e0 = _mm_sha1nexte_epu32(e0, msg2);
+        e1 = abcd;
+        msg3 = _mm_sha1msg2_epu32(msg3, msg2);
+        abcd = _mm_sha1rnds4_epu32(abcd, e0, 3);
+
+        e1 = _mm_sha1nexte_epu32(e1, msg3);
+        e0 = abcd;
+        abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+        e0 = _mm_sha1nexte_epu32(e0, eSave);
+        abcd = _mm_add_epi32(abcd, abcdSave);
+
+        Data += SHA_NATIVE_BLOCK_SIZE;
+    }
+
+    _mm_storeu_si128((__m128i*)State, _mm_shuffle_epi32(abcd, 0x1B));
+    State[4] = (ULONG)_mm_extract_epi32(e0, 3);
+}
+
+/*
+* ShapTransform256
+*
+* Purpose:
+*
+* SHA-256 block transform with SHA extensions.
+*
+*/
+VOID ShapTransform256(
+    _Inout_updates_(8) PULONG State,
+    _In_reads_bytes_(Blocks * SHA_NATIVE_BLOCK_SIZE) const UCHAR* Data,
+    _In_ SIZE_T Blocks
+)
+{
+    __m128i state0, state1, save0, save1, tmp;
+    __m128i msg0, msg1, msg2, msg3;
+    const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    //
+    // Rounds instructions take state as ABEF/CDGH halves.
+    //
+    tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&State[0]), 0xB1);
+    state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&State[4]), 0x1B);
+    state0 = _mm_alignr_epi8(tmp, state1, 8);
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+    while (Blocks--) {
+
+        save0 = state0;
+        save1 = state1;
+
+        msg0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(Data + 0)), mask);
+        tmp = _mm_add_epi32(msg0, _mm_loadu_si128((const __m128i*)&g_ShaK256[0]));
+        state1 = _mm_sha256rnds2_epu32(state1, state0, tmp);
+        state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(tmp, 0x0E));
+
+        msg1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(Data + 16)), mask);
+        tmp = _mm_add_epi32(msg1, _mm_loadu_si128((const __m128i*)&g_ShaK256[4]));
+        state1 = _mm_sha256rnds2_epu32(state1, state0, tmp);
+        state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(tmp, 0x0E));
+
+        msg2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(Data + 32)), mask);
+        tmp = _mm_add_epi32(msg2, _mm_loadu_si128((const __m128i*)&g_ShaK256[8]));
+        state1 = _mm_sha256rnds2_epu32(state1, state0, tmp);
+        state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(tmp, 0x0E));
+
+        msg3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(Data + 48)), mask);
+        tmp = _mm_add_epi32(msg3, _mm_loadu_si128((const __m128i*)&g_ShaK256[12]));
+        state1 = _mm_sha256rnds2_epu32(state1, state0, tmp);
+        state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(tmp, 0x0E));
+
+        msg0 = _mm_sha256msg2_epu32(_mm_add_epi32(_mm_sha256msg1_epu32(msg0, msg1),
+            _mm_alignr_epi8(msg3, msg2, 4)), msg3);
+        tmp = _mm_add_epi32(msg0, _mm_loadu_si128((const __m128i*)&g_ShaK256[16]));
+        state1 = _mm_sha256rnds2_epu32(state1, state0, tmp);
+        state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(tmp, 0x0E));
+
+        msg1 = _mm_sha256msg2_epu32(_mm_add_epi32(_mm_sha256msg1_epu32(msg1, msg2),
+            _mm_alignr_epi8(msg0, msg3, 4)), msg0);
+        tmp = _mm_add_epi32(msg1, _mm_loadu_si128((const __m128i*)&g_ShaK256[20]));
+        state1 = _mm_sha256rnds2_epu32(state1, state0, tmp);
+        state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(tmp, 0x0E));
+
+        msg2 = _mm_sha256msg2_epu32(_mm_add_epi32(_mm_sha256msg1_epu32(msg2, msg3),
+            _mm_alignr_epi8(msg1, msg0, 4)), msg1);
+        tmp = _mm_add_epi32(msg2, _mm_loadu_si128((const __m128i*)&g_ShaK256[24]));
+        state1 = _mm_sha256rnds2_epu32(state1, state0, tmp);
+        state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(tmp, 0x0E));
+
+        msg3 = _mm_sha256msg2_epu32(_mm_add_epi32(_mm_sha256msg1_epu32(msg3, msg0),
+            _mm_alignr_epi8(msg2, msg1, 4)), msg2);
+        tmp = _mm_add_epi32(msg3, _mm_loadu_si128((const __m128i*)&g_ShaK256[28]));
+        state1 = _mm_sha256rnds2_epu32(state1, state0, tmp);
+        state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(tmp, 0x0E));
+
+        msg0 = _mm_sha256msg2_epu32(_mm_add_epi32(_mm_sha256msg1_epu32(msg0, msg1),
+            _mm_alignr_epi8(msg3, msg2, 4)), msg3);
+        tmp = _mm_add_epi32(msg0, _mm_loadu_si128((const __m128i*)&g_ShaK256[32]));
+        state1 = _mm_sha256rnds2_epu32(state1, state0, tmp);
+        state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(tmp, 0x0E));
+
+        msg1 = _mm_sha256msg2_epu32(_mm_add_epi32(_mm_sha256msg1_epu32(msg1, msg2),
+            _mm_alignr_epi8(msg0, msg3, 4)), msg0);
+        tmp = _mm_add_epi32(msg1, _mm_loadu_si128((const __m128i*)&g_ShaK256[36]));
+        state1 = _mm_sha256rnds2_epu32(state1, state0, tmp);
+        state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(tmp, 0x0E));
+
+        msg2 = _mm_sha256msg2_epu32(_mm_add_epi32(_mm_sha256msg1_epu32(msg2, msg3),
+            _mm_alignr_epi8(msg1, msg0, 4)), msg1);
+        tmp = _mm_add_epi32(msg2, _mm_loadu_si128((const __m128i*)&g_ShaK256[40]));
+        state1 = _mm_sha256rnds2_epu32(state1, state0, tmp);
+        state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(tmp, 0x0E));
+
+        msg3 = _mm_sha256msg2_epu32(_mm_add_epi32(_mm_sha256msg1_epu32(msg3, msg0),
+            _mm_alignr_epi8(msg2, msg1, 4)), msg2);
+        tmp = _mm_add_epi32(msg3, _mm_loadu_si128((const __m128i*)&g_ShaK256[44]));
+        state1 = _mm_sha256rnds2_epu32(state1, state0, tmp);
+        state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(tmp, 0x0E));
+
+        msg0 = _mm_sha256msg2_epu32(_mm_add_epi32(_mm_sha256msg1_epu32(msg0, msg1),
+            _mm_alignr_epi8(msg3, msg2, 4)), msg3);
+        tmp = _mm_add_epi32(msg0, _mm_loadu_si128((const __m128i*)&g_ShaK256[48]));
+        state1 = _mm_sha256rnds2_epu32(state1, state0, tmp);
+        state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(tmp, 0x0E));
+
+        msg1 = _mm_sha256msg2_epu32(_mm_add_epi32(_mm_sha256msg1_epu32(msg1, msg2),
+            _mm_alignr_epi8(msg0, msg3, 4)), msg0);
+        tmp = _mm_add_epi32(msg1, _mm_loadu_si128((const __m128i*)&g_ShaK256[52]));
+        state1 = _mm_sha256rnds2_epu32(state1, state0, tmp);
+        state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(tmp, 0x0E));
+
+        msg2 = _mm_sha256msg2_epu32(_mm_add_epi32(_mm_sha256msg1_epu32(msg2, msg3),
+            _mm_alignr_epi8(msg1, msg0, 4)), msg1);
+        tmp = _mm_add_epi32(msg2, _mm_loadu_si128((const __m128i*)&g_ShaK256[56]));
+        state1 = _mm_sha256rnds2_epu32(state1, state0, tmp);
+        state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(tmp, 0x0E));
+
+        msg3 = _mm_sha256msg2_epu32(_mm_add_epi32(_mm_sha256msg1_epu32(msg3, msg0),
+            _mm_alignr_epi8(msg2, msg1, 4)), msg2);
+        tmp = _mm_add_epi32(msg3, _mm_loadu_si128((const __m128i*)&g_ShaK256[60]));
+        state1 = _mm_sha256rnds2_epu32(state1, state0, tmp);
+        state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(tmp, 0x0E));
+        state0 = _mm_add_epi32(state0, save0);
+        state1 = _mm_add_epi32(state1, save1);
+
+        Data += SHA_NATIVE_BLOCK_SIZE;
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1B);
+    state1 = _mm_shuffle_epi32(state1, 0xB1);
+    state0 = _mm_blend_epi16(tmp, state1, 0xF0);
+    state1 = _mm_alignr_epi8(state1, tmp, 8);
+
+    _mm_storeu_si128((__m128i*)&State[0], state0);
+    _mm_storeu_si128((__m128i*)&State[4], state1);
+}
+
+#define SHA_MB_ROTR(x, n) _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - (n)))
+#define SHA_MB_ROTL(x, n) _mm256_or_si256(_mm256_slli_epi32(x, n), _mm256_srli_epi32(x, 32 - (n)))
+#define SHA_MB_ADD(x, y) _mm256_add_epi32(x, y)
+#define SHA_MB_XOR3(x, y, z) _mm256_xor_si256(_mm256_xor_si256(x, y), z)
+
+/*
+* ShapMultiLoadBlocks
+*
+* Purpose:
+*
+* Load one block per lane as 16 vectors of big endian words, word t of lane i
+* goes to element i of vector t.
+*
+*/
+FORCEINLINE VOID ShapMultiLoadBlocks(
+    _In_reads_(SHA_MB_LANES) const UCHAR* const* Blocks,
+    _Out_writes_(16) __m256i* W
+)
+{
+    ULONG half, i;
+    __m256i r[SHA_MB_LANES], t[SHA_MB_LANES], u[SHA_MB_LANES];
+    const __m256i mask = _mm256_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL,
+        0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    for (half = 0; half < 2; half++) {
+
+        for (i = 0; i < SHA_MB_LANES; i++)
+            r[i] = _mm256_loadu_si256((const __m256i*)(Blocks[i] + half * 32));
+
+        //
+        // 8x8 transpose of 32 bit elements.
+        //
+        for (i = 0; i < SHA_MB_LANES; i += 2) {
+            t[i] = _mm256_unpacklo_epi32(r[i], r[i + 1]);
+            t[i + 1] = _mm256_unpackhi_epi32(r[i], r[i + 1]);
+        }
+
+        for (i = 0; i < SHA_MB_LANES; i += 4) {
+            u[i] = _mm256_unpacklo_epi64(t[i], t[i + 2]);
+            u[i + 1] = _mm256_unpackhi_epi64(t[i], t[i + 2]);
+            u[i + 2] = _mm256_unpacklo_epi64(t[i + 1], t[i + 3]);
+            u[i + 3] = _mm256_unpackhi_epi64(t[i + 1], t[i + 3]);
+        }
+
+        for (i = 0; i < 4; i++) {
+            W[half * 8 + i] = _mm256_shuffle_epi8(_mm256_permute2x128_si256(u[i], u[i + 4], 0x20), mask);
+            W[half * 8 + i + 4] = _mm256_shuffle_epi8(_mm256_permute2x128_si256(u[i], u[i + 4], 0x31), mask);
+        }
+    }
+}
+
+/*
+* ShapMultiTransform1
+*
+* Purpose:
+*
+* SHA-1 transform of one block per lane with AVX2.
+*
+*/
+VOID ShapMultiTransform1(
+    _Inout_ ULONG State[5][SHA_MB_LANES],
+    _In_reads_(SHA_MB_LANES) const UCHAR* const* Blocks
+)
+{
+    ULONG t;
+    __m256i w[16], a, b, c, d, e, f, k, tmp;
+
+    ShapMultiLoadBlocks(Blocks, w);
+
+    a = _mm256_loadu_si256((const __m256i*)State[0]);
+    b = _mm256_loadu_si256((const __m256i*)State[1]);
+    c = _mm256_loadu_si256((const __m256i*)State[2]);
+    d = _mm256_loadu_si256((const __m256i*)State[3]);
+    e = _mm256_loadu_si256((const __m256i*)State[4]);
+
+    for (t = 0; t < 80; t++) {
+
+        if (t >= 16) {
+            tmp = _mm256_xor_si256(SHA_MB_XOR3(w[(t - 3) & 15], w[(t - 8) & 15], w[(t - 14) & 15]),
+                w[t & 15]);
+            w[t & 15] = SHA_MB_ROTL(tmp, 1);
+        }
+
+        if (t < 20) {
+            f = _mm256_xor_si256(d, _mm256_and_si256(b, _mm256_xor_si256(c, d)));
+            k = _mm256_set1_epi32(0x5a827999);
+        }
+        else if (t < 40) {
+            f = SHA_MB_XOR3(b, c, d);
+            k = _mm256_set1_epi32(0x6ed9eba1);
+        }
+        else if (t < 60) {
+            f = _mm256_or_si256(_mm256_and_si256(b, c), _mm256_and_si256(d, _mm256_or_si256(b, c)));
+            k = _mm256_set1_epi32((INT)0x8f1bbcdc);
+        }
+        else {
+            f = SHA_MB_XOR3(b, c, d);
+            k = _mm256_set1_epi32((INT)0xca62c1d6);
+        }
+
+        tmp = SHA_MB_ADD(SHA_MB_ADD(SHA_MB_ROTL(a, 5), f), SHA_MB_ADD(SHA_MB_ADD(e, k), w[t & 15]));
+        e = d;
+        d = c;
+        c = SHA_MB_ROTL(b, 30);
+        b = a;
+        a = tmp;
+    }
+
+    _mm256_storeu_si256((__m256i*)State[0], SHA_MB_ADD(a, _mm256_loadu_si256((const __m256i*)State[0])));
+    _mm256_storeu_si256((__m256i*)State[1], SHA_MB_ADD(b, _mm256_loadu_si256((const __m256i*)State[1])));
+    _mm256_storeu_si256((__m256i*)State[2], SHA_MB_ADD(c, _mm256_loadu_si256((const __m256i*)State[2])));
+    _mm256_storeu_si256((__m256i*)State[3], SHA_MB_ADD(d, _mm256_loadu_si256((const __m256i*)State[3])));
+    _mm256_storeu_si256((__m256i*)State[4], SHA_MB_ADD(e, _mm256_loadu_si256((const __m256i*)State[4])));
+}
+
+/*
+* ShapMultiTransform256
+*
+* Purpose:
+*
+* SHA-256 transform of one block per lane with AVX2.
+*
+*/
+VOID ShapMultiTransform256(
+    _Inout_ ULONG State[8][SHA_MB_LANES],
+    _In_reads_(SHA_MB_LANES) const UCHAR* const* Blocks
+)
+{
+    ULONG t, i;
+    __m256i w[16], v[8], s0, s1, t1, t2;
+
+    ShapMultiLoadBlocks(Blocks, w);
+
+    for (i = 0; i < 8; i++)
+        v[i] = _mm256_loadu_si256((const __m256i*)State[i]);
+
+    for (t = 0; t < 64; t++) {
+
+        if (t >= 16) {
+            s0 = SHA_MB_XOR3(SHA_MB_ROTR(w[(t - 15) & 15], 7),
+                SHA_MB_ROTR(w[(t - 15) & 15], 18),
+                _mm256_srli_epi32(w[(t - 15) & 15], 3));
+            s1 = SHA_MB_XOR3(SHA_MB_ROTR(w[(t - 2) & 15], 17),
+                SHA_MB_ROTR(w[(t - 2) & 15], 19),
+                _mm256_srli_epi32(w[(t - 2) & 15], 10));
+            w[t & 15] = SHA_MB_ADD(SHA_MB_ADD(w[t & 15], s0), SHA_MB_ADD(w[(t - 7) & 15], s1));
+        }
+
+        //
+        // v[0..7] are a..h.
+        //
+        s1 = SHA_MB_XOR3(SHA_MB_ROTR(v[4], 6), SHA_MB_ROTR(v[4], 11), SHA_MB_ROTR(v[4], 25));
+        t1 = _mm256_xor_si256(_mm256_and_si256(v[4], v[5]), _mm256_andnot_si256(v[4], v[6]));
+        t1 = SHA_MB_ADD(SHA_MB_ADD(v[7], s1), SHA_MB_ADD(t1, w[t & 15]));
+        t1 = SHA_MB_ADD(t1, _mm256_set1_epi32((INT)g_ShaK256[t]));
+
+        s0 = SHA_MB_XOR3(SHA_MB_ROTR(v[0], 2), SHA_MB_ROTR(v[0], 13), SHA_MB_ROTR(v[0], 22));
+        t2 = SHA_MB_XOR3(_mm256_and_si256(v[0], v[1]),
+            _mm256_and_si256(v[0], v[2]),
+            _mm256_and_si256(v[1], v[2]));
+        t2 = SHA_MB_ADD(s0, t2);
+
+        v[7] = v[6];
+        v[6] = v[5];
+        v[5] = v[4];
+        v[4] = SHA_MB_ADD(v[3], t1);
+        v[3] = v[2];
+        v[2] = v[1];
+        v[1] = v[0];
+        v[0] = SHA_MB_ADD(t1, t2);
+    }
+
+    for (i = 0; i < 8; i++) {
+        _mm256_storeu_si256((__m256i*)State[i],
+            SHA_MB_ADD(v[i], _mm256_loadu_si256((const __m256i*)State[i])));
+    }
+}
+
+#endif // SHA_NATIVE_X86
+
+/*
+* ShapDetectSupport
+*
+* Purpose:
+*
+* INIT_ONCE callback, query CPU features required by block transforms.
+*
+*/
+BOOL CALLBACK ShapDetectSupport(
+    _Inout_ PINIT_ONCE InitOnce,
+    _Inout_opt_ PVOID Parameter,
+    _Out_opt_ PVOID* Context
+)
+{
+    UNREFERENCED_PARAMETER(InitOnce);
+    UNREFERENCED_PARAMETER(Parameter);
+
+    if (Context)
+        *Context = NULL;
+
+#ifdef SHA_NATIVE_X86
+    INT regs[4];
+
+    __cpuid(regs, 0);
+    if (regs[0] >= 7) {
+
+        __cpuid(regs, 1);
+
+        //
+        // SSSE3 (ECX bit 9) and SSE4.1 (ECX bit 19).
+        //
+        if ((regs[2] & (1 << 9)) && (regs[2] & (1 << 19))) {
+
+            //
+            // SHA extensions (leaf 7 EBX bit 29).
+            //
+            __cpuidex(regs, 7, 0);
+            g_ShaNativeSupported = ((regs[1] & (1 << 29)) != 0);
+            g_ShaMultiSupported = ((regs[1] & (1 << 5)) != 0);
+        }
+
+        //
+        // AVX2 (leaf 7 EBX bit 5) needs OSXSAVE with YMM state enabled by the OS.
+        //
+        __cpuid(regs, 1);
+        if (g_ShaMultiSupported) {
+            g_ShaMultiSupported = ((regs[2] & (1 << 27)) && (regs[2] & (1 << 28)) &&
+                ((_xgetbv(0) & 6) == 6));
+        }
+    }
+#endif
+
+    return TRUE;
+}
+
+/*
+* ShaNativeIsSupported
+*
+* Purpose:
+*
+* Return TRUE if native block transforms can run on this CPU.
+*
+*/
+BOOLEAN ShaNativeIsSupported(
+    VOID
+)
+{
+    InitOnceExecuteOnce(&g_ShaNativeInitOnce, ShapDetectSupport, NULL, NULL);
+    return g_ShaNativeSupported;
+}
+
+/*
+* ShaNativeDigestSize
+*
+* Purpose:
+*
+* Return digest size of the algorithm.
+*
+*/
+ULONG ShaNativeDigestSize(
+    _In_ ULONG Algorithm
+)
+{
+    switch (Algorithm) {
+    case SHA_NATIVE_SHA1:
+        return SHA1_DIGEST_SIZE;
+    case SHA_NATIVE_SHA256:
+        return SHA256_DIGEST_SIZE;
+    default:
+        return 0;
+    }
+}
+
+/*
+* ShapTransform
+*
+* Purpose:
+*
+* Process whole blocks with algorithm transform.
+*
+*/
+FORCEINLINE VOID ShapTransform(
+    _Inout_ PSHA_NATIVE_STATE State,
+    _In_reads_bytes_(Blocks * SHA_NATIVE_BLOCK_SIZE) const UCHAR* Data,
+    _In_ SIZE_T Blocks
+)
+{
+#ifdef SHA_NATIVE_X86
+    if (State->Algorithm == SHA_NATIVE_SHA1)
+        ShapTransform1(State->State, Data, Blocks);
+    else
+        ShapTransform256(State->State, Data, Blocks);
+#else
+    UNREFERENCED_PARAMETER(State);
+    UNREFERENCED_PARAMETER(Data);
+    UNREFERENCED_PARAMETER(Blocks);
+#endif
+}
+
+/*
+* ShaNativeInit
+*
+* Purpose:
+*
+* Set initial hash state.
+*
+*/
+VOID ShaNativeInit(
+    _Out_ PSHA_NATIVE_STATE State,
+    _In_ ULONG Algorithm
+)
+{
+    RtlSecureZeroMemory(State, sizeof(SHA_NATIVE_STATE));
+
+    State->Algorithm = Algorithm;
+
+    if (Algorithm == SHA_NATIVE_SHA1)
+        RtlCopyMemory(State->State, g_ShaInit1, sizeof(g_ShaInit1));
+    else
+        RtlCopyMemory(State->State, g_ShaInit256, sizeof(g_ShaInit256));
+}
+
+/*
+* ShaNativeUpdate
+*
+* Purpose:
+*
+* Hash data, whole blocks are processed directly from the input.
+*
+*/
+VOID ShaNativeUpdate(
+    _Inout_ PSHA_NATIVE_STATE State,
+    _In_reads_bytes_(Length) const UCHAR* Data,
+    _In_ SIZE_T Length
+)
+{
+    SIZE_T cbCopy, cBlocks;
+
+    State->TotalLength += Length;
+
+    if (State->BufferLength) {
+
+        cbCopy = min(Length, (SIZE_T)(SHA_NATIVE_BLOCK_SIZE - State->BufferLength));
+        RtlCopyMemory(&State->Buffer[State->BufferLength], Data, cbCopy);
+
+        State->BufferLength += (ULONG)cbCopy;
+        Data += cbCopy;
+        Length -= cbCopy;
+
+        if (State->BufferLength < SHA_NATIVE_BLOCK_SIZE)
+            return;
+
+        ShapTransform(State, State->Buffer, 1);
+        State->BufferLength = 0;
+    }
+
+    cBlocks = Length / SHA_NATIVE_BLOCK_SIZE;
+    if (cBlocks) {
+        ShapTransform(State, Data, cBlocks);
+        Data += cBlocks * SHA_NATIVE_BLOCK_SIZE;
+        Length -= cBlocks * SHA_NATIVE_BLOCK_SIZE;
+    }
+
+    if (Length) {
+        RtlCopyMemory(State->Buffer, Data, Length);
+        State->BufferLength = (ULONG)Length;
+    }
+}
+
+/*
+* ShaNativeFinish
+*
+* Purpose:
+*
+* Pad message, output big endian digest and reset state for next input.
+*
+*/
+VOID ShaNativeFinish(
+    _Inout_ PSHA_NATIVE_STATE State,
+    _Out_writes_bytes_(SHA256_DIGEST_SIZE) PUCHAR Digest
+)
+{
+    ULONG i, cWords;
+    ULONGLONG bitLength = State->TotalLength * 8;
+
+    State->Buffer[State->BufferLength++] = 0x80;
+
+    if (State->BufferLength > SHA_NATIVE_BLOCK_SIZE - sizeof(ULONGLONG)) {
+        RtlZeroMemory(&State->Buffer[State->BufferLength],
+            SHA_NATIVE_BLOCK_SIZE - State->BufferLength);
+        ShapTransform(State, State->Buffer, 1);
+        State->BufferLength = 0;
+    }
+
+    RtlZeroMemory(&State->Buffer[State->BufferLength],
+        SHA_NATIVE_BLOCK_SIZE - sizeof(ULONGLONG) - State->BufferLength);
+
+    for (i = 0; i < sizeof(ULONGLONG); i++)
+        State->Buffer[SHA_NATIVE_BLOCK_SIZE - 1 - i] = (UCHAR)(bitLength >> (i * 8));
+
+    ShapTransform(State, State->Buffer, 1);
+
+    cWords = ShaNativeDigestSize(State->Algorithm) / sizeof(ULONG);
+    for (i = 0; i < cWords; i++) {
+        Digest[i * 4] = (UCHAR)(State->State[i] >> 24);
+        Digest[i * 4 + 1] = (UCHAR)(State->State[i] >> 16);
+        Digest[i * 4 + 2] = (UCHAR)(State->State[i] >> 8);
+        Digest[i * 4 + 3] = (UCHAR)State->State[i];
+    }
+
+    ShaNativeInit(State, State->Algorithm);
+}
+
+/*
+* ShaMultiIsSupported
+*
+* Purpose:
+*
+* Return TRUE if multi-buffer engine can run on this CPU.
+*
+*/
+BOOLEAN ShaMultiIsSupported(
+    VOID
+)
+{
+    InitOnceExecuteOnce(&g_ShaNativeInitOnce, ShapDetectSupport, NULL, NULL);
+    return g_ShaMultiSupported;
+}
+
+/*
+* ShapMultiNextBlock
+*
+* Purpose:
+*
+* Return next block of the lane message, whole blocks inside a segment
+* are used in place. Sets Final when the block carries message length.
+*
+*/
+const UCHAR* ShapMultiNextBlock(
+    _Inout_ PSHA_MB_LANE Lane
+)
+{
+    ULONG i, cbBlock = 0;
+    SIZE_T cbCopy;
+    PSHA_MB_SEGMENT segment;
+    PSHA_MB_MESSAGE message = Lane->Message;
+
+    if (!Lane->LengthPending) {
+
+        while (Lane->Segment < message->SegmentCount) {
+
+            segment = &message->Segments[Lane->Segment];
+
+            if (Lane->Offset == segment->Length) {
+                Lane->Segment += 1;
+                Lane->Offset = 0;
+                continue;
+            }
+
+            if (cbBlock == 0 && segment->Length - Lane->Offset >= SHA_NATIVE_BLOCK_SIZE) {
+                Lane->Offset += SHA_NATIVE_BLOCK_SIZE;
+                Lane->TotalLength += SHA_NATIVE_BLOCK_SIZE;
+                return segment->Data + Lane->Offset - SHA_NATIVE_BLOCK_SIZE;
+            }
+
+            cbCopy = min(segment->Length - Lane->Offset, (SIZE_T)(SHA_NATIVE_BLOCK_SIZE - cbBlock));
+            RtlCopyMemory(&Lane->Block[cbBlock], segment->Data + Lane->Offset, cbCopy);
+
+            cbBlock += (ULONG)cbCopy;
+            Lane->Offset += cbCopy;
+            Lane->TotalLength += cbCopy;
+
+            if (cbBlock == SHA_NATIVE_BLOCK_SIZE)
+                return Lane->Block;
+        }
+
+        //
+        // Message data is over, start padding.
+        //
+        Lane->Block[cbBlock++] = 0x80;
+        RtlZeroMemory(&Lane->Block[cbBlock], SHA_NATIVE_BLOCK_SIZE - cbBlock);
+
+        if (cbBlock > SHA_NATIVE_BLOCK_SIZE - sizeof(ULONGLONG)) {
+            Lane->LengthPending = TRUE;
+            return Lane->Block;
+        }
+    }
+    else {
+        RtlZeroMemory(Lane->Block, SHA_NATIVE_BLOCK_SIZE);
+    }
+
+    for (i = 0; i < sizeof(ULONGLONG); i++)
+        Lane->Block[SHA_NATIVE_BLOCK_SIZE - 1 - i] = (UCHAR)((Lane->TotalLength * 8) >> (i * 8));
+
+    Lane->Final = TRUE;
+    return Lane->Block;
+}
+
+/*
+* ShaMultiHash
+*
+* Purpose:
+*
+* Hash independent messages with one message per SIMD lane.
+* Lane that finished its message takes the next one right away, so lanes
+* stay busy until the last messages. Digest is written big endian.
+* Must be called under exception handler when segments point to mapped data.
+*
+*/
+VOID ShaMultiHash(
+    _In_ ULONG Algorithm,
+    _Inout_updates_(Count) PSHA_MB_MESSAGE Messages,
+    _In_ ULONG Count
+)
+{
+#ifdef SHA_NATIVE_X86
+    ULONG i, j, next = 0, cActive = 0, cWords;
+    const ULONG* initState;
+    const UCHAR* blocks[SHA_MB_LANES];
+    SHA_MB_LANE lanes[SHA_MB_LANES];
+    __declspec(align(32)) ULONG state[8][SHA_MB_LANES];
+
+    if (Algorithm == SHA_NATIVE_SHA1) {
+        initState = g_ShaInit1;
+        cWords = 5;
+    }
+    else {
+        initState = g_ShaInit256;
+        cWords = 8;
+    }
+
+    RtlSecureZeroMemory(lanes, sizeof(lanes));
+    RtlSecureZeroMemory(state, sizeof(state));
+
+    for (;;) {
+
+        for (i = 0; i < SHA_MB_LANES; i++) {
+
+            if (lanes[i].Message == NULL && next < Count) {
+                RtlSecureZeroMemory(&lanes[i], sizeof(SHA_MB_LANE));
+                lanes[i].Message = &Messages[next++];
+                for (j = 0; j < cWords; j++)
+                    state[j][i] = initState[j];
+                cActive += 1;
+            }
+
+            blocks[i] = (lanes[i].Message) ?
+                ShapMultiNextBlock(&lanes[i]) : g_ShaMultiIdleBlock;
+        }
+
+        if (cActive == 0)
+            break;
+
+        if (Algorithm == SHA_NATIVE_SHA1)
+            ShapMultiTransform1(state, blocks);
+        else
+            ShapMultiTransform256(state, blocks);
+
+        for (i = 0; i < SHA_MB_LANES; i++) {
+
+            if (lanes[i].Message == NULL || !lanes[i].Final)
+                continue;
+
+            for (j = 0; j < cWords; j++) {
+                lanes[i].Message->Digest[j * 4] = (UCHAR)(state[j][i] >> 24);
+                lanes[i].Message->Digest[j * 4 + 1] = (UCHAR)(state[j][i] >> 16);
+                lanes[i].Message->Digest[j * 4 + 2] = (UCHAR)(state[j][i] >> 8);
+                lanes[i].Message->Digest[j * 4 + 3] = (UCHAR)state[j][i];
+            }
+
+            lanes[i].Message = NULL;
+            cActive -= 1;
+        }
+    }
+
+    _mm256_zeroupper();
+#else
+    UNREFERENCED_PARAMETER(Algorithm);
+    UNREFERENCED_PARAMETER(Messages);
+    UNREFERENCED_PARAMETER(Count);
+#endif
+}
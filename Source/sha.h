@@ -0,0 +1,83 @@
+/*******************************************************************************
+*
+*  (C) COPYRIGHT AUTHORS, 2026
+*
+*  TITLE:       SHA.H
+*
+*  VERSION:     1.05
+*
+*  DATE:        14 Oct 2026
+*
+*  Native SHA-1/SHA-256 implementation header file.
+*
+* THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+* ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED
+* TO THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*******************************************************************************/
+#pragma once
+
+#define SHA_NATIVE_NONE     0
+#define SHA_NATIVE_SHA1     1
+#define SHA_NATIVE_SHA256   2
+
+#define SHA_NATIVE_BLOCK_SIZE 64
+
+#define SHA1_DIGEST_SIZE    20
+#define SHA256_DIGEST_SIZE  32
+
+//
+// PSHA_NATIVE_STATE is declared in global.h for CNG_CTX.
+//
+struct _SHA_NATIVE_STATE {
+    ULONG State[8];
+    UCHAR Buffer[SHA_NATIVE_BLOCK_SIZE];
+    ULONGLONG TotalLength;
+    ULONG BufferLength;
+    ULONG Algorithm;
+};
+
+BOOLEAN ShaNativeIsSupported(
+    VOID);
+
+ULONG ShaNativeDigestSize(
+    _In_ ULONG Algorithm);
+
+VOID ShaNativeInit(
+    _Out_ PSHA_NATIVE_STATE State,
+    _In_ ULONG Algorithm);
+
+VOID ShaNativeUpdate(
+    _Inout_ PSHA_NATIVE_STATE State,
+    _In_reads_bytes_(Length) const UCHAR* Data,
+    _In_ SIZE_T Length);
+
+VOID ShaNativeFinish(
+    _Inout_ PSHA_NATIVE_STATE State,
+    _Out_writes_bytes_(SHA256_DIGEST_SIZE) PUCHAR Digest);
+
+//
+// Multi-buffer engine, one message per SIMD lane.
+//
+#define SHA_MB_LANES        8
+#define SHA_MB_SEGMENTS_MAX 4
+
+typedef struct _SHA_MB_SEGMENT {
+    const UCHAR* Data;
+    SIZE_T Length;
+} SHA_MB_SEGMENT, * PSHA_MB_SEGMENT;
+
+typedef struct _SHA_MB_MESSAGE {
+    SHA_MB_SEGMENT Segments[SHA_MB_SEGMENTS_MAX];
+    ULONG SegmentCount;
+    PUCHAR Digest;
+} SHA_MB_MESSAGE, * PSHA_MB_MESSAGE;
+
+BOOLEAN ShaMultiIsSupported(
+    VOID);
+
+VOID ShaMultiHash(
+    _In_ ULONG Algorithm,
+    _Inout_updates_(Count) PSHA_MB_MESSAGE Messages,
+    _In_ ULONG Count);
@@ -0,0 +1,266 @@
+/*******************************************************************************
+*
+*  (C) COPYRIGHT AUTHORS, 2026
+*
+*  TITLE:       STATS.CPP
+*
+*  VERSION:     1.05
+*
+*  DATE:        14 Oct 2026
+*
+*  Pipeline stage timers and counters.
+*
+*  Counters are process wide and updated with interlocked operations.
+*  Stage timings, rejected files and caught exceptions are also written as
+*  TraceLogging events of AuthHashCalc provider when a trace session
+*  enables it (provider name *AuthHashCalc for tracelog/wpr).
+*
+* THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+* ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED
+* TO THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*******************************************************************************/
+
+#include "global.h"
+#include <TraceLoggingProvider.h>
+
+//
+// Name hash GUID of "AuthHashCalc", as tracelog/wpr derive it for *AuthHashCalc.
+//
+TRACELOGGING_DEFINE_PROVIDER(g_StatsProvider,
+    "AuthHashCalc",
+    (0xa309eace, 0xd53d, 0x581b, 0x36, 0xd5, 0x8a, 0x0e, 0xda, 0x37, 0xdc, 0x6c));
+
+static PIPELINE_STATS g_PipelineStats;
+static LARGE_INTEGER g_StatsFrequency;
+static BOOLEAN g_StatsRegistered;
+
+static LPCSTR g_StatsStageNames[STATS_STAGE_COUNT] = {
+    "open", "section", "validate", "hash", "format"
+};
+
+/*
+* StatspTicksToMicroseconds
+*
+* Purpose:
+*
+* Convert QPC ticks to microseconds.
+*
+*/
+ULONGLONG StatspTicksToMicroseconds(
+    _In_ ULONGLONG Ticks
+)
+{
+    if (g_StatsFrequency.QuadPart == 0)
+        return 0;
+
+    return (Ticks / g_StatsFrequency.QuadPart) * 1000000ULL +
+        ((Ticks % g_StatsFrequency.QuadPart) * 1000000ULL) / g_StatsFrequency.QuadPart;
+}
+
+/*
+* StatsInitialize
+*
+* Purpose:
+*
+* Reset counters and register trace provider.
+*
+*/
+VOID StatsInitialize(
+    VOID
+)
+{
+    RtlSecureZeroMemory(&g_PipelineStats, sizeof(g_PipelineStats));
+    QueryPerformanceFrequency(&g_StatsFrequency);
+
+    g_StatsRegistered = SUCCEEDED(TraceLoggingRegister(g_StatsProvider));
+}
+
+/*
+* StatsShutdown
+*
+* Purpose:
+*
+* Unregister trace provider.
+*
+*/
+VOID StatsShutdown(
+    VOID
+)
+{
+    if (g_StatsRegistered) {
+        TraceLoggingUnregister(g_StatsProvider);
+        g_StatsRegistered = FALSE;
+    }
+}
+
+/*
+* StatsStageBegin
+*
+* Purpose:
+*
+* Return stage start timestamp.
+*
+*/
+ULONGLONG StatsStageBegin(
+    VOID
+)
+{
+    LARGE_INTEGER now;
+
+    QueryPerformanceCounter(&now);
+    return (ULONGLONG)now.QuadPart;
+}
+
+/*
+* StatsStageEnd
+*
+* Purpose:
+*
+* Account time elapsed since StatsStageBegin to the stage.
+*
+*/
+VOID StatsStageEnd(
+    _In_ ULONG Stage,
+    _In_ ULONGLONG StartTicks
+)
+{
+    LARGE_INTEGER now;
+    ULONGLONG ticks;
+
+    QueryPerformanceCounter(&now);
+    ticks = (ULONGLONG)now.QuadPart - StartTicks;
+
+    InterlockedAdd64(&g_PipelineStats.Stages[Stage].Ticks, (LONG64)ticks);
+    InterlockedIncrement64(&g_PipelineStats.Stages[Stage].Count);
+
+    TraceLoggingWrite(g_StatsProvider,
+        "Stage",
+        TraceLoggingString(g_StatsStageNames[Stage], "Name"),
+        TraceLoggingUInt64(StatspTicksToMicroseconds(ticks), "DurationUs"));
+}
+
+/*
+* StatsAddBytesHashed
+*
+* Purpose:
+*
+* Account bytes passed to hash providers, counted once per digest.
+*
+*/
+VOID StatsAddBytesHashed(
+    _In_ ULONGLONG Bytes
+)
+{
+    InterlockedAdd64(&g_PipelineStats.BytesHashed, (LONG64)Bytes);
+}
+
+/*
+* StatsFileRejected
+*
+* Purpose:
+*
+* Account file rejected by image validation.
+*
+*/
+VOID StatsFileRejected(
+    _In_opt_ LPCWSTR FileName,
+    _In_ DWORD LastError
+)
+{
+    ULONG slot;
+
+    slot = (LastError < STATS_VERIFY_CODES_COUNT - 1) ? LastError : STATS_VERIFY_CODES_COUNT - 1;
+
+    InterlockedIncrement64(&g_PipelineStats.FilesRejected);
+    InterlockedIncrement64(&g_PipelineStats.Rejected[slot]);
+
+    TraceLoggingWrite(g_StatsProvider,
+        "FileRejected",
+        TraceLoggingWideString(FileName ? FileName : L"", "FileName"),
+        TraceLoggingUInt32(LastError, "VerifyCode"),
+        TraceLoggingWideString(supImageVerifyErrorToString(LastError), "Reason"));
+}
+
+/*
+* StatsExceptionCaught
+*
+* Purpose:
+*
+* Account exception caught while accessing file data.
+*
+*/
+VOID StatsExceptionCaught(
+    VOID
+)
+{
+    InterlockedIncrement64(&g_PipelineStats.ExceptionsCaught);
+
+    TraceLoggingWrite(g_StatsProvider, "ExceptionCaught");
+}
+
+/*
+* StatsReportSummary
+*
+* Purpose:
+*
+* Write end of run summary event and output it to the stream if given.
+*
+*/
+VOID StatsReportSummary(
+    _In_opt_ FILE* lpOutStream
+)
+{
+    ULONG i;
+    ULONGLONG ticks, count;
+
+    for (i = 0; i < STATS_STAGE_COUNT; i++) {
+
+        ticks = (ULONGLONG)g_PipelineStats.Stages[i].Ticks;
+        count = (ULONGLONG)g_PipelineStats.Stages[i].Count;
+
+        TraceLoggingWrite(g_StatsProvider,
+            "StageSummary",
+            TraceLoggingString(g_StatsStageNames[i], "Name"),
+            TraceLoggingUInt64(count, "Count"),
+            TraceLoggingUInt64(StatspTicksToMicroseconds(ticks), "TotalUs"));
+    }
+
+    TraceLoggingWrite(g_StatsProvider,
+        "RunSummary",
+        TraceLoggingUInt64((ULONGLONG)g_PipelineStats.BytesHashed, "BytesHashed"),
+        TraceLoggingUInt64((ULONGLONG)g_PipelineStats.FilesRejected, "FilesRejected"),
+        TraceLoggingUInt64((ULONGLONG)g_PipelineStats.ExceptionsCaught, "ExceptionsCaught"));
+
+    if (lpOutStream == NULL)
+        return;
+
+    fprintf_s(lpOutStream, "\nStage\t\tcalls\ttotal ms\tavg us\n");
+
+    for (i = 0; i < STATS_STAGE_COUNT; i++) {
+
+        ticks = (ULONGLONG)g_PipelineStats.Stages[i].Ticks;
+        count = (ULONGLONG)g_PipelineStats.Stages[i].Count;
+
+        fprintf_s(lpOutStream, "%-8s\t%llu\t%.3f\t\t%.1f\n",
+            g_StatsStageNames[i],
+            count,
+            (double)StatspTicksToMicroseconds(ticks) / 1000.0,
+            (count) ? (double)StatspTicksToMicroseconds(ticks) / (double)count : 0.0);
+    }
+
+    fprintf_s(lpOutStream, "\nBytes hashed: %llu\nExceptions caught: %llu\nFiles rejected: %llu\n",
+        (ULONGLONG)g_PipelineStats.BytesHashed,
+        (ULONGLONG)g_PipelineStats.ExceptionsCaught,
+        (ULONGLONG)g_PipelineStats.FilesRejected);
+
+    for (i = 0; i < STATS_VERIFY_CODES_COUNT; i++) {
+        if (g_PipelineStats.Rejected[i]) {
+            fprintf_s(lpOutStream, "  %ws: %llu\n",
+                (i < STATS_VERIFY_CODES_COUNT - 1) ?
+                supImageVerifyErrorToString(i) : L"Other",
+                (ULONGLONG)g_PipelineStats.Rejected[i]);
+        }
+    }
+}
@@ -0,0 +1,75 @@
+/*******************************************************************************
+*
+*  (C) COPYRIGHT AUTHORS, 2026
+*
+*  TITLE:       STATS.H
+*
+*  VERSION:     1.05
+*
+*  DATE:        14 Oct 2026
+*
+*  Pipeline stage timers and counters header file.
+*
+* THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+* ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED
+* TO THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*******************************************************************************/
+#pragma once
+
+//
+// Open is CreateFile, section is NtCreateSection with headers/full view
+// mapping, hash includes page faults taken while digests are computed.
+//
+#define STATS_STAGE_OPEN        0
+#define STATS_STAGE_SECTION     1
+#define STATS_STAGE_VALIDATE    2
+#define STATS_STAGE_HASH        3
+#define STATS_STAGE_FORMAT      4
+#define STATS_STAGE_COUNT       5
+
+//
+// Rejected files are counted by IMAGE_VERIFY_* code, last slot is for
+// codes outside of known range.
+//
+#define STATS_VERIFY_CODES_COUNT (IMAGE_VERIFY_BAD_SECURITY_DIRECTORY_SIZE + 2)
+
+typedef struct _STATS_STAGE {
+    volatile LONG64 Ticks;
+    volatile LONG64 Count;
+} STATS_STAGE, * PSTATS_STAGE;
+
+typedef struct _PIPELINE_STATS {
+    STATS_STAGE Stages[STATS_STAGE_COUNT];
+    volatile LONG64 BytesHashed;
+    volatile LONG64 FilesRejected;
+    volatile LONG64 ExceptionsCaught;
+    volatile LONG64 Rejected[STATS_VERIFY_CODES_COUNT];
+} PIPELINE_STATS, * PPIPELINE_STATS;
+
+VOID StatsInitialize(
+    VOID);
+
+VOID StatsShutdown(
+    VOID);
+
+ULONGLONG StatsStageBegin(
+    VOID);
+
+VOID StatsStageEnd(
+    _In_ ULONG Stage,
+    _In_ ULONGLONG StartTicks);
+
+VOID StatsAddBytesHashed(
+    _In_ ULONGLONG Bytes);
+
+VOID StatsFileRejected(
+    _In_opt_ LPCWSTR FileName,
+    _In_ DWORD LastError);
+
+VOID StatsExceptionCaught(
+    VOID);
+
+VOID StatsReportSummary(
+    _In_opt_ FILE* lpOutStream);
@@ -0,0 +1,605 @@
+/*******************************************************************************
+*
+*  (C) COPYRIGHT AUTHORS, 2026
+*
+*  TITLE:       STORE.CPP
+*
+*  VERSION:     1.05
+*
+*  DATE:        14 Oct 2026
+*
+*  Persistent hash result store.
+*
+*  Memory mapped open addressing table, slot is selected by volume serial
+*  and file id, entry is valid while file size and last write time match.
+*  First STORE_ENTRY sized block of the file is the header, it also keeps
+*  change journal position used by incremental scans.
+*
+* THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+* ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED
+* TO THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*******************************************************************************/
+
+#include "global.h"
+
+//
+// Part of the key that selects the slot.
+//
+#define STORE_SLOT_KEY_SIZE FIELD_OFFSET(FILE_IDENTITY, FileSize)
+
+C_ASSERT(sizeof(STORE_HEADER) <= sizeof(STORE_ENTRY));
+
+/*
+* StorepHashKey
+*
+* Purpose:
+*
+* FNV-1a of volume serial and file id.
+*
+*/
+ULONG StorepHashKey(
+    _In_ PFILE_IDENTITY Key
+)
+{
+    ULONG i, hash = 2166136261UL;
+    PUCHAR p = (PUCHAR)Key;
+
+    for (i = 0; i < STORE_SLOT_KEY_SIZE; i++) {
+        hash ^= p[i];
+        hash *= 16777619UL;
+    }
+
+    return hash;
+}
+
+/*
+* StorepFindSlot
+*
+* Purpose:
+*
+* Return slot used by the file or first empty slot of the probe sequence.
+* NULL is returned when table is full and file is not there.
+*
+*/
+PSTORE_ENTRY StorepFindSlot(
+    _In_ PSTORE_HEADER Header,
+    _In_ PSTORE_ENTRY Entries,
+    _In_ PFILE_IDENTITY Key
+)
+{
+    ULONG i, index, mask;
+    PSTORE_ENTRY entry;
+
+    //
+    // Store left unmapped by failed resize.
+    //
+    if (Header == NULL)
+        return NULL;
+
+    mask = Header->Capacity - 1;
+    index = StorepHashKey(Key) & mask;
+
+    for (i = 0; i < Header->Capacity; i++) {
+
+        entry = &Entries[index];
+
+        if (entry->State == STORE_ENTRY_EMPTY)
+            return entry;
+
+        if (RtlEqualMemory(&entry->Key, Key, STORE_SLOT_KEY_SIZE))
+            return entry;
+
+        index = (index + 1) & mask;
+    }
+
+    return NULL;
+}
+
+/*
+* StorepMap
+*
+* Purpose:
+*
+* Map store file of given capacity for read and write.
+*
+*/
+BOOLEAN StorepMap(
+    _In_ PHASH_STORE Store,
+    _In_ ULONG Capacity
+)
+{
+    LARGE_INTEGER fileSize;
+    PUCHAR viewBase;
+
+    fileSize.QuadPart = ((LONGLONG)Capacity + 1) * sizeof(STORE_ENTRY);
+
+    Store->MappingHandle = CreateFileMapping(Store->FileHandle,
+        NULL,
+        PAGE_READWRITE,
+        fileSize.HighPart,
+        fileSize.LowPart,
+        NULL);
+
+    if (Store->MappingHandle == NULL)
+        return FALSE;
+
+    viewBase = (PUCHAR)MapViewOfFile(Store->MappingHandle,
+        FILE_MAP_READ | FILE_MAP_WRITE,
+        0,
+        0,
+        (SIZE_T)fileSize.QuadPart);
+
+    if (viewBase == NULL) {
+        CloseHandle(Store->MappingHandle);
+        Store->MappingHandle = NULL;
+        return FALSE;
+    }
+
+    Store->Header = (PSTORE_HEADER)viewBase;
+    Store->Entries = (PSTORE_ENTRY)(viewBase + sizeof(STORE_ENTRY));
+
+    return TRUE;
+}
+
+/*
+* StorepUnmap
+*
+* Purpose:
+*
+* Flush and unmap store file view.
+*
+*/
+VOID StorepUnmap(
+    _In_ PHASH_STORE Store
+)
+{
+    if (Store->Header) {
+        FlushViewOfFile(Store->Header, 0);
+        UnmapViewOfFile(Store->Header);
+        Store->Header = NULL;
+        Store->Entries = NULL;
+    }
+
+    if (Store->MappingHandle) {
+        CloseHandle(Store->MappingHandle);
+        Store->MappingHandle = NULL;
+    }
+}
+
+/*
+* StorepCapacity
+*
+* Purpose:
+*
+* Return capacity keeping table at most half full after ExpectedEntries are added.
+*
+*/
+ULONG StorepCapacity(
+    _In_ ULONG Count,
+    _In_ ULONG ExpectedEntries
+)
+{
+    ULONG capacity = STORE_MIN_CAPACITY;
+    ULONGLONG cRequired = ((ULONGLONG)Count + ExpectedEntries) * 2;
+
+    while (capacity < cRequired && capacity < 0x80000000UL)
+        capacity <<= 1;
+
+    return capacity;
+}
+
+/*
+* StorepRebuild
+*
+* Purpose:
+*
+* Resize store file to the new capacity keeping all used entries
+* and journal position.
+*
+*/
+BOOLEAN StorepRebuild(
+    _In_ PHASH_STORE Store,
+    _In_ ULONG OldCapacity,
+    _In_ ULONG NewCapacity
+)
+{
+    BOOLEAN bResult = FALSE;
+    ULONG i, cSaved = 0;
+    PSTORE_ENTRY saved = NULL, slot;
+    LARGE_INTEGER fileSize;
+    STORE_JOURNAL journal;
+
+    RtlSecureZeroMemory(&journal, sizeof(journal));
+
+    do {
+
+        //
+        // Save used entries of the old table.
+        //
+        if (OldCapacity) {
+
+            if (!StorepMap(Store, OldCapacity))
+                break;
+
+            journal = Store->Header->Journal;
+
+            if (Store->Header->Count) {
+                saved = (PSTORE_ENTRY)supHeapAlloc((SIZE_T)Store->Header->Count * sizeof(STORE_ENTRY));
+                if (saved == NULL) {
+                    StorepUnmap(Store);
+                    break;
+                }
+            }
+
+            for (i = 0; i < OldCapacity && cSaved < Store->Header->Count; i++) {
+                if (Store->Entries[i].State == STORE_ENTRY_USED)
+                    saved[cSaved++] = Store->Entries[i];
+            }
+
+            StorepUnmap(Store);
+        }
+
+        fileSize.QuadPart = ((LONGLONG)NewCapacity + 1) * sizeof(STORE_ENTRY);
+
+        if (!SetFilePointerEx(Store->FileHandle, fileSize, NULL, FILE_BEGIN) ||
+            !SetEndOfFile(Store->FileHandle))
+        {
+            break;
+        }
+
+        if (!StorepMap(Store, NewCapacity))
+            break;
+
+        RtlZeroMemory(Store->Header, (SIZE_T)fileSize.QuadPart);
+
+        Store->Header->Signature = STORE_SIGNATURE;
+        Store->Header->Version = STORE_VERSION;
+        Store->Header->EntrySize = sizeof(STORE_ENTRY);
+        Store->Header->Capacity = NewCapacity;
+        Store->Header->Journal = journal;
+
+        for (i = 0; i < cSaved; i++) {
+            slot = StorepFindSlot(Store->Header, Store->Entries, &saved[i].Key);
+            if (slot) {
+                *slot = saved[i];
+                Store->Header->Count += 1;
+            }
+        }
+
+        bResult = TRUE;
+
+    } while (FALSE);
+
+    if (saved)
+        supHeapFree(saved);
+
+    return bResult;
+}
+
+/*
+* StorepGrow
+*
+* Purpose:
+*
+* Grow table so it stays at most half full after ExpectedEntries are added.
+* Caller holds the lock exclusively.
+*
+*/
+BOOLEAN StorepGrow(
+    _In_ PHASH_STORE Store,
+    _In_ ULONG ExpectedEntries
+)
+{
+    ULONG oldCapacity, capacity;
+
+    if (Store->Header == NULL)
+        return FALSE;
+
+    oldCapacity = Store->Header->Capacity;
+    capacity = StorepCapacity(Store->Header->Count, ExpectedEntries);
+
+    if (capacity <= oldCapacity)
+        return TRUE;
+
+    StorepUnmap(Store);
+
+    //
+    // Old table is still intact in the file if rebuild fails.
+    //
+    if (!StorepRebuild(Store, oldCapacity, capacity)) {
+        StorepUnmap(Store);
+        StorepMap(Store, oldCapacity);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/*
+* StoreOpen
+*
+* Purpose:
+*
+* Open or create persistent store.
+* Table is grown on open so it stays at most half full after ExpectedEntries
+* new files are added. Store must be released with StoreClose.
+*
+*/
+NTSTATUS StoreOpen(
+    _In_ LPCWSTR FileName,
+    _In_ ULONG ExpectedEntries,
+    _In_ ULONG VerifyPercent,
+    _Out_ PHASH_STORE* Store
+)
+{
+    NTSTATUS ntStatus = STATUS_INSUFFICIENT_RESOURCES;
+    DWORD cbRead = 0;
+    ULONG oldCapacity = 0, capacity;
+    LARGE_INTEGER fileSize;
+    STORE_HEADER header;
+    PHASH_STORE store;
+
+    *Store = NULL;
+
+    store = (PHASH_STORE)supHeapAlloc(sizeof(HASH_STORE));
+    if (store == NULL)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    InitializeSRWLock(&store->Lock);
+    store->VerifyPercent = (VerifyPercent > 100) ? 100 : VerifyPercent;
+
+    do {
+
+        store->FileHandle = CreateFile(FileName,
+            GENERIC_READ | GENERIC_WRITE,
+            0,
+            NULL,
+            OPEN_ALWAYS,
+            FILE_ATTRIBUTE_NORMAL,
+            NULL);
+
+        if (store->FileHandle == INVALID_HANDLE_VALUE) {
+            store->FileHandle = NULL;
+            ntStatus = STATUS_ACCESS_DENIED;
+            break;
+        }
+
+        RtlSecureZeroMemory(&header, sizeof(header));
+
+        //
+        // Existing store is reused only if it is consistent.
+        //
+        if (GetFileSizeEx(store->FileHandle, &fileSize) &&
+            fileSize.QuadPart >= (LONGLONG)sizeof(STORE_ENTRY) &&
+            ReadFile(store->FileHandle, &header, sizeof(header), &cbRead, NULL) &&
+            cbRead == sizeof(header) &&
+            header.Signature == STORE_SIGNATURE &&
+            header.Version == STORE_VERSION &&
+            header.EntrySize == sizeof(STORE_ENTRY) &&
+            header.Capacity >= STORE_MIN_CAPACITY &&
+            (header.Capacity & (header.Capacity - 1)) == 0 &&
+            header.Count <= header.Capacity &&
+            fileSize.QuadPart == ((LONGLONG)header.Capacity + 1) * sizeof(STORE_ENTRY))
+        {
+            oldCapacity = header.Capacity;
+        }
+        else {
+            header.Count = 0;
+        }
+
+        capacity = StorepCapacity(header.Count, ExpectedEntries);
+
+        if (oldCapacity >= capacity) {
+            if (!StorepMap(store, oldCapacity))
+                break;
+        }
+        else {
+            if (!StorepRebuild(store, oldCapacity, capacity))
+                break;
+        }
+
+        *Store = store;
+        return STATUS_SUCCESS;
+
+    } while (FALSE);
+
+    StoreClose(store);
+    return ntStatus;
+}
+
+/*
+* StoreClose
+*
+* Purpose:
+*
+* Flush and release store.
+*
+*/
+VOID StoreClose(
+    _In_ PHASH_STORE Store
+)
+{
+    StorepUnmap(Store);
+
+    if (Store->FileHandle)
+        CloseHandle(Store->FileHandle);
+
+    supHeapFree(Store);
+}
+
+/*
+* StoreLookup
+*
+* Purpose:
+*
+* Copy stored value of the file if it is unchanged since it was stored.
+*
+*/
+BOOLEAN StoreLookup(
+    _In_ PHASH_STORE Store,
+    _In_ PFILE_IDENTITY Key,
+    _Out_writes_bytes_(STORE_VALUE_SIZE) PVOID Value
+)
+{
+    BOOLEAN bResult = FALSE;
+    PSTORE_ENTRY entry;
+
+    AcquireSRWLockShared(&Store->Lock);
+
+    entry = StorepFindSlot(Store->Header, Store->Entries, Key);
+    if (entry &&
+        entry->State == STORE_ENTRY_USED &&
+        entry->Key.FileSize == Key->FileSize &&
+        entry->Key.LastWriteTime == Key->LastWriteTime)
+    {
+        RtlCopyMemory(Value, entry->Value, STORE_VALUE_SIZE);
+        bResult = TRUE;
+    }
+
+    ReleaseSRWLockShared(&Store->Lock);
+
+    InterlockedIncrement((bResult) ? &Store->Statistics.Hits : &Store->Statistics.Misses);
+
+    return bResult;
+}
+
+/*
+* StoreInsert
+*
+* Purpose:
+*
+* Add or replace value for the file.
+* Table is doubled when it gets half full, so long running processes that
+* never reserve keep short probe sequences.
+*
+*/
+BOOLEAN StoreInsert(
+    _In_ PHASH_STORE Store,
+    _In_ PFILE_IDENTITY Key,
+    _In_reads_bytes_(STORE_VALUE_SIZE) PVOID Value
+)
+{
+    PSTORE_ENTRY entry;
+
+    AcquireSRWLockExclusive(&Store->Lock);
+
+    entry = StorepFindSlot(Store->Header, Store->Entries, Key);
+
+    //
+    // Failed grow keeps the current table, inserts go on until it is full.
+    //
+    if (entry &&
+        entry->State == STORE_ENTRY_EMPTY &&
+        Store->Header->Count >= Store->Header->Capacity / 2 &&
+        StorepGrow(Store, 1))
+    {
+        entry = StorepFindSlot(Store->Header, Store->Entries, Key);
+    }
+
+    if (entry) {
+
+        if (entry->State == STORE_ENTRY_EMPTY)
+            Store->Header->Count += 1;
+
+        entry->Key = *Key;
+        RtlCopyMemory(entry->Value, Value, STORE_VALUE_SIZE);
+        entry->State = STORE_ENTRY_USED;
+    }
+
+    ReleaseSRWLockExclusive(&Store->Lock);
+
+    return (entry != NULL);
+}
+
+/*
+* StoreReserve
+*
+* Purpose:
+*
+* Grow table so it stays at most half full after ExpectedEntries are added.
+* Used when number of files becomes known after store is opened.
+*
+*/
+BOOLEAN StoreReserve(
+    _In_ PHASH_STORE Store,
+    _In_ ULONG ExpectedEntries
+)
+{
+    BOOLEAN bResult;
+
+    AcquireSRWLockExclusive(&Store->Lock);
+    bResult = StorepGrow(Store, ExpectedEntries);
+    ReleaseSRWLockExclusive(&Store->Lock);
+
+    return bResult;
+}
+
+/*
+* StoreQueryJournal
+*
+* Purpose:
+*
+* Return change journal position recorded in the store.
+*
+*/
+VOID StoreQueryJournal(
+    _In_ PHASH_STORE Store,
+    _Out_ PSTORE_JOURNAL Journal
+)
+{
+    RtlSecureZeroMemory(Journal, sizeof(STORE_JOURNAL));
+
+    AcquireSRWLockShared(&Store->Lock);
+    if (Store->Header)
+        *Journal = Store->Header->Journal;
+    ReleaseSRWLockShared(&Store->Lock);
+}
+
+/*
+* StoreSetJournal
+*
+* Purpose:
+*
+* Record change journal position the store is up to date with.
+*
+*/
+VOID StoreSetJournal(
+    _In_ PHASH_STORE Store,
+    _In_ PSTORE_JOURNAL Journal
+)
+{
+    AcquireSRWLockExclusive(&Store->Lock);
+    if (Store->Header)
+        Store->Header->Journal = *Journal;
+    ReleaseSRWLockExclusive(&Store->Lock);
+}
+
+/*
+* StoreShouldVerify
+*
+* Purpose:
+*
+* Decide whether store hit is to be verified by hashing the file again.
+*
+*/
+BOOLEAN StoreShouldVerify(
+    _In_ PHASH_STORE Store
+)
+{
+    ULONG value = 0;
+
+    if (Store->VerifyPercent == 0)
+        return FALSE;
+
+    if (!NT_SUCCESS(BCryptGenRandom(NULL,
+        (PUCHAR)&value,
+        sizeof(value),
+        BCRYPT_USE_SYSTEM_PREFERRED_RNG)))
+    {
+        return TRUE;
+    }
+
+    return ((value % 100) < Store->VerifyPercent);
+}
@@ -0,0 +1,104 @@
+/*******************************************************************************
+*
+*  (C) COPYRIGHT AUTHORS, 2026
+*
+*  TITLE:       STORE.H
+*
+*  VERSION:     1.05
+*
+*  DATE:        14 Oct 2026
+*
+*  Persistent hash result store header file.
+*
+* THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+* ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED
+* TO THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*******************************************************************************/
+#pragma once
+
+#define STORE_SIGNATURE     'SRHA'
+#define STORE_VERSION       2
+#define STORE_VALUE_SIZE    464
+#define STORE_MIN_CAPACITY  1024
+
+#define STORE_ENTRY_EMPTY   0
+#define STORE_ENTRY_USED    1
+
+//
+// Change journal position the store is up to date with.
+//
+typedef struct _STORE_JOURNAL {
+    ULONGLONG VolumeSerialNumber;
+    ULONGLONG JournalId;
+    LONGLONG NextUsn;
+} STORE_JOURNAL, * PSTORE_JOURNAL;
+
+typedef struct _STORE_HEADER {
+    ULONG Signature;
+    ULONG Version;
+    ULONG EntrySize;
+    ULONG Capacity;
+    ULONG Count;
+    ULONG Reserved;
+    STORE_JOURNAL Journal;
+} STORE_HEADER, * PSTORE_HEADER;
+
+typedef struct _STORE_ENTRY {
+    FILE_IDENTITY Key;
+    ULONG State;
+    ULONG Reserved;
+    UCHAR Value[STORE_VALUE_SIZE];
+} STORE_ENTRY, * PSTORE_ENTRY;
+
+typedef struct _STORE_STATISTICS {
+    volatile LONG Hits;
+    volatile LONG Misses;
+    volatile LONG Verified;
+    volatile LONG Mismatched;
+} STORE_STATISTICS, * PSTORE_STATISTICS;
+
+typedef struct _HASH_STORE {
+    SRWLOCK Lock;
+    HANDLE FileHandle;
+    HANDLE MappingHandle;
+    PSTORE_HEADER Header;
+    PSTORE_ENTRY Entries;
+    ULONG VerifyPercent;
+    STORE_STATISTICS Statistics;
+} HASH_STORE, * PHASH_STORE;
+
+NTSTATUS StoreOpen(
+    _In_ LPCWSTR FileName,
+    _In_ ULONG ExpectedEntries,
+    _In_ ULONG VerifyPercent,
+    _Out_ PHASH_STORE* Store);
+
+VOID StoreClose(
+    _In_ PHASH_STORE Store);
+
+BOOLEAN StoreLookup(
+    _In_ PHASH_STORE Store,
+    _In_ PFILE_IDENTITY Key,
+    _Out_writes_bytes_(STORE_VALUE_SIZE) PVOID Value);
+
+BOOLEAN StoreInsert(
+    _In_ PHASH_STORE Store,
+    _In_ PFILE_IDENTITY Key,
+    _In_reads_bytes_(STORE_VALUE_SIZE) PVOID Value);
+
+BOOLEAN StoreReserve(
+    _In_ PHASH_STORE Store,
+    _In_ ULONG ExpectedEntries);
+
+VOID StoreQueryJournal(
+    _In_ PHASH_STORE Store,
+    _Out_ PSTORE_JOURNAL Journal);
+
+VOID StoreSetJournal(
+    _In_ PHASH_STORE Store,
+    _In_ PSTORE_JOURNAL Journal);
+
+BOOLEAN StoreShouldVerify(
+    _In_ PHASH_STORE Store);
@@ -1,12 +1,12 @@
 /*******************************************************************************
 *
-*  (C) COPYRIGHT AUTHORS, 2021
+*  (C) COPYRIGHT AUTHORS, 2021 - 2026
 *
 *  TITLE:       SUP.CPP
 *
-*  VERSION:     1.03
+*  VERSION:     1.05
 *
-*  DATE:        26 Oct 2021
+*  DATE:        14 Oct 2026
 *
 *  Program global support routines.
 *
@@ -19,30 +19,116 @@
 
 #include "global.h"
 
-#define RTL_MEG                   (1024UL * 1024UL)
 #define RTLP_IMAGE_MAX_DOS_HEADER (256UL * RTL_MEG)
 
 #define PE_SIGNATURE_SIZE 4
+
+typedef BOOL(WINAPI* pfnPrefetchVirtualMemory)(
+    _In_ HANDLE hProcess,
+    _In_ ULONG_PTR NumberOfEntries,
+    _In_reads_(NumberOfEntries) PWIN32_MEMORY_RANGE_ENTRY VirtualAddresses,
+    _In_ ULONG Flags);
+
+//
+// Windows 8+ only, resolved once on first window mapping.
 //
-// Major copy-paste.
+static INIT_ONCE g_PrefetchInitOnce = INIT_ONCE_STATIC_INIT;
+static pfnPrefetchVirtualMemory g_pfnPrefetchVirtualMemory = NULL;
+
+//
+// Byte to hex digit pair lookup tables, first digit in the low half so a
+// table entry stored to memory yields the digits in output order.
 //
-#define MM_SIZE_OF_LARGEST_IMAGE ((ULONG)0x77000000)
-#define MM_MAXIMUM_IMAGE_HEADER (2 * PAGE_SIZE)
-#define MM_MAXIMUM_IMAGE_SECTIONS                       \
-     ((MM_MAXIMUM_IMAGE_HEADER - (PAGE_SIZE + sizeof(IMAGE_NT_HEADERS))) /  \
-            sizeof(IMAGE_SECTION_HEADER))
+#define SUP_HEX_DIGIT(n, a) ((n) < 10 ? '0' + (n) : (a) + (n) - 10)
+
+#define SUP_HEX_PAIR(b, a) \
+    (USHORT)(SUP_HEX_DIGIT((b) >> 4, a) | (SUP_HEX_DIGIT((b) & 15, a) << 8))
+
+#define SUP_HEX_WPAIR(b, a) \
+    (ULONG)(SUP_HEX_DIGIT((b) >> 4, a) | ((ULONG)SUP_HEX_DIGIT((b) & 15, a) << 16))
+
+#define SUP_HEX_ROW4(m, b, a) m(b, a), m(b + 1, a), m(b + 2, a), m(b + 3, a)
+#define SUP_HEX_ROW16(m, b, a) SUP_HEX_ROW4(m, b, a), SUP_HEX_ROW4(m, b + 4, a), \
+    SUP_HEX_ROW4(m, b + 8, a), SUP_HEX_ROW4(m, b + 12, a)
+#define SUP_HEX_ROW64(m, b, a) SUP_HEX_ROW16(m, b, a), SUP_HEX_ROW16(m, b + 16, a), \
+    SUP_HEX_ROW16(m, b + 32, a), SUP_HEX_ROW16(m, b + 48, a)
+#define SUP_HEX_TABLE(m, a) SUP_HEX_ROW64(m, 0, a), SUP_HEX_ROW64(m, 64, a), \
+    SUP_HEX_ROW64(m, 128, a), SUP_HEX_ROW64(m, 192, a)
+
+static const USHORT g_supHexPairsA[2][256] = {
+    { SUP_HEX_TABLE(SUP_HEX_PAIR, 'a') },
+    { SUP_HEX_TABLE(SUP_HEX_PAIR, 'A') }
+};
+
+static const ULONG g_supHexPairsW[2][256] = {
+    { SUP_HEX_TABLE(SUP_HEX_WPAIR, L'a') },
+    { SUP_HEX_TABLE(SUP_HEX_WPAIR, L'A') }
+};
+
+/*
+* supHexEncodeA
+*
+* Purpose:
+*
+* Format buffer as zero terminated hex string into caller buffer.
+* Return number of characters written without terminator, zero if cchOutput
+* is less than Length * 2 + 1.
+*
+*/
+SIZE_T supHexEncodeA(
+    _In_reads_bytes_(Length) const BYTE* Buffer,
+    _In_ ULONG Length,
+    _In_ BOOLEAN UpcaseHex,
+    _Out_writes_(cchOutput) PCHAR Output,
+    _In_ SIZE_T cchOutput
+)
+{
+    ULONG i;
+    const USHORT* pairs = g_supHexPairsA[UpcaseHex ? 1 : 0];
+
+    if (cchOutput < (SIZE_T)Length * 2 + 1) {
+        if (cchOutput)
+            Output[0] = 0;
+        return 0;
+    }
+
+    for (i = 0; i < Length; i++)
+        *(USHORT UNALIGNED*)&Output[i * 2] = pairs[Buffer[i]];
 
-__inline WCHAR nibbletoh(BYTE c, BOOLEAN upcase)
+    Output[(SIZE_T)Length * 2] = 0;
+    return (SIZE_T)Length * 2;
+}
+
+/*
+* supHexEncodeW
+*
+* Purpose:
+*
+* Wide variant of supHexEncodeA.
+*
+*/
+SIZE_T supHexEncodeW(
+    _In_reads_bytes_(Length) const BYTE* Buffer,
+    _In_ ULONG Length,
+    _In_ BOOLEAN UpcaseHex,
+    _Out_writes_(cchOutput) PWCHAR Output,
+    _In_ SIZE_T cchOutput
+)
 {
-    if (c < 10)
-        return L'0' + c;
+    ULONG i;
+    const ULONG* pairs = g_supHexPairsW[UpcaseHex ? 1 : 0];
 
-    c -= 10;
+    if (cchOutput < (SIZE_T)Length * 2 + 1) {
+        if (cchOutput)
+            Output[0] = 0;
+        return 0;
+    }
 
-    if (upcase)
-        return L'A' + c;
+    for (i = 0; i < Length; i++)
+        *(ULONG UNALIGNED*)&Output[i * 2] = pairs[Buffer[i]];
 
-    return L'a' + c;
+    Output[(SIZE_T)Length * 2] = 0;
+    return (SIZE_T)Length * 2;
 }
 
 /*
@@ -52,6 +138,7 @@ __inline WCHAR nibbletoh(BYTE c, BOOLEAN upcase)
 *
 * Output hash.
 * Returned buffer must be freed with supHeapFree when no longer needed.
+* Use supHexEncodeW to format into existing buffer.
 *
 */
 LPWSTR supPrintHash(
@@ -60,22 +147,14 @@ LPWSTR supPrintHash(
     _In_ BOOLEAN UpcaseHex
 )
 {
-    ULONG   c;
+    SIZE_T  cch;
     PWCHAR  lpText;
-    BYTE    x;
-
-    lpText = (LPWSTR)supHeapAlloc(sizeof(WCHAR) + ((SIZE_T)Length * 2 * sizeof(WCHAR)));
-    if (lpText) {
 
-        for (c = 0; c < Length; ++c) {
-            x = Buffer[c];
+    cch = (SIZE_T)Length * 2 + 1;
 
-            lpText[c * 2] = nibbletoh(x >> 4, UpcaseHex);
-            lpText[c * 2 + 1] = nibbletoh(x & 15, UpcaseHex);
-        }
-
-        lpText[Length * 2] = 0;
-    }
+    lpText = (LPWSTR)supHeapAlloc(cch * sizeof(WCHAR));
+    if (lpText)
+        supHexEncodeW(Buffer, Length, UpcaseHex, lpText, cch);
 
     return lpText;
 }
@@ -154,7 +233,15 @@ VOID supDestroyFileViewInfo(
         NtClose(ViewInformation->SectionHandle);
         ViewInformation->SectionHandle = NULL;
     }
-    if (ViewInformation->ViewBase) {
+    if (ViewInformation->Reader) {
+        ReaderClose(ViewInformation->Reader);
+        ViewInformation->Reader = NULL;
+    }
+    if (ViewInformation->IoBackend == FILE_IO_BACKEND_BUFFER) {
+        ViewInformation->ViewBase = NULL;
+        ViewInformation->ViewSize = 0;
+    }
+    else if (ViewInformation->ViewBase) {
         if (NT_SUCCESS(NtUnmapViewOfSection(NtCurrentProcess(),
             ViewInformation->ViewBase)))
         {
@@ -168,20 +255,50 @@ VOID supDestroyFileViewInfo(
 }
 
 /*
-* supxInitializeFileViewInfo
+* supInitBufferViewInfo
 *
 * Purpose:
 *
-* Open file for mapping, create section, remember file size.
+* Describe caller memory holding first ViewSize bytes of the file as headers view.
+* Buffer must stay valid until view is destroyed, destroy never frees it.
 *
 */
-NTSTATUS supxInitializeFileViewInfo(
+VOID supInitBufferViewInfo(
+    _Inout_ PFILE_VIEW_INFO ViewInformation,
+    _In_reads_bytes_(ViewSize) const VOID* Buffer,
+    _In_ SIZE_T ViewSize,
+    _In_ ULONGLONG FileSize
+)
+{
+    ViewInformation->LastError = IMAGE_VERIFY_OK;
+    ViewInformation->IoBackend = FILE_IO_BACKEND_BUFFER;
+    ViewInformation->FileHandle = INVALID_HANDLE_VALUE;
+    ViewInformation->SectionHandle = NULL;
+    ViewInformation->ViewBase = (PVOID)Buffer;
+    ViewInformation->ViewSize = ViewSize;
+    ViewInformation->FileSize.QuadPart = (LONGLONG)FileSize;
+    ViewInformation->NtHeaders = NULL;
+    ViewInformation->Reader = NULL;
+}
+
+/*
+* supOpenInputFile
+*
+* Purpose:
+*
+* Open input file and remember its size.
+* Called by supMapInputFileForRead if file is not opened yet, callers may
+* open file earlier to query its identity before mapping.
+*
+*/
+NTSTATUS supOpenInputFile(
     _In_ PFILE_VIEW_INFO ViewInformation
 )
 {
     NTSTATUS ntStatus = STATUS_SUCCESS;
-    HANDLE fileHandle, sectionHandle = NULL;
+    HANDLE fileHandle;
     LARGE_INTEGER fileSize;
+    ULONGLONG startTicks = StatsStageBegin();
 
     fileSize.QuadPart = 0;
     fileHandle = CreateFile(ViewInformation->FileName,
@@ -199,23 +316,6 @@ NTSTATUS supxInitializeFileViewInfo(
             fileHandle = INVALID_HANDLE_VALUE;
             ntStatus = STATUS_FILE_INVALID;
         }
-        else {
-
-            ntStatus = NtCreateSection(
-                &sectionHandle,
-                SECTION_QUERY | SECTION_MAP_READ,
-                NULL,
-                &fileSize,
-                PAGE_READONLY,
-                SEC_COMMIT,
-                fileHandle);
-
-            if (!NT_SUCCESS(ntStatus)) {
-                CloseHandle(fileHandle);
-                fileHandle = INVALID_HANDLE_VALUE;
-            }
-
-        }
 
     }
     else {
@@ -225,17 +325,249 @@ NTSTATUS supxInitializeFileViewInfo(
     ViewInformation->LastError = IMAGE_VERIFY_OK;
     ViewInformation->FileHandle = fileHandle;
     ViewInformation->FileSize = fileSize;
+
+    StatsStageEnd(STATS_STAGE_OPEN, startTicks);
+
+    return ntStatus;
+}
+
+/*
+* supQueryFileIdentity
+*
+* Purpose:
+*
+* Query volume serial, file id, size and last write time of opened input file.
+* 128-bit file id is used where available (Windows 8+), file index otherwise.
+*
+*/
+BOOLEAN supQueryFileIdentity(
+    _In_ PFILE_VIEW_INFO ViewInformation,
+    _Out_ PFILE_IDENTITY Identity
+)
+{
+    BY_HANDLE_FILE_INFORMATION fileInfo;
+    FILE_ID_INFO fileIdInfo;
+
+    RtlSecureZeroMemory(Identity, sizeof(FILE_IDENTITY));
+
+    if (!GetFileInformationByHandle(ViewInformation->FileHandle, &fileInfo))
+        return FALSE;
+
+    Identity->FileSize = ((ULONGLONG)fileInfo.nFileSizeHigh << 32) | fileInfo.nFileSizeLow;
+    Identity->LastWriteTime = ((ULONGLONG)fileInfo.ftLastWriteTime.dwHighDateTime << 32) |
+        fileInfo.ftLastWriteTime.dwLowDateTime;
+
+    if (GetFileInformationByHandleEx(ViewInformation->FileHandle,
+        FileIdInfo,
+        &fileIdInfo,
+        sizeof(fileIdInfo)))
+    {
+        Identity->VolumeSerialNumber = fileIdInfo.VolumeSerialNumber;
+        Identity->FileId = fileIdInfo.FileId;
+    }
+    else {
+        Identity->VolumeSerialNumber = fileInfo.dwVolumeSerialNumber;
+        *(PULONGLONG)&Identity->FileId.Identifier[0] =
+            ((ULONGLONG)fileInfo.nFileIndexHigh << 32) | fileInfo.nFileIndexLow;
+    }
+
+    return TRUE;
+}
+
+/*
+* supxInitializeFileViewInfo
+*
+* Purpose:
+*
+* Create section for opened input file.
+* Partial map section covers largest headers view only.
+*
+*/
+NTSTATUS supxInitializeFileViewInfo(
+    _In_ PFILE_VIEW_INFO ViewInformation,
+    _In_ BOOLEAN PartialMap
+)
+{
+    NTSTATUS ntStatus;
+    HANDLE sectionHandle = NULL;
+    LARGE_INTEGER sectionSize;
+
+    sectionSize = ViewInformation->FileSize;
+    if (PartialMap && sectionSize.QuadPart > SUP_HEADERS_VIEW_MAX)
+        sectionSize.QuadPart = SUP_HEADERS_VIEW_MAX;
+
+    ntStatus = NtCreateSection(
+        &sectionHandle,
+        SECTION_QUERY | SECTION_MAP_READ,
+        NULL,
+        &sectionSize,
+        PAGE_READONLY,
+        SEC_COMMIT,
+        ViewInformation->FileHandle);
+
+    if (!NT_SUCCESS(ntStatus)) {
+        CloseHandle(ViewInformation->FileHandle);
+        ViewInformation->FileHandle = INVALID_HANDLE_VALUE;
+        sectionHandle = NULL;
+    }
+
+    ViewInformation->LastError = IMAGE_VERIFY_OK;
     ViewInformation->SectionHandle = sectionHandle;
 
     return ntStatus;
 }
 
+/*
+* supQueryHeadersExtent
+*
+* Purpose:
+*
+* Return headers view size needed to hold headers read by validation and
+* hashing as far as it can be judged from the view. Fields beyond the view
+* are covered by their largest size, caller repeats after view is grown.
+* Result is capped by file size and SUP_HEADERS_VIEW_MAX.
+* Returns zero for headers validation rejects anyway.
+*
+*/
+ULONGLONG supQueryHeadersExtent(
+    _In_ PFILE_VIEW_INFO ViewInformation
+)
+{
+    ULONG lfanew, sizeOfHeaders = 0;
+    ULONGLONG extent = 0, cbFileHeader, cbSections, viewSize = ViewInformation->ViewSize;
+    PIMAGE_DOS_HEADER dosHeader = (PIMAGE_DOS_HEADER)ViewInformation->ViewBase;
+    PIMAGE_NT_HEADERS ntHeaders;
+
+    __try {
+
+        do {
+
+            if (viewSize < sizeof(IMAGE_DOS_HEADER) ||
+                dosHeader->e_lfanew <= 0 ||
+                dosHeader->e_lfanew >= RTLP_IMAGE_MAX_DOS_HEADER)
+            {
+                return 0;
+            }
+
+            lfanew = (ULONG)dosHeader->e_lfanew;
+            extent = (ULONGLONG)lfanew + sizeof(IMAGE_NT_HEADERS64);
+
+            cbFileHeader = (ULONGLONG)lfanew + UFIELD_OFFSET(IMAGE_NT_HEADERS, OptionalHeader);
+            if (cbFileHeader + sizeof(WORD) > viewSize)
+                break;
+
+            ntHeaders = (PIMAGE_NT_HEADERS)((PCHAR)dosHeader + lfanew);
+
+            cbSections = cbFileHeader +
+                ntHeaders->FileHeader.SizeOfOptionalHeader +
+                (ULONGLONG)ntHeaders->FileHeader.NumberOfSections * sizeof(IMAGE_SECTION_HEADER);
+
+            if (cbSections > extent)
+                extent = cbSections;
+
+            if (ntHeaders->OptionalHeader.Magic == IMAGE_NT_OPTIONAL_HDR64_MAGIC) {
+                if ((ULONGLONG)lfanew + sizeof(IMAGE_NT_HEADERS64) <= viewSize)
+                    sizeOfHeaders = ((PIMAGE_NT_HEADERS64)ntHeaders)->OptionalHeader.SizeOfHeaders;
+            }
+            else {
+                if ((ULONGLONG)lfanew + sizeof(IMAGE_NT_HEADERS32) <= viewSize)
+                    sizeOfHeaders = ((PIMAGE_NT_HEADERS32)ntHeaders)->OptionalHeader.SizeOfHeaders;
+            }
+
+            if (sizeOfHeaders > extent)
+                extent = sizeOfHeaders;
+
+        } while (FALSE);
+
+    }
+    __except (EXCEPTION_EXECUTE_HANDLER) {
+        StatsExceptionCaught();
+        return 0;
+    }
+
+    if (extent > (ULONGLONG)ViewInformation->FileSize.QuadPart)
+        extent = (ULONGLONG)ViewInformation->FileSize.QuadPart;
+    if (extent > SUP_HEADERS_VIEW_MAX)
+        extent = SUP_HEADERS_VIEW_MAX;
+
+    return extent;
+}
+
+/*
+* supxGrowHeadersView
+*
+* Purpose:
+*
+* Remap headers view when headers extend past it. Whatever is still outside
+* the view is rejected by validation.
+*
+*/
+NTSTATUS supxGrowHeadersView(
+    _In_ PFILE_VIEW_INFO ViewInformation
+)
+{
+    NTSTATUS ntStatus = STATUS_SUCCESS;
+    ULONG i;
+    SIZE_T viewSize;
+    ULONGLONG extent;
+
+    //
+    // Each pass may reveal fields of the previous maximum estimate.
+    //
+    for (i = 0; i < 3; i++) {
+
+        extent = supQueryHeadersExtent(ViewInformation);
+        if (extent <= ViewInformation->ViewSize)
+            break;
+
+        ntStatus = NtUnmapViewOfSection(NtCurrentProcess(), ViewInformation->ViewBase);
+        if (!NT_SUCCESS(ntStatus))
+            break;
+
+        ViewInformation->ViewBase = NULL;
+        ViewInformation->ViewSize = 0;
+
+        viewSize = (SIZE_T)extent;
+        ntStatus = NtMapViewOfSection(ViewInformation->SectionHandle,
+            NtCurrentProcess(),
+            &ViewInformation->ViewBase,
+            0,
+            0,
+            NULL,
+            &viewSize,
+            ViewShare,
+            0,
+            PAGE_READONLY);
+
+        if (!NT_SUCCESS(ntStatus)) {
+            ViewInformation->ViewBase = NULL;
+            break;
+        }
+
+        //
+        // Rounded up view may pass file end, only file bytes count.
+        //
+        if ((ULONGLONG)viewSize > extent)
+            viewSize = (SIZE_T)extent;
+
+        ViewInformation->ViewSize = viewSize;
+    }
+
+    return ntStatus;
+}
+
 /*
 * supMapInputFileForRead
 *
 * Purpose:
 *
 * Create mapped section from input file.
+* Files larger than SUP_MAP_WINDOW_SIZE get headers view only, everything
+* beyond the view is accessed through supMapFileWindow.
+* Unbuffered backend always maps headers only and reads the rest with
+* file reader, mapping is used if reader could not be opened.
+* Partial map gives access to headers view only.
+* Headers view grows to cover headers lying past its initial size.
 *
 */
 NTSTATUS supMapInputFileForRead(
@@ -245,17 +577,33 @@ NTSTATUS supMapInputFileForRead(
 {
     NTSTATUS ntStatus;
     SIZE_T viewSize;
+    ULONGLONG startTicks;
+
+    if (ViewInformation->FileHandle == NULL ||
+        ViewInformation->FileHandle == INVALID_HANDLE_VALUE)
+    {
+        ntStatus = supOpenInputFile(ViewInformation);
+        if (!NT_SUCCESS(ntStatus))
+            return ntStatus;
+    }
 
-    ntStatus = supxInitializeFileViewInfo(ViewInformation);
-    if (!NT_SUCCESS(ntStatus))
+    startTicks = StatsStageBegin();
+
+    ntStatus = supxInitializeFileViewInfo(ViewInformation, PartialMap);
+    if (!NT_SUCCESS(ntStatus)) {
+        StatsStageEnd(STATS_STAGE_SECTION, startTicks);
         return ntStatus;
+    }
 
-    if (PartialMap) {
+    if (PartialMap ||
+        ViewInformation->IoBackend == FILE_IO_BACKEND_UNBUFFERED ||
+        ViewInformation->FileSize.QuadPart > SUP_MAP_WINDOW_SIZE)
+    {
 
-        if (ViewInformation->FileSize.QuadPart < RTL_MEG)
+        if (ViewInformation->FileSize.QuadPart < SUP_HEADERS_VIEW_SIZE)
             viewSize = (SIZE_T)ViewInformation->FileSize.QuadPart;
         else
-            viewSize = (SIZE_T)RTL_MEG;
+            viewSize = (SIZE_T)SUP_HEADERS_VIEW_SIZE;
 
     }
     else {
@@ -275,12 +623,155 @@ NTSTATUS supMapInputFileForRead(
         0,
         PAGE_READONLY);
 
-    if (NT_SUCCESS(ntStatus))
-        ViewInformation->ViewSize = viewSize;
+    if (!NT_SUCCESS(ntStatus)) {
+        StatsStageEnd(STATS_STAGE_SECTION, startTicks);
+        return ntStatus;
+    }
+
+    ViewInformation->ViewSize = viewSize;
+
+    if ((ULONGLONG)viewSize < (ULONGLONG)ViewInformation->FileSize.QuadPart) {
+        ntStatus = supxGrowHeadersView(ViewInformation);
+        if (!NT_SUCCESS(ntStatus)) {
+            StatsStageEnd(STATS_STAGE_SECTION, startTicks);
+            return ntStatus;
+        }
+    }
+
+    if (!PartialMap &&
+        ViewInformation->IoBackend == FILE_IO_BACKEND_UNBUFFERED &&
+        (ULONGLONG)ViewInformation->FileSize.QuadPart > viewSize)
+    {
+        ReaderOpen(ViewInformation->FileName,
+            (ULONGLONG)ViewInformation->FileSize.QuadPart,
+            ViewInformation->Arena,
+            &ViewInformation->Reader);
+    }
+
+    StatsStageEnd(STATS_STAGE_SECTION, startTicks);
 
     return ntStatus;
 }
 
+/*
+* supxInitPrefetch
+*
+* Purpose:
+*
+* INIT_ONCE callback, query PrefetchVirtualMemory availability.
+*
+*/
+BOOL CALLBACK supxInitPrefetch(
+    _Inout_ PINIT_ONCE InitOnce,
+    _Inout_opt_ PVOID Parameter,
+    _Out_opt_ PVOID* Context
+)
+{
+    HMODULE hKernel32;
+
+    UNREFERENCED_PARAMETER(InitOnce);
+    UNREFERENCED_PARAMETER(Parameter);
+
+    if (Context)
+        *Context = NULL;
+
+    hKernel32 = GetModuleHandle(TEXT("kernel32.dll"));
+    if (hKernel32) {
+        g_pfnPrefetchVirtualMemory = (pfnPrefetchVirtualMemory)GetProcAddress(hKernel32,
+            "PrefetchVirtualMemory");
+    }
+
+    return TRUE;
+}
+
+/*
+* supMapFileWindow
+*
+* Purpose:
+*
+* Map view of input file section starting at Offset aligned down to
+* allocation granularity, clipped by end of file.
+* Mapped range is submitted for prefetch, so by the time caller reaches
+* it data is already being read.
+*
+*/
+NTSTATUS supMapFileWindow(
+    _In_ PFILE_VIEW_INFO ViewInformation,
+    _In_ ULONGLONG Offset,
+    _In_ SIZE_T Size,
+    _Out_ PFILE_WINDOW Window
+)
+{
+    NTSTATUS ntStatus;
+    ULONGLONG fileSize = (ULONGLONG)ViewInformation->FileSize.QuadPart;
+    LARGE_INTEGER sectionOffset;
+    SIZE_T viewSize;
+    WIN32_MEMORY_RANGE_ENTRY rangeEntry;
+
+    RtlSecureZeroMemory(Window, sizeof(FILE_WINDOW));
+
+    if (Offset >= fileSize)
+        return STATUS_END_OF_FILE;
+
+    sectionOffset.QuadPart = (LONGLONG)(Offset & ~((ULONGLONG)SUP_MAP_WINDOW_ALIGN - 1));
+
+    viewSize = Size;
+    if (fileSize - (ULONGLONG)sectionOffset.QuadPart < viewSize)
+        viewSize = (SIZE_T)(fileSize - (ULONGLONG)sectionOffset.QuadPart);
+
+    ntStatus = NtMapViewOfSection(ViewInformation->SectionHandle,
+        NtCurrentProcess(),
+        &Window->Base,
+        0,
+        0,
+        &sectionOffset,
+        &viewSize,
+        ViewShare,
+        0,
+        PAGE_READONLY);
+
+    if (!NT_SUCCESS(ntStatus)) {
+        Window->Base = NULL;
+        return ntStatus;
+    }
+
+    //
+    // View size is page rounded, keep only bytes that belong to the file.
+    //
+    Window->Offset = (ULONGLONG)sectionOffset.QuadPart;
+    Window->Size = viewSize;
+    if (fileSize - Window->Offset < Window->Size)
+        Window->Size = (SIZE_T)(fileSize - Window->Offset);
+
+    InitOnceExecuteOnce(&g_PrefetchInitOnce, supxInitPrefetch, NULL, NULL);
+
+    if (g_pfnPrefetchVirtualMemory) {
+        rangeEntry.VirtualAddress = Window->Base;
+        rangeEntry.NumberOfBytes = Window->Size;
+        g_pfnPrefetchVirtualMemory(NtCurrentProcess(), 1, &rangeEntry, 0);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/*
+* supUnmapFileWindow
+*
+* Purpose:
+*
+* Release view mapped by supMapFileWindow.
+*
+*/
+VOID supUnmapFileWindow(
+    _Inout_ PFILE_WINDOW Window
+)
+{
+    if (Window->Base) {
+        NtUnmapViewOfSection(NtCurrentProcess(), Window->Base);
+        RtlSecureZeroMemory(Window, sizeof(FILE_WINDOW));
+    }
+}
+
 /*
 * supOpenDialogExecute
 *
@@ -370,173 +861,136 @@ BOOL supDragAndDropResolveTarget(
     return bResult;
 }
 
-#pragma warning(push)
-#pragma warning(disable: 4319)
-
 /*
 * supxValidateNtHeader
 *
 * Purpose:
 *
-* Common validation for file image header.
+* Dispatch on optional header flavor, validate header and build hash layout.
 *
 */
 BOOLEAN supxValidateNtHeader(
+    _In_ PFILE_VIEW_INFO ViewInformation,
     _In_ PIMAGE_NT_HEADERS Header,
-    _Out_ PDWORD ErrorCode
+    _In_ ULONG NtOffset
 )
 {
-    INT i;
-    ULONG64 lastSectionVA;
-    PIMAGE_NT_HEADERS32 pHdr32;
-    PIMAGE_NT_HEADERS64 pHdr64;
-    PIMAGE_SECTION_HEADER pSection;
-
-    if (Header->OptionalHeader.Magic == IMAGE_NT_OPTIONAL_HDR64_MAGIC) {
-
-        pHdr64 = PIMAGE_NT_HEADERS64(Header);
-
-        if (((pHdr64->OptionalHeader.FileAlignment & 511) != 0) &&
-            (pHdr64->OptionalHeader.FileAlignment != pHdr64->OptionalHeader.SectionAlignment))
-        {
-            *ErrorCode = IMAGE_VERIFY_BAD_FILE_ALIGNMENT;
-            return FALSE;
-        }
-
-        if (pHdr64->OptionalHeader.FileAlignment == 0) {
-            *ErrorCode = IMAGE_VERIFY_BAD_FILE_ALIGNMENT;
-            return FALSE;
-        }
-
-        if (((pHdr64->OptionalHeader.SectionAlignment - 1) &
-            pHdr64->OptionalHeader.SectionAlignment) != 0)
-        {
-            *ErrorCode = IMAGE_VERIFY_BAD_SECTION_ALIGNMENT;
-            return FALSE;
-        }
+    ULONGLONG fileSize = (ULONGLONG)ViewInformation->FileSize.QuadPart;
 
-        if (((pHdr64->OptionalHeader.FileAlignment - 1) &
-            pHdr64->OptionalHeader.FileAlignment) != 0)
-        {
-            *ErrorCode = IMAGE_VERIFY_BAD_FILE_ALIGNMENT;
-            return FALSE;
-        }
+    switch (Header->OptionalHeader.Magic) {
 
-        if (pHdr64->OptionalHeader.SectionAlignment < pHdr64->OptionalHeader.FileAlignment) {
-            *ErrorCode = IMAGE_VERIFY_BAD_SECTION_ALIGNMENT;
-            return FALSE;
-        }
+    case IMAGE_NT_TRAITS<IMAGE_NT_HEADERS64>::Magic:
+        return ImageValidate((PIMAGE_NT_HEADERS64)Header,
+            NtOffset,
+            fileSize,
+            &ViewInformation->Layout,
+            &ViewInformation->LastError);
 
-        if (pHdr64->OptionalHeader.SizeOfImage > MM_SIZE_OF_LARGEST_IMAGE) {
-            *ErrorCode = IMAGE_VERIFY_BAD_SIZEOFIMAGE;
-            return FALSE;
-        }
-
-        if (pHdr64->FileHeader.NumberOfSections > MM_MAXIMUM_IMAGE_SECTIONS) {
-            *ErrorCode = IMAGE_VERIFY_BAD_SECTION_COUNT;
-            return FALSE;
-        }
-
-        if (pHdr64->FileHeader.Machine != IMAGE_FILE_MACHINE_IA64 &&
-            pHdr64->FileHeader.Machine != IMAGE_FILE_MACHINE_AMD64 &&
-            pHdr64->FileHeader.Machine != IMAGE_FILE_MACHINE_ARM64)
-        {
-            *ErrorCode = IMAGE_VERIFY_BAD_FILE_HEADER_MACHINE;
-            return FALSE;
-        }
+    case IMAGE_NT_TRAITS<IMAGE_NT_HEADERS32>::Magic:
+        return ImageValidate((PIMAGE_NT_HEADERS32)Header,
+            NtOffset,
+            fileSize,
+            &ViewInformation->Layout,
+            &ViewInformation->LastError);
 
+    default:
+        ViewInformation->LastError = IMAGE_VERIFY_BAD_OPTIONAL_HEADER_MAGIC;
+        return FALSE;
     }
-    else if (Header->OptionalHeader.Magic == IMAGE_NT_OPTIONAL_HDR32_MAGIC) {
-
-        pHdr32 = PIMAGE_NT_HEADERS32(Header);
-
-        if (((pHdr32->OptionalHeader.FileAlignment & 511) != 0) &&
-            (pHdr32->OptionalHeader.FileAlignment != pHdr32->OptionalHeader.SectionAlignment))
-        {
-            *ErrorCode = IMAGE_VERIFY_BAD_FILE_ALIGNMENT;
-            return FALSE;
-        }
-
-        if (pHdr32->OptionalHeader.FileAlignment == 0) {
-            *ErrorCode = IMAGE_VERIFY_BAD_FILE_ALIGNMENT;
-            return FALSE;
-        }
-
-        if (((pHdr32->OptionalHeader.SectionAlignment - 1) &
-            pHdr32->OptionalHeader.SectionAlignment) != 0)
-        {
-            *ErrorCode = IMAGE_VERIFY_BAD_SECTION_ALIGNMENT;
-            return FALSE;
-        }
-
-        if (((pHdr32->OptionalHeader.FileAlignment - 1) &
-            pHdr32->OptionalHeader.FileAlignment) != 0)
-        {
-            *ErrorCode = IMAGE_VERIFY_BAD_FILE_ALIGNMENT;
-            return FALSE;
-        }
+}
 
-        if (pHdr32->OptionalHeader.SectionAlignment < pHdr32->OptionalHeader.FileAlignment) {
-            *ErrorCode = IMAGE_VERIFY_BAD_SECTION_ALIGNMENT;
-            return FALSE;
-        }
+/*
+* supxQueryHeaderLimit
+*
+* Purpose:
+*
+* Return number of leading file bytes header structures may occupy.
+*
+*/
+ULONGLONG supxQueryHeaderLimit(
+    _In_ PFILE_VIEW_INFO ViewInformation
+)
+{
+    ULONGLONG limit = ViewInformation->ViewSize;
 
-        if (pHdr32->OptionalHeader.SizeOfImage > MM_SIZE_OF_LARGEST_IMAGE) {
-            *ErrorCode = IMAGE_VERIFY_BAD_SIZEOFIMAGE;
-            return FALSE;
-        }
+    if (limit > (ULONGLONG)ViewInformation->FileSize.QuadPart)
+        limit = (ULONGLONG)ViewInformation->FileSize.QuadPart;
+    if (limit > SUP_HEADERS_VIEW_MAX)
+        limit = SUP_HEADERS_VIEW_MAX;
 
-        if (pHdr32->FileHeader.NumberOfSections > MM_MAXIMUM_IMAGE_SECTIONS) {
-            *ErrorCode = IMAGE_VERIFY_BAD_SECTION_COUNT;
-            return FALSE;
-        }
+    return limit;
+}
 
-        if (pHdr32->FileHeader.Machine != IMAGE_FILE_MACHINE_I386 &&
-            pHdr32->FileHeader.Machine != IMAGE_FILE_MACHINE_ARMNT)
-        {
-            *ErrorCode = IMAGE_VERIFY_BAD_FILE_HEADER_MACHINE;
-            return FALSE;
-        }
+/*
+* supxIsHeaderInBuffer
+*
+* Purpose:
+*
+* Check that NT headers and section table, the header structures read by
+* validation, lie inside the file and within largest headers view. Limit
+* is the same for mapped, buffer and pushed input, so same bytes give same
+* verdict. Header bytes hashed up to SizeOfHeaders are not checked, first
+* page hash takes missing ones as zeros, the rest comes by layout ranges.
+*
+*/
+BOOLEAN supxIsHeaderInBuffer(
+    _In_ PFILE_VIEW_INFO ViewInformation
+)
+{
+    ULONGLONG cbHeader, viewSize = supxQueryHeaderLimit(ViewInformation);
+    PIMAGE_DOS_HEADER dosHeader = (PIMAGE_DOS_HEADER)ViewInformation->ViewBase;
+    PIMAGE_NT_HEADERS ntHeaders;
 
-    }
-    else {
-        *ErrorCode = IMAGE_VERIFY_BAD_OPTIONAL_HEADER_MAGIC;
+    if (viewSize < sizeof(IMAGE_DOS_HEADER)) {
+        ViewInformation->LastError = IMAGE_VERIFY_BAD_DOSMAGIC;
         return FALSE;
     }
 
-    pSection = IMAGE_FIRST_SECTION(Header);
+    if (dosHeader->e_lfanew <= 0) {
+        ViewInformation->LastError = IMAGE_VERIFY_BAD_NEWEXE;
+        return FALSE;
+    }
 
-    lastSectionVA = (ULONG64)pSection->VirtualAddress;
+    cbHeader = (ULONGLONG)(ULONG)dosHeader->e_lfanew +
+        UFIELD_OFFSET(IMAGE_NT_HEADERS, OptionalHeader) + sizeof(WORD);
 
-    for (i = 0; i < Header->FileHeader.NumberOfSections; i++, pSection++) {
+    if (cbHeader > viewSize) {
+        ViewInformation->LastError = IMAGE_VERIFY_BAD_NEWEXE;
+        return FALSE;
+    }
 
-        if (pSection->VirtualAddress != lastSectionVA) {
-            *ErrorCode = IMAGE_VERIFY_BAD_NTHEADERS;
-            return FALSE;
-        }
+    ntHeaders = (PIMAGE_NT_HEADERS)((PCHAR)dosHeader + (ULONG)dosHeader->e_lfanew);
 
-        lastSectionVA += ALIGN_UP_BY(pSection->Misc.VirtualSize,
-            Header->OptionalHeader.SectionAlignment);
+    if (ntHeaders->OptionalHeader.Magic == IMAGE_NT_OPTIONAL_HDR64_MAGIC)
+        cbHeader = (ULONG)dosHeader->e_lfanew + sizeof(IMAGE_NT_HEADERS64);
+    else
+        cbHeader = (ULONG)dosHeader->e_lfanew + sizeof(IMAGE_NT_HEADERS32);
 
+    if (cbHeader > viewSize) {
+        ViewInformation->LastError = IMAGE_VERIFY_BAD_OPTIONAL_HEADER;
+        return FALSE;
     }
 
-    if (lastSectionVA != Header->OptionalHeader.SizeOfImage) {
-        *ErrorCode = IMAGE_VERIFY_BAD_NTHEADERS;
+    cbHeader = (ULONGLONG)(ULONG)dosHeader->e_lfanew +
+        UFIELD_OFFSET(IMAGE_NT_HEADERS, OptionalHeader) +
+        ntHeaders->FileHeader.SizeOfOptionalHeader +
+        (ULONGLONG)ntHeaders->FileHeader.NumberOfSections * sizeof(IMAGE_SECTION_HEADER);
+
+    if (cbHeader > viewSize) {
+        ViewInformation->LastError = IMAGE_VERIFY_BAD_NTHEADERS;
         return FALSE;
     }
 
-    *ErrorCode = IMAGE_VERIFY_OK;
     return TRUE;
 }
 
-#pragma warning(pop)
-
 /*
 * supIsValidImage
 *
 * Purpose:
 *
 * Check whatever image is in valid PE format.
+* Hash layout of valid image is stored in the view information.
 *
 */
 BOOLEAN supIsValidImage(
@@ -550,15 +1004,17 @@ BOOLEAN supIsValidImage(
 
     __try {
 
-        if (dosHeader->e_magic != IMAGE_DOS_SIGNATURE) {
+        if (supxQueryHeaderLimit(ViewInformation) < sizeof(IMAGE_DOS_HEADER) ||
+            dosHeader->e_magic != IMAGE_DOS_SIGNATURE)
+        {
             ViewInformation->LastError = IMAGE_VERIFY_BAD_DOSMAGIC;
             return FALSE;
         }
 
-        if (dosHeader->e_lfanew == 0 ||
-            (ULONG)dosHeader->e_lfanew > ViewInformation->FileSize.LowPart ||
-            (((ULONG)dosHeader->e_lfanew + PE_SIGNATURE_SIZE +
-                (ULONG)sizeof(IMAGE_FILE_HEADER)) >= ViewInformation->FileSize.LowPart) ||
+        if (dosHeader->e_lfanew <= 0 ||
+            (ULONGLONG)dosHeader->e_lfanew > (ULONGLONG)ViewInformation->FileSize.QuadPart ||
+            (((ULONGLONG)dosHeader->e_lfanew + PE_SIGNATURE_SIZE +
+                sizeof(IMAGE_FILE_HEADER)) >= (ULONGLONG)ViewInformation->FileSize.QuadPart) ||
             dosHeader->e_lfanew >= RTLP_IMAGE_MAX_DOS_HEADER)
         {
             ViewInformation->LastError = IMAGE_VERIFY_BAD_NEWEXE;
@@ -573,12 +1029,20 @@ BOOLEAN supIsValidImage(
             return FALSE;
         }
 
+        if ((ULONGLONG)(ULONG)dosHeader->e_lfanew + PE_SIGNATURE_SIZE > supxQueryHeaderLimit(ViewInformation)) {
+            ViewInformation->LastError = IMAGE_VERIFY_BAD_NEWEXE;
+            return FALSE;
+        }
+
         ntHeaders = (PIMAGE_NT_HEADERS)((PCHAR)ViewInformation->ViewBase + (ULONG)dosHeader->e_lfanew);
         if (ntHeaders->Signature != IMAGE_NT_SIGNATURE) {
             ViewInformation->LastError = IMAGE_VERIFY_BAD_NTSIGNATURE;
             return FALSE;
         }
 
+        if (!supxIsHeaderInBuffer(ViewInformation))
+            return FALSE;
+
         if ((ULONG)dosHeader->e_lfanew >= ntHeaders->OptionalHeader.SizeOfImage) {
             ViewInformation->LastError = IMAGE_VERIFY_BAD_NEWEXE;
             return FALSE;
@@ -606,10 +1070,11 @@ BOOLEAN supIsValidImage(
             return FALSE;
         }
 
-        return supxValidateNtHeader(ntHeaders, &ViewInformation->LastError);
+        return supxValidateNtHeader(ViewInformation, ntHeaders, (ULONG)dosHeader->e_lfanew);
 
     }
     __except (EXCEPTION_EXECUTE_HANDLER) {
+        StatsExceptionCaught();
         ViewInformation->LastError = IMAGE_VERIFY_EXCEPTION_IN_PROCESS;
         return FALSE;
     }
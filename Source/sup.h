@@ -1,12 +1,12 @@
 /*******************************************************************************
 *
-*  (C) COPYRIGHT AUTHORS, 2021
+*  (C) COPYRIGHT AUTHORS, 2021 - 2026
 *
 *  TITLE:       SUP.H
 *
-*  VERSION:     1.03
+*  VERSION:     1.05
 *
-*  DATE:        26 Oct 2021
+*  DATE:        14 Oct 2026
 *
 *  Support routines header file.
 *
@@ -39,6 +39,32 @@
 
 #define IMAGE_VERIFY_UNKNOWN_ERROR                      0xff
 
+//
+// Major copy-paste.
+//
+#define MM_SIZE_OF_LARGEST_IMAGE ((ULONG)0x77000000)
+#define MM_MAXIMUM_IMAGE_HEADER (2 * PAGE_SIZE)
+#define MM_MAXIMUM_IMAGE_SECTIONS                       \
+     ((MM_MAXIMUM_IMAGE_HEADER - (PAGE_SIZE + sizeof(IMAGE_NT_HEADERS))) /  \
+            sizeof(IMAGE_SECTION_HEADER))
+
+#define RTL_MEG (1024UL * 1024UL)
+
+//
+// Initial headers view size. View grows up to SUP_HEADERS_VIEW_MAX when
+// NT headers, section table or SizeOfHeaders lie beyond it, partial map
+// section is created with the maximum size.
+//
+#define SUP_HEADERS_VIEW_SIZE RTL_MEG
+#define SUP_HEADERS_VIEW_MAX (64 * RTL_MEG)
+
+//
+// Files above window size are mapped only for headers, the rest is
+// walked by sliding views of this size.
+//
+#define SUP_MAP_WINDOW_SIZE (64 * RTL_MEG)
+#define SUP_MAP_WINDOW_ALIGN 0x10000
+
 VOID supDestroyFileViewInfo(
     _In_ PFILE_VIEW_INFO ViewInformation);
 
@@ -52,10 +78,35 @@ VOID supClipboardCopy(
     _In_ LPCWSTR lpText,
     _In_ SIZE_T cbText);
 
+VOID supInitBufferViewInfo(
+    _Inout_ PFILE_VIEW_INFO ViewInformation,
+    _In_reads_bytes_(ViewSize) const VOID* Buffer,
+    _In_ SIZE_T ViewSize,
+    _In_ ULONGLONG FileSize);
+
+NTSTATUS supOpenInputFile(
+    _In_ PFILE_VIEW_INFO ViewInformation);
+
+BOOLEAN supQueryFileIdentity(
+    _In_ PFILE_VIEW_INFO ViewInformation,
+    _Out_ PFILE_IDENTITY Identity);
+
+ULONGLONG supQueryHeadersExtent(
+    _In_ PFILE_VIEW_INFO ViewInformation);
+
 NTSTATUS supMapInputFileForRead(
     _In_ PFILE_VIEW_INFO ViewInformation,
     _In_ BOOLEAN PartialMap);
 
+NTSTATUS supMapFileWindow(
+    _In_ PFILE_VIEW_INFO ViewInformation,
+    _In_ ULONGLONG Offset,
+    _In_ SIZE_T Size,
+    _Out_ PFILE_WINDOW Window);
+
+VOID supUnmapFileWindow(
+    _Inout_ PFILE_WINDOW Window);
+
 BOOL supOpenDialogExecute(
     _In_ HWND OwnerWindow,
     _Inout_ LPWSTR OpenFileName,
@@ -70,6 +121,20 @@ BOOL supDragAndDropResolveTarget(
 BOOLEAN supIsValidImage(
     _In_ PFILE_VIEW_INFO ViewInformation);
 
+SIZE_T supHexEncodeA(
+    _In_reads_bytes_(Length) const BYTE* Buffer,
+    _In_ ULONG Length,
+    _In_ BOOLEAN UpcaseHex,
+    _Out_writes_(cchOutput) PCHAR Output,
+    _In_ SIZE_T cchOutput);
+
+SIZE_T supHexEncodeW(
+    _In_reads_bytes_(Length) const BYTE* Buffer,
+    _In_ ULONG Length,
+    _In_ BOOLEAN UpcaseHex,
+    _Out_writes_(cchOutput) PWCHAR Output,
+    _In_ SIZE_T cchOutput);
+
 LPWSTR supPrintHash(
     _In_reads_bytes_(Length) LPBYTE Buffer,
     _In_ ULONG Length,
@@ -0,0 +1,538 @@
+/*******************************************************************************
+*
+*  (C) COPYRIGHT AUTHORS, 2026
+*
+*  TITLE:       USN.CPP
+*
+*  VERSION:     1.05
+*
+*  DATE:        14 Oct 2026
+*
+*  NTFS change journal support.
+*
+*  Incremental scan reads journal records since position recorded in the
+*  store and resolves changed executables by file id, so unchanged parts of
+*  the tree are neither enumerated nor opened.
+*
+* THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+* ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED
+* TO THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*******************************************************************************/
+
+#include "global.h"
+
+#define USN_READ_BUFFER_SIZE    0x10000
+#define USN_PATH_BUFFER_CCH     0x8000
+#define USN_IDS_INITIAL_CAPACITY 1024
+
+#define USN_CHANGE_REASONS (USN_REASON_FILE_CREATE | \
+    USN_REASON_DATA_OVERWRITE | \
+    USN_REASON_DATA_EXTEND | \
+    USN_REASON_DATA_TRUNCATION | \
+    USN_REASON_RENAME_NEW_NAME)
+
+static LPCWSTR g_UsnExecutableExtensions[] = {
+    L"exe", L"dll", L"sys", L"ocx", L"cpl", L"scr", L"drv", L"efi", L"mui", L"winmd"
+};
+
+//
+// Ids are kept in 128-bit form, V2 record ids are zero extended which is
+// also their extended file id.
+//
+typedef struct _USN_FILE_IDS {
+    PFILE_ID_128 Items;
+    ULONG Count;
+    ULONG Capacity;
+} USN_FILE_IDS, * PUSN_FILE_IDS;
+
+/*
+* UsnpIsExecutableName
+*
+* Purpose:
+*
+* Check journal record file name extension against executable extensions.
+*
+*/
+BOOLEAN UsnpIsExecutableName(
+    _In_reads_(cchName) LPCWSTR lpName,
+    _In_ ULONG cchName
+)
+{
+    ULONG i, cchExt;
+    LPCWSTR lpExt = NULL;
+
+    for (i = cchName; i > 0; i--) {
+        if (lpName[i - 1] == L'.') {
+            lpExt = &lpName[i];
+            break;
+        }
+    }
+
+    if (lpExt == NULL)
+        return FALSE;
+
+    cchExt = cchName - (ULONG)(lpExt - lpName);
+
+    for (i = 0; i < RTL_NUMBER_OF(g_UsnExecutableExtensions); i++) {
+        if (wcslen(g_UsnExecutableExtensions[i]) == cchExt &&
+            _wcsnicmp(lpExt, g_UsnExecutableExtensions[i], cchExt) == 0)
+        {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+/*
+* UsnpAddFileId
+*
+* Purpose:
+*
+* Append file id to the list.
+*
+*/
+BOOLEAN UsnpAddFileId(
+    _Inout_ PUSN_FILE_IDS FileIds,
+    _In_ const FILE_ID_128* FileId
+)
+{
+    ULONG newCapacity;
+    PFILE_ID_128 newItems;
+
+    if (FileIds->Count == FileIds->Capacity) {
+
+        newCapacity = (FileIds->Capacity) ?
+            FileIds->Capacity * 2 : USN_IDS_INITIAL_CAPACITY;
+
+        newItems = (PFILE_ID_128)supHeapAlloc(newCapacity * sizeof(FILE_ID_128));
+        if (newItems == NULL)
+            return FALSE;
+
+        if (FileIds->Items) {
+            RtlCopyMemory(newItems, FileIds->Items, FileIds->Count * sizeof(FILE_ID_128));
+            supHeapFree(FileIds->Items);
+        }
+
+        FileIds->Items = newItems;
+        FileIds->Capacity = newCapacity;
+    }
+
+    FileIds->Items[FileIds->Count++] = *FileId;
+    return TRUE;
+}
+
+/*
+* UsnpCompareFileIds
+*
+* Purpose:
+*
+* qsort callback.
+*
+*/
+INT __cdecl UsnpCompareFileIds(
+    _In_ const void* First,
+    _In_ const void* Second
+)
+{
+    return memcmp(First, Second, sizeof(FILE_ID_128));
+}
+
+/*
+* UsnpQueryFinalPath
+*
+* Purpose:
+*
+* Return normalized DOS path of opened file without \\?\ prefix.
+*
+*/
+LPCWSTR UsnpQueryFinalPath(
+    _In_ HANDLE FileHandle,
+    _Out_writes_(USN_PATH_BUFFER_CCH) LPWSTR lpBuffer,
+    _Out_ PULONG pcchPath
+)
+{
+    ULONG cch;
+
+    *pcchPath = 0;
+
+    cch = GetFinalPathNameByHandle(FileHandle,
+        lpBuffer,
+        USN_PATH_BUFFER_CCH,
+        FILE_NAME_NORMALIZED | VOLUME_NAME_DOS);
+
+    if (cch == 0 || cch >= USN_PATH_BUFFER_CCH)
+        return NULL;
+
+    if (cch > 6 && _wcsnicmp(lpBuffer, L"\\\\?\\", 4) == 0 && lpBuffer[5] == L':') {
+        lpBuffer += 4;
+        cch -= 4;
+    }
+
+    *pcchPath = cch;
+    return lpBuffer;
+}
+
+/*
+* UsnOpenVolume
+*
+* Purpose:
+*
+* Open volume holding the path and query its change journal.
+* Volume must be released with UsnCloseVolume.
+*
+*/
+NTSTATUS UsnOpenVolume(
+    _In_ LPCWSTR lpPath,
+    _Out_ PUSN_VOLUME Volume
+)
+{
+    DWORD cb = 0, dwSerial = 0;
+    SIZE_T cch;
+    WCHAR szMountPoint[MAX_PATH + 1], szVolume[MAX_PATH + 1];
+    USN_JOURNAL_DATA_V0 journalData;
+
+    RtlSecureZeroMemory(Volume, sizeof(USN_VOLUME));
+
+    if (!GetVolumePathName(lpPath, szMountPoint, RTL_NUMBER_OF(szMountPoint)) ||
+        !GetVolumeInformation(szMountPoint, NULL, 0, &dwSerial, NULL, NULL, NULL, 0) ||
+        !GetVolumeNameForVolumeMountPoint(szMountPoint, szVolume, RTL_NUMBER_OF(szVolume)))
+    {
+        return STATUS_OBJECT_PATH_NOT_FOUND;
+    }
+
+    //
+    // \\?\Volume{guid}\ names root directory, volume itself is without backslash.
+    //
+    cch = wcslen(szVolume);
+    if (cch && szVolume[cch - 1] == L'\\')
+        szVolume[cch - 1] = 0;
+
+    Volume->VolumeHandle = CreateFile(szVolume,
+        GENERIC_READ,
+        FILE_SHARE_READ | FILE_SHARE_WRITE,
+        NULL,
+        OPEN_EXISTING,
+        0,
+        NULL);
+
+    if (Volume->VolumeHandle == INVALID_HANDLE_VALUE) {
+        Volume->VolumeHandle = NULL;
+        return STATUS_ACCESS_DENIED;
+    }
+
+    RtlSecureZeroMemory(&journalData, sizeof(journalData));
+
+    if (!DeviceIoControl(Volume->VolumeHandle,
+        FSCTL_QUERY_USN_JOURNAL,
+        NULL,
+        0,
+        &journalData,
+        sizeof(journalData),
+        &cb,
+        NULL))
+    {
+        UsnCloseVolume(Volume);
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    Volume->FirstUsn = journalData.FirstUsn;
+    Volume->Journal.VolumeSerialNumber = dwSerial;
+    Volume->Journal.JournalId = journalData.UsnJournalID;
+    Volume->Journal.NextUsn = journalData.NextUsn;
+
+    return STATUS_SUCCESS;
+}
+
+/*
+* UsnCloseVolume
+*
+* Purpose:
+*
+* Close volume opened by UsnOpenVolume.
+*
+*/
+VOID UsnCloseVolume(
+    _In_ PUSN_VOLUME Volume
+)
+{
+    if (Volume->VolumeHandle) {
+        CloseHandle(Volume->VolumeHandle);
+        Volume->VolumeHandle = NULL;
+    }
+}
+
+/*
+* UsnCanResume
+*
+* Purpose:
+*
+* Check that recorded position belongs to the current journal and
+* records since it were not purged yet.
+*
+*/
+BOOLEAN UsnCanResume(
+    _In_ PUSN_VOLUME Volume,
+    _In_ PSTORE_JOURNAL Journal
+)
+{
+    return (Journal->JournalId != 0 &&
+        Journal->VolumeSerialNumber == Volume->Journal.VolumeSerialNumber &&
+        Journal->JournalId == Volume->Journal.JournalId &&
+        Journal->NextUsn >= Volume->FirstUsn &&
+        Journal->NextUsn <= Volume->Journal.NextUsn);
+}
+
+/*
+* UsnpReadChangedFileIds
+*
+* Purpose:
+*
+* Collect ids of executables created, modified or renamed between
+* StartUsn and journal position queried at volume open.
+* V2 and V3 (128-bit file id, ReFS) records are read, any other record
+* version fails with STATUS_NOT_SUPPORTED so caller does a full scan
+* instead of missing changes.
+*
+*/
+NTSTATUS UsnpReadChangedFileIds(
+    _In_ PUSN_VOLUME Volume,
+    _In_ LONGLONG StartUsn,
+    _Inout_ PUSN_FILE_IDS FileIds
+)
+{
+    NTSTATUS ntStatus = STATUS_SUCCESS;
+    DWORD cb;
+    PUCHAR buffer, bufferEnd, recordPtr;
+    PUSN_RECORD_COMMON_HEADER header;
+    PUSN_RECORD_V2 recordV2;
+    PUSN_RECORD_V3 recordV3;
+    READ_USN_JOURNAL_DATA_V1 readData;
+    FILE_ID_128 fileId;
+    USN usn;
+    DWORD reason, attributes;
+    LPCWSTR lpName;
+    ULONG cchName;
+
+    buffer = (PUCHAR)supHeapAlloc(USN_READ_BUFFER_SIZE);
+    if (buffer == NULL)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    RtlSecureZeroMemory(&readData, sizeof(readData));
+    readData.StartUsn = StartUsn;
+    readData.ReasonMask = USN_CHANGE_REASONS;
+    readData.UsnJournalID = Volume->Journal.JournalId;
+    readData.MinMajorVersion = 2;
+    readData.MaxMajorVersion = 3;
+
+    while (readData.StartUsn < Volume->Journal.NextUsn) {
+
+        cb = 0;
+        if (!DeviceIoControl(Volume->VolumeHandle,
+            FSCTL_READ_USN_JOURNAL,
+            &readData,
+            sizeof(readData),
+            buffer,
+            USN_READ_BUFFER_SIZE,
+            &cb,
+            NULL))
+        {
+            ntStatus = STATUS_UNSUCCESSFUL;
+            break;
+        }
+
+        if (cb <= sizeof(USN))
+            break;
+
+        //
+        // Output is next USN followed by records.
+        //
+        bufferEnd = buffer + cb;
+        recordPtr = buffer + sizeof(USN);
+
+        while (recordPtr + sizeof(USN_RECORD_COMMON_HEADER) <= bufferEnd) {
+
+            header = (PUSN_RECORD_COMMON_HEADER)recordPtr;
+            if (header->RecordLength == 0 || recordPtr + header->RecordLength > bufferEnd)
+                break;
+
+            RtlSecureZeroMemory(&fileId, sizeof(fileId));
+
+            if (header->MajorVersion == 2 && header->RecordLength >= sizeof(USN_RECORD_V2)) {
+                recordV2 = (PUSN_RECORD_V2)recordPtr;
+                usn = recordV2->Usn;
+                reason = recordV2->Reason;
+                attributes = recordV2->FileAttributes;
+                lpName = (LPCWSTR)(recordPtr + recordV2->FileNameOffset);
+                cchName = recordV2->FileNameLength / sizeof(WCHAR);
+                RtlCopyMemory(fileId.Identifier,
+                    &recordV2->FileReferenceNumber,
+                    sizeof(recordV2->FileReferenceNumber));
+            }
+            else if (header->MajorVersion == 3 && header->RecordLength >= sizeof(USN_RECORD_V3)) {
+                recordV3 = (PUSN_RECORD_V3)recordPtr;
+                usn = recordV3->Usn;
+                reason = recordV3->Reason;
+                attributes = recordV3->FileAttributes;
+                lpName = (LPCWSTR)(recordPtr + recordV3->FileNameOffset);
+                cchName = recordV3->FileNameLength / sizeof(WCHAR);
+                fileId = recordV3->FileReferenceNumber;
+            }
+            else {
+                ntStatus = STATUS_NOT_SUPPORTED;
+                break;
+            }
+
+            if ((PUCHAR)lpName + cchName * sizeof(WCHAR) > recordPtr + header->RecordLength) {
+                ntStatus = STATUS_INVALID_PARAMETER;
+                break;
+            }
+
+            if (usn < Volume->Journal.NextUsn &&
+                (attributes & FILE_ATTRIBUTE_DIRECTORY) == 0 &&
+                (reason & USN_REASON_FILE_DELETE) == 0 &&
+                UsnpIsExecutableName(lpName, cchName))
+            {
+                if (!UsnpAddFileId(FileIds, &fileId)) {
+                    ntStatus = STATUS_INSUFFICIENT_RESOURCES;
+                    break;
+                }
+            }
+
+            recordPtr += header->RecordLength;
+        }
+
+        if (!NT_SUCCESS(ntStatus))
+            break;
+
+        readData.StartUsn = *(USN*)buffer;
+    }
+
+    supHeapFree(buffer);
+    return ntStatus;
+}
+
+/*
+* UsnBuildChangedFileList
+*
+* Purpose:
+*
+* Add executables inside lpDirectory tree changed since StartUsn to the list.
+* Files changed several times are added once, deleted files are skipped.
+*
+*/
+NTSTATUS UsnBuildChangedFileList(
+    _In_ PUSN_VOLUME Volume,
+    _In_ LONGLONG StartUsn,
+    _In_ LPCWSTR lpDirectory,
+    _Inout_ PBATCH_FILE_LIST FileList
+)
+{
+    NTSTATUS ntStatus;
+    ULONG i, cchRoot = 0, cchPath;
+    HANDLE fileHandle;
+    LPWSTR lpRootBuffer = NULL, lpPathBuffer = NULL;
+    LPCWSTR lpRoot, lpPath;
+    FILE_ID_DESCRIPTOR fileId;
+    USN_FILE_IDS fileIds;
+
+    RtlSecureZeroMemory(&fileIds, sizeof(fileIds));
+
+    do {
+
+        lpRootBuffer = (LPWSTR)supHeapAlloc(USN_PATH_BUFFER_CCH * sizeof(WCHAR));
+        lpPathBuffer = (LPWSTR)supHeapAlloc(USN_PATH_BUFFER_CCH * sizeof(WCHAR));
+        if (lpRootBuffer == NULL || lpPathBuffer == NULL) {
+            ntStatus = STATUS_INSUFFICIENT_RESOURCES;
+            break;
+        }
+
+        //
+        // Root is normalized the same way as changed files for prefix match.
+        //
+        fileHandle = CreateFile(lpDirectory,
+            FILE_READ_ATTRIBUTES,
+            FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+            NULL,
+            OPEN_EXISTING,
+            FILE_FLAG_BACKUP_SEMANTICS,
+            NULL);
+
+        if (fileHandle == INVALID_HANDLE_VALUE) {
+            ntStatus = STATUS_OBJECT_PATH_NOT_FOUND;
+            break;
+        }
+
+        lpRoot = UsnpQueryFinalPath(fileHandle, lpRootBuffer, &cchRoot);
+        CloseHandle(fileHandle);
+
+        if (lpRoot == NULL) {
+            ntStatus = STATUS_OBJECT_PATH_NOT_FOUND;
+            break;
+        }
+
+        if (cchRoot && lpRoot[cchRoot - 1] == L'\\')
+            cchRoot -= 1;
+
+        ntStatus = UsnpReadChangedFileIds(Volume, StartUsn, &fileIds);
+        if (!NT_SUCCESS(ntStatus))
+            break;
+
+        if (fileIds.Count == 0)
+            break;
+
+        qsort(fileIds.Items, fileIds.Count, sizeof(FILE_ID_128), UsnpCompareFileIds);
+
+        for (i = 0; i < fileIds.Count; i++) {
+
+            if (i && UsnpCompareFileIds(&fileIds.Items[i], &fileIds.Items[i - 1]) == 0)
+                continue;
+
+            RtlSecureZeroMemory(&fileId, sizeof(fileId));
+            fileId.dwSize = sizeof(fileId);
+            fileId.Type = ExtendedFileIdType;
+            fileId.ExtendedFileId = fileIds.Items[i];
+
+            fileHandle = OpenFileById(Volume->VolumeHandle,
+                &fileId,
+                FILE_READ_ATTRIBUTES,
+                FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                NULL,
+                0);
+
+            //
+            // Deleted after the change was recorded.
+            //
+            if (fileHandle == INVALID_HANDLE_VALUE)
+                continue;
+
+            lpPath = UsnpQueryFinalPath(fileHandle, lpPathBuffer, &cchPath);
+            CloseHandle(fileHandle);
+
+            if (lpPath == NULL ||
+                cchPath <= cchRoot ||
+                lpPath[cchRoot] != L'\\' ||
+                _wcsnicmp(lpPath, lpRoot, cchRoot) != 0)
+            {
+                continue;
+            }
+
+            if (!BatchAddFile(FileList, lpPath)) {
+                ntStatus = STATUS_INSUFFICIENT_RESOURCES;
+                break;
+            }
+        }
+
+    } while (FALSE);
+
+    if (fileIds.Items)
+        supHeapFree(fileIds.Items);
+    if (lpPathBuffer)
+        supHeapFree(lpPathBuffer);
+    if (lpRootBuffer)
+        supHeapFree(lpRootBuffer);
+
+    return ntStatus;
+}
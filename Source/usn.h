@@ -0,0 +1,42 @@
+/*******************************************************************************
+*
+*  (C) COPYRIGHT AUTHORS, 2026
+*
+*  TITLE:       USN.H
+*
+*  VERSION:     1.05
+*
+*  DATE:        14 Oct 2026
+*
+*  NTFS change journal support header file.
+*
+* THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+* ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED
+* TO THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+* PARTICULAR PURPOSE.
+*
+*******************************************************************************/
+#pragma once
+
+typedef struct _USN_VOLUME {
+    HANDLE VolumeHandle;
+    LONGLONG FirstUsn;
+    STORE_JOURNAL Journal;
+} USN_VOLUME, * PUSN_VOLUME;
+
+NTSTATUS UsnOpenVolume(
+    _In_ LPCWSTR lpPath,
+    _Out_ PUSN_VOLUME Volume);
+
+VOID UsnCloseVolume(
+    _In_ PUSN_VOLUME Volume);
+
+BOOLEAN UsnCanResume(
+    _In_ PUSN_VOLUME Volume,
+    _In_ PSTORE_JOURNAL Journal);
+
+NTSTATUS UsnBuildChangedFileList(
+    _In_ PUSN_VOLUME Volume,
+    _In_ LONGLONG StartUsn,
+    _In_ LPCWSTR lpDirectory,
+    _Inout_ PBATCH_FILE_LIST FileList);